@@ -0,0 +1,225 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+/*
+Host (Linux) stand-in for the parts of the Arduino-ESP32 core used by
+src/main.cpp, for the [env:native] build. See native/mock.h for how the
+simulated hardware is driven.
+*/
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "esp_err.h"
+#include "esp_sleep.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define IRAM_ATTR
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// Flash is memory-mapped on the ESP32, so as in its pgmspace.h these are plain memory accesses
+class __FlashStringHelper;
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define F(s) ((const __FlashStringHelper*)(s))
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_float(addr) (*(const float*)(addr))
+#define pgm_read_double(addr) (*(const double*)(addr))
+#define pgm_read_ptr(addr) (*(void* const*)(addr))
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcpy_P strcpy
+
+class String {
+public:
+    String(const char* s = "") : s_(s ? s : "") {}
+    String(const std::string& s) : s_(s) {}
+    String(char c) : s_(1, c) {}
+    String(int v) : s_(std::to_string(v)) {}
+    String(unsigned int v) : s_(std::to_string(v)) {}
+    String(long v) : s_(std::to_string(v)) {}
+    String(unsigned long v) : s_(std::to_string(v)) {}
+    String(long long v) : s_(std::to_string(v)) {}
+    String(unsigned long long v) : s_(std::to_string(v)) {}
+    String(double v, unsigned int decimals = 2);
+
+    const char* c_str() const { return s_.c_str(); }
+    unsigned int length() const { return s_.size(); }
+    bool isEmpty() const { return s_.empty(); }
+    void reserve(unsigned int size) { s_.reserve(size); }
+    bool concat(const char* s) { s_ += s; return true; }
+    bool concat(const char* s, unsigned int len) { s_.append(s, len); return true; }
+    bool concat(const String& s) { s_ += s.s_; return true; }
+
+    String& operator+=(const String& s) { s_ += s.s_; return *this; }
+    String& operator+=(const char* s) { s_ += s; return *this; }
+    String& operator+=(char c) { s_ += c; return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a.s_ + b.s_); }
+    friend String operator+(const String& a, const char* b) { return String(a.s_ + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b.s_); }
+
+    bool equals(const String& s) const { return s_ == s.s_; }
+    bool equals(const char* s) const { return s_ == s; }
+    bool equalsIgnoreCase(const String& s) const { return strcasecmp(c_str(), s.c_str()) == 0; }
+    bool operator==(const String& s) const { return s_ == s.s_; }
+    bool operator==(const char* s) const { return s_ == s; }
+    bool operator!=(const String& s) const { return s_ != s.s_; }
+    bool operator!=(const char* s) const { return s_ != s; }
+    bool operator<(const String& s) const { return s_ < s.s_; }
+    char operator[](unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+    char charAt(unsigned int i) const { return (*this)[i]; }
+
+    int indexOf(char c, unsigned int from = 0) const { return find(s_.find(c, from)); }
+    int indexOf(const char* s, unsigned int from = 0) const { return find(s_.find(s, from)); }
+    int indexOf(const String& s, unsigned int from = 0) const { return find(s_.find(s.s_, from)); }
+    int lastIndexOf(char c) const { return find(s_.rfind(c)); }
+    bool startsWith(const String& s) const { return s_.compare(0, s.s_.size(), s.s_) == 0; }
+    bool endsWith(const String& s) const {
+        return s_.size() >= s.s_.size() && s_.compare(s_.size() - s.s_.size(), s.s_.size(), s.s_) == 0;
+    }
+    String substring(unsigned int from) const { return from < s_.size() ? String(s_.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        return from < to && from < s_.size() ? String(s_.substr(from, to - from)) : String();
+    }
+    void trim();
+    void toLowerCase();
+    void toUpperCase();
+    void replace(const String& from, const String& to);
+    void remove(unsigned int index, unsigned int count = (unsigned int)-1) {
+        if (index < s_.size()) s_.erase(index, count);
+    }
+    long toInt() const { return strtol(c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(c_str(), nullptr); }
+    double toDouble() const { return strtod(c_str(), nullptr); }
+
+    // ArduinoJson writes into String through these
+    size_t write(uint8_t c) { s_ += (char)c; return 1; }
+    size_t write(const uint8_t* buf, size_t len) { s_.append((const char*)buf, len); return len; }
+
+private:
+    static int find(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+    std::string s_;
+};
+
+class Print;
+
+class Printable {
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t len);
+    size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const __FlashStringHelper* s) { return write((const char*)s); }
+    size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v) { return printf("%d", v); }
+    size_t print(unsigned int v) { return printf("%u", v); }
+    size_t print(long v) { return printf("%ld", v); }
+    size_t print(unsigned long v) { return printf("%lu", v); }
+    size_t print(double v, int decimals = 2) { return printf("%.*f", decimals, v); }
+    size_t print(const Printable& p) { return p.printTo(*this); }
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T& v) { return print(v) + println(); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() {}
+    void setTimeout(unsigned long ms) { timeout_ = ms; }
+    size_t readBytes(uint8_t* buf, size_t len);
+    size_t readBytes(char* buf, size_t len) { return readBytes((uint8_t*)buf, len); }
+    String readString();
+    String readStringUntil(char terminator);
+
+protected:
+    int timedRead();
+    unsigned long timeout_ = 1000;
+};
+
+// Serial output goes to stdout; input is read from stdin without blocking
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buf, size_t len) override;
+    using Print::write;
+
+private:
+    int peeked_ = -1;
+};
+extern HardwareSerial Serial;
+
+struct EspClass {
+    void restart();  // Re-executes the program, keeping the data directory (flash) as it is
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    uint32_t getCpuFreqMHz() { return 240; }
+    uint32_t getCycleCount();
+};
+extern EspClass ESP;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(int pin, int mode);
+int digitalRead(int pin);
+void digitalWrite(int pin, int level);
+int analogRead(int pin);
+int digitalPinToInterrupt(int pin);
+void attachInterrupt(int interrupt, void (*handler)(), int mode);
+void detachInterrupt(int interrupt);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+void disableCore0WDT();
+void configTime(long gmtOffset, int daylightOffset, const char* server1, const char* server2 = nullptr,
+                const char* server3 = nullptr);
+
+#include <sys/time.h>
+
+#endif // NATIVE_ARDUINO_H
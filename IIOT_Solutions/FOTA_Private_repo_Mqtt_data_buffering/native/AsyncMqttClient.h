@@ -0,0 +1,80 @@
+#ifndef NATIVE_ASYNC_MQTT_CLIENT_H
+#define NATIVE_ASYNC_MQTT_CLIENT_H
+
+#include <functional>
+#include "Arduino.h"
+
+enum class AsyncMqttClientDisconnectReason : uint8_t {
+    TCP_DISCONNECTED = 0,
+    MQTT_UNACCEPTABLE_PROTOCOL_VERSION = 1,
+    MQTT_IDENTIFIER_REJECTED = 2,
+    MQTT_SERVER_UNAVAILABLE = 3,
+    MQTT_MALFORMED_CREDENTIALS = 4,
+    MQTT_NOT_AUTHORIZED = 5,
+    ESP8266_NOT_ENOUGH_SPACE = 6,
+    TLS_BAD_FINGERPRINT = 7
+};
+
+struct AsyncMqttClientMessageProperties {
+    uint8_t qos;
+    bool dup;
+    bool retain;
+};
+
+/*
+AsyncMqttClient against the in-process broker of the native build. As in
+the library, callbacks run on a separate (async_tcp-like) thread: connect
+results, PUBACK/PUBCOMP for QoS 1/2 publishes and incoming messages.
+Retained messages are delivered on subscribe; the will is published when
+the broker drops the session (mock::setBroker(false)).
+*/
+class AsyncMqttClient {
+public:
+    typedef std::function<void(bool sessionPresent)> OnConnectUserCallback;
+    typedef std::function<void(AsyncMqttClientDisconnectReason reason)> OnDisconnectUserCallback;
+    typedef std::function<void(uint16_t packetId, uint8_t qos)> OnSubscribeUserCallback;
+    typedef std::function<void(uint16_t packetId)> OnUnsubscribeUserCallback;
+    typedef std::function<void(char* topic, char* payload, AsyncMqttClientMessageProperties properties, size_t len,
+                               size_t index, size_t total)>
+        OnMessageUserCallback;
+    typedef std::function<void(uint16_t packetId)> OnPublishUserCallback;
+
+    AsyncMqttClient();
+
+    AsyncMqttClient& setKeepAlive(uint16_t seconds) { (void)seconds; return *this; }
+    AsyncMqttClient& setClientId(const char* clientId) { (void)clientId; return *this; }
+    AsyncMqttClient& setCleanSession(bool cleanSession) { (void)cleanSession; return *this; }
+    AsyncMqttClient& setMaxTopicLength(uint16_t length) { (void)length; return *this; }
+    AsyncMqttClient& setCredentials(const char* username, const char* password = nullptr) {
+        (void)username;
+        (void)password;
+        return *this;
+    }
+    AsyncMqttClient& setWill(const char* topic, uint8_t qos, bool retain, const char* payload = nullptr, size_t length = 0);
+    AsyncMqttClient& setServer(const char* host, uint16_t port);
+
+    AsyncMqttClient& onConnect(OnConnectUserCallback callback) { onConnect_ = callback; return *this; }
+    AsyncMqttClient& onDisconnect(OnDisconnectUserCallback callback) { onDisconnect_ = callback; return *this; }
+    AsyncMqttClient& onSubscribe(OnSubscribeUserCallback callback) { onSubscribe_ = callback; return *this; }
+    AsyncMqttClient& onUnsubscribe(OnUnsubscribeUserCallback callback) { onUnsubscribe_ = callback; return *this; }
+    AsyncMqttClient& onMessage(OnMessageUserCallback callback) { onMessage_ = callback; return *this; }
+    AsyncMqttClient& onPublish(OnPublishUserCallback callback) { onPublish_ = callback; return *this; }
+
+    bool connected() const;
+    void connect();
+    void disconnect(bool force = false);
+    uint16_t subscribe(const char* topic, uint8_t qos);
+    uint16_t unsubscribe(const char* topic);
+    uint16_t publish(const char* topic, uint8_t qos, bool retain, const char* payload = nullptr, size_t length = 0,
+                     bool dup = false, uint16_t messageId = 0);
+
+    // Called by the broker
+    OnConnectUserCallback onConnect_;
+    OnDisconnectUserCallback onDisconnect_;
+    OnSubscribeUserCallback onSubscribe_;
+    OnUnsubscribeUserCallback onUnsubscribe_;
+    OnMessageUserCallback onMessage_;
+    OnPublishUserCallback onPublish_;
+};
+
+#endif // NATIVE_ASYNC_MQTT_CLIENT_H
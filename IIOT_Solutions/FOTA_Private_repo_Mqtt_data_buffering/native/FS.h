@@ -0,0 +1,71 @@
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+#include <memory>
+#include "Arduino.h"
+
+namespace fs {
+
+struct FileImpl;
+
+// Files and directories of a host directory, with the Arduino FS semantics the firmware relies on:
+// name() is the base name, a directory is opened with open(path) and listed with openNextFile()
+class File : public Stream {
+public:
+    File() {}
+    explicit File(std::shared_ptr<FileImpl> impl) : impl_(impl) {}
+
+    operator bool() const;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t len) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override;
+    size_t read(uint8_t* buf, size_t len);
+    bool seek(uint32_t position);
+    size_t position() const;
+    size_t size() const;
+    void close();
+    const char* name() const;
+    const char* path() const;
+    bool isDirectory() const;
+    File openNextFile(const char* mode = "r");
+
+private:
+    std::shared_ptr<FileImpl> impl_;
+};
+
+class FS {
+public:
+    explicit FS(const char* subdir) : subdir_(subdir) {}
+    bool begin(bool formatOnFail = false, const char* basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+               const char* partitionLabel = "spiffs");
+    void end() {}
+    bool format();
+    File open(const char* path, const char* mode = "r", bool create = false);
+    File open(const String& path, const char* mode = "r", bool create = false) { return open(path.c_str(), mode, create); }
+    bool exists(const char* path);
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path);
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool rename(const char* from, const char* to);
+    bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+    bool mkdir(const char* path);
+    bool mkdir(const String& path) { return mkdir(path.c_str()); }
+    bool rmdir(const char* path);
+    size_t totalBytes();
+    size_t usedBytes();
+
+private:
+    std::string hostPath(const char* path) const;
+    const char* subdir_;
+};
+
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+
+#endif // NATIVE_FS_H
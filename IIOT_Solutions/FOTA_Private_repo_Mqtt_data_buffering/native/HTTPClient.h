@@ -0,0 +1,68 @@
+#ifndef NATIVE_HTTP_CLIENT_H
+#define NATIVE_HTTP_CLIENT_H
+
+#include <map>
+#include <vector>
+#include "WiFiClientSecure.h"
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_PARTIAL_CONTENT 206
+#define HTTP_CODE_NOT_MODIFIED 304
+#define HTTP_CODE_NOT_FOUND 404
+#define HTTP_CODE_RANGE_NOT_SATISFIABLE 416
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+/*
+HTTP/1.1 client with the HTTPClient API, over the caller's WiFiClient
+(so with WiFiClientSecure every URL is fetched from the local server, with
+its original path and Host header). With setReuse(true) the connection
+stays open between requests to the same host, as on the target.
+*/
+class HTTPClient {
+public:
+    bool begin(WiFiClient& client, const String& url);
+    bool begin(WiFiClient& client, const char* url) { return begin(client, String(url)); }
+    void end();
+    void setReuse(bool reuse) { reuse_ = reuse; }
+    void setTimeout(uint16_t ms) { timeoutMs_ = ms; }
+    void useHTTP10(bool http10) { http10_ = http10; }
+    bool connected() { return client_ && client_->connected(); }
+
+    void addHeader(const String& name, const String& value);
+    void collectHeaders(const char* names[], size_t count);
+    String header(const char* name);
+    bool hasHeader(const char* name);
+
+    int GET();
+    int getSize() { return size_; }
+    WiFiClient& getStream() { return *client_; }
+    WiFiClient* getStreamPtr() { return client_; }
+    String getString();
+
+    static String errorToString(int error);
+
+private:
+    bool readLine(std::string& line);
+
+    WiFiClient* client_ = nullptr;
+    std::string host_;
+    std::string path_;
+    std::string connectHost_;
+    uint16_t port_ = 80;
+    std::string connectedHost_;
+    std::string requestHeaders_;
+    std::vector<std::string> collect_;
+    std::map<std::string, std::string> headers_;
+    int size_ = -1;
+    bool chunked_ = false;
+    bool reuse_ = true;
+    bool http10_ = false;
+    bool canReuse_ = false;
+    uint16_t timeoutMs_ = 5000;
+};
+
+#endif // NATIVE_HTTP_CLIENT_H
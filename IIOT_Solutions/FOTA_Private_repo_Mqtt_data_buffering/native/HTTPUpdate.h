@@ -0,0 +1,7 @@
+#ifndef NATIVE_HTTP_UPDATE_H
+#define NATIVE_HTTP_UPDATE_H
+
+#include "HTTPClient.h"
+#include "Update.h"
+
+#endif // NATIVE_HTTP_UPDATE_H
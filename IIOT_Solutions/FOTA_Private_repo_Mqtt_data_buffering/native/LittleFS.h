@@ -0,0 +1,9 @@
+#ifndef NATIVE_LITTLEFS_H
+#define NATIVE_LITTLEFS_H
+
+#include "FS.h"
+
+// Mounted on <data dir>/littlefs; totalBytes() is the spiffs partition size from partitions.csv
+extern fs::FS LittleFS;
+
+#endif // NATIVE_LITTLEFS_H
@@ -0,0 +1,47 @@
+#ifndef NATIVE_PREFERENCES_H
+#define NATIVE_PREFERENCES_H
+
+#include "Arduino.h"
+
+// NVS namespaces as directories under <data dir>/nvs, one file per key holding the raw value
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false);
+    void end() { name_.clear(); }
+
+    bool isKey(const char* key);
+    bool remove(const char* key);
+    bool clear();
+
+    size_t putBytes(const char* key, const void* value, size_t len);
+    size_t getBytes(const char* key, void* buf, size_t maxLen);
+    size_t getBytesLength(const char* key);
+
+    size_t putString(const char* key, const String& value) { return putBytes(key, value.c_str(), value.length()); }
+    String getString(const char* key, const String& defaultValue = String());
+
+    size_t putUChar(const char* key, uint8_t value) { return putBytes(key, &value, sizeof(value)); }
+    uint8_t getUChar(const char* key, uint8_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putUShort(const char* key, uint16_t value) { return putBytes(key, &value, sizeof(value)); }
+    uint16_t getUShort(const char* key, uint16_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putUInt(const char* key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putULong(const char* key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+    uint32_t getULong(const char* key, uint32_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putULong64(const char* key, uint64_t value) { return putBytes(key, &value, sizeof(value)); }
+    uint64_t getULong64(const char* key, uint64_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putBool(const char* key, bool value) { return putUChar(key, value); }
+    bool getBool(const char* key, bool defaultValue = false) { return getUChar(key, defaultValue); }
+
+private:
+    template <typename T> T get(const char* key, T defaultValue) {
+        T value;
+        return getBytesLength(key) == sizeof(T) && getBytes(key, &value, sizeof(T)) == sizeof(T) ? value : defaultValue;
+    }
+    std::string path(const char* key) const;
+
+    std::string name_;
+    bool readOnly_ = false;
+};
+
+#endif // NATIVE_PREFERENCES_H
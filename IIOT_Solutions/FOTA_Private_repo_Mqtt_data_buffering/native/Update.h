@@ -0,0 +1,33 @@
+#ifndef NATIVE_UPDATE_H
+#define NATIVE_UPDATE_H
+
+#include "Arduino.h"
+#include "esp_partition.h"
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+// Writes into the next OTA partition through esp_partition_*, selecting it for boot on end()
+class UpdateClass {
+public:
+    bool begin(size_t size = UPDATE_SIZE_UNKNOWN);
+    size_t write(uint8_t* data, size_t len);
+    size_t writeStream(Stream& stream);
+    bool end(bool evenIfRemaining = false);
+    void abort();
+    bool isFinished() { return finished_; }
+    bool hasError() { return error_ != nullptr; }
+    const char* errorString() { return error_ ? error_ : "No Error"; }
+    size_t progress() { return progress_; }
+    size_t size() { return size_; }
+    size_t remaining() { return size_ - progress_; }
+
+private:
+    const esp_partition_t* partition_ = nullptr;
+    size_t size_ = 0;
+    size_t progress_ = 0;
+    bool finished_ = false;
+    const char* error_ = nullptr;
+};
+extern UpdateClass Update;
+
+#endif // NATIVE_UPDATE_H
@@ -0,0 +1,86 @@
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+#include "Arduino.h"
+
+typedef enum {
+    ARDUINO_EVENT_WIFI_READY = 0,
+    ARDUINO_EVENT_WIFI_STA_START,
+    ARDUINO_EVENT_WIFI_STA_CONNECTED,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP,
+    ARDUINO_EVENT_WIFI_STA_LOST_IP,
+} arduino_event_id_t;
+typedef arduino_event_id_t WiFiEvent_t;
+
+typedef enum { WL_IDLE_STATUS = 0, WL_NO_SSID_AVAIL = 1, WL_CONNECTED = 3, WL_CONNECT_FAILED = 4, WL_DISCONNECTED = 6 } wl_status_t;
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+typedef enum { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+
+class IPAddress : public Printable {
+public:
+    IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : bytes_{a, b, c, d} {}
+    String toString() const;
+    uint8_t operator[](int index) const { return bytes_[index]; }
+    size_t printTo(Print& p) const override { return p.print(toString()); }
+
+private:
+    uint8_t bytes_[4];
+};
+
+// Plain TCP client on a host socket
+class WiFiClient : public Stream {
+public:
+    WiFiClient() {}
+    virtual ~WiFiClient() { stop(); }
+    WiFiClient(const WiFiClient&) = delete;
+    WiFiClient& operator=(const WiFiClient&) = delete;
+
+    int connect(const char* host, uint16_t port) { return connect(host, port, 5000); }
+    virtual int connect(const char* host, uint16_t port, int32_t timeoutMs);
+    bool connected();
+    void stop();
+    int available() override;
+    int read() override;
+    int read(uint8_t* buf, size_t len);
+    int peek() override;
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t len) override;
+    using Print::write;
+    void setTimeout(uint32_t seconds) { Stream::setTimeout(seconds * 1000); }
+
+private:
+    bool fill(int timeoutMs);
+
+    int fd_ = -1;
+    uint8_t buf_[1460];
+    size_t head_ = 0;
+    size_t tail_ = 0;
+};
+
+// Station mode only: begin() "associates" after a short simulated delay unless mock::setWifi(false)
+class WiFiClass {
+public:
+    typedef void (*EventHandler)(WiFiEvent_t event);
+
+    void begin(const char* ssid, const char* password);
+    bool disconnect(bool wifiOff = false);
+    bool reconnect();
+    wl_status_t status();
+    bool isConnected() { return status() == WL_CONNECTED; }
+    bool mode(wifi_mode_t mode) { (void)mode; return true; }
+    IPAddress localIP();
+    int8_t RSSI() { return -55; }
+    String macAddress() { return "24:0A:C4:00:00:01"; }
+    void onEvent(EventHandler handler) { handler_ = handler; }
+    bool setSleep(bool enabled) { (void)enabled; return true; }
+    bool setSleep(wifi_ps_type_t type) { (void)type; return true; }
+
+    void dispatch(WiFiEvent_t event); // Used by the mock to raise events
+
+private:
+    EventHandler handler_ = nullptr;
+};
+extern WiFiClass WiFi;
+
+#endif // NATIVE_WIFI_H
@@ -0,0 +1,17 @@
+#ifndef NATIVE_WIFI_CLIENT_SECURE_H
+#define NATIVE_WIFI_CLIENT_SECURE_H
+
+#include "WiFi.h"
+
+// No TLS on the host: every connection goes in plain TCP to NATIVE_HTTP_HOST:NATIVE_HTTP_PORT (see mock.h),
+// whatever host the firmware asked for, and certificates are ignored
+class WiFiClientSecure : public WiFiClient {
+public:
+    using WiFiClient::connect;
+    int connect(const char* host, uint16_t port, int32_t timeoutMs) override;
+    void setCACert(const char* rootCA) { (void)rootCA; }
+    void setInsecure() {}
+    void setHandshakeTimeout(unsigned long seconds) { (void)seconds; }
+};
+
+#endif // NATIVE_WIFI_CLIENT_SECURE_H
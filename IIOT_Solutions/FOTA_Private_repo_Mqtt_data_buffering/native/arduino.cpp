@@ -0,0 +1,267 @@
+// Arduino core functions for the native build, see Arduino.h
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <random>
+
+#include "Arduino.h"
+#include "mock.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace {
+
+const uint32_t HEAP_SIZE = 320 * 1024; // Usable DRAM heap of an ESP32 after WiFi and the Arduino core start
+uint32_t minFreeHeap = HEAP_SIZE;
+std::mutex serialLock;
+std::mt19937 rng(0);
+
+} // namespace
+
+// String
+
+String::String(double v, unsigned int decimals) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+    s_ = buf;
+}
+
+void String::trim() {
+    size_t start = s_.find_first_not_of(" \t\r\n");
+    size_t end = s_.find_last_not_of(" \t\r\n");
+    s_ = start == std::string::npos ? "" : s_.substr(start, end - start + 1);
+}
+
+void String::toLowerCase() {
+    std::transform(s_.begin(), s_.end(), s_.begin(), ::tolower);
+}
+
+void String::toUpperCase() {
+    std::transform(s_.begin(), s_.end(), s_.begin(), ::toupper);
+}
+
+void String::replace(const String& from, const String& to) {
+    if (from.s_.empty()) {
+        return;
+    }
+    for (size_t pos = 0; (pos = s_.find(from.s_, pos)) != std::string::npos; pos += to.s_.size()) {
+        s_.replace(pos, from.s_.size(), to.s_);
+    }
+}
+
+// Print and Stream
+
+size_t Print::write(const uint8_t* buf, size_t len) {
+    size_t n = 0;
+    while (n < len && write(buf[n])) {
+        n++;
+    }
+    return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+    char small[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (len < 0) {
+        return 0;
+    }
+    if ((size_t)len < sizeof(small)) {
+        return write((const uint8_t*)small, len);
+    }
+    std::string big(len + 1, '\0');
+    va_start(args, format);
+    vsnprintf(&big[0], big.size(), format, args);
+    va_end(args);
+    return write((const uint8_t*)big.data(), len);
+}
+
+int Stream::timedRead() {
+    unsigned long start = millis();
+    do {
+        int c = read();
+        if (c >= 0) {
+            return c;
+        }
+        mock::sleepUs(1000);
+    } while (millis() - start < timeout_);
+    return -1;
+}
+
+size_t Stream::readBytes(uint8_t* buf, size_t len) {
+    size_t n = 0;
+    while (n < len) {
+        int c = timedRead();
+        if (c < 0) {
+            break;
+        }
+        buf[n++] = c;
+    }
+    return n;
+}
+
+String Stream::readString() {
+    String s;
+    for (int c = timedRead(); c >= 0; c = timedRead()) {
+        s += (char)c;
+    }
+    return s;
+}
+
+String Stream::readStringUntil(char terminator) {
+    String s;
+    for (int c = timedRead(); c >= 0 && c != terminator; c = timedRead()) {
+        s += (char)c;
+    }
+    return s;
+}
+
+// Serial
+
+int HardwareSerial::available() {
+    if (peeked_ >= 0) {
+        return 1;
+    }
+    struct pollfd in = {STDIN_FILENO, POLLIN, 0};
+    return poll(&in, 1, 0) > 0 && (in.revents & POLLIN) ? 1 : 0;
+}
+
+int HardwareSerial::read() {
+    if (peeked_ >= 0) {
+        int c = peeked_;
+        peeked_ = -1;
+        return c;
+    }
+    uint8_t c;
+    return available() && ::read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+}
+
+int HardwareSerial::peek() {
+    if (peeked_ < 0) {
+        peeked_ = read();
+    }
+    return peeked_;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t len) {
+    std::lock_guard<std::mutex> guard(serialLock);
+    size_t n = fwrite(buf, 1, len, stdout);
+    fflush(stdout);
+    return n;
+}
+
+// ESP
+
+void EspClass::restart() {
+    Serial.println("[native] restart");
+    mock::restart();
+}
+
+// Heap figures follow the host allocator's bytes in use against the ESP32's heap size, so changes in the
+// firmware's allocations show up as they would on the target
+uint32_t EspClass::getFreeHeap() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    size_t used = mallinfo2().uordblks;
+#else
+    size_t used = (unsigned)mallinfo().uordblks;
+#endif
+    uint32_t freeHeap = used < HEAP_SIZE ? HEAP_SIZE - used : 0;
+    minFreeHeap = std::min(minFreeHeap, freeHeap);
+    return freeHeap;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    getFreeHeap();
+    return minFreeHeap;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+    return getFreeHeap();
+}
+
+uint32_t EspClass::getCycleCount() {
+    return (uint32_t)(mock::nowUs() * getCpuFreqMHz());
+}
+
+// Time
+
+unsigned long millis() {
+    return mock::nowUs() / 1000;
+}
+
+unsigned long micros() {
+    return mock::nowUs();
+}
+
+void delay(unsigned long ms) {
+    vTaskDelay(ms);
+}
+
+void delayMicroseconds(unsigned int us) {
+    mock::sleepUs(us);
+}
+
+void yield() {
+}
+
+// GPIO
+
+void pinMode(int pin, int mode) {
+    if (mode == INPUT_PULLUP) {
+        mock::setPin(pin, HIGH);
+    }
+}
+
+int digitalRead(int pin) {
+    return mock::pin(pin);
+}
+
+void digitalWrite(int pin, int level) {
+    mock::setPin(pin, level);
+}
+
+int analogRead(int pin) {
+    return mock::pin(pin);
+}
+
+int digitalPinToInterrupt(int pin) {
+    return pin;
+}
+
+// Misc
+
+long random(long max) {
+    return max > 0 ? random(0, max) : 0;
+}
+
+long random(long min, long max) {
+    return min < max ? std::uniform_int_distribution<long>(min, max - 1)(rng) : min;
+}
+
+void randomSeed(unsigned long seed) {
+    rng.seed(seed);
+}
+
+void disableCore0WDT() {
+}
+
+void configTime(long gmtOffset, int daylightOffset, const char* server1, const char* server2, const char* server3) {
+    (void)gmtOffset;
+    (void)daylightOffset;
+    (void)server1;
+    (void)server2;
+    (void)server3;
+    // The host clock is already set; gettimeofday() works as after SNTP sync
+}
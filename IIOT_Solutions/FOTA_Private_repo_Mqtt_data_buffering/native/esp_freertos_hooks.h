@@ -0,0 +1,14 @@
+#ifndef NATIVE_ESP_FREERTOS_HOOKS_H
+#define NATIVE_ESP_FREERTOS_HOOKS_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*esp_freertos_tick_cb_t)(void);
+typedef bool (*esp_freertos_idle_cb_t)(void);
+
+// Tick hooks run every simulated millisecond with the "current task" set to the core's idle task
+// when no task pinned to it is running
+esp_err_t esp_register_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t hook, UBaseType_t core);
+esp_err_t esp_register_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t hook, UBaseType_t core);
+
+#endif // NATIVE_ESP_FREERTOS_HOOKS_H
@@ -0,0 +1,354 @@
+// ESP-IDF services for the native build: partitions, OTA boot selection, esp_timer, NVS, sleep, power management
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Arduino.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_pm.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "mock.h"
+#include "nvs_flash.h"
+
+struct NativeEspTimer {
+    esp_timer_cb_t callback;
+    void* arg;
+    uint64_t periodUs; // 0 for one-shot
+    uint64_t dueUs;
+    bool active;
+};
+
+namespace {
+
+// partitions.csv
+esp_partition_t partitions[] = {
+    {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, 0x140000, "app0", false},
+    {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x150000, 0x140000, "app1", false},
+    {ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, 0x290000, 0x170000, "spiffs", false},
+};
+std::mutex flashLock;
+const esp_partition_t* running = nullptr;
+
+std::string partitionPath(const esp_partition_t* partition) {
+    return mock::dataDir() + "/" + partition->label + ".bin";
+}
+
+// Opens the partition's backing file, creating it erased on first use
+FILE* openPartition(const esp_partition_t* partition) {
+    std::string path = partitionPath(partition);
+    FILE* f = fopen(path.c_str(), "r+b");
+    if (!f) {
+        f = fopen(path.c_str(), "w+b");
+        std::vector<uint8_t> erased(SPI_FLASH_SEC_SIZE, 0xFF);
+        for (uint32_t i = 0; f && i < partition->size; i += erased.size()) {
+            fwrite(erased.data(), 1, erased.size(), f);
+        }
+    }
+    return f;
+}
+
+bool inRange(const esp_partition_t* partition, size_t offset, size_t size) {
+    return partition && offset <= partition->size && size <= partition->size - offset;
+}
+
+std::string otadataPath() {
+    return mock::dataDir() + "/otadata";
+}
+
+std::mutex timerLock;
+std::condition_variable timerChanged;
+std::vector<NativeEspTimer*> espTimers;
+std::once_flag timerTaskStarted;
+
+// The esp_timer task: runs due callbacks in order, one at a time
+void timerTask() {
+    std::unique_lock<std::mutex> lock(timerLock);
+    for (;;) {
+        NativeEspTimer* next = nullptr;
+        for (NativeEspTimer* t : espTimers) {
+            if (t->active && (!next || t->dueUs < next->dueUs)) {
+                next = t;
+            }
+        }
+        uint64_t now = mock::nowUs();
+        if (!next) {
+            timerChanged.wait(lock);
+        } else if (next->dueUs > now) {
+            timerChanged.wait_for(lock, std::chrono::microseconds((uint64_t)((next->dueUs - now) / mock::timeScale())));
+        } else {
+            if (next->periodUs) {
+                next->dueUs += next->periodUs;
+                if (next->dueUs < now) {
+                    next->dueUs = now + next->periodUs; // Skip missed periods instead of bursting
+                }
+            } else {
+                next->active = false;
+            }
+            esp_timer_cb_t callback = next->callback;
+            void* arg = next->arg;
+            lock.unlock();
+            callback(arg);
+            lock.lock();
+        }
+    }
+}
+
+uint64_t wakeupUs = 0;
+
+} // namespace
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_NVS_NOT_FOUND:
+        return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_OTA_VALIDATE_FAILED:
+        return "ESP_ERR_OTA_VALIDATE_FAILED";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+// Partitions
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label) {
+    for (const esp_partition_t& p : partitions) {
+        if (p.type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || p.subtype == subtype)
+            && (!label || strcmp(label, p.label) == 0)) {
+            return &p;
+        }
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size) {
+    if (!inRange(partition, offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    std::lock_guard<std::mutex> guard(flashLock);
+    FILE* f = openPartition(partition);
+    bool ok = f && fseek(f, offset, SEEK_SET) == 0 && fread(dst, 1, size, f) == size;
+    if (f) {
+        fclose(f);
+    }
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size) {
+    if (!inRange(partition, offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    std::lock_guard<std::mutex> guard(flashLock);
+    FILE* f = openPartition(partition);
+    std::vector<uint8_t> cells(size);
+    bool ok = f && fseek(f, offset, SEEK_SET) == 0 && fread(cells.data(), 1, size, f) == size;
+    const uint8_t* bytes = (const uint8_t*)src;
+    for (size_t i = 0; i < size; i++) {
+        cells[i] &= bytes[i]; // Programming only clears bits
+    }
+    ok = ok && fseek(f, offset, SEEK_SET) == 0 && fwrite(cells.data(), 1, size, f) == size;
+    if (f) {
+        fclose(f);
+    }
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    if (!inRange(partition, offset, size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (offset % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> guard(flashLock);
+    FILE* f = openPartition(partition);
+    std::vector<uint8_t> erased(size, 0xFF);
+    bool ok = f && fseek(f, offset, SEEK_SET) == 0 && fwrite(erased.data(), 1, size, f) == size;
+    if (f) {
+        fclose(f);
+    }
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+// OTA
+
+const esp_partition_t* esp_ota_get_boot_partition() {
+    std::ifstream in(otadataPath());
+    std::string label;
+    in >> label;
+    const esp_partition_t* boot = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY,
+                                                           label.empty() ? "app0" : label.c_str());
+    return boot ? boot : &partitions[0];
+}
+
+const esp_partition_t* esp_ota_get_running_partition() {
+    if (!running) {
+        running = esp_ota_get_boot_partition();
+    }
+    return running;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start) {
+    const esp_partition_t* from = start ? start : esp_ota_get_running_partition();
+    return from == &partitions[0] ? &partitions[1] : &partitions[0];
+}
+
+const esp_partition_t* esp_ota_get_last_invalid_partition() {
+    return nullptr;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    if (!partition || partition->type != ESP_PARTITION_TYPE_APP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint8_t magic = 0;
+    if (esp_partition_read(partition, 0, &magic, 1) != ESP_OK || magic != 0xE9) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    std::ofstream(otadataPath()) << partition->label << "\n";
+    return ESP_OK;
+}
+
+// esp_timer
+
+int64_t esp_timer_get_time() {
+    return mock::nowUs();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    if (!args || !args->callback || !handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::call_once(timerTaskStarted, [] { std::thread(timerTask).detach(); });
+    std::lock_guard<std::mutex> guard(timerLock);
+    *handle = new NativeEspTimer{args->callback, args->arg, 0, 0, false};
+    espTimers.push_back(*handle);
+    return ESP_OK;
+}
+
+static esp_err_t startTimer(esp_timer_handle_t timer, uint64_t us, bool periodic) {
+    std::lock_guard<std::mutex> guard(timerLock);
+    if (!timer || timer->active) {
+        return timer ? ESP_ERR_INVALID_STATE : ESP_ERR_INVALID_ARG;
+    }
+    timer->periodUs = periodic ? us : 0;
+    timer->dueUs = mock::nowUs() + us;
+    timer->active = true;
+    timerChanged.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+    return startTimer(timer, periodUs, true);
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+    return startTimer(timer, timeoutUs, false);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> guard(timerLock);
+    if (!timer || !timer->active) {
+        return timer ? ESP_ERR_INVALID_STATE : ESP_ERR_INVALID_ARG;
+    }
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    std::lock_guard<std::mutex> guard(timerLock);
+    if (!timer || timer->active) {
+        return timer ? ESP_ERR_INVALID_STATE : ESP_ERR_INVALID_ARG;
+    }
+    espTimers.erase(std::find(espTimers.begin(), espTimers.end(), timer));
+    delete timer;
+    return ESP_OK;
+}
+
+// Watchdog
+
+esp_err_t esp_task_wdt_init(uint32_t timeoutSeconds, bool panic) {
+    (void)timeoutSeconds;
+    (void)panic;
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_deinit() {
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_add(void* task) {
+    (void)task;
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reset() {
+    return ESP_OK;
+}
+
+// NVS
+
+esp_err_t nvs_flash_init() {
+    std::error_code ignored;
+    std::filesystem::create_directories(mock::dataDir() + "/nvs", ignored);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase() {
+    std::error_code ignored;
+    std::filesystem::remove_all(mock::dataDir() + "/nvs", ignored);
+    return nvs_flash_init();
+}
+
+// Sleep
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs) {
+    wakeupUs = timeUs;
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start() {
+    Serial.printf("[native] deep sleep for %llu us\n", (unsigned long long)wakeupUs);
+    mock::sleepUs(wakeupUs);
+    mock::restart();
+}
+
+void esp_deep_sleep(uint64_t timeUs) {
+    esp_sleep_enable_timer_wakeup(timeUs);
+    esp_deep_sleep_start();
+}
+
+// Power management
+
+esp_err_t esp_pm_configure(const void* config) {
+    const esp_pm_config_esp32_t* pm = static_cast<const esp_pm_config_esp32_t*>(config);
+    fprintf(stderr, "[native] power management: %d-%d MHz, light sleep %s\n", pm->min_freq_mhz, pm->max_freq_mhz,
+            pm->light_sleep_enable ? "on" : "off");
+    return ESP_OK;
+}
@@ -0,0 +1,19 @@
+#ifndef NATIVE_ESP_OTA_OPS_H
+#define NATIVE_ESP_OTA_OPS_H
+
+/*
+Boot selection between app0 and app1, kept in the data directory. There is
+no bootloader: the "running" partition is the one selected when the program
+started, and esp_ota_set_boot_partition() only checks that the image starts
+with the ESP32 image magic byte (0xE9) before selecting it.
+*/
+
+#include "esp_partition.h"
+
+const esp_partition_t* esp_ota_get_running_partition();
+const esp_partition_t* esp_ota_get_boot_partition();
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start);
+const esp_partition_t* esp_ota_get_last_invalid_partition();
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+
+#endif // NATIVE_ESP_OTA_OPS_H
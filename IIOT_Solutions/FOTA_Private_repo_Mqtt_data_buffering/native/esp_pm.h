@@ -0,0 +1,16 @@
+#ifndef NATIVE_ESP_PM_H
+#define NATIVE_ESP_PM_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+// ESP-IDF 4.x layout, as in Arduino-ESP32 2.x
+typedef struct {
+    int max_freq_mhz;
+    int min_freq_mhz;
+    bool light_sleep_enable;
+} esp_pm_config_esp32_t;
+
+esp_err_t esp_pm_configure(const void* config); // Accepted and ignored: the host never sleeps
+
+#endif // NATIVE_ESP_PM_H
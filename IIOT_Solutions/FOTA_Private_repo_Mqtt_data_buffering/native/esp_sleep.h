@@ -0,0 +1,11 @@
+#ifndef NATIVE_ESP_SLEEP_H
+#define NATIVE_ESP_SLEEP_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs);
+void esp_deep_sleep_start(); // Sleeps for the wakeup time, then restarts like ESP.restart()
+void esp_deep_sleep(uint64_t timeUs);
+
+#endif // NATIVE_ESP_SLEEP_H
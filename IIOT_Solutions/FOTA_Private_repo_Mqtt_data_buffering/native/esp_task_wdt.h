@@ -0,0 +1,12 @@
+#ifndef NATIVE_ESP_TASK_WDT_H
+#define NATIVE_ESP_TASK_WDT_H
+
+#include "esp_err.h"
+
+// There is no watchdog on the host; these only report success
+esp_err_t esp_task_wdt_init(uint32_t timeoutSeconds, bool panic);
+esp_err_t esp_task_wdt_deinit();
+esp_err_t esp_task_wdt_add(void* task);
+esp_err_t esp_task_wdt_reset();
+
+#endif // NATIVE_ESP_TASK_WDT_H
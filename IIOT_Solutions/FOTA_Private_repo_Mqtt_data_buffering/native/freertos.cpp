@@ -0,0 +1,523 @@
+// FreeRTOS API on std::thread, see freertos/FreeRTOS.h
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <string>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "esp_freertos_hooks.h"
+#include "mock.h"
+
+struct NativeTask {
+    std::string name;
+    UBaseType_t priority;
+    int core;
+    std::mutex lock;
+    std::condition_variable wake;
+    uint32_t notifications;
+    BaseType_t affinity = tskNO_AFFINITY;
+    uint32_t stackDepth = 0;
+};
+
+struct NativeQueue {
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<uint8_t> storage;      // length items, allocated up front like the FreeRTOS queue
+    UBaseType_t head;                  // Oldest item
+    UBaseType_t count;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+};
+
+struct NativeEventGroup {
+    std::mutex lock;
+    std::condition_variable changed;
+    EventBits_t bits;
+};
+
+struct NativeTimer {
+    std::string name;
+    TickType_t period;
+    bool autoReload;
+    void* id;
+    TimerCallbackFunction_t callback;
+    bool active;
+    uint64_t dueUs;
+};
+
+namespace {
+
+// The Arduino loop task runs on core 1; other threads (timer service, MQTT, WiFi events) act as core 0 system tasks
+NativeTask loopTask = {"loopTask", 1, 1, {}, {}, 0, 1, 8192};
+NativeTask systemTask = {"system", configMAX_PRIORITIES - 1, 0, {}, {}, 0};
+NativeTask idleTasks[portNUM_PROCESSORS] = {{"IDLE0", 0, 0, {}, {}, 0}, {"IDLE1", 0, 1, {}, {}, 0}};
+NativeTask busyTasks[portNUM_PROCESSORS] = {{"busy0", 1, 0, {}, {}, 0}, {"busy1", 1, 1, {}, {}, 0}};
+thread_local NativeTask* currentTask = nullptr;
+std::atomic<int> runningTasks[portNUM_PROCESSORS];
+std::mutex taskListLock;
+std::vector<NativeTask*> taskList = {&loopTask}; // For xTaskGetHandle()
+
+std::recursive_mutex criticalLock;
+
+std::mutex timerLock;
+std::condition_variable timerChanged;
+std::vector<NativeTimer*> timers;
+std::once_flag timerServiceStarted;
+
+esp_freertos_tick_cb_t tickHooks[portNUM_PROCESSORS];
+std::once_flag tickThreadStarted;
+
+NativeTask* self() {
+    if (!currentTask) {
+        currentTask = &systemTask;
+    }
+    return currentTask;
+}
+
+// Simulated ticks to a real-time deadline for condition variable waits
+std::chrono::steady_clock::time_point deadline(TickType_t ticks) {
+    return std::chrono::steady_clock::now()
+           + std::chrono::microseconds((uint64_t)(ticks * 1000.0 / mock::timeScale()));
+}
+
+template <typename Predicate>
+bool waitFor(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, TickType_t ticks, Predicate ready) {
+    if (ready()) {
+        return true;
+    }
+    if (ticks == 0) {
+        return false;
+    }
+    mock::taskBlocked();
+    bool ok;
+    if (ticks == portMAX_DELAY) {
+        cv.wait(lock, ready);
+        ok = true;
+    } else {
+        ok = cv.wait_until(lock, deadline(ticks), ready);
+    }
+    mock::taskRunning();
+    return ok;
+}
+
+void timerService() {
+    currentTask = &systemTask;
+    std::unique_lock<std::mutex> lock(timerLock);
+    for (;;) {
+        NativeTimer* next = nullptr;
+        for (NativeTimer* timer : timers) {
+            if (timer->active && (!next || timer->dueUs < next->dueUs)) {
+                next = timer;
+            }
+        }
+        uint64_t now = mock::nowUs();
+        if (!next) {
+            timerChanged.wait(lock);
+        } else if (next->dueUs > now) {
+            timerChanged.wait_until(lock, std::chrono::steady_clock::now()
+                                              + std::chrono::microseconds((uint64_t)((next->dueUs - now) / mock::timeScale())));
+        } else {
+            if (next->autoReload) {
+                next->dueUs += next->period * 1000ULL;
+            } else {
+                next->active = false;
+            }
+            lock.unlock();
+            next->callback(next);
+            lock.lock();
+        }
+    }
+}
+
+// Calls the tick hooks once per simulated millisecond, as the tick interrupt would on each core
+void tickThread() {
+    uint64_t tick = mock::nowUs() / 1000;
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        uint64_t now = mock::nowUs() / 1000;
+        for (int n = 0; tick < now && n < 100; tick++, n++) {
+            for (int core = 0; core < portNUM_PROCESSORS; core++) {
+                if (tickHooks[core]) {
+                    currentTask = runningTasks[core] > 0 ? &busyTasks[core] : &idleTasks[core];
+                    tickHooks[core]();
+                }
+            }
+        }
+        tick = now;
+    }
+}
+
+void startTask(NativeTask* task, TaskFunction_t function, void* parameter) {
+    runningTasks[task->core]++;
+    std::thread([task, function, parameter] {
+        currentTask = task;
+        function(parameter);
+    }).detach();
+}
+
+} // namespace
+
+namespace mock {
+
+void taskBlocked() {
+    runningTasks[self()->core]--;
+}
+
+void taskRunning() {
+    runningTasks[self()->core]++;
+}
+
+void startLoopTask() {
+    currentTask = &loopTask;
+    runningTasks[loopTask.core]++;
+}
+
+} // namespace mock
+
+void vPortEnterCritical(portMUX_TYPE* mux) {
+    (void)mux;
+    criticalLock.lock();
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+    (void)mux;
+    criticalLock.unlock();
+}
+
+// Tasks
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    NativeTask* task = new NativeTask();
+    task->name = name;
+    task->priority = priority;
+    task->core = core == tskNO_AFFINITY ? 0 : core;
+    task->notifications = 0;
+    task->affinity = core;
+    task->stackDepth = stackDepth;
+    {
+        std::lock_guard<std::mutex> guard(taskListLock);
+        taskList.push_back(task);
+    }
+    if (handle) {
+        *handle = task;
+    }
+    startTask(task, function, parameter);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter,
+                       UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stackDepth, parameter, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr || task == currentTask) {
+        // A thread cannot be killed from outside; a task deleting itself just stops
+        mock::taskBlocked();
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::hours(1));
+        }
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    mock::taskBlocked();
+    mock::sleepUs(ticks * 1000ULL);
+    mock::taskRunning();
+}
+
+TickType_t xTaskGetTickCount() {
+    return mock::nowUs() / 1000;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return self();
+}
+
+TaskHandle_t xTaskGetHandle(const char* name) {
+    std::lock_guard<std::mutex> guard(taskListLock);
+    for (NativeTask* task : taskList) {
+        if (task->name == name) {
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+BaseType_t xTaskGetAffinity(TaskHandle_t task) {
+    return (task ? task : self())->affinity;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(UBaseType_t core) {
+    return &idleTasks[core % portNUM_PROCESSORS];
+}
+
+BaseType_t xPortGetCoreID() {
+    return self()->core;
+}
+
+const char* pcTaskGetName(TaskHandle_t task) {
+    return (task ? task : self())->name.c_str();
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    return (task ? task : self())->priority;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+    (task ? task : self())->priority = priority;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return (task ? task : self())->stackDepth; // Host stacks are not measured: always reported unused
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notifications++;
+    task->wake.notify_all();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken) {
+    xTaskNotifyGive(task);
+    if (woken) {
+        *woken = pdTRUE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    NativeTask* task = self();
+    std::unique_lock<std::mutex> lock(task->lock);
+    waitFor(task->wake, lock, ticks, [task] { return task->notifications > 0; });
+    uint32_t value = task->notifications;
+    if (value > 0) {
+        task->notifications = clear ? 0 : value - 1;
+    }
+    return value;
+}
+
+// Queues and semaphores
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    NativeQueue* queue = new NativeQueue();
+    queue->storage.resize((size_t)length * itemSize);
+    queue->head = 0;
+    queue->count = 0;
+    queue->length = length;
+    queue->itemSize = itemSize;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitFor(queue->changed, lock, wait, [queue] { return queue->count < queue->length; })) {
+        return errQUEUE_FULL;
+    }
+    if (queue->itemSize > 0) {
+        size_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(&queue->storage[tail * queue->itemSize], item, queue->itemSize);
+    }
+    queue->count++;
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t wait) {
+    return xQueueSend(queue, item, wait);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken) {
+    if (woken) {
+        *woken = pdTRUE;
+    }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait) {
+    std::unique_lock<std::mutex> lock(queue->lock);
+    if (!waitFor(queue->changed, lock, wait, [queue] { return queue->count > 0; })) {
+        return pdFALSE;
+    }
+    if (queue->itemSize > 0) {
+        memcpy(item, &queue->storage[(size_t)queue->head * queue->itemSize], queue->itemSize);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->length - queue->count;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+// A semaphore is a queue of empty items: giving adds one, taking removes one
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+    xSemaphoreGive(mutex);
+    return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) {
+    return xQueueReceive(semaphore, nullptr, wait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return xQueueSend(semaphore, nullptr, 0);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* woken) {
+    return xQueueSendFromISR(semaphore, nullptr, woken);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    vQueueDelete(semaphore);
+}
+
+// Event groups
+
+EventGroupHandle_t xEventGroupCreate() {
+    NativeEventGroup* group = new NativeEventGroup();
+    group->bits = 0;
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> guard(group->lock);
+    group->bits |= bits;
+    group->changed.notify_all();
+    return group->bits;
+}
+
+BaseType_t xEventGroupSetBitsFromISR(EventGroupHandle_t group, EventBits_t bits, BaseType_t* woken) {
+    xEventGroupSetBits(group, bits);
+    if (woken) {
+        *woken = pdTRUE;
+    }
+    return pdPASS;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> guard(group->lock);
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> guard(group->lock);
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit, BaseType_t waitForAll,
+                                TickType_t wait) {
+    std::unique_lock<std::mutex> lock(group->lock);
+    auto ready = [group, bits, waitForAll] {
+        return waitForAll ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    bool met = waitFor(group->changed, lock, wait, ready);
+    EventBits_t value = group->bits;
+    if (met && clearOnExit) {
+        group->bits &= ~bits;
+    }
+    return value;
+}
+
+// Software timers
+
+TimerHandle_t xTimerCreate(const char* name, TickType_t period, UBaseType_t autoReload, void* id,
+                           TimerCallbackFunction_t callback) {
+    std::call_once(timerServiceStarted, [] { std::thread(timerService).detach(); });
+    NativeTimer* timer = new NativeTimer();
+    timer->name = name;
+    timer->period = period;
+    timer->autoReload = autoReload;
+    timer->id = id;
+    timer->callback = callback;
+    timer->active = false;
+    timer->dueUs = 0;
+    std::lock_guard<std::mutex> guard(timerLock);
+    timers.push_back(timer);
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait) {
+    (void)wait;
+    std::lock_guard<std::mutex> guard(timerLock);
+    timer->active = true;
+    timer->dueUs = mock::nowUs() + timer->period * 1000ULL;
+    timerChanged.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait) {
+    (void)wait;
+    std::lock_guard<std::mutex> guard(timerLock);
+    timer->active = false;
+    timerChanged.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait) {
+    return xTimerStart(timer, wait);
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait) {
+    {
+        std::lock_guard<std::mutex> guard(timerLock);
+        timer->period = period;
+    }
+    return xTimerStart(timer, wait); // Also starts a dormant timer, as in FreeRTOS
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer) {
+    std::lock_guard<std::mutex> guard(timerLock);
+    return timer->active;
+}
+
+void* pvTimerGetTimerID(TimerHandle_t timer) {
+    return timer->id;
+}
+
+// Tick hooks
+
+esp_err_t esp_register_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t hook, UBaseType_t core) {
+    if (core >= portNUM_PROCESSORS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    tickHooks[core] = hook;
+    std::call_once(tickThreadStarted, [] { std::thread(tickThread).detach(); });
+    return ESP_OK;
+}
+
+esp_err_t esp_register_freertos_idle_hook_for_cpu(esp_freertos_idle_cb_t hook, UBaseType_t core) {
+    (void)hook;
+    (void)core;
+    return ESP_ERR_NOT_SUPPORTED;
+}
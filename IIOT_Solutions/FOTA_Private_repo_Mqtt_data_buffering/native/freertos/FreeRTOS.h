@@ -0,0 +1,49 @@
+#ifndef NATIVE_FREERTOS_H
+#define NATIVE_FREERTOS_H
+
+/*
+FreeRTOS on std::thread. Tasks are threads, ticks are milliseconds of the
+simulated clock (mock::nowUs()), and critical sections share one recursive
+mutex. Priorities and core affinity are recorded but not enforced.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t EventBits_t;
+typedef uint8_t StackType_t;
+typedef void (*TaskFunction_t)(void*);
+
+typedef struct NativeTask* TaskHandle_t;
+typedef struct NativeQueue* QueueHandle_t;
+typedef struct NativeQueue* SemaphoreHandle_t;
+typedef struct NativeEventGroup* EventGroupHandle_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define errQUEUE_FULL 0
+#define configTICK_RATE_HZ 1000
+#define configMAX_PRIORITIES 25
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY 0xffffffffUL
+#define portNUM_PROCESSORS 2
+#define tskNO_AFFINITY 0x7fffffff
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+typedef struct { int unused; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+void vPortEnterCritical(portMUX_TYPE* mux);
+void vPortExitCritical(portMUX_TYPE* mux);
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux) vPortExitCritical(mux)
+#define portYIELD_FROM_ISR(woken) (void)(woken)
+
+#endif // NATIVE_FREERTOS_H
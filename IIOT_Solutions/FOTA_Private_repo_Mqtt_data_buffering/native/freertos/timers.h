@@ -0,0 +1,19 @@
+#ifndef NATIVE_FREERTOS_TIMERS_H
+#define NATIVE_FREERTOS_TIMERS_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct NativeTimer* TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+// Callbacks run one at a time on a timer service thread, as on the target
+TimerHandle_t xTimerCreate(const char* name, TickType_t period, UBaseType_t autoReload, void* id,
+                           TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait);
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer);
+void* pvTimerGetTimerID(TimerHandle_t timer);
+
+#endif // NATIVE_FREERTOS_TIMERS_H
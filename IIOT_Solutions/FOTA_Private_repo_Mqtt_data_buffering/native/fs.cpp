@@ -0,0 +1,338 @@
+// LittleFS and Preferences on host directories, see FS.h and Preferences.h
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "FS.h"
+#include "LittleFS.h"
+#include "Preferences.h"
+#include "esp_partition.h"
+#include "mock.h"
+
+namespace fs {
+
+struct FileImpl {
+    std::string hostPath;
+    std::string path; // As the firmware named it
+    std::string name;
+    FILE* file = nullptr;
+    bool directory = false;
+    std::vector<std::string> entries;
+    size_t next = 0;
+
+    ~FileImpl() {
+        if (file) {
+            fclose(file);
+        }
+    }
+};
+
+namespace {
+
+std::shared_ptr<FileImpl> openHost(const std::string& hostPath, const std::string& path, const char* mode) {
+    auto impl = std::make_shared<FileImpl>();
+    impl->hostPath = hostPath;
+    impl->path = path;
+    impl->name = path.substr(path.find_last_of('/') + 1);
+    struct stat st;
+    if (stat(hostPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        impl->directory = true;
+        std::error_code ignored;
+        for (const auto& entry : std::filesystem::directory_iterator(hostPath, ignored)) {
+            impl->entries.push_back(entry.path().filename().string());
+        }
+        std::sort(impl->entries.begin(), impl->entries.end());
+        return impl;
+    }
+    std::string fopenMode = std::string(mode) + "b";
+    impl->file = fopen(hostPath.c_str(), fopenMode.c_str());
+    return impl->file ? impl : nullptr;
+}
+
+// Operations left before mock::cutPowerAfter() cuts the power; SIZE_MAX while it stays on
+size_t powerBudget = SIZE_MAX;
+bool powerOff = false;
+
+enum Power { POWER_ON, POWER_CUT, POWER_OFF };
+
+// Accounts for one operation that changes the flash
+Power flashOperation() {
+    if (powerOff) {
+        return POWER_OFF;
+    }
+    if (powerBudget == SIZE_MAX) {
+        return POWER_ON;
+    }
+    if (powerBudget == 0) {
+        powerOff = true;
+        return POWER_CUT;
+    }
+    powerBudget--;
+    return POWER_ON;
+}
+
+size_t blocks(uintmax_t bytes) {
+    return (bytes + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+}
+
+} // namespace
+
+// File
+
+File::operator bool() const {
+    return impl_ && (impl_->file || impl_->directory);
+}
+
+size_t File::write(const uint8_t* buf, size_t len) {
+    if (!impl_ || !impl_->file) {
+        return 0;
+    }
+    switch (flashOperation()) {
+    case POWER_ON:
+        return fwrite(buf, 1, len, impl_->file);
+    case POWER_CUT:
+        return fwrite(buf, 1, len / 2, impl_->file); // Torn write
+    default:
+        return 0;
+    }
+}
+
+int File::available() {
+    return impl_ && impl_->file ? (int)(size() - position()) : 0;
+}
+
+int File::read() {
+    return impl_ && impl_->file ? fgetc(impl_->file) : -1;
+}
+
+size_t File::read(uint8_t* buf, size_t len) {
+    return impl_ && impl_->file ? fread(buf, 1, len, impl_->file) : 0;
+}
+
+int File::peek() {
+    if (!impl_ || !impl_->file) {
+        return -1;
+    }
+    int c = fgetc(impl_->file);
+    if (c != EOF) {
+        ungetc(c, impl_->file);
+    }
+    return c;
+}
+
+void File::flush() {
+    if (impl_ && impl_->file) {
+        fflush(impl_->file);
+    }
+}
+
+bool File::seek(uint32_t position) {
+    return impl_ && impl_->file && fseek(impl_->file, position, SEEK_SET) == 0;
+}
+
+size_t File::position() const {
+    return impl_ && impl_->file ? ftell(impl_->file) : 0;
+}
+
+size_t File::size() const {
+    if (!impl_ || !impl_->file) {
+        return 0;
+    }
+    fflush(impl_->file);
+    struct stat st;
+    return fstat(fileno(impl_->file), &st) == 0 ? st.st_size : 0;
+}
+
+void File::close() {
+    impl_.reset();
+}
+
+const char* File::name() const {
+    return impl_ ? impl_->name.c_str() : "";
+}
+
+const char* File::path() const {
+    return impl_ ? impl_->path.c_str() : "";
+}
+
+bool File::isDirectory() const {
+    return impl_ && impl_->directory;
+}
+
+File File::openNextFile(const char* mode) {
+    if (!isDirectory() || impl_->next >= impl_->entries.size()) {
+        return File();
+    }
+    const std::string& entry = impl_->entries[impl_->next++];
+    std::string path = impl_->path == "/" ? "/" + entry : impl_->path + "/" + entry;
+    return File(openHost(impl_->hostPath + "/" + entry, path, mode));
+}
+
+// FS
+
+std::string FS::hostPath(const char* path) const {
+    return mock::dataDir() + "/" + subdir_ + (path[0] == '/' ? "" : "/") + path;
+}
+
+bool FS::begin(bool formatOnFail, const char* basePath, uint8_t maxOpenFiles, const char* partitionLabel) {
+    (void)formatOnFail;
+    (void)basePath;
+    (void)maxOpenFiles;
+    (void)partitionLabel;
+    std::error_code error;
+    std::filesystem::create_directories(hostPath("/"), error);
+    return !error;
+}
+
+bool FS::format() {
+    std::error_code error;
+    std::filesystem::remove_all(hostPath("/"), error);
+    return begin();
+}
+
+File FS::open(const char* path, const char* mode, bool create) {
+    std::string host = hostPath(path);
+    if (mode[0] != 'r' && flashOperation() != POWER_ON) {
+        return File();
+    }
+    if (create && mode[0] != 'r') {
+        std::error_code ignored;
+        std::filesystem::create_directories(std::filesystem::path(host).parent_path(), ignored);
+    }
+    return File(openHost(host, path, mode));
+}
+
+bool FS::exists(const char* path) {
+    struct stat st;
+    return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path) {
+    return flashOperation() == POWER_ON && ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+    return flashOperation() == POWER_ON && ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+    return flashOperation() == POWER_ON && (::mkdir(hostPath(path).c_str(), 0755) == 0 || errno == EEXIST);
+}
+
+bool FS::rmdir(const char* path) {
+    return flashOperation() == POWER_ON && ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+size_t FS::totalBytes() {
+    const esp_partition_t* spiffs = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, nullptr);
+    return spiffs ? spiffs->size : 0;
+}
+
+// Whole blocks per file and directory, as LittleFS allocates them
+size_t FS::usedBytes() {
+    size_t used = 2 * SPI_FLASH_SEC_SIZE; // Superblocks
+    std::error_code ignored;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(hostPath("/"), ignored)) {
+        used += entry.is_regular_file(ignored) ? blocks(entry.file_size(ignored)) : SPI_FLASH_SEC_SIZE;
+    }
+    return used;
+}
+
+} // namespace fs
+
+fs::FS LittleFS("littlefs");
+
+namespace mock {
+
+void cutPowerAfter(size_t operations) {
+    fs::powerBudget = operations;
+    fs::powerOff = false;
+}
+
+void restorePower() {
+    fs::powerBudget = SIZE_MAX;
+    fs::powerOff = false;
+}
+
+} // namespace mock
+
+// Preferences
+
+namespace {
+
+const size_t NVS_KEY_MAX = 15; // Longer keys fail on the target, so they fail here too
+
+} // namespace
+
+std::string Preferences::path(const char* key) const {
+    return mock::dataDir() + "/nvs/" + name_ + "/" + key;
+}
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    std::string dir = mock::dataDir() + "/nvs/" + name;
+    std::error_code error;
+    if (readOnly && !std::filesystem::is_directory(dir, error)) {
+        return false; // A read-only open does not create the namespace
+    }
+    std::filesystem::create_directories(dir, error);
+    name_ = name;
+    readOnly_ = readOnly;
+    return !error;
+}
+
+bool Preferences::isKey(const char* key) {
+    struct stat st;
+    return !name_.empty() && stat(path(key).c_str(), &st) == 0;
+}
+
+bool Preferences::remove(const char* key) {
+    return !name_.empty() && !readOnly_ && ::remove(path(key).c_str()) == 0;
+}
+
+bool Preferences::clear() {
+    if (name_.empty() || readOnly_) {
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::remove_all(mock::dataDir() + "/nvs/" + name_, error);
+    std::filesystem::create_directories(mock::dataDir() + "/nvs/" + name_, error);
+    return !error;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+    if (name_.empty() || readOnly_ || strlen(key) > NVS_KEY_MAX) {
+        return 0;
+    }
+    std::ofstream out(path(key), std::ios::binary | std::ios::trunc);
+    out.write((const char*)value, len);
+    return out ? len : 0;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    struct stat st;
+    return !name_.empty() && stat(path(key).c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+    size_t len = getBytesLength(key);
+    if (len == 0 || len > maxLen) {
+        return 0;
+    }
+    std::ifstream in(path(key), std::ios::binary);
+    in.read((char*)buf, len);
+    return in ? len : 0;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+    if (!isKey(key)) {
+        return defaultValue;
+    }
+    std::ifstream in(path(key), std::ios::binary);
+    return String(std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()));
+}
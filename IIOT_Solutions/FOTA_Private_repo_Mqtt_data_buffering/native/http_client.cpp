@@ -0,0 +1,193 @@
+// HTTPClient for the native build, see HTTPClient.h
+
+#include <strings.h>
+#include <algorithm>
+
+#include "HTTPClient.h"
+
+namespace {
+
+std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+} // namespace
+
+bool HTTPClient::begin(WiFiClient& client, const String& url) {
+    std::string u = url.c_str();
+    size_t scheme = u.find("://");
+    if (scheme == std::string::npos) {
+        return false;
+    }
+    size_t slash = u.find('/', scheme + 3);
+    std::string host = u.substr(scheme + 3, slash == std::string::npos ? std::string::npos : slash - scheme - 3);
+    if (&client != client_ || host != connectedHost_) {
+        canReuse_ = false;
+    }
+    client_ = &client;
+    host_ = host;
+    path_ = slash == std::string::npos ? "/" : u.substr(slash);
+    size_t colon = host.find(':');
+    connectHost_ = host.substr(0, colon);
+    port_ = colon != std::string::npos ? atoi(host.c_str() + colon + 1) : u.compare(0, 5, "https") == 0 ? 443 : 80;
+    requestHeaders_.clear();
+    headers_.clear();
+    size_ = -1;
+    chunked_ = false;
+    return true;
+}
+
+void HTTPClient::end() {
+    if (!client_) {
+        return;
+    }
+    if (client_->connected()) {
+        while (client_->available() > 0) {
+            client_->read(); // Like the target, unread body bytes are dropped before the connection is reused
+        }
+    }
+    if (!(reuse_ && canReuse_)) {
+        client_->stop();
+        connectedHost_.clear();
+    }
+    requestHeaders_.clear();
+}
+
+void HTTPClient::addHeader(const String& name, const String& value) {
+    requestHeaders_ += std::string(name.c_str()) + ": " + value.c_str() + "\r\n";
+}
+
+void HTTPClient::collectHeaders(const char* names[], size_t count) {
+    collect_.clear();
+    for (size_t i = 0; i < count; i++) {
+        collect_.push_back(lower(names[i]));
+    }
+}
+
+String HTTPClient::header(const char* name) {
+    auto it = headers_.find(lower(name));
+    return it == headers_.end() ? String() : String(it->second);
+}
+
+bool HTTPClient::hasHeader(const char* name) {
+    return headers_.count(lower(name)) > 0;
+}
+
+bool HTTPClient::readLine(std::string& line) {
+    line.clear();
+    uint8_t c;
+    while (client_->readBytes(&c, 1) == 1) {
+        if (c == '\n') {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            return true;
+        }
+        line += (char)c;
+    }
+    return false;
+}
+
+int HTTPClient::GET() {
+    if (!client_) {
+        return HTTPC_ERROR_NOT_CONNECTED;
+    }
+    client_->Stream::setTimeout(timeoutMs_);
+    if (!(canReuse_ && client_->connected())) {
+        if (!client_->connect(connectHost_.c_str(), port_, timeoutMs_)) {
+            return HTTPC_ERROR_CONNECTION_REFUSED;
+        }
+        connectedHost_ = host_;
+    }
+    std::string request = "GET " + path_ + (http10_ ? " HTTP/1.0\r\n" : " HTTP/1.1\r\n");
+    request += "Host: " + host_ + "\r\n";
+    request += "User-Agent: ESP32HTTPClient\r\n";
+    request += std::string("Connection: ") + (reuse_ && !http10_ ? "keep-alive" : "close") + "\r\n";
+    request += requestHeaders_ + "\r\n";
+    if (client_->write((const uint8_t*)request.data(), request.size()) != request.size()) {
+        return HTTPC_ERROR_SEND_HEADER_FAILED;
+    }
+
+    std::string line;
+    if (!readLine(line) || line.compare(0, 5, "HTTP/") != 0) {
+        client_->stop();
+        return line.empty() ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+    }
+    int code = atoi(line.c_str() + line.find(' ') + 1);
+    canReuse_ = reuse_ && !http10_ && line.compare(0, 8, "HTTP/1.1") == 0;
+    headers_.clear();
+    size_ = -1;
+    chunked_ = false;
+    while (readLine(line) && !line.empty()) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = lower(line.substr(0, colon));
+        size_t start = line.find_first_not_of(' ', colon + 1);
+        std::string value = start == std::string::npos ? "" : line.substr(start);
+        if (name == "content-length") {
+            size_ = atoi(value.c_str());
+        } else if (name == "transfer-encoding" && strcasecmp(value.c_str(), "chunked") == 0) {
+            chunked_ = true;
+        } else if (name == "connection" && strcasecmp(value.c_str(), "close") == 0) {
+            canReuse_ = false;
+        }
+        if (std::find(collect_.begin(), collect_.end(), name) != collect_.end()) {
+            headers_[name] = value;
+        }
+    }
+    if (code == HTTP_CODE_NOT_MODIFIED) {
+        size_ = 0;
+    }
+    if (size_ < 0 && !chunked_) {
+        canReuse_ = false; // The body ends when the server closes
+    }
+    return code;
+}
+
+String HTTPClient::getString() {
+    std::string body;
+    if (chunked_) {
+        std::string line;
+        while (readLine(line)) {
+            size_t n = strtoul(line.c_str(), nullptr, 16);
+            if (n == 0) {
+                readLine(line);
+                break;
+            }
+            size_t at = body.size();
+            body.resize(at + n);
+            body.resize(at + client_->readBytes((uint8_t*)&body[at], n));
+            readLine(line);
+        }
+    } else if (size_ >= 0) {
+        body.resize(size_);
+        body.resize(client_->readBytes((uint8_t*)&body[0], size_));
+    } else {
+        uint8_t buf[512];
+        size_t n;
+        while ((n = client_->readBytes(buf, sizeof(buf))) > 0) {
+            body.append((const char*)buf, n);
+        }
+    }
+    return String(body);
+}
+
+String HTTPClient::errorToString(int error) {
+    switch (error) {
+    case HTTPC_ERROR_CONNECTION_REFUSED:
+        return "connection refused";
+    case HTTPC_ERROR_SEND_HEADER_FAILED:
+        return "send header failed";
+    case HTTPC_ERROR_NOT_CONNECTED:
+        return "not connected";
+    case HTTPC_ERROR_CONNECTION_LOST:
+        return "connection lost";
+    case HTTPC_ERROR_READ_TIMEOUT:
+        return "read Timeout";
+    default:
+        return String();
+    }
+}
@@ -0,0 +1,101 @@
+// Entry point of the native build: runs setup() and loop() as the Arduino core does, plus the stdin commands
+// described in mock.h
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include "mock.h"
+
+void setup();
+void loop();
+
+namespace {
+
+// Times count commands from the broker publish until pin takes the commanded level, alternating levels.
+// json sends {"state": "0|1"} (output 0), otherwise the two-byte {output 0, level} fast-path command.
+void actuate(const std::string& topic, int pin, int count, bool json) {
+    std::vector<uint64_t> samples;
+    for (int i = 0; i < count; i++) {
+        int level = mock::pin(pin) ? 0 : 1;
+        std::string payload = json ? std::string("{\"state\":\"") + (char)('0' + level) + "\"}"
+                                   : std::string{(char)0, (char)level};
+        uint64_t start = mock::nowUs();
+        mock::mqttDeliver(topic, payload);
+        while (mock::pin(pin) != level && mock::nowUs() - start < 1000000) {
+            std::this_thread::yield();
+        }
+        if (mock::pin(pin) != level) {
+            fprintf(stderr, "[native] actuate: pin %d did not change, is %s routed?\n", pin, topic.c_str());
+            return;
+        }
+        samples.push_back(mock::nowUs() - start - mock::mqttDeliveryDelayUs());
+    }
+    if (samples.empty()) {
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    fprintf(stderr, "[native] actuate %s: %d commands, publish to pin p50 %llu us, p99 %llu us, max %llu us "
+            "after the broker's %llu us delivery delay\n", json ? "json" : "binary", count,
+            (unsigned long long)samples[samples.size() / 2], (unsigned long long)samples[samples.size() * 99 / 100],
+            (unsigned long long)samples.back(), (unsigned long long)mock::mqttDeliveryDelayUs());
+}
+
+void commands() {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::istringstream in(line);
+        std::string command;
+        in >> command;
+        if (command == "pin") {
+            int pin, level;
+            if (in >> pin >> level) {
+                mock::setPin(pin, level);
+            }
+        } else if (command == "wifi") {
+            int up;
+            if (in >> up) {
+                mock::setWifi(up);
+            }
+        } else if (command == "broker") {
+            int up;
+            if (in >> up) {
+                mock::setBroker(up);
+            }
+        } else if (command == "mqtt") {
+            std::string topic, payload;
+            in >> topic;
+            std::getline(in >> std::ws, payload);
+            mock::mqttDeliver(topic, payload);
+        } else if (command == "actuate") {
+            std::string topic, format;
+            int pin, count;
+            if (in >> topic >> pin >> count) {
+                in >> format;
+                actuate(topic, pin, count, format == "json");
+            }
+        } else if (command == "restart") {
+            mock::restart();
+        } else if (!command.empty()) {
+            fprintf(stderr, "[native] unknown command: %s\n", command.c_str());
+        }
+    }
+}
+
+} // namespace
+
+#ifndef PIO_UNIT_TESTING // pio test links the tests' own main()
+int main(int argc, char** argv) {
+    mock::begin(argc, argv);
+    std::thread(commands).detach();
+    mock::startLoopTask();
+    setup();
+    for (;;) {
+        loop();
+    }
+}
+#endif
@@ -0,0 +1,157 @@
+// The mbedtls calls used by the firmware, see the headers in native/mbedtls
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include "mbedtls/base64.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/sha256.h"
+
+// SHA-256
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx) {
+    ctx->sha.reset();
+    ctx->is224 = 0;
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx) {
+    (void)ctx;
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224) {
+    ctx->sha.reset();
+    ctx->is224 = is224;
+    return is224 ? -1 : 0;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t len) {
+    ctx->sha.update(input, len);
+    return 0;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char output[32]) {
+    ctx->sha.finish(output);
+    return 0;
+}
+
+int mbedtls_sha256(const unsigned char* input, size_t len, unsigned char output[32], int is224) {
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    int err = mbedtls_sha256_starts(&ctx, is224);
+    if (err == 0) {
+        mbedtls_sha256_update(&ctx, input, len);
+        mbedtls_sha256_finish(&ctx, output);
+    }
+    return err;
+}
+
+// Base64
+
+namespace {
+
+const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int sextet(unsigned char c) {
+    const char* at = c ? strchr(ALPHABET, c) : nullptr;
+    return at ? (int)(at - ALPHABET) : -1;
+}
+
+} // namespace
+
+int mbedtls_base64_decode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen) {
+    std::string out;
+    uint32_t bits = 0;
+    int count = 0;
+    bool padding = false;
+    for (size_t i = 0; i < slen; i++) {
+        unsigned char c = src[i];
+        if (c == ' ' || c == '\r' || c == '\n') {
+            continue;
+        }
+        if (c == '=') {
+            padding = true;
+            continue;
+        }
+        int value = sextet(c);
+        if (value < 0 || padding) {
+            *olen = 0;
+            return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+        }
+        bits = bits << 6 | value;
+        if (++count == 4) {
+            out += (char)(bits >> 16);
+            out += (char)(bits >> 8);
+            out += (char)bits;
+            bits = 0;
+            count = 0;
+        }
+    }
+    if (count == 1) {
+        *olen = 0;
+        return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+    }
+    if (count == 2) {
+        out += (char)(bits >> 4);
+    } else if (count == 3) {
+        out += (char)(bits >> 10);
+        out += (char)(bits >> 2);
+    }
+    *olen = out.size();
+    if (!dst || dlen < out.size()) {
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    memcpy(dst, out.data(), out.size());
+    return 0;
+}
+
+int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen) {
+    size_t needed = (slen + 2) / 3 * 4 + 1;
+    if (!dst || dlen < needed) {
+        *olen = needed;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    unsigned char* p = dst;
+    for (size_t i = 0; i < slen; i += 3) {
+        uint32_t bits = src[i] << 16 | (i + 1 < slen ? src[i + 1] << 8 : 0) | (i + 2 < slen ? src[i + 2] : 0);
+        *p++ = ALPHABET[bits >> 18 & 63];
+        *p++ = ALPHABET[bits >> 12 & 63];
+        *p++ = i + 1 < slen ? ALPHABET[bits >> 6 & 63] : '=';
+        *p++ = i + 2 < slen ? ALPHABET[bits & 63] : '=';
+    }
+    *p = '\0';
+    *olen = p - dst;
+    return 0;
+}
+
+// Public keys
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx) {
+    ctx->parsed = 0;
+}
+
+void mbedtls_pk_free(mbedtls_pk_context* ctx) {
+    ctx->parsed = 0;
+}
+
+int mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen) {
+    std::string pem((const char*)key, keylen);
+    ctx->parsed = pem.find("-----BEGIN PUBLIC KEY-----") != std::string::npos
+                  && pem.find("-----END PUBLIC KEY-----") != std::string::npos;
+    return ctx->parsed ? 0 : MBEDTLS_ERR_PK_KEY_INVALID_FORMAT;
+}
+
+int mbedtls_pk_can_do(const mbedtls_pk_context* ctx, mbedtls_pk_type_t type) {
+    return ctx->parsed && (type == MBEDTLS_PK_ECKEY || type == MBEDTLS_PK_ECDSA);
+}
+
+int mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t md, const unsigned char* hash, size_t hashLen,
+                      const unsigned char* sig, size_t sigLen) {
+    (void)ctx;
+    (void)md;
+    (void)hash;
+    (void)hashLen;
+    (void)sig;
+    (void)sigLen;
+    return MBEDTLS_ERR_PK_FEATURE_UNAVAILABLE;
+}
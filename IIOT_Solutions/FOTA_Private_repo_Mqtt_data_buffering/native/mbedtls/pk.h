@@ -0,0 +1,30 @@
+#ifndef NATIVE_MBEDTLS_PK_H
+#define NATIVE_MBEDTLS_PK_H
+
+/*
+Public key API without the cryptography: keys parse (PEM framing only) but
+mbedtls_pk_verify() always fails with MBEDTLS_ERR_PK_FEATURE_UNAVAILABLE.
+Signed updates are therefore refused natively; build with
+-DOTA_REQUIRE_SIGNATURE=false and unsigned manifests to exercise the OTA path.
+*/
+
+#include <stddef.h>
+
+#define MBEDTLS_ERR_PK_KEY_INVALID_FORMAT -0x3D00
+#define MBEDTLS_ERR_PK_FEATURE_UNAVAILABLE -0x3980
+
+typedef enum { MBEDTLS_MD_NONE = 0, MBEDTLS_MD_SHA256 = 6 } mbedtls_md_type_t;
+typedef enum { MBEDTLS_PK_NONE = 0, MBEDTLS_PK_RSA, MBEDTLS_PK_ECKEY, MBEDTLS_PK_ECKEY_DH, MBEDTLS_PK_ECDSA } mbedtls_pk_type_t;
+
+typedef struct {
+    int parsed;
+} mbedtls_pk_context;
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx);
+void mbedtls_pk_free(mbedtls_pk_context* ctx);
+int mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t keylen);
+int mbedtls_pk_can_do(const mbedtls_pk_context* ctx, mbedtls_pk_type_t type);
+int mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t md, const unsigned char* hash, size_t hashLen,
+                      const unsigned char* sig, size_t sigLen);
+
+#endif // NATIVE_MBEDTLS_PK_H
@@ -0,0 +1,19 @@
+#ifndef NATIVE_MBEDTLS_SHA256_H
+#define NATIVE_MBEDTLS_SHA256_H
+
+#include <stddef.h>
+#include "../../src/sha256.h"
+
+typedef struct {
+    Sha256 sha;
+    int is224;
+} mbedtls_sha256_context;
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx);
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224); // SHA-224 is not supported
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t len);
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char output[32]);
+int mbedtls_sha256(const unsigned char* input, size_t len, unsigned char output[32], int is224);
+
+#endif // NATIVE_MBEDTLS_SHA256_H
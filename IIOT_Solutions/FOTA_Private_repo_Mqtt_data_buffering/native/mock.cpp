@@ -0,0 +1,112 @@
+// Simulated clock, pins and data directory, see mock.h
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "Arduino.h"
+#include "mock.h"
+
+namespace {
+
+const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+double scale = 1.0;
+std::string dir;
+char** args = nullptr;
+
+std::mutex pinLock;
+std::map<int, int> levels;
+struct Interrupt {
+    void (*handler)();
+    int mode;
+};
+std::map<int, Interrupt> interrupts;
+
+} // namespace
+
+namespace mock {
+
+void begin(int argc, char** argv) {
+    (void)argc;
+    args = argv;
+    const char* s = getenv("NATIVE_TIME_SCALE");
+    if (s && atof(s) > 0) {
+        scale = atof(s);
+    }
+    const char* d = getenv("NATIVE_DATA_DIR");
+    if (d && *d) {
+        dir = d;
+        ::mkdir(dir.c_str(), 0755);
+    } else {
+        char tmp[] = "/tmp/esp32-native-XXXXXX";
+        dir = mkdtemp(tmp) ? tmp : ".";
+    }
+    fprintf(stderr, "[native] data directory %s, time scale %g\n", dir.c_str(), scale);
+}
+
+const std::string& dataDir() {
+    return dir;
+}
+
+uint64_t nowUs() {
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    return (uint64_t)(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() * scale);
+}
+
+double timeScale() {
+    return scale;
+}
+
+void sleepUs(uint64_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)(us / scale)));
+}
+
+void setPin(int pin, int level) {
+    Interrupt interrupt = {nullptr, 0};
+    int previous;
+    {
+        std::lock_guard<std::mutex> guard(pinLock);
+        previous = levels[pin];
+        levels[pin] = level;
+        auto it = interrupts.find(pin);
+        if (it != interrupts.end()) {
+            interrupt = it->second;
+        }
+    }
+    bool rising = !previous && level;
+    bool falling = previous && !level;
+    if (interrupt.handler && ((interrupt.mode == RISING && rising) || (interrupt.mode == FALLING && falling)
+                              || (interrupt.mode == CHANGE && (rising || falling)))) {
+        interrupt.handler();
+    }
+}
+
+int pin(int pin) {
+    std::lock_guard<std::mutex> guard(pinLock);
+    return levels[pin];
+}
+
+void restart() {
+    fflush(stdout);
+    setenv("NATIVE_DATA_DIR", dir.c_str(), 1);
+    static char* fallback[] = {(char*)"firmware", nullptr};
+    execv("/proc/self/exe", args ? args : fallback);
+    perror("[native] restart failed");
+    exit(1);
+}
+
+} // namespace mock
+
+void attachInterrupt(int interrupt, void (*handler)(), int mode) {
+    std::lock_guard<std::mutex> guard(pinLock);
+    interrupts[interrupt] = {handler, mode};
+}
+
+void detachInterrupt(int interrupt) {
+    std::lock_guard<std::mutex> guard(pinLock);
+    interrupts.erase(interrupt);
+}
@@ -0,0 +1,77 @@
+#ifndef NATIVE_MOCK_H
+#define NATIVE_MOCK_H
+
+/*
+Controls for the simulated hardware behind the native build.
+
+Everything the firmware persists (LittleFS, NVS, OTA partitions) lives in a
+data directory, NATIVE_DATA_DIR or a fresh temporary directory, so a run can
+be restarted, ESP.restart() included, with its flash contents intact.
+
+The clock runs NATIVE_TIME_SCALE times faster than real time (default 1):
+millis(), esp_timer_get_time(), FreeRTOS ticks, timers and timeouts all use
+it, so an hour of OTA polling or buffering can be replayed in a minute.
+
+TLS connections (WiFiClientSecure) go to NATIVE_HTTP_HOST:NATIVE_HTTP_PORT
+(default 127.0.0.1:8000) in plain TCP, so HTTPS requests reach a local
+server such as tools/range_server.py with their original path and Host. MQTT talks to an in-process broker: published
+messages are logged (NATIVE_MQTT_LOG=0 silences them) and can be collected,
+and messages can be injected on any subscribed topic.
+
+Lines typed on stdin are handled by the native main(): "pin <n> <0|1>",
+"wifi <0|1>", "broker <0|1>", "mqtt <topic> <payload>", "restart" and
+"actuate <topic> <pin> <count> [json]", which publishes output commands and
+reports the time until the pin changes.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace mock {
+
+void begin(int argc, char** argv);
+const std::string& dataDir();
+
+uint64_t nowUs();
+double timeScale();
+void sleepUs(uint64_t us); // Sleeps for us of simulated time
+
+void setPin(int pin, int level); // Runs attached interrupt handlers on the calling thread
+int pin(int pin);
+
+void setWifi(bool up);
+void setBroker(bool up);
+void dropMqttSessions(); // What the broker sees when the device loses its link: sessions end, wills are published
+void restart(); // Re-executes the program with the same data directory
+
+// Payload bytes through WiFiClient sockets so far (HTTP and "HTTPS"; MQTT goes to the in-process broker).
+// There is no TLS on the host, so record and handshake overhead are not included.
+uint64_t tcpBytesSent();
+uint64_t tcpBytesReceived();
+
+// Power loss on the flash behind LittleFS: once `operations` more writes, write opens, renames and removes have
+// gone through, the next one is cut short (a write keeps half of its bytes, anything else does not happen) and
+// every later one fails until restorePower(). Tests step the cut point through a sequence to reset it anywhere.
+void cutPowerAfter(size_t operations);
+void restorePower();
+
+struct Published {
+    std::string topic;
+    std::string payload;
+    uint8_t qos;
+    bool retain;
+};
+void mqttDeliver(const std::string& topic, const std::string& payload, bool retain = false);
+uint64_t mqttDeliveryDelayUs(); // Simulated time from a publish reaching the broker to onMessage
+std::vector<Published> takePublished();
+
+// Bookkeeping for the CPU idle sampling: a task counts as busy unless it is blocked in a FreeRTOS call
+void taskBlocked();
+void taskRunning();
+void startLoopTask(); // Makes the calling thread the Arduino loop task (core 1)
+
+} // namespace mock
+
+#endif // NATIVE_MOCK_H
@@ -0,0 +1,356 @@
+// In-process MQTT broker behind AsyncMqttClient, see AsyncMqttClient.h
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AsyncMqttClient.h"
+#include "WiFi.h"
+#include "mock.h"
+
+namespace {
+
+const uint64_t ROUND_TRIP_US = 20000;  // Broker latency for CONNACK, SUBACK, PUBACK
+const size_t SEGMENT = 1436;           // Incoming payloads arrive in TCP segments, as onMessage index/total chunks
+const size_t PUBLISHED_KEPT = 1000;
+
+struct Session {
+    bool connected = false;
+    std::vector<std::string> filters;
+    std::string willTopic;
+    std::string willPayload;
+    uint8_t willQos = 0;
+    bool willRetain = false;
+    uint16_t nextId = 1;
+};
+
+struct Event {
+    uint64_t dueUs;
+    std::function<void()> run;
+};
+
+struct Broker {
+    std::mutex lock;
+    std::map<const AsyncMqttClient*, Session> sessions;
+    std::map<std::string, std::string> retained;
+    std::deque<mock::Published> published;
+};
+
+// Constructed on first use: the firmware's AsyncMqttClient is a global that registers itself during static init
+Broker& broker() {
+    static Broker instance;
+    return instance;
+}
+
+std::atomic<bool> brokerUp(true);
+const bool logPublishes = !getenv("NATIVE_MQTT_LOG") || strcmp(getenv("NATIVE_MQTT_LOG"), "0") != 0;
+
+// The async_tcp task: every callback runs here, in order
+std::mutex eventLock;
+std::condition_variable eventAdded;
+std::deque<Event> events;
+std::once_flag eventTaskStarted;
+
+void eventTask() {
+    std::unique_lock<std::mutex> lock(eventLock);
+    for (;;) {
+        if (events.empty()) {
+            eventAdded.wait(lock);
+            continue;
+        }
+        uint64_t now = mock::nowUs();
+        if (events.front().dueUs > now) {
+            eventAdded.wait_for(lock, std::chrono::microseconds((uint64_t)((events.front().dueUs - now) / mock::timeScale())));
+            continue;
+        }
+        std::function<void()> run = std::move(events.front().run);
+        events.pop_front();
+        lock.unlock();
+        run();
+        lock.lock();
+    }
+}
+
+void post(uint64_t delayUs, std::function<void()> run) {
+    std::call_once(eventTaskStarted, [] { std::thread(eventTask).detach(); });
+    std::lock_guard<std::mutex> guard(eventLock);
+    Event event = {mock::nowUs() + delayUs, std::move(run)};
+    auto at = events.end();
+    while (at != events.begin() && std::prev(at)->dueUs > event.dueUs) {
+        --at;
+    }
+    events.insert(at, std::move(event));
+    eventAdded.notify_all();
+}
+
+bool matches(const std::string& filter, const std::string& topic) {
+    size_t f = 0;
+    size_t t = 0;
+    while (f < filter.size()) {
+        if (filter[f] == '#') {
+            return true;
+        }
+        size_t fEnd = filter.find('/', f);
+        size_t tEnd = topic.find('/', t);
+        if (t > topic.size()) {
+            return false;
+        }
+        std::string level = filter.substr(f, fEnd == std::string::npos ? std::string::npos : fEnd - f);
+        if (level != "+" && level != topic.substr(t, tEnd == std::string::npos ? std::string::npos : tEnd - t)) {
+            return false;
+        }
+        if ((fEnd == std::string::npos) != (tEnd == std::string::npos)) {
+            // "a/#" also matches "a"
+            return fEnd != std::string::npos && filter.compare(fEnd, std::string::npos, "/#") == 0;
+        }
+        if (fEnd == std::string::npos) {
+            return true;
+        }
+        f = fEnd + 1;
+        t = tEnd + 1;
+    }
+    return t >= topic.size();
+}
+
+void deliver(AsyncMqttClient* client, const std::string& topic, const std::string& payload, uint8_t qos, bool retain) {
+    post(ROUND_TRIP_US / 2, [=] {
+        {
+            std::lock_guard<std::mutex> guard(broker().lock);
+            if (!broker().sessions[client].connected) {
+                return;
+            }
+        }
+        if (!client->onMessage_) {
+            return;
+        }
+        std::vector<char> topicCopy(topic.begin(), topic.end());
+        topicCopy.push_back('\0');
+        std::vector<char> chunk;
+        size_t index = 0;
+        do {
+            size_t n = std::min(SEGMENT, payload.size() - index);
+            chunk.assign(payload.begin() + index, payload.begin() + index + n);
+            chunk.push_back('\0');
+            AsyncMqttClientMessageProperties properties = {qos, false, retain};
+            client->onMessage_(topicCopy.data(), chunk.data(), properties, n, index, payload.size());
+            index += n;
+        } while (index < payload.size());
+    });
+}
+
+// Caller holds the broker lock
+void route(const std::string& topic, const std::string& payload, uint8_t qos, bool retain) {
+    if (retain) {
+        if (payload.empty()) {
+            broker().retained.erase(topic);
+        } else {
+            broker().retained[topic] = payload;
+        }
+    }
+    for (auto& entry : broker().sessions) {
+        if (!entry.second.connected) {
+            continue;
+        }
+        for (const std::string& filter : entry.second.filters) {
+            if (matches(filter, topic)) {
+                deliver(const_cast<AsyncMqttClient*>(entry.first), topic, payload, qos, false);
+                break;
+            }
+        }
+    }
+}
+
+uint16_t nextPacketId(Session& session) {
+    uint16_t id = session.nextId++;
+    if (session.nextId == 0) {
+        session.nextId = 1; // 0 is not a valid packet id
+    }
+    return id;
+}
+
+void dropSession(AsyncMqttClient* client, Session& session, bool publishWill) {
+    session.connected = false;
+    if (publishWill && !session.willTopic.empty()) {
+        route(session.willTopic, session.willPayload, session.willQos, session.willRetain);
+    }
+    post(0, [client] {
+        if (client->onDisconnect_) {
+            client->onDisconnect_(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);
+        }
+    });
+}
+
+} // namespace
+
+namespace mock {
+
+void setBroker(bool up) {
+    brokerUp = up;
+    if (!up) {
+        dropMqttSessions();
+    }
+}
+
+// The broker sees the connections time out, so wills are published
+void dropMqttSessions() {
+    std::lock_guard<std::mutex> guard(broker().lock);
+    for (auto& entry : broker().sessions) {
+        if (entry.second.connected) {
+            dropSession(const_cast<AsyncMqttClient*>(entry.first), entry.second, true);
+        }
+    }
+}
+
+void mqttDeliver(const std::string& topic, const std::string& payload, bool retain) {
+    std::lock_guard<std::mutex> guard(broker().lock);
+    route(topic, payload, 0, retain);
+}
+
+uint64_t mqttDeliveryDelayUs() {
+    return ROUND_TRIP_US / 2;
+}
+
+std::vector<Published> takePublished() {
+    std::lock_guard<std::mutex> guard(broker().lock);
+    std::vector<Published> taken(broker().published.begin(), broker().published.end());
+    broker().published.clear();
+    return taken;
+}
+
+} // namespace mock
+
+AsyncMqttClient::AsyncMqttClient() {
+    std::lock_guard<std::mutex> guard(broker().lock);
+    broker().sessions[this];
+}
+
+AsyncMqttClient& AsyncMqttClient::setWill(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length) {
+    std::lock_guard<std::mutex> guard(broker().lock);
+    Session& session = broker().sessions[this];
+    session.willTopic = topic ? topic : "";
+    session.willPayload = payload ? std::string(payload, length ? length : strlen(payload)) : "";
+    session.willQos = qos;
+    session.willRetain = retain;
+    return *this;
+}
+
+AsyncMqttClient& AsyncMqttClient::setServer(const char* host, uint16_t port) {
+    (void)host;
+    (void)port;
+    return *this;
+}
+
+bool AsyncMqttClient::connected() const {
+    std::lock_guard<std::mutex> guard(broker().lock);
+    auto it = broker().sessions.find(this);
+    return it != broker().sessions.end() && it->second.connected;
+}
+
+void AsyncMqttClient::connect() {
+    bool reachable = WiFi.isConnected() && brokerUp;
+    post(ROUND_TRIP_US, [this, reachable] {
+        {
+            std::lock_guard<std::mutex> guard(broker().lock);
+            Session& session = broker().sessions[this];
+            if (session.connected) {
+                return;
+            }
+            session.connected = reachable && brokerUp;
+            session.filters.clear(); // Clean session
+        }
+        if (!reachable) {
+            if (onDisconnect_) {
+                onDisconnect_(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);
+            }
+        } else if (onConnect_) {
+            onConnect_(false);
+        }
+    });
+}
+
+void AsyncMqttClient::disconnect(bool force) {
+    std::lock_guard<std::mutex> guard(broker().lock);
+    Session& session = broker().sessions[this];
+    if (session.connected) {
+        dropSession(this, session, force); // A forced close looks like a lost connection to the broker
+    }
+}
+
+uint16_t AsyncMqttClient::subscribe(const char* topic, uint8_t qos) {
+    std::lock_guard<std::mutex> guard(broker().lock);
+    Session& session = broker().sessions[this];
+    if (!session.connected) {
+        return 0;
+    }
+    session.filters.push_back(topic);
+    uint16_t id = nextPacketId(session);
+    post(ROUND_TRIP_US, [this, id, qos] {
+        if (onSubscribe_) {
+            onSubscribe_(id, qos);
+        }
+    });
+    for (const auto& message : broker().retained) {
+        if (matches(topic, message.first)) {
+            deliver(this, message.first, message.second, qos, true);
+        }
+    }
+    return id;
+}
+
+uint16_t AsyncMqttClient::unsubscribe(const char* topic) {
+    std::lock_guard<std::mutex> guard(broker().lock);
+    Session& session = broker().sessions[this];
+    if (!session.connected) {
+        return 0;
+    }
+    session.filters.erase(std::remove(session.filters.begin(), session.filters.end(), std::string(topic)),
+                          session.filters.end());
+    uint16_t id = nextPacketId(session);
+    post(ROUND_TRIP_US, [this, id] {
+        if (onUnsubscribe_) {
+            onUnsubscribe_(id);
+        }
+    });
+    return id;
+}
+
+uint16_t AsyncMqttClient::publish(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length,
+                                  bool dup, uint16_t messageId) {
+    (void)dup;
+    (void)messageId;
+    std::lock_guard<std::mutex> guard(broker().lock);
+    Session& session = broker().sessions[this];
+    if (!session.connected) {
+        return 0;
+    }
+    std::string body = payload ? std::string(payload, length ? length : strlen(payload)) : "";
+    if (logPublishes) {
+        fprintf(stderr, "[mqtt] %s (qos %u%s, %zu bytes) %.*s\n", topic, qos, retain ? ", retained" : "", body.size(),
+                (int)std::min<size_t>(body.size(), 200), body.c_str());
+    }
+    broker().published.push_back({topic, body, qos, retain});
+    if (broker().published.size() > PUBLISHED_KEPT) {
+        broker().published.pop_front();
+    }
+    route(topic, body, qos, retain);
+    if (qos == 0) {
+        return 1; // As the library: QoS 0 has no packet id
+    }
+    uint16_t id = nextPacketId(session);
+    post(ROUND_TRIP_US, [this, id] {
+        if (onPublish_) {
+            onPublish_(id);
+        }
+    });
+    return id;
+}
@@ -0,0 +1,9 @@
+#ifndef NATIVE_NVS_H
+#define NATIVE_NVS_H
+
+#include "esp_err.h"
+
+// Preferences keeps its own files (see Preferences.h); only partition-level calls exist here
+typedef uint32_t nvs_handle_t;
+
+#endif // NATIVE_NVS_H
@@ -0,0 +1,9 @@
+#ifndef NATIVE_NVS_FLASH_H
+#define NATIVE_NVS_FLASH_H
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init();
+esp_err_t nvs_flash_erase(); // Deletes every Preferences namespace
+
+#endif // NATIVE_NVS_FLASH_H
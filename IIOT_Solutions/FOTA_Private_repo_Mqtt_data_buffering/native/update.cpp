@@ -0,0 +1,83 @@
+// Update for the native build, see Update.h
+
+#include <algorithm>
+
+#include "Update.h"
+#include "esp_ota_ops.h"
+
+UpdateClass Update;
+
+bool UpdateClass::begin(size_t size) {
+    partition_ = esp_ota_get_next_update_partition(nullptr);
+    progress_ = 0;
+    finished_ = false;
+    error_ = nullptr;
+    size_ = size == UPDATE_SIZE_UNKNOWN ? partition_->size : size;
+    if (size_ > partition_->size) {
+        error_ = "Not Enough Space";
+        return false;
+    }
+    // Erased up front; the target erases sector by sector as it writes, which only changes the timing
+    size_t erase = (size_ + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    if (esp_partition_erase_range(partition_, 0, erase) != ESP_OK) {
+        error_ = "Flash Erase Failed";
+        return false;
+    }
+    return true;
+}
+
+size_t UpdateClass::write(uint8_t* data, size_t len) {
+    if (error_ || !partition_) {
+        return 0;
+    }
+    if (len > size_ - progress_) {
+        error_ = "Update Too Large";
+        return 0;
+    }
+    if (progress_ == 0 && len > 0 && data[0] != 0xE9) {
+        error_ = "Wrong Magic Byte";
+        return 0;
+    }
+    if (esp_partition_write(partition_, progress_, data, len) != ESP_OK) {
+        error_ = "Flash Write Failed";
+        return 0;
+    }
+    progress_ += len;
+    return len;
+}
+
+size_t UpdateClass::writeStream(Stream& stream) {
+    uint8_t buf[4096];
+    size_t written = 0;
+    while (remaining() > 0) {
+        size_t n = stream.readBytes(buf, std::min(sizeof(buf), remaining()));
+        if (n == 0 || write(buf, n) != n) {
+            if (!error_) {
+                error_ = "Stream Read Timeout";
+            }
+            break;
+        }
+        written += n;
+    }
+    return written;
+}
+
+bool UpdateClass::end(bool evenIfRemaining) {
+    if (error_ || !partition_) {
+        return false;
+    }
+    if (progress_ < size_ && !evenIfRemaining) {
+        error_ = "End Failed";
+        return false;
+    }
+    if (esp_ota_set_boot_partition(partition_) != ESP_OK) {
+        error_ = "Magic Byte Invalid";
+        return false;
+    }
+    finished_ = true;
+    return true;
+}
+
+void UpdateClass::abort() {
+    error_ = "Aborted";
+}
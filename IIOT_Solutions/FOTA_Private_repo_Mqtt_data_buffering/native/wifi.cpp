@@ -0,0 +1,248 @@
+// WiFi station and TCP client for the native build, see WiFi.h
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "WiFi.h"
+#include "WiFiClientSecure.h"
+#include "mock.h"
+
+WiFiClass WiFi;
+
+namespace {
+
+const uint64_t ASSOCIATE_US = 500000; // Association and DHCP take about half a second
+
+std::atomic<bool> linkUp(true);     // The access point is reachable (mock::setWifi)
+std::atomic<bool> started(false);   // begin() was called and not disconnect()
+std::atomic<bool> associated(false);
+std::mutex eventLock;               // Events are delivered one at a time, like the event task
+std::atomic<uint64_t> bytesSent(0);
+std::atomic<uint64_t> bytesReceived(0);
+
+void associate() {
+    std::thread([] {
+        mock::sleepUs(ASSOCIATE_US);
+        if (started && linkUp && !associated.exchange(true)) {
+            WiFi.dispatch(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+            WiFi.dispatch(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+        }
+    }).detach();
+}
+
+void lose() {
+    if (associated.exchange(false)) {
+        std::thread([] { WiFi.dispatch(ARDUINO_EVENT_WIFI_STA_DISCONNECTED); }).detach();
+    }
+}
+
+} // namespace
+
+namespace mock {
+
+void setWifi(bool up) {
+    linkUp = up;
+    if (!up) {
+        lose();
+        dropMqttSessions();
+    } else if (started) {
+        associate(); // The driver keeps retrying, so it comes back without the firmware asking
+    }
+}
+
+uint64_t tcpBytesSent() {
+    return bytesSent;
+}
+
+uint64_t tcpBytesReceived() {
+    return bytesReceived;
+}
+
+} // namespace mock
+
+String IPAddress::toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes_[0], bytes_[1], bytes_[2], bytes_[3]);
+    return buf;
+}
+
+// WiFiClass
+
+void WiFiClass::begin(const char* ssid, const char* password) {
+    (void)password;
+    fprintf(stderr, "[native] WiFi connecting to %s\n", ssid);
+    started = true;
+    associate();
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+    (void)wifiOff;
+    started = false;
+    lose();
+    return true;
+}
+
+bool WiFiClass::reconnect() {
+    started = true;
+    associate();
+    return true;
+}
+
+wl_status_t WiFiClass::status() {
+    return associated ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+IPAddress WiFiClass::localIP() {
+    return associated ? IPAddress(192, 168, 4, 2) : IPAddress();
+}
+
+void WiFiClass::dispatch(WiFiEvent_t event) {
+    std::lock_guard<std::mutex> guard(eventLock);
+    if (handler_) {
+        handler_(event);
+    }
+}
+
+// WiFiClient
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeoutMs) {
+    stop();
+    if (!WiFi.isConnected()) {
+        return 0;
+    }
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* addr;
+    if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &addr) != 0) {
+        return 0;
+    }
+    fd_ = socket(addr->ai_family, addr->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, addr->ai_protocol);
+    int rc = fd_ < 0 ? -1 : ::connect(fd_, addr->ai_addr, addr->ai_addrlen);
+    freeaddrinfo(addr);
+    if (rc < 0 && fd_ >= 0 && errno == EINPROGRESS) {
+        struct pollfd out = {fd_, POLLOUT, 0};
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (poll(&out, 1, timeoutMs / mock::timeScale() + 1) == 1 && getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len) == 0
+            && err == 0) {
+            rc = 0;
+        }
+    }
+    if (rc < 0) {
+        stop();
+        return 0;
+    }
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return 1;
+}
+
+bool WiFiClient::connected() {
+    if (fd_ < 0) {
+        return false;
+    }
+    if (head_ < tail_) {
+        return true;
+    }
+    uint8_t c;
+    ssize_t n = recv(fd_, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void WiFiClient::stop() {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    head_ = tail_ = 0;
+}
+
+bool WiFiClient::fill(int timeoutMs) {
+    if (head_ < tail_) {
+        return true;
+    }
+    if (fd_ < 0) {
+        return false;
+    }
+    struct pollfd in = {fd_, POLLIN, 0};
+    if (poll(&in, 1, timeoutMs > 0 ? (int)(timeoutMs / mock::timeScale()) + 1 : 0) != 1) {
+        return false;
+    }
+    ssize_t n = recv(fd_, buf_, sizeof(buf_), MSG_DONTWAIT);
+    if (n <= 0) {
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            stop();
+        }
+        return false;
+    }
+    head_ = 0;
+    tail_ = n;
+    bytesReceived += n;
+    return true;
+}
+
+int WiFiClient::available() {
+    fill(0);
+    return tail_ - head_;
+}
+
+int WiFiClient::read() {
+    return fill(0) ? buf_[head_++] : -1;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t len) {
+    if (!fill(0)) {
+        return fd_ < 0 ? -1 : 0;
+    }
+    size_t n = std::min(len, tail_ - head_);
+    memcpy(buf, buf_ + head_, n);
+    head_ += n;
+    return n;
+}
+
+int WiFiClient::peek() {
+    return fill(0) ? buf_[head_] : -1;
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t len) {
+    size_t sent = 0;
+    while (fd_ >= 0 && sent < len) {
+        ssize_t n = send(fd_, buf + sent, len - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            sent += n;
+            bytesSent += n;
+            continue;
+        }
+        struct pollfd out = {fd_, POLLOUT, 0};
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK) || poll(&out, 1, timeout_) != 1) {
+            stop();
+        }
+    }
+    return sent;
+}
+
+// WiFiClientSecure
+
+int WiFiClientSecure::connect(const char* host, uint16_t port, int32_t timeoutMs) {
+    (void)host;
+    (void)port;
+    const char* server = getenv("NATIVE_HTTP_HOST");
+    const char* serverPort = getenv("NATIVE_HTTP_PORT");
+    return WiFiClient::connect(server && *server ? server : "127.0.0.1", serverPort && *serverPort ? atoi(serverPort) : 8000,
+                               timeoutMs);
+}
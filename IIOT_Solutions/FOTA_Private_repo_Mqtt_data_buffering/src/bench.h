@@ -0,0 +1,237 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+Micro-benchmark harness for the BENCHMARK build (envs esp32dev-bench and
+native-bench in platformio.ini). Only main.cpp may include it.
+
+Each case runs with a growing iteration count until one measurement takes
+at least BENCH_MIN_TIME_US, like google-benchmark, and is timed with
+esp_timer_get_time() and the CPU cycle counter. Heap allocations made by
+the benchmarking task are counted by wrapping malloc/calloc/realloc/free at
+link time (-Wl,--wrap=...); operator new is routed through malloc so
+String, ArduinoJson and new/delete all show up, on target and on the host.
+
+Results are printed in google-benchmark's JSON format, so its
+tools/compare.py works on them as well as tools/bench_compare.py:
+
+    {"context": {...},
+     "benchmarks": [{"name": "bufferReading", "iterations": 40960,
+                     "real_time": 812.4, "time_unit": "ns",
+                     "cycles_per_iteration": 195.0,
+                     "allocs_per_iteration": 0.0, "bytes_per_iteration": 0.0}, ...]}
+
+Figures that are not per-call costs (heap left after a long run, a
+compression ratio) are attached with counter() and printed as
+google-benchmark user counters of the case.
+*/
+
+#include <Arduino.h>
+#include <new>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifndef BENCH_MIN_TIME_US
+#define BENCH_MIN_TIME_US 500000 // Minimum duration of the measured run of each case
+#endif
+
+#ifndef BENCH_MAX_COUNTERS
+#define BENCH_MAX_COUNTERS 4 // User counters per case
+#endif
+
+#ifdef ARDUINO_ARCH_ESP32
+#define BENCH_PLATFORM "esp32"
+#else
+#define BENCH_PLATFORM "native"
+#endif
+
+namespace bench {
+
+struct HeapCounters {
+    TaskHandle_t task;           // Only this task's allocations are counted; null when not measuring
+    uint32_t allocs;
+    uint64_t bytes;
+};
+
+inline HeapCounters& heap() {
+    static HeapCounters counters;
+    return counters;
+}
+
+inline void countAllocation(size_t size) {
+    HeapCounters& c = heap();
+    if (c.task && c.task == xTaskGetCurrentTaskHandle()) {
+        c.allocs++;
+        c.bytes += size;
+    }
+}
+
+class Runner {
+public:
+    explicit Runner(Print& out) : out_(out), count_(0), counters_(0) {}
+
+    void begin(const char* firmwareVersion, const char* platform) {
+        out_.printf("{\"context\": {\"executable\": \"firmware %s\", \"host_name\": \"%s\", \"num_cpus\": %d, "
+                    "\"mhz_per_cpu\": %lu, \"cpu_scaling_enabled\": false, \"library_build_type\": \"release\", "
+                    "\"min_time_us\": %lu, \"caches\": []},\n \"benchmarks\": [\n",
+                    firmwareVersion, platform, portNUM_PROCESSORS, (unsigned long)ESP.getCpuFreqMHz(),
+                    (unsigned long)BENCH_MIN_TIME_US);
+    }
+
+    // Time body() per call. maxIterations caps cases that talk to the network or the broker.
+    template <typename F>
+    void run(const char* name, F body, uint32_t maxIterations = 0xFFFFFFFF) {
+        body(); // Warm up caches and lazily allocated state
+        uint32_t iterations = 1;
+        Sample sample;
+        for (;;) {
+            sample = measure(body, iterations);
+            if (sample.us >= BENCH_MIN_TIME_US || iterations >= maxIterations) {
+                break;
+            }
+            // Aim 40% past the minimum time, growing at least 2x and at most 10x per round
+            uint64_t next = sample.us > 0 ? (uint64_t)iterations * BENCH_MIN_TIME_US * 14 / 10 / sample.us
+                                          : (uint64_t)iterations * 10;
+            next = next < (uint64_t)iterations * 2 ? (uint64_t)iterations * 2 : next;
+            next = next > (uint64_t)iterations * 10 ? (uint64_t)iterations * 10 : next;
+            iterations = next > maxIterations ? maxIterations : (uint32_t)next;
+        }
+        double ns = sample.us * 1000.0 / iterations;
+        out_.printf("%s  {\"name\": \"%s\", \"run_name\": \"%s\", \"run_type\": \"iteration\", \"repetitions\": 1, "
+                    "\"repetition_index\": 0, \"threads\": 1, \"iterations\": %lu, \"real_time\": %.1f, "
+                    "\"cpu_time\": %.1f, \"time_unit\": \"ns\", \"cycles_per_iteration\": %.1f, "
+                    "\"allocs_per_iteration\": %.2f, \"bytes_per_iteration\": %.1f",
+                    count_ ? ",\n" : "", name, name, (unsigned long)iterations, ns, ns,
+                    (double)sample.cycles / iterations, (double)sample.allocs / iterations,
+                    (double)sample.bytes / iterations);
+        for (uint32_t i = 0; i < counters_; i++) {
+            out_.printf(", \"%s\": %.2f", counterNames_[i], counterValues_[i]);
+        }
+        out_.printf("}");
+        counters_ = 0;
+        count_++;
+    }
+
+    // Attach a figure to the case run next (or being run, when called from its body). name must be a literal.
+    void counter(const char* name, double value) {
+        for (uint32_t i = 0; i < counters_; i++) {
+            if (strcmp(counterNames_[i], name) == 0) {
+                counterValues_[i] = value;
+                return;
+            }
+        }
+        if (counters_ < BENCH_MAX_COUNTERS) {
+            counterNames_[counters_] = name;
+            counterValues_[counters_++] = value;
+        }
+    }
+
+    // Records why a case was not run, without breaking the JSON
+    void skip(const char* name, const char* reason) {
+        out_.printf("%s  {\"name\": \"%s\", \"run_name\": \"%s\", \"run_type\": \"iteration\", \"error_occurred\": true, "
+                    "\"error_message\": \"%s\", \"iterations\": 0, \"real_time\": 0, \"cpu_time\": 0, \"time_unit\": \"ns\"}",
+                    count_ ? ",\n" : "", name, name, reason);
+        count_++;
+    }
+
+    void end() {
+        out_.printf("\n]}\n");
+    }
+
+private:
+    struct Sample {
+        uint64_t us;
+        uint64_t cycles;
+        uint32_t allocs;
+        uint64_t bytes;
+    };
+
+    template <typename F>
+    Sample measure(F& body, uint32_t iterations) {
+        HeapCounters& c = heap();
+        c.allocs = 0;
+        c.bytes = 0;
+        c.task = xTaskGetCurrentTaskHandle();
+        uint64_t cycles = 0;
+        uint32_t lastCycle = ESP.getCycleCount();
+        int64_t start = esp_timer_get_time();
+        for (uint32_t i = 0; i < iterations; i++) {
+            body();
+            uint32_t cycle = ESP.getCycleCount();
+            cycles += (uint32_t)(cycle - lastCycle); // The 32-bit counter wraps every ~18 s at 240 MHz
+            lastCycle = cycle;
+        }
+        int64_t elapsed = esp_timer_get_time() - start;
+        c.task = nullptr;
+        vTaskDelay(1); // Let the idle task feed the watchdog between rounds
+        Sample sample = {(uint64_t)elapsed, cycles, c.allocs, c.bytes};
+        return sample;
+    }
+
+    Print& out_;
+    uint32_t count_;
+    const char* counterNames_[BENCH_MAX_COUNTERS];
+    double counterValues_[BENCH_MAX_COUNTERS];
+    uint32_t counters_;
+};
+
+} // namespace bench
+
+// Allocation counting, linked in with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size) {
+    bench::countAllocation(size);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    bench::countAllocation(count * size);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    bench::countAllocation(size);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr) {
+    __real_free(ptr);
+}
+}
+
+// On the host libstdc++ is a shared library whose malloc calls the wrapper cannot see
+void* operator new(size_t size) {
+    void* ptr = malloc(size);
+    if (!ptr) {
+        abort();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+#endif // BENCH_H
@@ -0,0 +1,223 @@
+#ifndef BLOCK_CODEC_H
+#define BLOCK_CODEC_H
+
+/*
+Columnar block encoding for backlog replay.
+
+A block carries up to a few hundred (timestamp, value) readings in one
+publish on BUFFERED_DATA_TOPIC:
+
+    offset size  field
+    0      2     magic "CB"
+    2      1     version (1)
+    3      1     flags   bit0 = body is LZ4 block compressed
+    4      2     record count            (u16, little endian)
+    6      2     uncompressed body size  (u16, little endian)
+    8      ...   body
+
+The uncompressed body holds two columns of LEB128 varints, all timestamps
+first, then all values:
+    timestamps: first value, then zigzag delta-of-delta (a steady sample
+                period encodes as a run of zero bytes)
+    values:     zigzag first value, then zigzag deltas
+
+The body is then run through a greedy LZ4 block compressor; if that does not
+save space the raw columns are sent instead. tools/decode_block.py is the
+reference decoder.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef BLOCK_MAX_BODY
+#define BLOCK_MAX_BODY 1016        // Uncompressed column bytes per block
+#endif
+
+class BlockEncoder {
+public:
+    static const size_t HEADER_SIZE = 8;
+    static const uint8_t VERSION = 1;
+    static const uint8_t FLAG_LZ4 = 0x01;
+    static const size_t MAX_RECORDS = 0xFFFF;
+
+    void reset() {
+        count_ = 0;
+        tsLen_ = 0;
+        valueLen_ = 0;
+    }
+
+    // Append one reading. Returns false (and leaves the block unchanged) when it would not fit.
+    bool add(uint32_t timestamp, uint32_t value) {
+        if (count_ >= MAX_RECORDS) {
+            return false;
+        }
+        uint8_t ts[5];
+        uint8_t val[5];
+        size_t tsBytes;
+        size_t valBytes;
+        int32_t delta = 0;
+        if (count_ == 0) {
+            tsBytes = putVarint(ts, timestamp);
+            valBytes = putVarint(val, zigzag((int32_t)value));
+        } else {
+            delta = (int32_t)(timestamp - lastTimestamp_);
+            tsBytes = putVarint(ts, zigzag(delta - lastDelta_));
+            valBytes = putVarint(val, zigzag((int32_t)(value - lastValue_)));
+        }
+        if (tsLen_ + valueLen_ + tsBytes + valBytes > BLOCK_MAX_BODY) {
+            return false;
+        }
+        memcpy(tsColumn_ + tsLen_, ts, tsBytes);
+        memcpy(valueColumn_ + valueLen_, val, valBytes);
+        tsLen_ += tsBytes;
+        valueLen_ += valBytes;
+        lastDelta_ = delta;
+        lastTimestamp_ = timestamp;
+        lastValue_ = value;
+        count_++;
+        return true;
+    }
+
+    // Write header and body to out. Returns the block size, or 0 if out is too small.
+    size_t finish(uint8_t* out, size_t capacity) {
+        if (count_ == 0 || capacity < HEADER_SIZE) {
+            return 0;
+        }
+        size_t rawLen = tsLen_ + valueLen_;
+        memcpy(body_, tsColumn_, tsLen_);
+        memcpy(body_ + tsLen_, valueColumn_, valueLen_);
+
+        uint8_t flags = 0;
+        size_t bodyLen = lz4Compress(body_, rawLen, out + HEADER_SIZE, capacity - HEADER_SIZE);
+        if (bodyLen > 0 && bodyLen < rawLen) {
+            flags |= FLAG_LZ4;
+        } else if (rawLen <= capacity - HEADER_SIZE) {
+            memcpy(out + HEADER_SIZE, body_, rawLen);
+            bodyLen = rawLen;
+        } else {
+            return 0;
+        }
+
+        out[0] = 'C';
+        out[1] = 'B';
+        out[2] = VERSION;
+        out[3] = flags;
+        out[4] = count_ & 0xFF;
+        out[5] = count_ >> 8;
+        out[6] = rawLen & 0xFF;
+        out[7] = rawLen >> 8;
+        return HEADER_SIZE + bodyLen;
+    }
+
+    size_t count() const { return count_; }
+    size_t rawSize() const { return tsLen_ + valueLen_; }
+
+    // Greedy LZ4 block-format compressor. Returns 0 if the result does not fit in dst.
+    static size_t lz4Compress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) {
+        static const size_t MIN_MATCH = 4;
+        static const size_t LAST_LITERALS = 5;
+        static const size_t MATCH_LIMIT = 12; // No match may start in the last 12 bytes
+        static const uint16_t EMPTY = 0xFFFF;
+        uint16_t table[1 << LZ4_HASH_BITS];
+        for (size_t i = 0; i < (1u << LZ4_HASH_BITS); i++) {
+            table[i] = EMPTY;
+        }
+
+        size_t out = 0;
+        size_t anchor = 0;
+        size_t ip = 0;
+        while (len > MATCH_LIMIT && ip < len - MATCH_LIMIT) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t h = (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+            uint16_t ref = table[h];
+            table[h] = ip;
+            if (ref == EMPTY || ip - ref > 0xFFFF || read32(src + ref) != sequence) {
+                ip++;
+                continue;
+            }
+            size_t matchLen = MIN_MATCH;
+            while (ip + matchLen < len - LAST_LITERALS && src[ref + matchLen] == src[ip + matchLen]) {
+                matchLen++;
+            }
+            if (!emitSequence(dst, capacity, out, src + anchor, ip - anchor, ip - ref, matchLen - MIN_MATCH)) {
+                return 0;
+            }
+            ip += matchLen;
+            anchor = ip;
+        }
+        // Trailing literals, token with no match part
+        if (!emitSequence(dst, capacity, out, src + anchor, len - anchor, 0, SIZE_MAX)) {
+            return 0;
+        }
+        return out;
+    }
+
+private:
+    static const unsigned LZ4_HASH_BITS = 10;
+
+    static uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+
+    static size_t putVarint(uint8_t* out, uint32_t v) {
+        size_t n = 0;
+        while (v >= 0x80) {
+            out[n++] = (v & 0x7F) | 0x80;
+            v >>= 7;
+        }
+        out[n++] = v;
+        return n;
+    }
+
+    static uint32_t read32(const uint8_t* p) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static bool putLength(uint8_t* dst, size_t capacity, size_t& out, size_t extra) {
+        while (extra >= 255) {
+            if (out >= capacity) return false;
+            dst[out++] = 255;
+            extra -= 255;
+        }
+        if (out >= capacity) return false;
+        dst[out++] = extra;
+        return true;
+    }
+
+    // matchCode is matchLen - 4, or SIZE_MAX for the final literal-only sequence.
+    static bool emitSequence(uint8_t* dst, size_t capacity, size_t& out,
+                             const uint8_t* literals, size_t literalLen, size_t offset, size_t matchCode) {
+        bool last = matchCode == SIZE_MAX;
+        if (out >= capacity) return false;
+        uint8_t token = (literalLen >= 15 ? 15 : literalLen) << 4;
+        if (!last) {
+            token |= matchCode >= 15 ? 15 : matchCode;
+        }
+        dst[out++] = token;
+        if (literalLen >= 15 && !putLength(dst, capacity, out, literalLen - 15)) return false;
+        if (out + literalLen > capacity) return false;
+        memcpy(dst + out, literals, literalLen);
+        out += literalLen;
+        if (last) {
+            return true;
+        }
+        if (out + 2 > capacity) return false;
+        dst[out++] = offset & 0xFF;
+        dst[out++] = offset >> 8;
+        if (matchCode >= 15 && !putLength(dst, capacity, out, matchCode - 15)) return false;
+        return true;
+    }
+
+    uint8_t tsColumn_[BLOCK_MAX_BODY];
+    uint8_t valueColumn_[BLOCK_MAX_BODY];
+    uint8_t body_[BLOCK_MAX_BODY];
+    size_t count_ = 0;
+    size_t tsLen_ = 0;
+    size_t valueLen_ = 0;
+    uint32_t lastTimestamp_ = 0;
+    uint32_t lastValue_ = 0;
+    int32_t lastDelta_ = 0;
+};
+
+#endif // BLOCK_CODEC_H
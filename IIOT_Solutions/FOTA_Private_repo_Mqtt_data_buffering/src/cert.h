@@ -27,6 +27,13 @@ const char * rootCACertificate = \
 "MrY=\n"
 "-----END CERTIFICATE-----\n";
 
+// Public half of the firmware signing key (ECDSA P-256), see tools/sign_image.py. Replace with your own.
+const char * otaSigningKey = \
+"-----BEGIN PUBLIC KEY-----\n"
+"MFkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAEErcK69R0Eb0YBHB6ZGf12pRW/fV2\n"
+"sqKk4S+DM6mjb5cwbBr27/0Cx+Uq5ZSkI+T0nc919+UurPHmBwvitOa9fg==\n"
+"-----END PUBLIC KEY-----\n";
+
 
 
 #endif
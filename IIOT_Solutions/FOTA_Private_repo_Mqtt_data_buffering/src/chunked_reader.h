@@ -0,0 +1,162 @@
+#ifndef CHUNKED_READER_H
+#define CHUNKED_READER_H
+
+/*
+Decoder for HTTP/1.1 chunked transfer coding, so a response without
+Content-Length is parsed straight from the connection instead of being
+collected in a String first.
+
+Source is anything with size_t readBytes(char* buf, size_t len) where a
+short count means the connection ended or timed out, like Arduino's Stream.
+ChunkedReader has the read()/readBytes() pair ArduinoJson accepts as a
+custom reader:
+
+    ChunkedReader<WiFiClient> body(*otaHttps.getStreamPtr());
+    deserializeJson(doc, body, DeserializationOption::Filter(filter));
+    body.finish();   // Read up to the end of the body, so the connection can carry the next request
+
+read() returns -1 and readBytes() a short count at the end of the body, and
+also when the framing is malformed or the connection drops; failed() tells
+those apart. Chunk extensions and trailer fields are skipped.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename Source>
+class ChunkedReader {
+public:
+    explicit ChunkedReader(Source& source) : source_(source), remaining_(0), state_(SIZE) {}
+
+    int read() {
+        char c;
+        return readBytes(&c, 1) == 1 ? (uint8_t)c : -1;
+    }
+
+    size_t readBytes(char* buf, size_t len) {
+        size_t n = 0;
+        while (n < len && nextChunk()) {
+            size_t want = len - n < remaining_ ? len - n : remaining_;
+            size_t got = source_.readBytes(buf + n, want);
+            n += got;
+            remaining_ -= got;
+            if (got < want) {
+                state_ = FAILED;
+            }
+        }
+        return n;
+    }
+
+    // Skips whatever the caller did not read; true if the body ended with a well-formed last chunk
+    bool finish() {
+        char skipped[64];
+        while (readBytes(skipped, sizeof(skipped)) > 0) {
+        }
+        return state_ == DONE;
+    }
+
+    bool failed() const { return state_ == FAILED; }
+
+private:
+    enum State {
+        SIZE,                      // Next is a chunk-size line
+        DATA,                      // remaining_ bytes of the current chunk, then its CRLF
+        DONE,                      // Last chunk and trailer read
+        FAILED
+    };
+
+    // True with remaining_ > 0 when there is chunk data to read
+    bool nextChunk() {
+        if (state_ == DATA && remaining_ > 0) {
+            return true;
+        }
+        if (state_ == DATA) {
+            state_ = skipLine() == 0 ? SIZE : FAILED; // CRLF after the chunk data
+        }
+        if (state_ != SIZE) {
+            return false;
+        }
+        size_t size;
+        if (!readSize(size)) {
+            state_ = FAILED;
+            return false;
+        }
+        if (size == 0) {
+            long field;
+            while ((field = skipLine()) > 0) { // Trailer fields, up to the empty line
+            }
+            state_ = field == 0 ? DONE : FAILED;
+            return false;
+        }
+        remaining_ = size;
+        state_ = DATA;
+        return true;
+    }
+
+    // chunk-size [; extensions] CRLF. Hex digits only up to the first ';', whitespace or CR.
+    bool readSize(size_t& size) {
+        size = 0;
+        int digits = 0;
+        bool inSize = true;
+        char c;
+        for (;;) {
+            if (source_.readBytes(&c, 1) != 1) {
+                return false;
+            }
+            if (c == '\n') {
+                return digits > 0;
+            }
+            if (!inSize) {
+                continue;
+            }
+            int value = hexValue(c);
+            if (value >= 0) {
+                if (size >> (sizeof(size_t) * 8 - 4)) {
+                    return false;  // Would overflow
+                }
+                size = size << 4 | (size_t)value;
+                digits++;
+            } else if (c == ';' || c == ' ' || c == '\t' || c == '\r') {
+                inSize = false;
+            } else {
+                return false;
+            }
+        }
+    }
+
+    // Reads one line; its length without CRLF, or -1 if the connection ended first
+    long skipLine() {
+        long length = 0;
+        char c;
+        for (;;) {
+            if (source_.readBytes(&c, 1) != 1) {
+                return -1;
+            }
+            if (c == '\n') {
+                return length;
+            }
+            if (c != '\r') {
+                length++;
+            }
+        }
+    }
+
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    Source& source_;
+    size_t remaining_;
+    State state_;
+};
+
+#endif // CHUNKED_READER_H
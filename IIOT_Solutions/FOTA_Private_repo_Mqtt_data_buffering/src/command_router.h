@@ -0,0 +1,148 @@
+#ifndef COMMAND_ROUTER_H
+#define COMMAND_ROUTER_H
+
+/*
+Compile-time dispatch tables for MQTT topics and command keys.
+
+A table is a constexpr array of Routes (key string, handler). makeRouter()
+turns it into a Router at compile time: it searches for a seed under which
+the seeded FNV-1a hash of every key lands in a different slot of a table
+four times the number of routes (a perfect hash for that key set), and fills
+the slots with route indices. A lookup is one hash over the incoming key,
+one slot read and a single string compare to confirm the match, however many
+routes there are:
+
+    constexpr router::Route<TopicHandler> topicRoutes[] = {
+        {SUBSCRIBE_TOPIC, handleCommandMessage},
+        {OTA_MANIFEST_TOPIC, handleManifestMessage},
+    };
+    constexpr auto topicRouter = router::makeRouter(topicRoutes);
+    static_assert(topicRouter.ok(), "no perfect hash for topicRoutes");
+
+    const router::Route<TopicHandler>* route = topicRouter.find(topic);
+
+Handlers can be any function pointer type, so each table has its own
+signature. Everything is C++11 constexpr (recursion instead of loops) and the
+Router itself ends up in flash.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace router {
+
+template <typename Handler>
+struct Route {
+    const char* key;
+    Handler handler;
+};
+
+const uint32_t FNV_OFFSET = 2166136261UL;
+const uint32_t FNV_PRIME = 16777619UL;
+const uint32_t MAX_SEEDS = 200;    // Seeds tried before giving up (ok() is false)
+
+constexpr uint32_t seedBasis(uint32_t seed) {
+    return (uint32_t)(FNV_OFFSET ^ (seed * 0x9E3779B9UL));
+}
+
+constexpr uint32_t hashLiteral(const char* s, uint32_t h) {
+    return *s ? hashLiteral(s + 1, (uint32_t)((h ^ (uint8_t)*s) * FNV_PRIME)) : h;
+}
+
+// Same value as hashLiteral() for a key of len bytes, at run time
+inline uint32_t hash(const char* s, size_t len, uint32_t seed) {
+    uint32_t h = seedBasis(seed);
+    for (size_t i = 0; i < len; i++) {
+        h = (uint32_t)((h ^ (uint8_t)s[i]) * FNV_PRIME);
+    }
+    return h;
+}
+
+constexpr size_t slotOf(uint32_t h, size_t mask) {
+    return (h ^ (h >> 16)) & mask;
+}
+
+constexpr size_t tableSize(size_t routes, size_t size = 1) {
+    return size >= routes * 4 ? size : tableSize(routes, size * 2);
+}
+
+template <typename Handler>
+constexpr size_t keySlot(const Route<Handler>* routes, size_t i, uint32_t seed, size_t mask) {
+    return slotOf(hashLiteral(routes[i].key, seedBasis(seed)), mask);
+}
+
+// No route after i shares route i's slot
+template <typename Handler>
+constexpr bool slotUnique(const Route<Handler>* routes, size_t n, size_t i, size_t j, uint32_t seed, size_t mask) {
+    return j >= n || (keySlot(routes, i, seed, mask) != keySlot(routes, j, seed, mask)
+                      && slotUnique(routes, n, i, j + 1, seed, mask));
+}
+
+template <typename Handler>
+constexpr bool perfect(const Route<Handler>* routes, size_t n, size_t i, uint32_t seed, size_t mask) {
+    return i >= n || (slotUnique(routes, n, i, i + 1, seed, mask) && perfect(routes, n, i + 1, seed, mask));
+}
+
+template <typename Handler>
+constexpr uint32_t findSeed(const Route<Handler>* routes, size_t n, size_t mask, uint32_t seed = 0) {
+    return seed >= MAX_SEEDS || perfect(routes, n, 0, seed, mask) ? seed : findSeed(routes, n, mask, seed + 1);
+}
+
+// Index of the route in slot, -1 if it is empty
+template <typename Handler>
+constexpr int slotOwner(const Route<Handler>* routes, size_t n, uint32_t seed, size_t mask, size_t slot, size_t i = 0) {
+    return i >= n ? -1 : keySlot(routes, i, seed, mask) == slot ? (int)i : slotOwner(routes, n, seed, mask, slot, i + 1);
+}
+
+// 0..N-1 as a parameter pack, for filling the slot array
+template <size_t... I>
+struct Indices {};
+
+template <size_t N, size_t... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct MakeIndices<0, I...> {
+    typedef Indices<I...> type;
+};
+
+template <typename Handler, size_t N>
+class Router {
+    static_assert(N > 0 && N <= 64, "Router tables hold 1 to 64 routes");
+
+public:
+    static constexpr size_t SIZE = tableSize(N);
+
+    template <size_t... Slot>
+    constexpr Router(const Route<Handler>* routes, uint32_t seed, Indices<Slot...>)
+        : routes_(routes), seed_(seed), owners_{(int8_t)slotOwner(routes, N, seed, SIZE - 1, Slot)...} {}
+
+    constexpr bool ok() const { return seed_ < MAX_SEEDS; }
+
+    const Route<Handler>* find(const char* key, size_t len) const {
+        int owner = owners_[slotOf(hash(key, len, seed_), SIZE - 1)];
+        if (owner < 0) {
+            return nullptr;
+        }
+        const char* candidate = routes_[owner].key;
+        return strncmp(candidate, key, len) == 0 && candidate[len] == '\0' ? &routes_[owner] : nullptr;
+    }
+
+    const Route<Handler>* find(const char* key) const { return find(key, strlen(key)); }
+
+private:
+    const Route<Handler>* routes_;
+    uint32_t seed_;
+    int8_t owners_[SIZE];
+};
+
+template <typename Handler, size_t N>
+constexpr Router<Handler, N> makeRouter(const Route<Handler> (&routes)[N]) {
+    return Router<Handler, N>(routes, findSeed(routes, N, Router<Handler, N>::SIZE - 1),
+                              typename MakeIndices<Router<Handler, N>::SIZE>::type());
+}
+
+} // namespace router
+
+#endif // COMMAND_ROUTER_H
@@ -11,6 +11,7 @@ const char* password ="12345678910" ;
 
 #define ROLLBACK_PIN 4  // GPIO4 pin
 #define RESET_BUTTON 0     // GPIO0 button
+#define OUTPUT_PIN 2       // GPIO2 (on-board LED), driven by "state" and ACTUATION_TOPIC commands
 #define SOFT_RESET_TIME 3000 // 3 seconds for soft reset
 #define DOUBLE_PRESS_WINDOW 500 // 500ms for double press
 #define DEBOUNCE_TIME 50  // Adjust based on the switch's bounce characteristics
@@ -21,10 +22,85 @@ const char* password ="12345678910" ;
 #define LAST_WILL_TOPIC "device/status"   // Topic for Last Will message
 #define BIRTH_TOPIC "device/status"       // Topic for Birth message*/
 #define SUBSCRIBE_TOPIC "test/counter/datasub" // Topic to subscribe to
+#define OTA_MANIFEST_TOPIC "device/ota/" DEVICE_ACCESS_TOKEN // Retained firmware manifest published by the fleet server
+#define METRICS_TOPIC "device/metrics/" DEVICE_ACCESS_TOKEN // Latency percentiles, see publishLatencyMetrics()
+#define ACTUATION_TOPIC "device/actuate/" DEVICE_ACCESS_TOKEN // Binary {output, level} commands, see handleActuation()
+#define SAMPLES_TOPIC "device/samples/" DEVICE_ACCESS_TOKEN // Per-window sample statistics, see publishSampleWindows()
 #define DEVICE_ACCESS_TOKEN "ESP32" // Replace with your device's access token
 
+// Sparkplug B mode: NBIRTH/NDEATH replace the JSON birth/will and data goes out as NDATA with metric aliases
+#define SPARKPLUG_B_ENABLED false
+#define SPARKPLUG_GROUP_ID "IIoT"
+#define SPARKPLUG_EDGE_NODE_ID DEVICE_ACCESS_TOKEN
+#define SPARKPLUG_TOPIC(type) "spBv1.0/" SPARKPLUG_GROUP_ID "/" type "/" SPARKPLUG_EDGE_NODE_ID
+#define SPARKPLUG_MAX_PAYLOAD 256 // Largest NBIRTH the encoder will build
+
+#ifndef DEBUG_PRINTS
 #define DEBUG_PRINTS true
-#define MAX_BUFFER_SIZE 10
+#endif
+#ifndef BENCHMARK
+#define BENCHMARK false            // Build flag of the *-bench envs: run the hot-path benchmarks (bench.h) at boot
+#endif
+#define MAX_BUFFER_SIZE 10         // Readings held in RAM before they are spilled to the flash data log
+#define BUFFERED_PAYLOAD_SIZE 1024 // Max bytes per buffered-data publish when draining the data log
+#define BLOCK_MAX_BODY (BUFFERED_PAYLOAD_SIZE - 8) // Column bytes per replay block, leaves room for its header
+#define REPLAY_WINDOW_MAX 8         // Max buffered-data publishes awaiting an ack
+#define REPLAY_ACK_TIMEOUT 10000    // ms without an ack before in-flight replay is resent
+#define MQTT_MESSAGE_MAX 8192       // Largest incoming payload accepted; bigger messages are dropped
+#define MQTT_MESSAGE_POOL 2         // Reassembly buffers of MQTT_MESSAGE_MAX bytes (static RAM)
+#define MQTT_QUEUE_LENGTH 16        // MQTT events (messages, acks, connects) waiting for mqttTask()
+#define MQTT_QUEUE_RESERVE 4        // Queue slots messages may not take, kept for acks and connection events
+#define MQTT_EVENT_INLINE 256       // Payload bytes carried in the queue item (commands, manifests); larger use a pool buffer
+#define STATS_INTERVAL 60000        // ms between CPU idle reports
+#define METRICS_INTERVAL 60000      // ms between latency snapshots on METRICS_TOPIC
+#define METRICS_PAYLOAD_SIZE 1536   // Bytes; one snapshot of every latency histogram, plus queue, report and task stats
+#define COUNTER_INTERVAL 5000       // ms between counter samples; each is published only if the report policy says so
+#define SAMPLE_RATE_HZ 200          // Samples per second taken from every source in sampleSources
+#define SAMPLE_WINDOW COUNTER_INTERVAL // ms per aggregation window; each window's statistics are published once
+#define REPORT_DEADBAND 0           // Default report policy of every metric, change at runtime with {"report": ...}:
+#define REPORT_DEADBAND_PCT 0       //   absolute and percent change needed to report (0 = any change),
+#define REPORT_MIN_INTERVAL 0       //   ms between reported changes,
+#define REPORT_HEARTBEAT 300000     //   ms without a report before the value is sent anyway (0 = never)
+#define MQTT_KEEPALIVE 15           // s; AsyncMqttClient's default, used outside low-power mode
+#define POWER_LOW_DEFAULT false     // Low-power mode at first boot, change at runtime with {"power": {"mode": "low"}}:
+#define POWER_FLUSH_INTERVAL 300000 //   ms a buffered reading waits at most for the radio,
+#define POWER_FLUSH_READINGS 60     //   or wake it as soon as this many readings wait
+#define POWER_KEEPALIVE 120         // Low power: MQTT keep-alive (s); the broker sends the will after 1.5x this in silence
+#define POWER_SAMPLE_RATE_HZ 10     // Low power: sample rate; SAMPLE_RATE_HZ timer wake-ups would keep the CPU out of light sleep
+#define POWER_MIN_CPU_MHZ 80        // Low power: CPU clock while no task needs more (frequency scaling)
+#define POWER_SUPPLY_MV 3300        // Energy estimate: supply voltage, and average module current
+#define POWER_ACTIVE_MA 110         //   with WiFi power save off (low-power flushes),
+#define POWER_MODEM_SLEEP_MA 30     //   in modem sleep (normal mode, and low power without light sleep),
+#define POWER_LIGHT_SLEEP_MA 3      //   in modem sleep with automatic light sleep (low power between flushes)
+
+// Task table (taskTable in main.cpp): core, FreeRTOS priority and stack bytes of every task. Core 0 carries
+// the WiFi driver, TCP and TLS; core 1 is kept for sampling, so a saturated network never delays a sample.
+#define NETWORK_TASK_CORE 0         // AsyncTCP's task; set by CONFIG_ASYNC_TCP_RUNNING_CORE in platformio.ini
+#define NETWORK_TASK_PRIORITY 3     // Applied once the task exists (it is created on the first connect)
+#define NETWORK_TASK_STACK 16384    // Bytes; AsyncTCP's default, set by CONFIG_ASYNC_TCP_STACK_SIZE
+#define MQTT_TASK_CORE 0
+#define MQTT_TASK_PRIORITY 2        // Below the AsyncTCP task, above otaTask() and loggerTask()
+#define MQTT_TASK_STACK 8192        // Bytes; command JSON, manifests and backlog replay run on the MQTT task
+#define LOG_TASK_CORE 0
+#define LOG_TASK_PRIORITY 1         // Counter readings: publishing, or buffering to flash while offline
+#define LOG_TASK_STACK 8192         // Bytes; data log writes and replay batches (low-power flushes) run on this task
+#define OTA_TASK_CORE 0
+#define OTA_TASK_PRIORITY 1         // Slow GitHub responses and firmware downloads only use otherwise idle CPU
+#define OTA_TASK_STACK 8192         // Bytes; TLS handshakes and JSON parsing run on the OTA task
+#define SAMPLE_TASK_CORE 1          // Must differ from NETWORK_TASK_CORE (checked at compile time)
+#define SAMPLE_TASK_PRIORITY 5      // Above everything else on its core
+#define SAMPLE_TASK_STACK 4096      // Bytes; the sampling task only reads sources and updates running sums
+#define LOOP_TASK_CORE 1            // loop(); fixed by the Arduino core (ARDUINO_RUNNING_CORE), checked at boot
+#define LOOP_TASK_PRIORITY 1        // Blocked unless an event is pending; yields to the sampling task
+#define LOOP_TASK_STACK 8192        // Bytes; the Arduino default, set with SET_LOOP_TASK_STACK_SIZE()
+#define BENCH_TASK_CORE 0           // The online benchmarks run on their own task once MQTT is up
+#define BENCH_TASK_PRIORITY 1
+#define BENCH_TASK_STACK 8192       // Bytes
+
+#define BENCH_CONNECT_TIMEOUT 60000 // ms to wait for MQTT before the online benchmarks are skipped
+#define BENCH_PUBLISH_ITERATIONS 200 // Cap on QoS 2 publishes issued by the online benchmark
+#define BENCH_OFFLINE_TICKS 100000  // Offline counter ticks of the RAM tier heap report
+#define BENCH_OUTAGE_TICKS 720      // Ticks per simulated outage (1 h at COUNTER_INTERVAL), then a reconnect drains
 
 // Firmware Version
 String FirmwareVer = "1.0.1";
@@ -34,5 +110,15 @@ String FirmwareVer = "1.0.1";
 
 // URLs
 #define URL_fw_Version "https://raw.githubusercontent.com/MadeeshaLakshan/ESP32_OTA_Github/main/version.json"
+#define OTA_CHECK_INTERVAL 5000      // Version check interval (ms) while MQTT is down; change at runtime with {"ota_interval": ms} on SUBSCRIBE_TOPIC
+#define OTA_FALLBACK_INTERVAL 3600000 // Version check interval (ms) while MQTT is up and manifests are pushed on OTA_MANIFEST_TOPIC
+#define OTA_MIN_CHECK_INTERVAL 1000  // Lower bound for runtime changes
+#define OTA_BOARD "esp32"            // This board's key in multi-board manifests
+#define OTA_CHANNEL "stable"         // Default release channel; change at runtime with {"ota_channel": "beta"}
+#define OTA_RANGE_CHUNK 65536        // Bytes per Range request; progress is checkpointed to NVS after each
+#define OTA_RANGE_RETRIES 5          // Consecutive failed chunks before the download is left for the next check
+#ifndef OTA_REQUIRE_SIGNATURE
+#define OTA_REQUIRE_SIGNATURE true   // Refuse images whose manifest has no valid "signature" (key in cert.h)
+#endif
 
 #endif // CONFIG_H
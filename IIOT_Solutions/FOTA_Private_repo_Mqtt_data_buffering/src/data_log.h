@@ -0,0 +1,408 @@
+#ifndef DATA_LOG_H
+#define DATA_LOG_H
+
+/*
+Persistent store-and-forward log for readings that could not be published.
+
+The log lives on the LittleFS file system, which is mounted on the `spiffs`
+partition from partitions.csv. Records are appended to numbered segment files
+under LOG_DIR, each framed as
+
+    [length : u16][crc32 : u32][payload : length bytes]
+
+Appends are collected in a page-sized RAM batch and written to flash in one
+go, so a reading costs one flash write per page instead of one per record.
+Call flush() before a planned restart; an unplanned reset loses at most the
+unflushed batch.
+
+After a reset begin() scans the newest segment and cuts it back to the last
+record whose CRC matches, so a write interrupted by power loss never corrupts
+the records before it. The cut copies the intact prefix to LOG_RECOVER_FILE
+and renames it over the segment, which LittleFS does atomically: a reset
+during recovery leaves the segment as it was, and the next begin() deletes
+the stale copy and starts over.
+
+Two cursors are kept:
+  read   - next record handed out by read()
+  commit - oldest record not yet confirmed delivered
+Records between commit and read are in flight. rewind() moves read back to
+commit (e.g. after the broker connection dropped); commit() releases records
+and deletes segments that are fully delivered. The commit cursor is stored in
+LOG_CURSOR_FILE so a reboot resumes draining from the last confirmed record.
+
+The class is not thread safe; callers serialise access themselves.
+*/
+
+#include <Arduino.h>
+#include "LittleFS.h"
+
+#ifndef LOG_DIR
+#define LOG_DIR "/log"
+#endif
+#ifndef LOG_CURSOR_FILE
+#define LOG_CURSOR_FILE LOG_DIR "/cursor"
+#endif
+#ifndef LOG_RECOVER_FILE
+#define LOG_RECOVER_FILE LOG_DIR "/recover.tmp"
+#endif
+#ifndef LOG_PAGE_SIZE
+#define LOG_PAGE_SIZE 256          // Flash page; appends are batched to this size
+#endif
+#ifndef LOG_SEGMENT_SIZE
+#define LOG_SEGMENT_SIZE 4096      // One flash sector per segment file
+#endif
+#ifndef LOG_MAX_SEGMENTS
+#define LOG_MAX_SEGMENTS 128       // 512 KB of backlog before the oldest data is dropped
+#endif
+#ifndef LOG_COMMIT_PERSIST_EVERY
+#define LOG_COMMIT_PERSIST_EVERY 16 // Commits between cursor file writes (flash wear)
+#endif
+
+struct LogCursor {
+    uint32_t segment;
+    uint32_t offset;
+
+    bool operator==(const LogCursor& other) const { return segment == other.segment && offset == other.offset; }
+    bool operator!=(const LogCursor& other) const { return !(*this == other); }
+};
+
+class DataLog {
+public:
+    static const size_t HEADER_SIZE = 6;
+    static const size_t MAX_RECORD_SIZE = LOG_PAGE_SIZE - HEADER_SIZE;
+
+    // Mount-time recovery. LittleFS must already be mounted.
+    bool begin() {
+        if (!LittleFS.exists(LOG_DIR) && !LittleFS.mkdir(LOG_DIR)) {
+            return false;
+        }
+
+        if (LittleFS.exists(LOG_RECOVER_FILE)) {
+            LittleFS.remove(LOG_RECOVER_FILE); // Left by a reset during recovery; its segment is still intact
+        }
+
+        firstSegment_ = UINT32_MAX;
+        lastSegment_ = 0;
+        File dir = LittleFS.open(LOG_DIR);
+        if (!dir || !dir.isDirectory()) {
+            return false;
+        }
+        File entry = dir.openNextFile();
+        while (entry) {
+            uint32_t id;
+            if (parseSegmentName(entry.name(), id)) {
+                if (id < firstSegment_) firstSegment_ = id;
+                if (id > lastSegment_) lastSegment_ = id;
+            }
+            entry.close();
+            entry = dir.openNextFile();
+        }
+        dir.close();
+
+        bool torn = false;
+        if (firstSegment_ == UINT32_MAX) {
+            firstSegment_ = lastSegment_ = 1;
+            lastSize_ = 0;
+        } else {
+            lastSize_ = validLength(lastSegment_);
+            torn = !truncateSegment(lastSegment_, lastSize_);
+        }
+
+        if (!loadCursor(commit_) || commit_.segment < firstSegment_ || commit_.segment > lastSegment_ ||
+            (commit_.segment == lastSegment_ && commit_.offset > lastSize_)) {
+            commit_ = {firstSegment_, 0};
+        }
+        read_ = commit_;
+        pendingLen_ = 0;
+        commitsSincePersist_ = 0;
+        if (torn) {
+            startSegment(); // The tail could not be cut off: reads stop at it, appends go to a fresh segment
+        }
+        return true;
+    }
+
+    // Queue one record. Returns false if the record is too large or flash is full.
+    bool append(const void* data, size_t len) {
+        if (len == 0 || len > MAX_RECORD_SIZE) {
+            return false;
+        }
+        if (pendingLen_ + HEADER_SIZE + len > LOG_PAGE_SIZE && !flush()) {
+            return false;
+        }
+        uint32_t crc = crc32(static_cast<const uint8_t*>(data), len);
+        uint8_t* p = pending_ + pendingLen_;
+        p[0] = len & 0xFF;
+        p[1] = len >> 8;
+        for (int i = 0; i < 4; i++) {
+            p[2 + i] = (crc >> (8 * i)) & 0xFF;
+        }
+        memcpy(p + HEADER_SIZE, data, len);
+        pendingLen_ += HEADER_SIZE + len;
+        appended_++;
+        return true;
+    }
+
+    // Write the batched page to flash.
+    bool flush() {
+        if (pendingLen_ == 0) {
+            return true;
+        }
+        if (lastSize_ > 0 && lastSize_ + pendingLen_ > LOG_SEGMENT_SIZE) {
+            startSegment();
+        }
+        File file = LittleFS.open(segmentPath(lastSegment_), "a");
+        if (!file) {
+            return false;
+        }
+        size_t written = file.write(pending_, pendingLen_);
+        file.close();
+        if (written != pendingLen_) {
+            // A short write leaves a torn tail; cut it off so later appends stay readable.
+            if (!truncateSegment(lastSegment_, lastSize_)) {
+                startSegment();
+            }
+            return false;
+        }
+        lastSize_ += pendingLen_;
+        pendingLen_ = 0;
+        return true;
+    }
+
+    // Copy the record at the read cursor into buf and advance the cursor.
+    // Returns false when nothing is left (unflushed records are not visible).
+    bool read(void* buf, size_t capacity, size_t& len) {
+        while (read_ != end()) {
+            if (!openRead()) {
+                // Segment exhausted or missing: continue with the next one.
+                nextReadSegment();
+                continue;
+            }
+            uint8_t header[HEADER_SIZE];
+            if (readFile_.read(header, HEADER_SIZE) != HEADER_SIZE) {
+                nextReadSegment();
+                continue;
+            }
+            size_t recordLen = header[0] | (header[1] << 8);
+            uint32_t crc = header[2] | (header[3] << 8) | ((uint32_t)header[4] << 16) | ((uint32_t)header[5] << 24);
+            if (recordLen == 0 || recordLen > MAX_RECORD_SIZE || recordLen > capacity ||
+                readFile_.read(static_cast<uint8_t*>(buf), recordLen) != recordLen ||
+                crc32(static_cast<const uint8_t*>(buf), recordLen) != crc) {
+                // Damaged record inside a sealed segment: skip the rest of it.
+                nextReadSegment();
+                continue;
+            }
+            len = recordLen;
+            read_.offset += HEADER_SIZE + recordLen;
+            return true;
+        }
+        return false;
+    }
+
+    // Release every record before `upTo` (a cursor previously returned by readCursor()).
+    void commit(const LogCursor& upTo) {
+        commit_ = upTo;
+        bool droppedSegment = false;
+        while (firstSegment_ < commit_.segment) {
+            LittleFS.remove(segmentPath(firstSegment_));
+            firstSegment_++;
+            droppedSegment = true;
+        }
+        if (droppedSegment || ++commitsSincePersist_ >= LOG_COMMIT_PERSIST_EVERY) {
+            persistCursor();
+        }
+    }
+
+    // Forget in-flight reads; the next read() returns the oldest undelivered record.
+    void rewind() {
+        read_ = commit_;
+        closeRead();
+    }
+
+    // Move the read cursor to a position between commit and the end of the log.
+    void seekRead(const LogCursor& cursor) {
+        read_ = cursor;
+    }
+
+    // Write the commit cursor now instead of waiting for LOG_COMMIT_PERSIST_EVERY.
+    void persistCursor() {
+        File file = LittleFS.open(LOG_DIR "/cursor.tmp", "w");
+        if (!file) {
+            return;
+        }
+        uint32_t words[3] = {commit_.segment, commit_.offset, 0};
+        words[2] = crc32(reinterpret_cast<const uint8_t*>(words), 8);
+        file.write(reinterpret_cast<const uint8_t*>(words), sizeof(words));
+        file.close();
+        LittleFS.rename(LOG_DIR "/cursor.tmp", LOG_CURSOR_FILE);
+        commitsSincePersist_ = 0;
+    }
+
+    LogCursor readCursor() const { return read_; }
+    LogCursor commitCursor() const { return commit_; }
+    bool hasUnread() const { return read_ != end() || pendingLen_ > 0; }
+    bool hasUndelivered() const { return commit_ != end() || pendingLen_ > 0; }
+    uint32_t appendedCount() const { return appended_; }
+    uint32_t droppedSegments() const { return droppedSegments_; }
+    size_t segmentCount() const { return lastSegment_ - firstSegment_ + 1; }
+
+    static uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0) {
+        static const uint32_t table[16] = {
+            0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+            0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+        crc = ~crc;
+        for (size_t i = 0; i < len; i++) {
+            crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+            crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+        }
+        return ~crc;
+    }
+
+private:
+    LogCursor end() const { return {lastSegment_, (uint32_t)lastSize_}; }
+
+    static String segmentPath(uint32_t id) {
+        char path[32];
+        snprintf(path, sizeof(path), LOG_DIR "/%08lx.seg", (unsigned long)id);
+        return String(path);
+    }
+
+    static bool parseSegmentName(const char* name, uint32_t& id) {
+        const char* base = strrchr(name, '/');
+        base = base ? base + 1 : name;
+        if (strlen(base) != 12 || strcmp(base + 8, ".seg") != 0) {
+            return false;
+        }
+        char* endPtr;
+        id = strtoul(base, &endPtr, 16);
+        return endPtr == base + 8;
+    }
+
+    // Walk a segment record by record; returns the length of its intact prefix.
+    size_t validLength(uint32_t id) {
+        File file = LittleFS.open(segmentPath(id), "r");
+        if (!file) {
+            return 0;
+        }
+        size_t fileSize = file.size();
+        size_t good = 0;
+        uint8_t record[LOG_PAGE_SIZE];
+        while (good + HEADER_SIZE <= fileSize) {
+            if (file.read(record, HEADER_SIZE) != HEADER_SIZE) break;
+            size_t recordLen = record[0] | (record[1] << 8);
+            uint32_t crc = record[2] | (record[3] << 8) | ((uint32_t)record[4] << 16) | ((uint32_t)record[5] << 24);
+            if (recordLen == 0 || recordLen > MAX_RECORD_SIZE || good + HEADER_SIZE + recordLen > fileSize) break;
+            if (file.read(record, recordLen) != recordLen || crc32(record, recordLen) != crc) break;
+            good += HEADER_SIZE + recordLen;
+        }
+        file.close();
+        return good;
+    }
+
+    // Cut a segment back to its first `length` bytes. LittleFS has no truncate here: the prefix is copied to
+    // LOG_RECOVER_FILE, checked, and renamed over the segment (atomic, so the segment is never missing).
+    // Returns false, leaving the segment untouched, if it could not be cut.
+    bool truncateSegment(uint32_t id, size_t length) {
+        String path = segmentPath(id);
+        File src = LittleFS.open(path, "r");
+        if (src && src.size() <= length) {
+            src.close();
+            return true;
+        }
+        File dst = LittleFS.open(LOG_RECOVER_FILE, "w");
+        uint8_t chunk[LOG_PAGE_SIZE];
+        size_t copied = 0;
+        while (src && dst && copied < length) {
+            size_t n = src.read(chunk, length - copied < sizeof(chunk) ? length - copied : sizeof(chunk));
+            if (n == 0 || dst.write(chunk, n) != n) break;
+            copied += n;
+        }
+        bool ok = src && dst && copied == length;
+        src.close();
+        dst.close();
+        if (!ok || !LittleFS.rename(LOG_RECOVER_FILE, path)) {
+            LittleFS.remove(LOG_RECOVER_FILE);
+            return false;
+        }
+        return true;
+    }
+
+    bool loadCursor(LogCursor& cursor) {
+        File file = LittleFS.open(LOG_CURSOR_FILE, "r");
+        if (!file) {
+            return false;
+        }
+        uint32_t words[3];
+        bool ok = file.read(reinterpret_cast<uint8_t*>(words), sizeof(words)) == sizeof(words) &&
+                  crc32(reinterpret_cast<const uint8_t*>(words), 8) == words[2];
+        file.close();
+        if (ok) {
+            cursor = {words[0], words[1]};
+        }
+        return ok;
+    }
+
+    void startSegment() {
+        lastSegment_++;
+        lastSize_ = 0;
+        while (segmentCount() > LOG_MAX_SEGMENTS) {
+            // Flash budget exhausted: drop the oldest backlog rather than the newest readings.
+            closeRead();
+            LittleFS.remove(segmentPath(firstSegment_));
+            firstSegment_++;
+            droppedSegments_++;
+            if (commit_.segment < firstSegment_) {
+                commit_ = {firstSegment_, 0};
+                persistCursor();
+            }
+            if (read_.segment < firstSegment_) {
+                read_ = commit_;
+            }
+        }
+    }
+
+    bool openRead() {
+        if (readFile_ && readSegment_ == read_.segment && readFileSize_ > read_.offset && readFile_.position() == read_.offset) {
+            return true;
+        }
+        closeRead();
+        readFile_ = LittleFS.open(segmentPath(read_.segment), "r");
+        if (!readFile_) {
+            return false;
+        }
+        readSegment_ = read_.segment;
+        readFileSize_ = readFile_.size();
+        return readFileSize_ > read_.offset && readFile_.seek(read_.offset);
+    }
+
+    void closeRead() {
+        if (readFile_) {
+            readFile_.close();
+        }
+        readFileSize_ = 0;
+    }
+
+    void nextReadSegment() {
+        closeRead();
+        if (read_.segment < lastSegment_) {
+            read_ = {read_.segment + 1, 0};
+        } else {
+            read_ = end();
+        }
+    }
+
+    uint8_t pending_[LOG_PAGE_SIZE];
+    size_t pendingLen_ = 0;
+    uint32_t firstSegment_ = 1;
+    uint32_t lastSegment_ = 1;
+    size_t lastSize_ = 0;
+    LogCursor read_ = {1, 0};
+    LogCursor commit_ = {1, 0};
+    File readFile_;
+    uint32_t readSegment_ = 0;
+    size_t readFileSize_ = 0;
+    uint32_t commitsSincePersist_ = 0;
+    uint32_t appended_ = 0;
+    uint32_t droppedSegments_ = 0;
+};
+
+#endif // DATA_LOG_H
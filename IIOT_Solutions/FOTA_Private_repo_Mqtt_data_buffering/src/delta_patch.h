@@ -0,0 +1,173 @@
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+/*
+Streaming applier for delta firmware patches.
+
+A patch rebuilds the new image from the image in the running OTA partition
+plus literal bytes, front to back, so it can be applied straight from the
+HTTPS stream into the next OTA partition:
+
+    offset size  field
+    0      2     magic "DP"
+    2      1     version (1)
+    3      1     flags (0)
+    4      4     source image size (u32, little endian)
+    8      4     target image size (u32, little endian)
+    12     32    SHA-256 of the source image
+    44     32    SHA-256 of the target image
+    76     ...   commands
+
+    0x01 COPY    u32 source offset, varint length  -- bytes from the old image
+    0x02 INSERT  varint length, bytes              -- literal bytes
+    0x00 END
+
+RAM use is one CHUNK_SIZE buffer regardless of image size. Hashing is left
+to the caller's Source/Sink so the applier itself has no platform
+dependencies; tools/delta_patch.py builds patches and tools/delta_apply.cpp
+runs this applier against partition image files on a PC.
+
+    Input:  size_t read(uint8_t* buf, size_t len)   -- short count means end of stream
+    Source: bool read(uint32_t offset, uint8_t* buf, size_t len)
+    Sink:   bool write(const uint8_t* buf, size_t len)
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+struct DeltaHeader {
+    uint32_t sourceSize;
+    uint32_t targetSize;
+    uint8_t sourceHash[32];
+    uint8_t targetHash[32];
+};
+
+class DeltaApplier {
+public:
+    static const size_t HEADER_SIZE = 76;
+    static const uint8_t VERSION = 1;
+    static const size_t CHUNK_SIZE = 512;
+
+    enum Result {
+        OK,
+        TRUNCATED,       // Stream ended before END
+        BAD_HEADER,
+        BAD_COMMAND,
+        SOURCE_RANGE,    // COPY outside the source image
+        TARGET_OVERFLOW, // Output would exceed targetSize, or END came early
+        READ_FAILED,     // Source read error
+        WRITE_FAILED,    // Sink write error
+    };
+
+    template <typename Input>
+    static bool readHeader(Input& in, DeltaHeader& header) {
+        uint8_t raw[HEADER_SIZE];
+        if (in.read(raw, sizeof(raw)) != sizeof(raw)) {
+            return false;
+        }
+        if (raw[0] != 'D' || raw[1] != 'P' || raw[2] != VERSION) {
+            return false;
+        }
+        header.sourceSize = get32(raw + 4);
+        header.targetSize = get32(raw + 8);
+        memcpy(header.sourceHash, raw + 12, 32);
+        memcpy(header.targetHash, raw + 44, 32);
+        return true;
+    }
+
+    // Run the commands after the header. Returns OK once END is reached with exactly targetSize bytes written.
+    template <typename Input, typename Source, typename Sink>
+    static Result apply(Input& in, const DeltaHeader& header, Source& source, Sink& sink) {
+        uint8_t chunk[CHUNK_SIZE];
+        uint32_t written = 0;
+        for (;;) {
+            uint8_t op;
+            if (in.read(&op, 1) != 1) {
+                return TRUNCATED;
+            }
+            if (op == OP_END) {
+                return written == header.targetSize ? OK : TARGET_OVERFLOW;
+            }
+
+            uint32_t offset = 0;
+            uint32_t length;
+            if (op == OP_COPY) {
+                uint8_t raw[4];
+                if (in.read(raw, 4) != 4) {
+                    return TRUNCATED;
+                }
+                offset = get32(raw);
+            } else if (op != OP_INSERT) {
+                return BAD_COMMAND;
+            }
+            if (!readVarint(in, length)) {
+                return TRUNCATED;
+            }
+            if (length > header.targetSize - written) {
+                return TARGET_OVERFLOW;
+            }
+            if (op == OP_COPY && (offset > header.sourceSize || length > header.sourceSize - offset)) {
+                return SOURCE_RANGE;
+            }
+
+            while (length > 0) {
+                size_t n = length < CHUNK_SIZE ? length : CHUNK_SIZE;
+                if (op == OP_COPY) {
+                    if (!source.read(offset, chunk, n)) {
+                        return READ_FAILED;
+                    }
+                    offset += n;
+                } else if (in.read(chunk, n) != n) {
+                    return TRUNCATED;
+                }
+                if (!sink.write(chunk, n)) {
+                    return WRITE_FAILED;
+                }
+                written += n;
+                length -= n;
+            }
+        }
+    }
+
+    static const char* resultName(Result result) {
+        switch (result) {
+            case OK: return "ok";
+            case TRUNCATED: return "truncated";
+            case BAD_HEADER: return "bad header";
+            case BAD_COMMAND: return "bad command";
+            case SOURCE_RANGE: return "copy outside source image";
+            case TARGET_OVERFLOW: return "target size mismatch";
+            case READ_FAILED: return "source read failed";
+            case WRITE_FAILED: return "write failed";
+        }
+        return "unknown";
+    }
+
+private:
+    static const uint8_t OP_END = 0x00;
+    static const uint8_t OP_COPY = 0x01;
+    static const uint8_t OP_INSERT = 0x02;
+
+    static uint32_t get32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    template <typename Input>
+    static bool readVarint(Input& in, uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            uint8_t b;
+            if (in.read(&b, 1) != 1) {
+                return false;
+            }
+            value |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif // DELTA_PATCH_H
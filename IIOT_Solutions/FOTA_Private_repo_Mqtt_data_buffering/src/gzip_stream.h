@@ -0,0 +1,433 @@
+#ifndef GZIP_STREAM_H
+#define GZIP_STREAM_H
+
+/*
+Streaming gzip decompressor for compressed firmware images.
+
+Pulls compressed bytes from an Input and pushes the inflated image to a
+Sink, so an image goes from the HTTPS stream into the OTA partition without
+being staged anywhere. The caller provides the 32 KB DEFLATE window, which
+doubles as the output buffer: the Sink receives it in pieces of up to
+WINDOW_SIZE bytes whenever it wraps and once more at the end. Apart from
+that the decoder needs about 1.5 KB (Huffman tables, input buffer).
+
+Huffman codes are decoded canonically one bit at a time, like zlib's
+reference "puff" decoder: slow compared to table-driven inflate, but still
+far faster than the network it reads from. The gzip trailer (CRC-32 and
+size) is checked before inflate() reports OK.
+
+    Input: size_t read(uint8_t* buf, size_t len)   -- short count means end of stream
+    Sink:  bool write(const uint8_t* buf, size_t len)
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class GzipInflater {
+public:
+    static const size_t WINDOW_SIZE = 32768;
+
+    enum Result {
+        OK,
+        TRUNCATED,     // Input ended early
+        BAD_HEADER,    // Not gzip/deflate
+        BAD_DATA,      // Invalid deflate stream
+        BAD_CHECKSUM,  // CRC-32 or size in the trailer does not match
+        WRITE_FAILED,
+    };
+
+    explicit GzipInflater(uint8_t* window) : window_(window) {}
+
+    template <typename Input, typename Sink>
+    Result inflate(Input& in, Sink& sink) {
+        pos_ = 0;
+        flushed_ = 0;
+        total_ = 0;
+        crc_ = 0xFFFFFFFF;
+        inputBytes_ = 0;
+        bitBuf_ = 0;
+        bitCount_ = 0;
+        inPos_ = 0;
+        inLen_ = 0;
+        error_ = OK;
+
+        if (!readHeader(in)) {
+            return error_ != OK ? error_ : BAD_HEADER;
+        }
+        bool last;
+        do {
+            last = bits(in, 1);
+            int type = bits(in, 2);
+            if (type == 0) {
+                stored(in, sink);
+            } else if (type == 1) {
+                fixed();
+                codes(in, sink);
+            } else if (type == 2) {
+                dynamic(in);
+                if (error_ == OK) {
+                    codes(in, sink);
+                }
+            } else {
+                fail(BAD_DATA);
+            }
+        } while (!last && error_ == OK);
+        if (error_ != OK) {
+            return error_;
+        }
+        if (!flush(sink)) {
+            return WRITE_FAILED;
+        }
+
+        // Trailer: CRC-32 and size of the output, both little endian
+        bitCount_ = 0;
+        uint32_t trailer[2] = {0, 0};
+        for (int i = 0; i < 8; i++) {
+            trailer[i / 4] |= (uint32_t)byte(in) << (8 * (i % 4));
+        }
+        if (error_ != OK) {
+            return error_;
+        }
+        if (trailer[0] != (crc_ ^ 0xFFFFFFFF) || trailer[1] != total_) {
+            return BAD_CHECKSUM;
+        }
+        return OK;
+    }
+
+    uint32_t inputBytes() const { return inputBytes_; }
+    uint32_t outputBytes() const { return total_; }
+
+    static const char* resultName(Result result) {
+        switch (result) {
+            case OK: return "ok";
+            case TRUNCATED: return "truncated";
+            case BAD_HEADER: return "not gzip";
+            case BAD_DATA: return "invalid deflate data";
+            case BAD_CHECKSUM: return "checksum mismatch";
+            case WRITE_FAILED: return "write failed";
+        }
+        return "unknown";
+    }
+
+private:
+    static const int MAX_BITS = 15;
+    static const int MAX_LCODES = 286;
+    static const int MAX_DCODES = 30;
+    static const int FIXED_LCODES = 288;
+
+    struct Huffman {
+        int16_t count[MAX_BITS + 1]; // Number of codes of each length
+        int16_t symbol[FIXED_LCODES]; // Symbols ordered by code
+    };
+
+    void fail(Result result) {
+        if (error_ == OK) {
+            error_ = result;
+        }
+    }
+
+    template <typename Input>
+    uint8_t byte(Input& in) {
+        if (inPos_ == inLen_) {
+            inLen_ = error_ == OK ? in.read(inBuf_, sizeof(inBuf_)) : 0;
+            inPos_ = 0;
+            if (inLen_ == 0) {
+                fail(TRUNCATED);
+                return 0;
+            }
+        }
+        inputBytes_++;
+        return inBuf_[inPos_++];
+    }
+
+    template <typename Input>
+    uint32_t bits(Input& in, int need) {
+        uint32_t value = bitBuf_;
+        while (bitCount_ < need) {
+            value |= (uint32_t)byte(in) << bitCount_;
+            bitCount_ += 8;
+        }
+        bitBuf_ = value >> need;
+        bitCount_ -= need;
+        return value & ((1u << need) - 1);
+    }
+
+    template <typename Input>
+    bool readHeader(Input& in) {
+        static const uint8_t FHCRC = 0x02, FEXTRA = 0x04, FNAME = 0x08, FCOMMENT = 0x10;
+        uint8_t header[10];
+        for (int i = 0; i < 10; i++) {
+            header[i] = byte(in);
+        }
+        if (error_ != OK || header[0] != 0x1F || header[1] != 0x8B || header[2] != 8) {
+            return false;
+        }
+        uint8_t flags = header[3];
+        if (flags & FEXTRA) {
+            uint16_t len = byte(in);
+            len |= byte(in) << 8;
+            while (len-- && error_ == OK) {
+                byte(in);
+            }
+        }
+        if (flags & FNAME) {
+            while (byte(in) != 0 && error_ == OK) {}
+        }
+        if (flags & FCOMMENT) {
+            while (byte(in) != 0 && error_ == OK) {}
+        }
+        if (flags & FHCRC) {
+            byte(in);
+            byte(in);
+        }
+        return error_ == OK;
+    }
+
+    void put(uint8_t value) {
+        window_[pos_++] = value;
+        total_++;
+    }
+
+    // Hand the bytes produced since the last flush to the sink
+    template <typename Sink>
+    bool flush(Sink& sink) {
+        size_t n = pos_ - flushed_;
+        if (n > 0) {
+            crc_ = crc32(crc_, window_ + flushed_, n);
+            if (!sink.write(window_ + flushed_, n)) {
+                return false;
+            }
+        }
+        if (pos_ == WINDOW_SIZE) {
+            pos_ = 0;
+        }
+        flushed_ = pos_;
+        return true;
+    }
+
+    template <typename Input, typename Sink>
+    void stored(Input& in, Sink& sink) {
+        bitBuf_ = 0;
+        bitCount_ = 0;
+        uint16_t len = byte(in);
+        len |= byte(in) << 8;
+        uint16_t nlen = byte(in);
+        nlen |= byte(in) << 8;
+        if (error_ == OK && len != (uint16_t)~nlen) {
+            fail(BAD_DATA);
+        }
+        while (len-- && error_ == OK) {
+            put(byte(in));
+            if (pos_ == WINDOW_SIZE && !flush(sink)) {
+                fail(WRITE_FAILED);
+            }
+        }
+    }
+
+    template <typename Input>
+    int decode(Input& in, const Huffman& h) {
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (int len = 1; len <= MAX_BITS; len++) {
+            code |= bits(in, 1);
+            int count = h.count[len];
+            if (code - count < first) {
+                return h.symbol[index + (code - first)];
+            }
+            index += count;
+            first += count;
+            first <<= 1;
+            code <<= 1;
+        }
+        fail(error_ != OK ? error_ : BAD_DATA);
+        return -1;
+    }
+
+    // Build a canonical Huffman table from code lengths. Returns false for an over-subscribed set.
+    static bool construct(Huffman& h, const uint8_t* length, int n) {
+        memset(h.count, 0, sizeof(h.count));
+        for (int symbol = 0; symbol < n; symbol++) {
+            h.count[length[symbol]]++;
+        }
+        int left = 1;
+        for (int len = 1; len <= MAX_BITS; len++) {
+            left <<= 1;
+            left -= h.count[len];
+            if (left < 0) {
+                return false;
+            }
+        }
+        int16_t offs[MAX_BITS + 1];
+        offs[1] = 0;
+        for (int len = 1; len < MAX_BITS; len++) {
+            offs[len + 1] = offs[len] + h.count[len];
+        }
+        for (int symbol = 0; symbol < n; symbol++) {
+            if (length[symbol] != 0) {
+                h.symbol[offs[length[symbol]]++] = symbol;
+            }
+        }
+        return true;
+    }
+
+    void fixed() {
+        uint8_t lengths[FIXED_LCODES];
+        int symbol = 0;
+        for (; symbol < 144; symbol++) lengths[symbol] = 8;
+        for (; symbol < 256; symbol++) lengths[symbol] = 9;
+        for (; symbol < 280; symbol++) lengths[symbol] = 7;
+        for (; symbol < FIXED_LCODES; symbol++) lengths[symbol] = 8;
+        construct(lencode_, lengths, FIXED_LCODES);
+        for (symbol = 0; symbol < MAX_DCODES; symbol++) lengths[symbol] = 5;
+        construct(distcode_, lengths, MAX_DCODES);
+    }
+
+    template <typename Input>
+    void dynamic(Input& in) {
+        static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+        uint8_t lengths[MAX_LCODES + MAX_DCODES];
+        int nlen = bits(in, 5) + 257;
+        int ndist = bits(in, 5) + 1;
+        int ncode = bits(in, 4) + 4;
+        if (nlen > MAX_LCODES || ndist > MAX_DCODES) {
+            fail(BAD_DATA);
+            return;
+        }
+        int index = 0;
+        for (; index < ncode; index++) lengths[order[index]] = bits(in, 3);
+        for (; index < 19; index++) lengths[order[index]] = 0;
+        if (!construct(lencode_, lengths, 19)) {
+            fail(BAD_DATA);
+            return;
+        }
+
+        index = 0;
+        while (index < nlen + ndist && error_ == OK) {
+            int symbol = decode(in, lencode_);
+            if (symbol < 16) {
+                lengths[index++] = symbol;
+                continue;
+            }
+            uint8_t len = 0;
+            int repeat;
+            if (symbol == 16) {
+                if (index == 0) {
+                    fail(BAD_DATA);
+                    return;
+                }
+                len = lengths[index - 1];
+                repeat = 3 + bits(in, 2);
+            } else if (symbol == 17) {
+                repeat = 3 + bits(in, 3);
+            } else {
+                repeat = 11 + bits(in, 7);
+            }
+            if (index + repeat > nlen + ndist) {
+                fail(BAD_DATA);
+                return;
+            }
+            while (repeat--) lengths[index++] = len;
+        }
+        if (error_ != OK || lengths[256] == 0) {
+            fail(BAD_DATA);
+            return;
+        }
+        if (!construct(lencode_, lengths, nlen) || !construct(distcode_, lengths + nlen, ndist)) {
+            fail(BAD_DATA);
+        }
+    }
+
+    template <typename Input, typename Sink>
+    void codes(Input& in, Sink& sink) {
+        static const uint16_t lengthBase[29] = {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const uint8_t lengthExtra[29] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static const uint16_t distBase[30] = {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static const uint8_t distExtra[30] = {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        for (;;) {
+            int symbol = decode(in, lencode_);
+            if (error_ != OK) {
+                return;
+            }
+            if (symbol < 256) {
+                put(symbol);
+            } else if (symbol == 256) {
+                return;
+            } else {
+                symbol -= 257;
+                if (symbol >= 29) {
+                    fail(BAD_DATA);
+                    return;
+                }
+                uint32_t len = lengthBase[symbol] + bits(in, lengthExtra[symbol]);
+                symbol = decode(in, distcode_);
+                if (error_ != OK) {
+                    return;
+                }
+                if (symbol >= 30) {
+                    fail(BAD_DATA);
+                    return;
+                }
+                uint32_t dist = distBase[symbol] + bits(in, distExtra[symbol]);
+                if (dist > total_ || dist > WINDOW_SIZE) {
+                    fail(BAD_DATA);
+                    return;
+                }
+                size_t from = (pos_ + WINDOW_SIZE - dist) % WINDOW_SIZE;
+                while (len--) {
+                    put(window_[from]);
+                    from = (from + 1) % WINDOW_SIZE;
+                    if (pos_ == WINDOW_SIZE && !flush(sink)) {
+                        fail(WRITE_FAILED);
+                        return;
+                    }
+                }
+                continue;
+            }
+            if (pos_ == WINDOW_SIZE && !flush(sink)) {
+                fail(WRITE_FAILED);
+                return;
+            }
+        }
+    }
+
+    // Reflected CRC-32 (gzip), four bits at a time
+    static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len) {
+        static const uint32_t table[16] = {
+            0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+            0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+        for (size_t i = 0; i < len; i++) {
+            crc ^= data[i];
+            crc = (crc >> 4) ^ table[crc & 0x0F];
+            crc = (crc >> 4) ^ table[crc & 0x0F];
+        }
+        return crc;
+    }
+
+    uint8_t* window_;
+    size_t pos_ = 0;          // Next write position in window_
+    size_t flushed_ = 0;      // window_[flushed_, pos_) not yet given to the sink
+    uint32_t total_ = 0;      // Bytes inflated
+    uint32_t crc_ = 0xFFFFFFFF;
+    uint32_t inputBytes_ = 0;
+    uint32_t bitBuf_ = 0;
+    int bitCount_ = 0;
+    uint8_t inBuf_[256];
+    size_t inPos_ = 0;
+    size_t inLen_ = 0;
+    Result error_ = OK;
+    Huffman lencode_;
+    Huffman distcode_;
+};
+
+#endif // GZIP_STREAM_H
@@ -0,0 +1,101 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+/*
+Resumable writer for firmware images going into an OTA partition.
+
+Bytes are written in order; each flash sector is erased when the write
+position enters it. At every sector boundary the writer can produce a
+Checkpoint (offset and SHA-256 midstate) for the caller to persist. After a
+disconnect or reboot, resume() continues from the last checkpoint: the
+sector at that offset is erased again and rewritten, so bytes written after
+the checkpoint never leave stale data behind, and the hash picks up exactly
+where it was saved.
+
+    Flash: bool erase(uint32_t offset, size_t len)
+           bool write(uint32_t offset, const uint8_t* buf, size_t len)
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sha256.h"
+
+struct ImageCheckpoint {
+    uint32_t offset;     // Bytes written and hashed, a multiple of SECTOR_SIZE
+    uint32_t size;       // Total image size
+    uint32_t hash[8];    // SHA-256 midstate at offset
+};
+
+template <typename Flash>
+class ImageWriter {
+public:
+    static const uint32_t SECTOR_SIZE = 4096;
+
+    explicit ImageWriter(Flash& flash) : flash_(flash) {}
+
+    void start(uint32_t size) {
+        size_ = size;
+        offset_ = 0;
+        sha_.reset();
+    }
+
+    // Continue from a saved checkpoint. Returns false if it cannot be used.
+    bool resume(const ImageCheckpoint& checkpoint) {
+        if (checkpoint.offset % SECTOR_SIZE != 0 || checkpoint.offset > checkpoint.size) {
+            return false;
+        }
+        size_ = checkpoint.size;
+        offset_ = checkpoint.offset;
+        sha_.restoreState(checkpoint.hash, offset_);
+        return true;
+    }
+
+    bool write(const uint8_t* data, size_t len) {
+        if (len > size_ - offset_) {
+            return false;
+        }
+        while (len > 0) {
+            if (offset_ % SECTOR_SIZE == 0 && !flash_.erase(offset_, SECTOR_SIZE)) {
+                return false;
+            }
+            size_t n = SECTOR_SIZE - offset_ % SECTOR_SIZE;
+            if (n > len) {
+                n = len;
+            }
+            if (!flash_.write(offset_, data, n)) {
+                return false;
+            }
+            sha_.update(data, n);
+            offset_ += n;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    // True right after a sector was completed; checkpoint() is only valid then.
+    bool atSectorBoundary() const { return offset_ % SECTOR_SIZE == 0; }
+
+    ImageCheckpoint checkpoint() const {
+        ImageCheckpoint checkpoint;
+        checkpoint.offset = offset_;
+        checkpoint.size = size_;
+        sha_.saveState(checkpoint.hash);
+        return checkpoint;
+    }
+
+    bool complete() const { return offset_ == size_; }
+
+    void finish(uint8_t digest[Sha256::DIGEST_SIZE]) { sha_.finish(digest); }
+
+    uint32_t offset() const { return offset_; }
+    uint32_t size() const { return size_; }
+
+private:
+    Flash& flash_;
+    Sha256 sha_;
+    uint32_t size_ = 0;
+    uint32_t offset_ = 0;
+};
+
+#endif // IMAGE_WRITER_H
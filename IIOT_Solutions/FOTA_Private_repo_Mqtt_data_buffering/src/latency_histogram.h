@@ -0,0 +1,146 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+/*
+Fixed-bucket latency histograms for the device metrics topic.
+
+Durations are recorded in microseconds into log-linear buckets: exact below
+4 us, then four buckets per power of two, so any value up to 2^32 us (71
+minutes) lands in one of 124 counters with at most 25% relative width.
+record() is a count-leading-zeros and one relaxed atomic increment, safe to
+call from any task at the same time; there is no lock and no heap.
+
+take() moves the counts out (resetting them) and reduces them to a Summary
+with p50/p90/p99 and the maximum of the interval. A percentile is reported
+as the upper bound of its bucket, capped at the maximum seen, so it never
+understates the latency.
+
+PublishAckTimer remembers when a QoS 1/2 publish was handed to the client,
+keyed by packet id, so the ack callback can record publish-to-ack time.
+Slots are indexed by packet id, which the client increments per publish; a
+slot is overwritten if Slots newer publishes go out before the ack, and that
+sample is simply lost.
+*/
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_timer.h"
+
+class LatencyHistogram {
+public:
+    static const int BUCKETS = 124;
+
+    struct Summary {
+        uint32_t count;
+        uint32_t p50;
+        uint32_t p90;
+        uint32_t p99;
+        uint32_t max;
+    };
+
+    void record(uint32_t us) {
+        counts_[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+        uint32_t seen = max_.load(std::memory_order_relaxed);
+        while (us > seen && !max_.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Summary of everything recorded since the previous take()
+    Summary take() {
+        uint32_t counts[BUCKETS];
+        Summary summary = {0, 0, 0, 0, max_.exchange(0, std::memory_order_relaxed)};
+        for (int i = 0; i < BUCKETS; i++) {
+            counts[i] = counts_[i].exchange(0, std::memory_order_relaxed);
+            summary.count += counts[i];
+        }
+        summary.p50 = percentile(counts, summary, 50);
+        summary.p90 = percentile(counts, summary, 90);
+        summary.p99 = percentile(counts, summary, 99);
+        return summary;
+    }
+
+    static int bucketOf(uint32_t us) {
+        if (us < 4) {
+            return us;
+        }
+        int octave = 31 - __builtin_clz(us);       // 2..31
+        int sub = (us >> (octave - 2)) & 3;        // The two bits after the leading one
+        return (octave - 1) * 4 + sub;
+    }
+
+    // Largest value that falls into bucket
+    static uint32_t bucketUpper(int bucket) {
+        if (bucket < 4) {
+            return bucket;
+        }
+        int octave = bucket / 4 + 1;
+        uint32_t width = 1UL << (octave - 2);
+        return (uint32_t)((4 + bucket % 4) * (uint64_t)width + width - 1);
+    }
+
+private:
+    static uint32_t percentile(const uint32_t* counts, const Summary& summary, uint32_t pct) {
+        if (summary.count == 0) {
+            return 0;
+        }
+        uint32_t rank = (uint32_t)(((uint64_t)summary.count * pct + 99) / 100); // 1-based, rounded up
+        uint32_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                uint32_t upper = bucketUpper(i);
+                return upper < summary.max ? upper : summary.max;
+            }
+        }
+        return summary.max; // Only when record() raced with take()
+    }
+
+    std::atomic<uint32_t> counts_[BUCKETS] = {};
+    std::atomic<uint32_t> max_{0};
+};
+
+// Records the lifetime of the scope, for functions with several returns
+class LatencyScope {
+public:
+    explicit LatencyScope(LatencyHistogram& histogram) : histogram_(histogram), start_(esp_timer_get_time()) {}
+    ~LatencyScope() { histogram_.record((uint32_t)(esp_timer_get_time() - start_)); }
+
+private:
+    LatencyHistogram& histogram_;
+    int64_t start_;
+};
+
+template <size_t Slots>
+class PublishAckTimer {
+public:
+    void sent(uint16_t packetId, uint32_t nowUs) {
+        Slot& slot = slots_[packetId % Slots];
+        slot.sentUs.store(nowUs, std::memory_order_relaxed);
+        slot.packetId.store(packetId, std::memory_order_release);
+    }
+
+    // True with the time since sent() if packetId is still tracked
+    bool acked(uint16_t packetId, uint32_t nowUs, uint32_t& elapsedUs) {
+        Slot& slot = slots_[packetId % Slots];
+        uint32_t expected = packetId;
+        if (slot.packetId.load(std::memory_order_acquire) != expected) {
+            return false;
+        }
+        uint32_t sentUs = slot.sentUs.load(std::memory_order_relaxed);
+        if (!slot.packetId.compare_exchange_strong(expected, 0, std::memory_order_acq_rel)) {
+            return false; // Reused by a newer publish meanwhile
+        }
+        elapsedUs = nowUs - sentUs;
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> packetId{0};     // 0 is never a valid packet id
+        std::atomic<uint32_t> sentUs{0};
+    };
+    Slot slots_[Slots];
+};
+
+#endif // LATENCY_HISTOGRAM_H
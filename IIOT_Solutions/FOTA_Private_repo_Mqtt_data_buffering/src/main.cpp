@@ -124,6 +124,7 @@ Rollback pin support
 #include <WiFiClientSecure.h>
 #include "LittleFS.h"
 #include <ArduinoJson.h>
+#include <Preferences.h>      // NVS storage for OTA check state
 #include <AsyncMqttClient.h>      // Non-blocking MQTT library for ESP32
 #include "cert.h"
 #include "config.h"  // Include the config file
@@ -131,10 +132,40 @@ Rollback pin support
 #include "esp_ota_ops.h"    // Include ESP-IDF OTA operations header
 #include "freertos/FreeRTOS.h"  // FreeRTOS library for task scheduling and timers
 #include "freertos/timers.h"    // FreeRTOS timers
+#include "freertos/semphr.h"    // FreeRTOS mutex guarding the data buffer
+#include "freertos/queue.h"     // MQTT callbacks hand their work to mqttTask()
+#include "freertos/event_groups.h" // Event bits that wake the main and OTA tasks
+#include "esp_freertos_hooks.h" // Tick hook sampling idle time
+#include "esp_timer.h"      // Microsecond timestamps for latency measurements
+#include "esp_pm.h"         // Frequency scaling and automatic light sleep in low-power mode
 #include "esp_task_wdt.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_task_wdt.h" // Include WDT control
+#include "data_log.h"     // Flash-backed store-and-forward log
+#include "ring_buffer.h"  // Allocation-free RAM tier in front of the data log
+#include "replay_window.h" // Ack-driven in-flight window for backlog replay
+#include "block_codec.h"   // Columnar delta + LZ4 encoding of replayed records
+#include "sparkplug.h"     // Sparkplug B payload encoder
+#include "report_filter.h" // Report-by-exception deadbands and heartbeats
+#include "sample_window.h" // Lock-free windowed statistics of sampled sources
+#include "power_schedule.h" // Low-power flush schedule and energy estimate
+#include "delta_patch.h"   // Streaming delta firmware patches
+#include "gzip_stream.h"   // Streaming gzip decompression of firmware images
+#include "image_writer.h"  // Resumable writes into the OTA partition
+#include "semver.h"        // Version precedence for manifests
+#include "chunked_reader.h" // Chunked version.json parsed from the connection
+#include "latency_histogram.h" // Lock-free latency histograms for the metrics topic
+#include "payload_format.h" // Heap-free publish payloads
+#include "message_pool.h"   // Reassembly of fragmented incoming messages
+#include "command_router.h" // Compile-time topic and command tables
+#include "mbedtls/sha256.h"
+#include "mbedtls/pk.h"      // Firmware signature check
+#include "mbedtls/base64.h"
+#if BENCHMARK
+#include "bench.h"           // Hot-path micro-benchmarks, BENCHMARK builds only
+#endif
+#include <sys/time.h>
 
 
 #define DEBUG_PRINT(x) if(DEBUG_PRINTS) Serial.print(x)
@@ -143,12 +174,37 @@ Rollback pin support
 
 
 // Function declarations
+typedef void (*TopicHandler)(const char* payload, size_t len);     // Whole message on a topic in topicRoutes
+typedef void (*CommandHandler)(JsonVariantConst value);            // Value of a key in commandRoutes
 void initFileSystem();
 void printPartitionInfo();
 void rollbackToPreviousFirmware();
 void checkForUpdate();
-void firmwareUpdate();
-int FirmwareVersionCheck();
+void otaTask(void* parameter);
+struct Manifest;
+void firmwareUpdate(const Manifest& manifest);
+bool deltaUpdate(const Manifest& manifest);
+bool gzipUpdate(const Manifest& manifest);
+bool resumableUpdate(const Manifest& manifest);
+bool loadDownloadCheckpoint(const Manifest& manifest, const esp_partition_t* target, ImageCheckpoint& checkpoint, String& etag);
+void saveDownloadCheckpoint(const Manifest& manifest, const esp_partition_t* target, const ImageCheckpoint& checkpoint, const String& etag);
+void clearDownloadCheckpoint();
+void reportDownload(uint32_t downloaded, uint32_t imageBytes, unsigned long downloadStart);
+bool partitionHashMatches(const esp_partition_t* partition, uint32_t size, const uint8_t* expected);
+bool digestMatchesHex(const uint8_t* digest, const String& hex);
+bool verifyImage(const Manifest& manifest, const uint8_t* digest, uint32_t hashedBytes);
+bool signatureValid(const String& signatureBase64, const uint8_t* digest);
+int FirmwareVersionCheck(Manifest& manifest);
+bool readManifest(JsonVariantConst root, const String& channel, Manifest& manifest);
+JsonVariantConst selectManifest(JsonVariantConst root, const String& channel);
+void buildManifestFilter(JsonDocument& filter, const String& channel);
+String updateChannel();
+void setUpdateChannel(const char* channel);
+void initOtaClient();
+bool otaBegin(const String& url);
+void setCheckInterval(unsigned long ms);
+void setReportPolicies(JsonObjectConst metrics);
+void setPowerSettings(JsonObjectConst settings);
 void saveRootCACertificate(const char* rootCA);
 bool loadRootCACertificate(String &rootCA);
 void connectToWifi();
@@ -156,21 +212,85 @@ void connectToMqtt();
 void WiFiEvent(WiFiEvent_t event);
 void onMqttConnect(bool sessionPresent);
 void onMqttDisconnect(AsyncMqttClientDisconnectReason reason);
+void onMqttPublish(uint16_t packetId);
+void mqttTask(void* parameter);
+bool handleNextMqttEvent(TickType_t wait);
+void handleMqttConnect(int64_t eventUs);
+void handleMqttDisconnect(int64_t eventUs);
+void handleMqttAck(uint16_t packetId, int64_t eventUs);
 void processBufferedData();
+void bufferReading(uint32_t value);
+void spillRamBuffer();
+void flushBufferedData();
 void publishSensorData(void* parameter);
 void onMqttMessage(char* topic, char* payload, AsyncMqttClientMessageProperties properties, size_t len, size_t index, size_t total);
+void handleMqttMessage(const char* topic, TopicHandler handler, const char* payload, size_t len);
+void handleCommandMessage(const char* payload, size_t len);
+void handleManifestMessage(const char* payload, size_t len);
+void handleActuation(const char* payload, size_t len);
+void handleSparkplugCommand(const char* payload, size_t len);
+void setStateCommand(const char* state);
+void setOutput(uint8_t output, bool on);
 void saveCredentials(const char* ssid, const char* password);
 bool loadCredentials(String &ssid, String &password);
 void IRAM_ATTR buttonISR();
+void IRAM_ATTR rollbackISR();
+void IRAM_ATTR sampleIdleTick();
+void reportCpuStats();
+uint16_t timedPublish(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length = 0);
+void publishLatencyMetrics();
+void samplingTask(void* parameter);
+void loggerTask(void* parameter);
+void startTask(uint8_t id, TaskFunction_t function);
+void applyTaskTable();
+void reportTaskStats();
+void publishSampleWindows();
+bool readSimulatedSource(float& value);
+void loadReportPolicies();
+bool shouldReport(uint8_t metric, double value);
+void loadPowerSettings();
+void applyPowerMode();
+void holdReading(uint32_t value);
+void startFlush();
+void endFlush();
+void recordDelivered(uint32_t readings);
 void handleSoftReset();
 void handleHardReset();
+uint64_t epochMillis();
+void setSparkplugWill();
+void publishSparkplugBirth();
+bool publishSparkplugData(uint32_t value);
+#if BENCHMARK
+void runOfflineBenchmarks();
+void benchmarkTask(void* parameter);
+#endif
 
 volatile unsigned long pressStartTime = 0;
 volatile unsigned long lastPressTime = 0;
 volatile int pressCount = 0;
-volatile bool softResetFlag = false;
-volatile bool hardResetFlag = false;
-const int MAX_PROCESS_PER_CALL = 5;     
+
+// Event bits for the main task (loop()); it sleeps until one of them is set
+EventGroupHandle_t systemEvents;
+const EventBits_t EVT_SOFT_RESET = BIT0;   // Long press, set by buttonISR()
+const EventBits_t EVT_HARD_RESET = BIT1;   // Double press, set by buttonISR()
+const EventBits_t EVT_ROLLBACK = BIT2;     // ROLLBACK_PIN pulled low, set by rollbackISR()
+const EventBits_t EVT_STATS = BIT3;        // statsTimer: print CPU statistics
+const EventBits_t EVT_METRICS = BIT4;      // metricsTimer: publish latency histograms
+const EventBits_t EVT_WINDOW = BIT5;       // samplingTask() closed a window: publish its statistics
+const EventBits_t EVT_BUTTONS = EVT_SOFT_RESET | EVT_HARD_RESET | EVT_ROLLBACK;
+
+// Event bits for otaTask(); without them it only wakes for the next version.json poll
+EventGroupHandle_t otaEvents;
+const EventBits_t OTA_EVT_MANIFEST = BIT0;   // mqttTask() read a manifest with a new version
+const EventBits_t OTA_EVT_RESCHEDULE = BIT1; // Poll interval changed (MQTT up/down, ota_interval)
+
+TimerHandle_t statsTimer;                  // Periodic EVT_STATS
+TimerHandle_t metricsTimer;                // Periodic EVT_METRICS
+volatile int64_t buttonEventUs = 0;        // esp_timer time the last button/rollback event was raised
+uint32_t buttonLatencyMaxUs = 0;           // Worst ISR-to-handler latency seen
+volatile uint32_t sampledTicks[portNUM_PROCESSORS]; // Ticks seen by sampleIdleTick() per core
+volatile uint32_t idleTicks[portNUM_PROCESSORS];    // ... of which interrupted the idle task
+const int MAX_PROCESS_PER_CALL = 5;     // Max buffered-data publishes issued per processBufferedData() call
 
 // MQTT and FreeRTOS objects
 AsyncMqttClient mqttClient;       // MQTT client for non-blocking communication
@@ -178,19 +298,267 @@ TimerHandle_t mqttReconnectTimer; // Timer for reconnecting to MQTT broker
 TimerHandle_t wifiReconnectTimer; // Timer for reconnecting to Wi-Fi
 TimerHandle_t counterTimer;       // Timer for publishing counter data periodically
 
+// One buffered reading as stored in the data log
+struct SensorRecord {
+    uint32_t timestamp;           // millis() when the reading was taken
+    uint32_t counter;
+};
+
 // Global variables
 unsigned long counter = 0;        // Counter variable for publishing
-String bufferedData = "";         // Buffer for storing unsent data
+RingBuffer<SensorRecord, MAX_BUFFER_SIZE> ramBuffer; // Offline readings, pushed lock-free by loggerTask()
+DataLog dataLog;                  // Persistent buffer for unsent data (LittleFS on the spiffs partition)
+SemaphoreHandle_t bufferMutex;    // Serialises dataLog, replayWindow and ramBuffer consumers between the logger and MQTT tasks
+// End of a replay batch in the data log, and the number of records replayed up to there
+struct ReplayMark {
+    LogCursor end;
+    uint32_t records;
+};
+ReplayWindow<ReplayMark, REPLAY_WINDOW_MAX> replayWindow; // Buffered-data publishes awaiting their ack
+uint32_t replayRecordsSent = 0;   // Records in batches sent so far; rewinds with the data log
+uint32_t replayRecordsAcked = 0;  // Records up to the commit point (both guarded by bufferMutex)
+BlockEncoder blockEncoder;        // Column scratch for replay blocks (guarded by bufferMutex)
+typedef MessagePool<MQTT_MESSAGE_POOL, MQTT_MESSAGE_MAX> MqttMessagePool;
+MqttMessagePool mqttMessagePool;  // Buffers for messages that arrive in several TCP segments
+MessageAssembler<MqttMessagePool> mqttAssembler(mqttMessagePool); // Only used by onMqttMessage()
+int64_t mqttMessageArrivalUs = 0; // esp_timer time the first piece of the message being assembled arrived
+int64_t mqttMessageStartUs = 0;   // ... and of the message mqttTask() is handling
+
+// Incoming topics and JSON command keys, each routed through a perfect hash built at compile time (command_router.h)
+// A command handler that only runs when the value has the type its function takes
+template <typename T, void (*Handler)(T)>
+void typedCommand(JsonVariantConst value) {
+    if (value.is<T>()) {
+        Handler(value.as<T>());
+    } else {
+        DEBUG_PRINTLN("Command value has the wrong type");
+    }
+}
 
-unsigned long previousMillis = 0;  // will store last time update was checked
-const long interval = 5000;        // interval at which to check for updates (milliseconds)
-String newFirmwareURL = "";        // Variable to store new firmware URL
+constexpr router::Route<TopicHandler> topicRoutes[] = {
+    {SUBSCRIBE_TOPIC, handleCommandMessage},
+    {OTA_MANIFEST_TOPIC, handleManifestMessage},
+    {ACTUATION_TOPIC, handleActuation},
+    {SPARKPLUG_TOPIC("NCMD"), handleSparkplugCommand},
+};
+constexpr auto topicRouter = router::makeRouter(topicRoutes);
+static_assert(topicRouter.ok(), "No perfect hash for topicRoutes");
+
+constexpr router::Route<CommandHandler> commandRoutes[] = {
+    {"ota_interval", typedCommand<unsigned long, setCheckInterval>}, // {"ota_interval": 60000}: version.json poll interval
+    {"ota_channel", typedCommand<const char*, setUpdateChannel>},    // {"ota_channel": "beta"}: release channel
+    {"state", typedCommand<const char*, setStateCommand>},           // {"state": "0"} or {"state": "1"}: output 0
+    {"report", typedCommand<JsonObjectConst, setReportPolicies>},    // {"report": {"counter": {"deadband": 5}}}: see setReportPolicies()
+    {"power", typedCommand<JsonObjectConst, setPowerSettings>},      // {"power": {"mode": "low"}}: see setPowerSettings()
+};
+constexpr auto commandRouter = router::makeRouter(commandRoutes);
+static_assert(commandRouter.ok(), "No perfect hash for commandRoutes");
+
+const uint8_t outputPins[] = {OUTPUT_PIN}; // Outputs addressed by index in commands
+
+// AsyncMqttClient callbacks run on the AsyncTCP task, which also handles every other packet and ack.
+// They only copy what happened into mqttEvents; mqttTask() does the parsing, publishing and replay.
+struct MqttEvent {
+    enum Type : uint8_t { CONNECTED, DISCONNECTED, ACKED, MESSAGE } type;
+    uint16_t packetId;             // ACKED
+    uint16_t length;               // MESSAGE: payload bytes
+    int64_t us;                    // esp_timer time of the callback (first piece for messages)
+    const router::Route<TopicHandler>* route; // MESSAGE
+    char* buffer;                  // MESSAGE: pool buffer holding the payload, nullptr if it is inline
+    char inlinePayload[MQTT_EVENT_INLINE];
+};
+static_assert(MQTT_MESSAGE_MAX <= UINT16_MAX, "MqttEvent::length is 16 bits");
+QueueHandle_t mqttEvents;
+struct MqttQueueStats {
+    uint32_t maxDepth;             // Most events waiting at once
+    uint32_t dropped;              // Events lost to a full queue
+    uint32_t rejected;             // Messages over MQTT_MESSAGE_MAX or without a free pool buffer
+} mqttQueueStats;                  // Written by the AsyncTCP task only
+
+// Payload templates: the literal parts are fixed at compile time, the capacity fits the widest field value
+constexpr char COUNTER_PREFIX[] = "Counter: ";
+constexpr char BIRTH_PREFIX[] = "{\"status\":\"online\", \"deviceId\":\"" DEVICE_ACCESS_TOKEN "\", \"ip\":\"";
+constexpr char BIRTH_SUFFIX[] = "\"}";
+typedef payload::Payload<payload::capacity(sizeof(COUNTER_PREFIX), payload::UINT32_CHARS)> CounterPayload;
+typedef payload::Payload<payload::capacity(sizeof(BIRTH_PREFIX), payload::IPV4_CHARS, sizeof(BIRTH_SUFFIX))> BirthPayload;
+
+// Sparkplug B metric aliases, announced in NBIRTH
+enum SparkplugAlias : int32_t {
+    ALIAS_REBIRTH = 1,
+    ALIAS_COUNTER = 2,
+    ALIAS_FW_VERSION = 3,
+    ALIAS_IP = 4,
+};
+uint8_t sparkplugBdSeq = 255;     // Birth/death sequence, incremented before each connect (first session uses 0)
+uint8_t sparkplugSeq = 0;         // Message sequence, 0 in NBIRTH and wrapping at 256
+uint8_t sparkplugDeath[32];       // NDEATH payload; the client keeps a pointer to it as the will
+
+volatile unsigned long interval = OTA_CHECK_INTERVAL; // interval at which to check for updates (milliseconds), settable at runtime
+String otaChannel = OTA_CHANNEL;   // Release channel followed in multi-board manifests (guarded by manifestMutex)
+Preferences otaPrefs;              // ETag/Last-Modified of version.json and the check interval
+
+// Published values, each reported by exception (report_filter.h)
+enum ReportMetric {
+    REPORT_COUNTER,                // counter, sampled by counterTimer
+    REPORT_SIM,                    // Window mean of the simulated sample source
+    REPORT_COUNT
+};
+const char* const reportNames[REPORT_COUNT] = {"counter", "sim"};
+ReportFilter reportFilters[REPORT_COUNT];
+portMUX_TYPE reportLock = portMUX_INITIALIZER_UNLOCKED; // Policy changes (MQTT task) against samples (logger task, loop())
+Preferences reportPrefs;           // Policies set over MQTT, one ReportPolicy per metric name
+
+// Inputs read by samplingTask() at SAMPLE_RATE_HZ. A source is a read function plus a row here (and a
+// ReportMetric for its window mean); publishing needs no change. read() runs on the sampling task and must
+// not block: an ADC read or the last value polled by a Modbus task fits, a bus transaction does not.
+struct SampleSource {
+    const char* name;              // "source" in SAMPLES_TOPIC messages; also its report metric name
+    uint8_t metric;                // ReportMetric of the window mean
+    bool (*read)(float& value);    // false if there is no sample this time
+};
+const SampleSource sampleSources[] = {
+    {"sim", REPORT_SIM, readSimulatedSource},
+};
+const size_t SAMPLE_SOURCES = sizeof(sampleSources) / sizeof(sampleSources[0]);
+SampleWindow sampleWindows[SAMPLE_SOURCES];
+esp_timer_handle_t sampleTimer;    // Wakes samplingTask() every 1/SAMPLE_RATE_HZ s
+volatile uint32_t sampleDueUs;     // Low bits of esp_timer time of the last wake, for LAT_SAMPLE_WAKE
+uint32_t sampleOverruns = 0;       // Sample periods the sampling task was too late for (written by it only)
+
+// Low-power mode (power_schedule.h): readings wait in the buffer and the radio sleeps between flushes.
+// WiFi stays associated and the MQTT session up, so the will still only fires for a device that is gone.
+volatile bool lowPowerMode = POWER_LOW_DEFAULT;
+volatile bool radioFlushing = false; // Low power: radio awake until the backlog is drained
+bool lightSleepAvailable = false;  // esp_pm_configure() accepted automatic light sleep
+FlushSchedule flushSchedule;
+EnergyMeter energyMeter(PowerProfile{POWER_SUPPLY_MV, {POWER_ACTIVE_MA, POWER_MODEM_SLEEP_MA, POWER_LIGHT_SLEEP_MA}});
+portMUX_TYPE powerLock = portMUX_INITIALIZER_UNLOCKED; // flushSchedule and energyMeter (logger, MQTT and main tasks)
+Preferences powerPrefs;            // Power settings set over MQTT
+
+// **Task table**: core, priority and stack of every task, from config.h. Tasks created here are pinned by
+// startTask(); loopTask (Arduino core) and async_tcp (AsyncTCP, created on the first connect) are not ours
+// to create, so their core and stack are build settings checked below and applyTaskTable() sets their
+// priority and warns if they run elsewhere.
+enum TaskId {
+    TASK_LOOP,
+    TASK_NETWORK,
+    TASK_MQTT,
+    TASK_LOGGER,
+    TASK_OTA,
+    TASK_SAMPLING,
+    TASK_BENCH,
+    TASK_COUNT
+};
+struct TaskSpec {
+    const char* name;              // FreeRTOS task name, also in the metrics message
+    BaseType_t core;
+    UBaseType_t priority;
+    uint32_t stack;                // Bytes
+    bool external;                 // Created outside main.cpp: found by name, priority set at runtime
+};
+const TaskSpec taskTable[TASK_COUNT] = {
+    {"loopTask", LOOP_TASK_CORE, LOOP_TASK_PRIORITY, LOOP_TASK_STACK, true},
+    {"async_tcp", NETWORK_TASK_CORE, NETWORK_TASK_PRIORITY, NETWORK_TASK_STACK, true},
+    {"mqtt", MQTT_TASK_CORE, MQTT_TASK_PRIORITY, MQTT_TASK_STACK, false},
+    {"logger", LOG_TASK_CORE, LOG_TASK_PRIORITY, LOG_TASK_STACK, false},
+    {"ota", OTA_TASK_CORE, OTA_TASK_PRIORITY, OTA_TASK_STACK, false},
+    {"sampling", SAMPLE_TASK_CORE, SAMPLE_TASK_PRIORITY, SAMPLE_TASK_STACK, false},
+    {"bench", BENCH_TASK_CORE, BENCH_TASK_PRIORITY, BENCH_TASK_STACK, false},
+};
+TaskHandle_t taskHandles[TASK_COUNT]; // nullptr until the task is started (or found, for external ones)
+static_assert(SAMPLE_TASK_CORE != NETWORK_TASK_CORE, "Sampling must not share a core with AsyncTCP");
+static_assert(SAMPLE_TASK_CORE != OTA_TASK_CORE, "Sampling must not share a core with OTA's TLS");
+#ifdef CONFIG_ASYNC_TCP_RUNNING_CORE
+static_assert(CONFIG_ASYNC_TCP_RUNNING_CORE == NETWORK_TASK_CORE, "AsyncTCP build flag differs from NETWORK_TASK_CORE");
+#endif
+#ifdef CONFIG_ASYNC_TCP_STACK_SIZE
+static_assert(CONFIG_ASYNC_TCP_STACK_SIZE == NETWORK_TASK_STACK, "AsyncTCP build flag differs from NETWORK_TASK_STACK");
+#endif
+#ifdef ARDUINO_RUNNING_CORE
+static_assert(ARDUINO_RUNNING_CORE == LOOP_TASK_CORE, "loop() runs on ARDUINO_RUNNING_CORE, not LOOP_TASK_CORE");
+#endif
+#ifdef SET_LOOP_TASK_STACK_SIZE
+SET_LOOP_TASK_STACK_SIZE(LOOP_TASK_STACK);
+#endif
+// Download details of a newer release, filled in by readManifest(). Passed by value or const reference
+// only: an update checks its image against the same manifest it downloaded it from.
+struct Manifest {
+    String url;                    // bin_url
+    size_t size = 0;               // Image size announced by the manifest, 0 if unknown
+    String sha256;                 // Image hash announced by the manifest (hex), empty if unknown
+    String patchURL;               // Delta patch from FirmwareVer to the new version, empty if none offered
+    bool gzip = false;             // bin_url points at a gzip-compressed image
+    String signature;              // Base64 ECDSA signature of the image hash, checked against otaSigningKey
+};
+Manifest announcedManifest;        // Latest newer manifest from OTA_MANIFEST_TOPIC (guarded by manifestMutex)
+SemaphoreHandle_t manifestMutex;   // Held only to copy announcedManifest or otaChannel in or out, never during a download
+
+// OTA HTTPS client, kept for the whole run so version checks reuse one TLS connection (HTTP keep-alive)
+WiFiClientSecure otaClient;
+HTTPClient otaHttps;               // Long-lived too: HTTPClient's destructor closes the connection
+String otaRootCA;                  // setCACert() keeps a pointer, so the PEM must outlive otaClient
+String otaHost;                    // Host otaClient is currently connected to
+
+// Cost of the OTA connection, printed after every version check
+struct OtaHttpStats {
+    uint32_t requests;             // Requests issued through otaHttps
+    uint32_t handshakes;           // Requests that needed a new TCP + TLS connection
+    uint32_t lastHandshakeMs;
+    uint32_t maxHandshakeMs;
+    uint32_t tlsHeap;              // Heap held by the last established TLS session
+    uint32_t minFreeHeap;          // Heap low-water mark since boot, sampled after each request
+    uint32_t lastDownloadBytes;    // Bytes received for the last firmware image
+    uint32_t lastDownloadMs;
+    uint32_t hashUs;               // Time spent hashing the last image (only bytes received this boot)
+    uint32_t verifyUs;             // Time of the last signature check
+} otaStats;
+
+// Latency histograms (latency_histogram.h), summarised on METRICS_TOPIC every METRICS_INTERVAL
+enum LatencyMetric {
+    LAT_PUBLISH,                   // mqttClient.publish() call
+    LAT_PUBLISH_ACK,               // QoS 1/2 publish until its PUBACK/PUBCOMP
+    LAT_WIFI_CONNECT,              // Boot or link loss until an IP is assigned
+    LAT_MQTT_CONNECT,              // Boot or MQTT disconnect until CONNACK
+    LAT_OTA_CHECK,                 // FirmwareVersionCheck()
+    LAT_OTA_DOWNLOAD,              // Firmware image transfer
+    LAT_OTA_VERIFY,                // Hash and signature check of a downloaded image
+    LAT_MQTT_MESSAGE,              // onMqttMessage() callback, per piece
+    LAT_ACTUATION,                 // First piece of a command message until its output pin is written
+    LAT_MQTT_QUEUE,                // MQTT callback until mqttTask() picks the event up
+    LAT_SAMPLE_WAKE,               // Sample timer until samplingTask() runs
+    LAT_COUNT
+};
+const char* const latencyNames[LAT_COUNT] = {"publish", "publish_ack", "wifi_connect", "mqtt_connect",
+                                             "ota_check", "ota_download", "ota_verify", "mqtt_message",
+                                             "actuation", "mqtt_queue", "sample_wake"};
+LatencyHistogram latency[LAT_COUNT];
+PublishAckTimer<32> publishAcks;   // Send times of unacked QoS 1/2 publishes
+int64_t wifiDownSinceUs = 0;       // esp_timer time WiFi went down, 0 while connected
+int64_t mqttDownSinceUs = 0;       // ... and MQTT
 
 void setup() {
     Serial.begin(115200);
     pinMode(RESET_BUTTON, INPUT_PULLUP);
     pinMode(ROLLBACK_PIN, INPUT_PULLUP);  // Set up the rollback pin as an input with an internal pull-up resistor
+    for (uint8_t pin : outputPins) {
+        pinMode(pin, OUTPUT);
+    }
     initFileSystem();
+    systemEvents = xEventGroupCreate();
+    otaEvents = xEventGroupCreate();
+    otaPrefs.begin("ota", false);
+    interval = otaPrefs.getULong("interval", OTA_CHECK_INTERVAL);
+    otaChannel = otaPrefs.getString("channel", OTA_CHANNEL);
+    loadReportPolicies();
+    loadPowerSettings();
+    bufferMutex = xSemaphoreCreateMutex();
+    manifestMutex = xSemaphoreCreateMutex();
+    mqttEvents = xQueueCreate(MQTT_QUEUE_LENGTH, sizeof(MqttEvent));
+    if (dataLog.begin()) {
+        DEBUG_PRINTLN("Data log recovered");
+    } else {
+        DEBUG_PRINTLN("Failed to open data log");
+    }
 
     // Save the root CA certificate to LittleFS
     saveRootCACertificate(rootCACertificate);
@@ -210,10 +578,13 @@ void setup() {
     } else {
         DEBUG_PRINTLN("Failed to load Root CA");
     }
+    initOtaClient();
 
     mqttReconnectTimer = xTimerCreate("mqttTimer", pdMS_TO_TICKS(2000), pdFALSE, (void*)0, reinterpret_cast<TimerCallbackFunction_t>(connectToMqtt));
     wifiReconnectTimer = xTimerCreate("wifiTimer", pdMS_TO_TICKS(15000), pdFALSE, (void*)0, reinterpret_cast<TimerCallbackFunction_t>(connectToWifi));
-    counterTimer = xTimerCreate("counterTimer", pdMS_TO_TICKS(5000), pdTRUE, (void*)0, [](TimerHandle_t xTimer) { publishSensorData(nullptr); });
+    counterTimer = xTimerCreate("counterTimer", pdMS_TO_TICKS(COUNTER_INTERVAL), pdTRUE, (void*)0, [](TimerHandle_t xTimer) { xTaskNotifyGive(taskHandles[TASK_LOGGER]); });
+    statsTimer = xTimerCreate("statsTimer", pdMS_TO_TICKS(STATS_INTERVAL), pdTRUE, (void*)0, [](TimerHandle_t xTimer) { xEventGroupSetBits(systemEvents, EVT_STATS); });
+    metricsTimer = xTimerCreate("metricsTimer", pdMS_TO_TICKS(METRICS_INTERVAL), pdTRUE, (void*)0, [](TimerHandle_t xTimer) { xEventGroupSetBits(systemEvents, EVT_METRICS); });
 
     // Register Wi-Fi event handler
     WiFi.onEvent(WiFiEvent);
@@ -222,12 +593,37 @@ void setup() {
     mqttClient.onConnect(onMqttConnect);
     mqttClient.onDisconnect(onMqttDisconnect);
     mqttClient.onMessage(onMqttMessage);
+    mqttClient.onPublish(onMqttPublish);
     mqttClient.setServer(MQTT_HOST, MQTT_PORT); // Set MQTT broker
     // Configure Last Will (Testament) Message
-    mqttClient.setWill(LAST_WILL_TOPIC, 2, true, "{\"status\":\"offline\", \"deviceId\":\"" DEVICE_ACCESS_TOKEN "\"}");
+    if (!SPARKPLUG_B_ENABLED) {
+        mqttClient.setWill(LAST_WILL_TOPIC, 2, true, "{\"status\":\"offline\", \"deviceId\":\"" DEVICE_ACCESS_TOKEN "\"}");
+    }
 
+#if BENCHMARK
+    runOfflineBenchmarks();      // Before WiFi, so the publish path measured is the buffering one
+    startTask(TASK_BENCH, benchmarkTask);
+#endif
+    wifiDownSinceUs = mqttDownSinceUs = esp_timer_get_time(); // The first connects count from boot
     connectToWifi();             // Start Wi-Fi connection
+    applyTaskTable();            // loopTask; async_tcp is picked up on the first MQTT connect
+    startTask(TASK_OTA, otaTask); // HTTPS checks never block loop()
+    startTask(TASK_MQTT, mqttTask);
+    startTask(TASK_LOGGER, loggerTask);
+    startTask(TASK_SAMPLING, samplingTask);
     xTimerStart(counterTimer, 0); // Start counter timer for publishing data
+    xTimerStart(statsTimer, 0);
+    xTimerStart(metricsTimer, 0);
+    const esp_timer_create_args_t sampleTimerArgs = {[](void*) {
+                                                         sampleDueUs = (uint32_t)esp_timer_get_time();
+                                                         xTaskNotifyGive(taskHandles[TASK_SAMPLING]);
+                                                     },
+                                                     nullptr, ESP_TIMER_TASK, "sample", true};
+    esp_timer_create(&sampleTimerArgs, &sampleTimer);
+    applyPowerMode();            // Starts the sample timer at the mode's rate
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        esp_register_freertos_tick_hook_for_cpu(sampleIdleTick, core);
+    }
 
     
     // Initialize NVS
@@ -239,32 +635,71 @@ void setup() {
     ESP_ERROR_CHECK(ret);
 
     attachInterrupt(digitalPinToInterrupt(RESET_BUTTON), buttonISR, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(ROLLBACK_PIN), rollbackISR, FALLING);
+    if (digitalRead(ROLLBACK_PIN) == LOW) {
+        xEventGroupSetBits(systemEvents, EVT_ROLLBACK); // Held low since boot: no edge to catch
+    }
 }
 
+// Main task: sleeps until an ISR or timer sets an event bit, so nothing here waits on the network
 void loop() {
-    
-    if (softResetFlag) {
-        softResetFlag = false;
-        handleSoftReset();
+    EventBits_t events = xEventGroupWaitBits(systemEvents, EVT_BUTTONS | EVT_STATS | EVT_METRICS | EVT_WINDOW, pdTRUE, pdFALSE, portMAX_DELAY);
+
+    if (events & EVT_BUTTONS) {
+        uint32_t latencyUs = esp_timer_get_time() - buttonEventUs;
+        if (latencyUs > buttonLatencyMaxUs) {
+            buttonLatencyMaxUs = latencyUs;
+        }
+        DEBUG_PRINTF("Button event handled after %lu us (max %lu us)\n", (unsigned long)latencyUs, (unsigned long)buttonLatencyMaxUs);
     }
 
-    if (hardResetFlag) {
-        hardResetFlag = false;
+    if (events & EVT_HARD_RESET) {
         handleHardReset();
+    } else if (events & EVT_SOFT_RESET) {
+        handleSoftReset();
     }
 
-    vTaskDelay(pdMS_TO_TICKS(10));  // FreeRTOS friendly delay
-
-
-    unsigned long currentMillis = millis();
-    if (digitalRead(ROLLBACK_PIN) == LOW) {  // Check if the rollback pin is triggered (assuming active low)
+    if ((events & EVT_ROLLBACK) && digitalRead(ROLLBACK_PIN) == LOW) {  // Still low: not a glitch (active low)
         DEBUG_PRINTLN("Rollback pin triggered. Rolling back to previous firmware.");
         rollbackToPreviousFirmware();
     }
 
-    if (currentMillis - previousMillis >= interval) {
-        previousMillis = currentMillis;
-        checkForUpdate();
+    if (events & EVT_STATS) {
+        reportCpuStats();
+    }
+
+    if (events & EVT_METRICS) {
+        publishLatencyMetrics();
+    }
+
+    if (events & EVT_WINDOW) {
+        publishSampleWindows();
+    }
+}
+
+// OTA task: low priority, so slow GitHub responses and firmware downloads only use otherwise idle CPU.
+// Updates are normally announced on OTA_MANIFEST_TOPIC; polling version.json is only a fallback.
+void otaTask(void* parameter) {
+    unsigned long lastCheck = millis();
+    for (;;) {
+        unsigned long pollInterval = mqttClient.connected() ? OTA_FALLBACK_INTERVAL : interval;
+        unsigned long elapsed = millis() - lastCheck;
+        TickType_t wait = elapsed >= pollInterval ? 0 : pdMS_TO_TICKS(pollInterval - elapsed);
+        EventBits_t events = xEventGroupWaitBits(otaEvents, OTA_EVT_MANIFEST | OTA_EVT_RESCHEDULE, pdTRUE, pdFALSE, wait);
+
+        if (events & OTA_EVT_MANIFEST) {
+            lastCheck = millis();
+            // Our own copy: a manifest redelivered during the download only replaces announcedManifest,
+            // and sets OTA_EVT_MANIFEST again for the next pass if this update fails
+            xSemaphoreTake(manifestMutex, portMAX_DELAY);
+            Manifest manifest = announcedManifest;
+            xSemaphoreGive(manifestMutex);
+            DEBUG_PRINTLN("New firmware announced over MQTT. Updating...");
+            firmwareUpdate(manifest);
+        } else if (millis() - lastCheck >= pollInterval) {
+            lastCheck = millis();
+            checkForUpdate();
+        }
     }
 }
 
@@ -333,138 +768,511 @@ void checkForUpdate() {
     DEBUG_PRINT("Checking for firmware updates... Current version: ");
     DEBUG_PRINTLN(FirmwareVer);
 
-    if (FirmwareVersionCheck()) {
+    Manifest manifest;
+    int64_t checkStart = esp_timer_get_time();
+    int available = FirmwareVersionCheck(manifest);
+    latency[LAT_OTA_CHECK].record((uint32_t)(esp_timer_get_time() - checkStart));
+    if (available) {
         DEBUG_PRINTLN("New firmware detected. Updating...");
-        firmwareUpdate();
+        firmwareUpdate(manifest);
     } else {
         DEBUG_PRINTLN("No new firmware available.");
     }
 }
 
-void firmwareUpdate() {
-    WiFiClientSecure* client = new WiFiClientSecure;
+void firmwareUpdate(const Manifest& manifest) {
+    if (manifest.patchURL.length() > 0) {
+        if (deltaUpdate(manifest)) {
+            DEBUG_PRINTLN("Delta update completed successfully. Rebooting...");
+            flushBufferedData();
+            ESP.restart();
+        }
+        DEBUG_PRINTLN("Delta update failed, downloading the full image");
+    }
 
-    if (client) {
-        String rootCA;
-        if (loadRootCACertificate(rootCA)) {
-            client->setCACert(rootCA.c_str());
+    // A gzip stream cannot be picked up midway; plain images are fetched in resumable chunks
+    if (manifest.gzip ? gzipUpdate(manifest) : resumableUpdate(manifest)) {
+        DEBUG_PRINTLN("Update completed successfully. Rebooting...");
+        flushBufferedData();
+        ESP.restart();
+    }
+}
+
+// Adapters between DeltaApplier and the OTA download (see delta_patch.h)
+struct OtaStream {
+    WiFiClient* client;
+    size_t read(uint8_t* buf, size_t len) { return client->readBytes(buf, len); }
+};
+
+struct RunningImage {
+    const esp_partition_t* partition;
+    bool read(uint32_t offset, uint8_t* buf, size_t len) {
+        return esp_partition_read(partition, offset, buf, len) == ESP_OK;
+    }
+};
+
+struct UpdateSink {
+    mbedtls_sha256_context* sha;
+    bool write(const uint8_t* buf, size_t len) {
+        int64_t start = esp_timer_get_time();
+        mbedtls_sha256_update(sha, buf, len); // Hardware SHA on the ESP32
+        otaStats.hashUs += esp_timer_get_time() - start;
+        return Update.write(const_cast<uint8_t*>(buf), len) == len;
+    }
+};
+
+// Rebuild the new image from the running partition and the patch at manifest.patchURL.
+// Nothing is committed unless the result matches the patch's (and the manifest's) SHA-256.
+bool deltaUpdate(const Manifest& manifest) {
+    if (!otaBegin(manifest.patchURL)) {
+        DEBUG_PRINTLN("HTTP client setup failed for delta update.");
+        return false;
+    }
+    otaHttps.addHeader("Authorization", "token " + String(GITHUB_TOKEN));
+
+    DEBUG_PRINTLN("Starting delta patch download...");
+    int httpCode = otaHttps.GET();
+    bool applied = false;
+    if (httpCode == HTTP_CODE_OK) {
+        OtaStream in = {otaHttps.getStreamPtr()};
+        const esp_partition_t* running = esp_ota_get_running_partition();
+        DeltaHeader header;
+        if (!DeltaApplier::readHeader(in, header)) {
+            DEBUG_PRINTLN("Not a delta patch");
+        } else if (header.sourceSize > running->size || !partitionHashMatches(running, header.sourceSize, header.sourceHash)) {
+            DEBUG_PRINTLN("Delta patch does not apply to the running image");
+        } else if (!Update.begin(header.targetSize)) {
+            DEBUG_PRINTF("Not enough space for OTA update: %lu bytes needed\n", (unsigned long)header.targetSize);
         } else {
-            DEBUG_PRINTLN("Using built-in root CA");
-            client->setCACert(rootCACertificate);  // Fallback to the built-in root CA
-        }
-
-        HTTPClient https;
-
-        if (https.begin(*client, newFirmwareURL)) { // Begin connection with firmware URL
-            https.addHeader("Authorization", "token " + String(GITHUB_TOKEN)); // Add the authorization header
-
-            DEBUG_PRINTLN("Starting firmware download...");
-            int httpCode = https.GET(); // Perform GET request to download firmware binary
-
-            if (httpCode == HTTP_CODE_OK) {
-                // Stream the firmware directly to the update process
-                WiFiClient* updateClient = https.getStreamPtr();
-                size_t contentLength = https.getSize();
-
-                if (contentLength > 0) {
-                    DEBUG_PRINTF("Firmware size: %d bytes\n", contentLength);
-
-                    // Start the OTA update
-                    if (Update.begin(contentLength)) {
-                        size_t written = Update.writeStream(*updateClient);
-                        if (written == contentLength) {
-                            DEBUG_PRINTLN("Firmware update successfully written!");
-                        } else {
-                            DEBUG_PRINTF("Firmware update failed! Written: %d of %d bytes\n", written, contentLength);
-                        }
-
-                        // End the update process
-                        if (Update.end()) {
-                            if (Update.isFinished()) {
-                                DEBUG_PRINTLN("Update completed successfully. Rebooting...");
-                                ESP.restart();
-                            } else {
-                                DEBUG_PRINTLN("Update not finished. Something went wrong!");
-                            }
-                        } else {
-                            DEBUG_PRINTF("Update failed: %s\n", Update.errorString());
-                        }
-                    } else {
-                        DEBUG_PRINTF("Not enough space for OTA update: %d bytes needed\n", contentLength);
-                    }
-                } else {
-                    DEBUG_PRINTLN("Content length invalid or zero.");
-                }
+            mbedtls_sha256_context sha;
+            mbedtls_sha256_init(&sha);
+            mbedtls_sha256_starts(&sha, 0);
+            otaStats.hashUs = 0;
+            RunningImage source = {running};
+            UpdateSink sink = {&sha};
+            DeltaApplier::Result result = DeltaApplier::apply(in, header, source, sink);
+            uint8_t digest[32];
+            mbedtls_sha256_finish(&sha, digest);
+            mbedtls_sha256_free(&sha);
+
+            if (result != DeltaApplier::OK) {
+                DEBUG_PRINTF("Delta patch failed: %s\n", DeltaApplier::resultName(result));
+            } else if (memcmp(digest, header.targetHash, sizeof(digest)) != 0) {
+                DEBUG_PRINTLN("Patched image hash mismatch");
+            } else if (!verifyImage(manifest, digest, header.targetSize)) {
+                DEBUG_PRINTLN("Patched image rejected");
+            } else if (!Update.end()) {
+                DEBUG_PRINTF("Update failed: %s\n", Update.errorString());
             } else {
-                DEBUG_PRINTF("Firmware download failed, HTTP code: %d\n", httpCode);
+                applied = Update.isFinished();
+            }
+            if (!applied) {
+                Update.abort();
             }
-
-            https.end(); // End the HTTP connection
-        } else {
-            DEBUG_PRINTLN("HTTP client setup failed for firmware update.");
         }
+    } else {
+        DEBUG_PRINTF("Delta patch download failed, HTTP code: %d\n", httpCode);
+    }
 
-        delete client; // Clean up
+    otaHttps.end();
+    if (!applied) {
+        otaClient.stop(); // The rest of the patch may still be in flight
     }
+    return applied;
 }
 
-int FirmwareVersionCheck() {
-    String payload;
-    int httpCode;
-    String FirmwareURL = URL_fw_Version;
-    FirmwareURL += "?";
-    FirmwareURL += String(rand());
+// Inflate a gzip image from the download straight into Update, with one 32 KB window on the heap.
+// The image is only committed if the gzip CRC and, when the manifest has one, the SHA-256 match.
+bool gzipUpdate(const Manifest& manifest) {
+    if (!otaBegin(manifest.url)) {
+        DEBUG_PRINTLN("HTTP client setup failed for firmware update.");
+        return false;
+    }
+    otaHttps.addHeader("Authorization", "token " + String(GITHUB_TOKEN)); // Add the authorization header
+
+    DEBUG_PRINTLN("Starting compressed firmware download...");
+    unsigned long downloadStart = millis();
+    int httpCode = otaHttps.GET();
+    if (httpCode != HTTP_CODE_OK) {
+        DEBUG_PRINTF("Firmware download failed, HTTP code: %d\n", httpCode);
+        otaHttps.end();
+        otaClient.stop();
+        return false;
+    }
 
-    WiFiClientSecure* client = new WiFiClientSecure;
+    uint8_t* window = static_cast<uint8_t*>(malloc(GzipInflater::WINDOW_SIZE));
+    GzipInflater* inflater = window ? new GzipInflater(window) : nullptr;
+    if (!inflater) {
+        DEBUG_PRINTLN("Not enough memory to decompress the firmware");
+        free(window);
+        otaHttps.end();
+        otaClient.stop();
+        return false;
+    }
+    if (!Update.begin(manifest.size > 0 ? manifest.size : UPDATE_SIZE_UNKNOWN)) {
+        DEBUG_PRINTF("Not enough space for OTA update: %lu bytes needed\n", (unsigned long)manifest.size);
+        delete inflater;
+        free(window);
+        otaHttps.end();
+        otaClient.stop();
+        return false;
+    }
 
-    if (client) {
-        String rootCA;
-        if (loadRootCACertificate(rootCA)) {
-            client->setCACert(rootCA.c_str());
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    otaStats.hashUs = 0;
+    OtaStream in = {otaHttps.getStreamPtr()};
+    UpdateSink sink = {&sha};
+    GzipInflater::Result result = inflater->inflate(in, sink);
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+    reportDownload(inflater->inputBytes(), inflater->outputBytes(), downloadStart);
+
+    bool applied = false;
+    if (result != GzipInflater::OK) {
+        DEBUG_PRINTF("Firmware decompression failed: %s\n", GzipInflater::resultName(result));
+    } else if (!verifyImage(manifest, digest, inflater->outputBytes())) {
+        DEBUG_PRINTLN("Firmware image rejected");
+    } else if (!Update.end(manifest.size == 0)) { // Without a manifest size the partition is not filled
+        DEBUG_PRINTF("Update failed: %s\n", Update.errorString());
+    } else {
+        applied = Update.isFinished();
+    }
+    if (!applied) {
+        Update.abort();
+    }
+    delete inflater;
+    free(window);
+    otaHttps.end();
+    if (!applied) {
+        otaClient.stop(); // The rest of the image may still be in flight
+    }
+    return applied;
+}
+
+// Flash access for ImageWriter: raw writes into the OTA partition, bypassing Update (which cannot resume)
+struct OtaPartition {
+    const esp_partition_t* partition;
+    uint32_t flashUs;              // Time in erase/write; the rest of ImageWriter::write() is hashing
+    uint32_t hashUs;
+    bool erase(uint32_t offset, size_t len) {
+        int64_t start = esp_timer_get_time();
+        bool ok = esp_partition_erase_range(partition, offset, len) == ESP_OK;
+        flashUs += esp_timer_get_time() - start;
+        return ok;
+    }
+    bool write(uint32_t offset, const uint8_t* buf, size_t len) {
+        int64_t start = esp_timer_get_time();
+        bool ok = esp_partition_write(partition, offset, buf, len) == ESP_OK;
+        flashUs += esp_timer_get_time() - start;
+        return ok;
+    }
+};
+
+// Fetch the rest of the current OTA_RANGE_CHUNK with a Range request and write it. Returns false if
+// the request failed or the connection dropped; the writer then holds everything received so far.
+bool downloadRange(const Manifest& manifest, ImageWriter<OtaPartition>& writer, OtaPartition& flash, String& etag,
+                   uint32_t& received) {
+    if (!otaBegin(manifest.url)) {
+        return false;
+    }
+    uint32_t from = writer.offset();
+    uint32_t to = (from / OTA_RANGE_CHUNK + 1) * OTA_RANGE_CHUNK - 1; // Chunks end on checkpoint boundaries
+    otaHttps.addHeader("Authorization", "token " + String(GITHUB_TOKEN));
+    otaHttps.addHeader("Range", "bytes=" + String(from) + "-" + String(to));
+    if (etag.length() > 0) {
+        otaHttps.addHeader("If-Range", etag); // A changed file comes back whole (200) instead of mixing versions
+    }
+    const char* rangeHeaders[] = {"Content-Range", "ETag"};
+    otaHttps.collectHeaders(rangeHeaders, 2);
+
+    int httpCode = otaHttps.GET();
+    int length = otaHttps.getSize();
+    if (httpCode == HTTP_CODE_PARTIAL_CONTENT) {
+        // Content-Range: bytes <from>-<to>/<total>
+        String range = otaHttps.header("Content-Range");
+        uint32_t total = range.substring(range.indexOf('/') + 1).toInt();
+        if (writer.size() == 0 && from == 0) {
+            writer.start(total);
+        } else if (total != writer.size() || (uint32_t)range.substring(6).toInt() != from) {
+            DEBUG_PRINTLN("Firmware changed on the server, restarting download");
+            writer.start(0);
+            etag = "";
+            clearDownloadCheckpoint();
+            length = 0;
+        }
+    } else if (httpCode == HTTP_CODE_OK && length > 0) {
+        DEBUG_PRINTLN("Server sent the whole image");
+        writer.start(length);
+        clearDownloadCheckpoint();
+    } else {
+        DEBUG_PRINTF("Firmware download failed, HTTP code: %d\n", httpCode);
+        length = -1;
+    }
+    if (length <= 0) {
+        otaHttps.end();
+        otaClient.stop();
+        return length == 0; // A changed image is fetched again from byte 0 right away
+    }
+    etag = otaHttps.header("ETag");
+
+    WiFiClient* stream = otaHttps.getStreamPtr();
+    uint8_t buf[1024];
+    while (length > 0) {
+        size_t n = stream->readBytes(buf, length < (int)sizeof(buf) ? length : sizeof(buf));
+        if (n == 0) {
+            break; // Timed out or disconnected
+        }
+        int64_t start = esp_timer_get_time();
+        uint32_t flashStart = flash.flashUs;
+        bool written = writer.write(buf, n);
+        flash.hashUs += esp_timer_get_time() - start - (flash.flashUs - flashStart);
+        if (!written) {
+            DEBUG_PRINTLN("Flash write failed");
+            writer.start(0);
+            clearDownloadCheckpoint();
+            break;
+        }
+        length -= n;
+        received += n;
+    }
+    otaHttps.end();
+    if (length > 0) {
+        DEBUG_PRINTF("Firmware download interrupted at %lu bytes\n", (unsigned long)writer.offset());
+        otaClient.stop();
+        return false;
+    }
+    if (writer.atSectorBoundary() && !writer.complete()) {
+        saveDownloadCheckpoint(manifest, flash.partition, writer.checkpoint(), etag);
+    }
+    return true;
+}
+
+// Download bin_url in OTA_RANGE_CHUNK pieces straight into the next OTA partition. Progress and the
+// running SHA-256 are checkpointed in NVS, so after a dropped link or a reboot the download continues
+// from the last checkpoint instead of byte 0. The image is only booted if its hash matches.
+bool resumableUpdate(const Manifest& manifest) {
+    const esp_partition_t* target = esp_ota_get_next_update_partition(NULL);
+    OtaPartition flash = {target, 0, 0};
+    ImageWriter<OtaPartition> writer(flash);
+    ImageCheckpoint checkpoint;
+    String etag;
+    if (loadDownloadCheckpoint(manifest, target, checkpoint, etag) && writer.resume(checkpoint)) {
+        DEBUG_PRINTF("Resuming firmware download at %lu of %lu bytes\n",
+                     (unsigned long)writer.offset(), (unsigned long)writer.size());
+    } else {
+        writer.start(0); // The size comes with the first response
+        etag = "";
+    }
+
+    DEBUG_PRINTLN("Starting firmware download...");
+    unsigned long downloadStart = millis();
+    uint32_t received = 0;
+    int failures = 0;
+    while (writer.size() == 0 || !writer.complete()) {
+        if (downloadRange(manifest, writer, flash, etag, received)) {
+            failures = 0;
+        } else if (++failures > OTA_RANGE_RETRIES) {
+            DEBUG_PRINTF("Firmware download stopped at %lu bytes, will resume on the next check\n",
+                         (unsigned long)writer.offset());
+            return false;
         } else {
-            DEBUG_PRINTLN("Using built-in root CA");
-            client->setCACert(rootCACertificate);  // Fallback to the built-in root CA
+            vTaskDelay(pdMS_TO_TICKS(1000 * failures));
+        }
+        if (writer.size() > target->size || (manifest.size > 0 && writer.size() > 0 && writer.size() != manifest.size)) {
+            DEBUG_PRINTF("Firmware size %lu does not match the manifest or the partition\n", (unsigned long)writer.size());
+            clearDownloadCheckpoint();
+            return false;
         }
+    }
+    reportDownload(received, writer.size(), downloadStart);
+    clearDownloadCheckpoint();
+
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    writer.finish(digest);
+    otaStats.hashUs = flash.hashUs;
+    if (!verifyImage(manifest, digest, received)) {
+        DEBUG_PRINTLN("Firmware image rejected");
+        return false;
+    }
+    esp_err_t err = esp_ota_set_boot_partition(target); // Also verifies the image's own checksum
+    if (err != ESP_OK) {
+        DEBUG_PRINTF("Downloaded image rejected: %s\n", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+// Download progress in NVS, only valid for the same URL and target partition
+bool loadDownloadCheckpoint(const Manifest& manifest, const esp_partition_t* target, ImageCheckpoint& checkpoint, String& etag) {
+    if (otaPrefs.getString("dl_url", "") != manifest.url || otaPrefs.getULong("dl_part", 0) != target->address) {
+        return false;
+    }
+    if (otaPrefs.getBytes("dl_state", &checkpoint, sizeof(checkpoint)) != sizeof(checkpoint)) {
+        return false;
+    }
+    etag = otaPrefs.getString("dl_etag", "");
+    return checkpoint.size > 0 && checkpoint.size <= target->size;
+}
 
-        HTTPClient https;
+void saveDownloadCheckpoint(const Manifest& manifest, const esp_partition_t* target, const ImageCheckpoint& checkpoint, const String& etag) {
+    otaPrefs.putString("dl_url", manifest.url);
+    otaPrefs.putULong("dl_part", target->address);
+    otaPrefs.putString("dl_etag", etag);
+    otaPrefs.putBytes("dl_state", &checkpoint, sizeof(checkpoint));
+}
+
+void clearDownloadCheckpoint() {
+    otaPrefs.remove("dl_url");
+    otaPrefs.remove("dl_state");
+}
 
-        if (https.begin(*client, FirmwareURL)) {
-            https.addHeader("Authorization", "token " + String(GITHUB_TOKEN)); // Add the authorization header
-            DEBUG_PRINT("[HTTPS] GET...\n");
-            delay(100);
-            httpCode = https.GET();
-            delay(100);
-            if (httpCode == HTTP_CODE_OK) {
-                payload = https.getString();
+void reportDownload(uint32_t downloaded, uint32_t imageBytes, unsigned long downloadStart) {
+    otaStats.lastDownloadBytes = downloaded;
+    otaStats.lastDownloadMs = millis() - downloadStart;
+    latency[LAT_OTA_DOWNLOAD].record(otaStats.lastDownloadMs * 1000);
+    otaStats.minFreeHeap = ESP.getMinFreeHeap();
+    DEBUG_PRINTF("Firmware download: %lu bytes for a %lu byte image in %lu ms, min free heap %lu B\n",
+                 (unsigned long)downloaded, (unsigned long)imageBytes,
+                 (unsigned long)otaStats.lastDownloadMs, (unsigned long)otaStats.minFreeHeap);
+}
+
+// SHA-256 over the first size bytes of a partition
+bool partitionHashMatches(const esp_partition_t* partition, uint32_t size, const uint8_t* expected) {
+    uint8_t buf[DeltaApplier::CHUNK_SIZE];
+    uint8_t digest[32];
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    bool ok = true;
+    for (uint32_t offset = 0; ok && offset < size; offset += sizeof(buf)) {
+        size_t n = size - offset < sizeof(buf) ? size - offset : sizeof(buf);
+        ok = esp_partition_read(partition, offset, buf, n) == ESP_OK;
+        mbedtls_sha256_update(&sha, buf, n);
+    }
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+    return ok && memcmp(digest, expected, sizeof(digest)) == 0;
+}
+
+bool digestMatchesHex(const uint8_t* digest, const String& hex) {
+    char expected[65];
+    for (int i = 0; i < 32; i++) {
+        snprintf(expected + i * 2, 3, "%02x", digest[i]);
+    }
+    return hex.equalsIgnoreCase(expected);
+}
+
+// Final check before an image may be booted: the manifest's hash and, with OTA_REQUIRE_SIGNATURE, its
+// signature over that hash. digest was computed while the image was written, so flash is not read again.
+bool verifyImage(const Manifest& manifest, const uint8_t* digest, uint32_t hashedBytes) {
+    LatencyScope timing(latency[LAT_OTA_VERIFY]);
+    if (manifest.sha256.length() > 0 && !digestMatchesHex(digest, manifest.sha256)) {
+        DEBUG_PRINTLN("Firmware hash does not match the manifest");
+        return false;
+    }
+    int64_t start = esp_timer_get_time();
+    bool signedOk = manifest.signature.length() > 0 && signatureValid(manifest.signature, digest);
+    otaStats.verifyUs = esp_timer_get_time() - start;
+    DEBUG_PRINTF("Image verify cost: sha256 %lu us/MB over %lu bytes, signature %lu us\n",
+                 hashedBytes ? (unsigned long)((uint64_t)otaStats.hashUs * 1048576 / hashedBytes) : 0UL,
+                 (unsigned long)hashedBytes, (unsigned long)otaStats.verifyUs);
+    if (!signedOk && (OTA_REQUIRE_SIGNATURE || manifest.signature.length() > 0)) {
+        DEBUG_PRINTLN(manifest.signature.length() ? "Firmware signature invalid" : "Firmware is not signed");
+        return false;
+    }
+    return true;
+}
+
+// ECDSA P-256 signature (DER, base64 in the manifest) over the image's SHA-256, see tools/sign_image.py
+bool signatureValid(const String& signatureBase64, const uint8_t* digest) {
+    uint8_t signature[80]; // DER ECDSA P-256 signatures are at most 72 bytes
+    size_t signatureLen = 0;
+    if (mbedtls_base64_decode(signature, sizeof(signature), &signatureLen,
+                              (const unsigned char*)signatureBase64.c_str(), signatureBase64.length()) != 0) {
+        return false;
+    }
+    mbedtls_pk_context key;
+    mbedtls_pk_init(&key);
+    bool valid = mbedtls_pk_parse_public_key(&key, (const unsigned char*)otaSigningKey, strlen(otaSigningKey) + 1) == 0
+                 && mbedtls_pk_can_do(&key, MBEDTLS_PK_ECDSA)
+                 && mbedtls_pk_verify(&key, MBEDTLS_MD_SHA256, digest, 32, signature, signatureLen) == 0;
+    mbedtls_pk_free(&key);
+    return valid;
+}
+
+// Poll version.json; returns 1 with manifest filled in when it offers a newer release
+int FirmwareVersionCheck(Manifest& manifest) {
+    JsonDocument doc;                  // Only the filtered fields for this board, whatever the manifest size
+    DeserializationError error;
+    int httpCode = 0;
+    String FirmwareURL = URL_fw_Version;
+    String etag, lastModified;         // Validators returned with this response
+    String channel = updateChannel();  // One channel for the filter and the entry, even if it changes meanwhile
+
+    if (otaBegin(FirmwareURL)) {
+        otaHttps.addHeader("Authorization", "token " + String(GITHUB_TOKEN)); // Add the authorization header
+        // Conditional GET: while version.json is unchanged the server answers 304 without a body
+        String knownEtag = otaPrefs.getString("etag", "");
+        String knownModified = otaPrefs.getString("modified", "");
+        if (knownEtag.length() > 0) {
+            otaHttps.addHeader("If-None-Match", knownEtag);
+        }
+        if (knownModified.length() > 0) {
+            otaHttps.addHeader("If-Modified-Since", knownModified);
+        }
+        const char* responseHeaders[] = {"ETag", "Last-Modified", "Transfer-Encoding"};
+        otaHttps.collectHeaders(responseHeaders, 3);
+        DEBUG_PRINT("[HTTPS] GET...\n");
+        httpCode = otaHttps.GET();
+        if (httpCode == HTTP_CODE_OK) {
+            etag = otaHttps.header("ETag");
+            lastModified = otaHttps.header("Last-Modified");
+            // Parse straight from the connection, keeping only the fields readManifest() looks at
+            JsonDocument filter;
+            buildManifestFilter(filter, channel);
+            int length = otaHttps.getSize();
+            uint32_t freeHeap = ESP.getFreeHeap();
+            if (otaHttps.header("Transfer-Encoding").equalsIgnoreCase("chunked")) {
+                ChunkedReader<WiFiClient> body(*otaHttps.getStreamPtr());
+                error = deserializeJson(doc, body, DeserializationOption::Filter(filter));
+                if (!body.finish()) {
+                    otaClient.stop(); // The rest of the body would be read as the next response
+                }
             } else {
-                DEBUG_PRINTLN("Error Occurred During Version Check: ");
-                DEBUG_PRINTLN(httpCode);
+                error = deserializeJson(doc, otaHttps.getStream(), DeserializationOption::Filter(filter));
             }
-            https.end();
+            DEBUG_PRINTF("version.json: %d bytes, %ld B of heap kept after filtering\n", length, (long)freeHeap - (long)ESP.getFreeHeap());
+        } else if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+            DEBUG_PRINTLN("version.json not modified");
+        } else {
+            DEBUG_PRINTLN("Error Occurred During Version Check: ");
+            DEBUG_PRINTLN(httpCode);
         }
-        delete client;
+        otaHttps.end(); // Keeps the connection open for the next check unless the server closed it
+        otaStats.minFreeHeap = ESP.getMinFreeHeap();
+        DEBUG_PRINTF("OTA HTTPS: %lu requests, %lu handshakes (last %lu ms, max %lu ms), TLS heap %lu B, min free heap %lu B\n",
+                     (unsigned long)otaStats.requests, (unsigned long)otaStats.handshakes,
+                     (unsigned long)otaStats.lastHandshakeMs, (unsigned long)otaStats.maxHandshakeMs,
+                     (unsigned long)otaStats.tlsHeap, (unsigned long)otaStats.minFreeHeap);
     }
 
     if (httpCode == HTTP_CODE_OK) {
-        // Parse JSON payload
-        JsonDocument doc ;
-        DeserializationError error = deserializeJson(doc, payload);
         if (error) {
             DEBUG_PRINT("JSON deserialization failed: ");
             DEBUG_PRINTLN(error.f_str());
             return 0;
         }
 
-        String newVersion = doc["version"].as<String>();
-        newFirmwareURL = doc["bin_url"].as<String>();
-        newVersion.trim();
-        newFirmwareURL.trim();
-
-        if (newVersion.equals(FirmwareVer)) {
+        if (!readManifest(doc, channel, manifest)) {
+            // Only remember the validators once nothing is left to do, so a failed update is retried
+            otaPrefs.putString("etag", etag);
+            otaPrefs.putString("modified", lastModified);
             DEBUG_PRINTF("\nDevice is already on the latest firmware version: %s\n", FirmwareVer.c_str());
             return 0;
         } else {
-            DEBUG_PRINTLN(newVersion);
             DEBUG_PRINTLN("New Firmware Detected");
             return 1;
         }
@@ -472,6 +1280,142 @@ int FirmwareVersionCheck() {
     return 0;
 }
 
+// Take the download details from a manifest ({"version", "bin_url", "size", "sha256", "signature", "compression", "patch"}; version.json or
+// the retained OTA_MANIFEST_TOPIC message), see selectManifest(). Returns true, with manifest filled in, if it announces a newer
+// version than FirmwareVer.
+bool readManifest(JsonVariantConst root, const String& channel, Manifest& manifest) {
+    JsonVariantConst entry = selectManifest(root, channel);
+    String newVersion = entry["version"].as<String>();
+    newVersion.trim();
+    if (newVersion.length() == 0) {
+        return false;
+    }
+    if (SemVer::compare(newVersion.c_str(), FirmwareVer.c_str()) <= 0) {
+        if (!newVersion.equals(FirmwareVer)) {
+            DEBUG_PRINTF("Ignoring manifest version %s, not newer than %s\n", newVersion.c_str(), FirmwareVer.c_str());
+        }
+        return false;
+    }
+    manifest.url = entry["bin_url"].as<String>();
+    manifest.url.trim();
+    manifest.size = entry["size"] | 0;
+    manifest.sha256 = entry["sha256"] | "";
+    // A delta patch is only usable if it was built against the image running now
+    String patchFrom = entry["patch"]["from"] | "";
+    manifest.patchURL = patchFrom.equals(FirmwareVer) ? entry["patch"]["url"] | "" : "";
+    manifest.gzip = strcmp(entry["compression"] | "", "gzip") == 0;
+    manifest.signature = entry["signature"] | "";
+    DEBUG_PRINTF("Manifest version %s, %lu bytes, sha256 %s\n", newVersion.c_str(), (unsigned long)manifest.size,
+                 manifest.sha256.length() ? manifest.sha256.c_str() : "-");
+    return manifest.url.length() > 0;
+}
+
+// Manifests may list several boards and channels: {"esp32": {"stable": {...}, "beta": {...}}, "esp8266": ...}.
+// This board's entry for channel is used; a newer stable release wins over an older beta. Flat
+// manifests, at the top level or under the board name, still work.
+JsonVariantConst selectManifest(JsonVariantConst root, const String& channel) {
+    JsonVariantConst board = root[OTA_BOARD];
+    if (board.isNull()) {
+        board = root;
+    }
+    JsonVariantConst entry = board[channel.c_str()];
+    JsonVariantConst stable = board["stable"];
+    if (entry.isNull() || (!stable.isNull() && SemVer::compare(stable["version"] | "", entry["version"] | "") > 0)) {
+        entry = stable;
+    }
+    return entry.isNull() ? board : entry;
+}
+
+// Everything selectManifest() and readManifest() may read, so other boards and channels never reach the heap
+void buildManifestFilter(JsonDocument& filter, const String& channel) {
+    static const char* const fields[] = {"version", "bin_url", "size", "sha256", "signature", "compression", "patch"};
+    for (const char* field : fields) {
+        filter[field] = true;
+        filter[OTA_BOARD][field] = true;
+        filter[OTA_BOARD]["stable"][field] = true;
+        filter[OTA_BOARD][channel.c_str()][field] = true;
+    }
+}
+
+// The OTA client lives for the whole run, so the CA is loaded and the client configured once
+void initOtaClient() {
+    if (loadRootCACertificate(otaRootCA)) {
+        otaClient.setCACert(otaRootCA.c_str());
+    } else {
+        DEBUG_PRINTLN("Using built-in root CA");
+        otaClient.setCACert(rootCACertificate);  // Fallback to the built-in root CA
+    }
+    otaHttps.setReuse(true);
+}
+
+// Point otaHttps at url over the shared connection. A new TCP + TLS connection is only made when
+// the previous one was closed or went to another host; its cost is recorded in otaStats.
+bool otaBegin(const String& url) {
+    int hostStart = url.indexOf("://") + 3;
+    int hostEnd = url.indexOf('/', hostStart);
+    String host = url.substring(hostStart, hostEnd < 0 ? url.length() : hostEnd);
+    uint16_t port = 443;
+    int colon = host.indexOf(':');
+    if (colon >= 0) {
+        port = host.substring(colon + 1).toInt();
+        host = host.substring(0, colon);
+    }
+
+    otaStats.requests++;
+    if (otaClient.connected() && host != otaHost) {
+        otaClient.stop();
+    }
+    if (otaClient.connected()) {
+        DEBUG_PRINTLN("Reusing OTA connection to " + host);
+    } else {
+        uint32_t heapBefore = ESP.getFreeHeap();
+        unsigned long start = millis();
+        if (!otaClient.connect(host.c_str(), port)) {
+            DEBUG_PRINTLN("TLS connection to " + host + " failed");
+            return false;
+        }
+        otaStats.handshakes++;
+        otaStats.lastHandshakeMs = millis() - start;
+        if (otaStats.lastHandshakeMs > otaStats.maxHandshakeMs) {
+            otaStats.maxHandshakeMs = otaStats.lastHandshakeMs;
+        }
+        uint32_t heapAfter = ESP.getFreeHeap();
+        otaStats.tlsHeap = heapBefore > heapAfter ? heapBefore - heapAfter : 0;
+        otaHost = host;
+    }
+    // HTTPClient sees the client already connected and sends the request on it
+    return otaHttps.begin(otaClient, url);
+}
+
+// Change the version check interval at runtime and keep it across reboots
+void setCheckInterval(unsigned long ms) {
+    if (ms < OTA_MIN_CHECK_INTERVAL) {
+        ms = OTA_MIN_CHECK_INTERVAL;
+    }
+    interval = ms;
+    otaPrefs.putULong("interval", ms);
+    xEventGroupSetBits(otaEvents, OTA_EVT_RESCHEDULE);
+    DEBUG_PRINTF("Version check interval set to %lu ms\n", ms);
+}
+
+// A copy of otaChannel, taken once per manifest so the filter and the entry read agree
+String updateChannel() {
+    xSemaphoreTake(manifestMutex, portMAX_DELAY);
+    String channel = otaChannel;
+    xSemaphoreGive(manifestMutex);
+    return channel;
+}
+
+void setUpdateChannel(const char* channel) {
+    xSemaphoreTake(manifestMutex, portMAX_DELAY);
+    otaChannel = channel;
+    xSemaphoreGive(manifestMutex);
+    otaPrefs.putString("channel", channel);
+    otaPrefs.remove("etag"); // Same version.json, but another entry in it may now apply
+    otaPrefs.remove("modified");
+    DEBUG_PRINTF("Update channel set to %s\n", channel);
+}
+
 void saveRootCACertificate(const char* rootCA) {
     File file = LittleFS.open("/rootCA.pem", "w");
     if (!file) {
@@ -542,6 +1486,10 @@ void connectToWifi() {
 void connectToMqtt() {
   if (!mqttClient.connected()) {
     DEBUG_PRINTLN("Connecting to MQTT...");
+    if (SPARKPLUG_B_ENABLED) {
+      setSparkplugWill(); // NDEATH replaces the JSON last will
+    }
+    mqttClient.setKeepAlive(lowPowerMode ? POWER_KEEPALIVE : MQTT_KEEPALIVE);
     mqttClient.connect();
   }
 }
@@ -550,99 +1498,484 @@ void WiFiEvent(WiFiEvent_t event) {
   switch (event) {
     case ARDUINO_EVENT_WIFI_STA_GOT_IP:
       DEBUG_PRINTLN("WiFi connected");
+      if (wifiDownSinceUs) {
+        latency[LAT_WIFI_CONNECT].record((uint32_t)(esp_timer_get_time() - wifiDownSinceUs));
+        wifiDownSinceUs = 0;
+      }
       DEBUG_PRINT("IP address: ");
       DEBUG_PRINTLN(WiFi.localIP());
+      if (SPARKPLUG_B_ENABLED) {
+        configTime(0, 0, "pool.ntp.org"); // Sparkplug timestamps are UTC milliseconds
+      }
       connectToMqtt();  // Connect to MQTT after getting an IP
       break;
     case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
       DEBUG_PRINTLN("WiFi lost connection");
+      if (!wifiDownSinceUs) {
+        wifiDownSinceUs = esp_timer_get_time(); // Only the first of the events sent while reconnecting
+      }
       xTimerStop(mqttReconnectTimer, 0);
       xTimerStart(wifiReconnectTimer, 0); // Start Wi-Fi reconnect timer
       break;
   }
 }
 
-void onMqttConnect(bool sessionPresent) {
+void handleMqttConnect(int64_t eventUs) {
   DEBUG_PRINTLN("Connected to MQTT.");
+  if (mqttDownSinceUs) {
+    latency[LAT_MQTT_CONNECT].record((uint32_t)(eventUs - mqttDownSinceUs));
+    mqttDownSinceUs = 0;
+  }
   mqttClient.subscribe(SUBSCRIBE_TOPIC, 2); // Subscribe to the counter topic
-  // Publish birth messag
-  String birthMessage = "{\"status\":\"online\", \"deviceId\":\"" DEVICE_ACCESS_TOKEN "\", \"ip\":\"" + WiFi.localIP().toString() + "\"}";
-  mqttClient.publish(BIRTH_TOPIC, 2, true, birthMessage.c_str());
-  processBufferedData();
+  mqttClient.subscribe(OTA_MANIFEST_TOPIC, 1); // Retained manifest arrives right away, later ones as they are published
+  mqttClient.subscribe(ACTUATION_TOPIC, 1);   // Binary output commands; setting a level twice is harmless
+  xEventGroupSetBits(otaEvents, OTA_EVT_RESCHEDULE); // Back to the slow fallback poll
+  applyTaskTable();                                  // async_tcp exists from the first connect on
+  if (SPARKPLUG_B_ENABLED) {
+    mqttClient.subscribe(SPARKPLUG_TOPIC("NCMD"), 0);
+    publishSparkplugBirth();
+  } else {
+    // Publish birth messag
+    BirthPayload birthMessage;
+    birthMessage.add(BIRTH_PREFIX).addIp(WiFi.localIP()).add(BIRTH_SUFFIX);
+    mqttClient.publish(BIRTH_TOPIC, 2, true, birthMessage.c_str(), birthMessage.length());
+  }
+  if (lowPowerMode) {
+    startFlush(); // The radio is awake for the connect anyway
+  } else {
+    processBufferedData();
+  }
 }
 
-
-void onMqttDisconnect(AsyncMqttClientDisconnectReason reason) {
+void handleMqttDisconnect(int64_t eventUs) {
   DEBUG_PRINTLN("Disconnected from MQTT.");
+  if (!mqttDownSinceUs) {
+    mqttDownSinceUs = eventUs; // Failed reconnect attempts end up here too
+  }
+  xEventGroupSetBits(otaEvents, OTA_EVT_RESCHEDULE); // No manifests without MQTT: poll version.json at interval
+  // Unacked replay batches are resent after the next connect
+  if (xSemaphoreTake(bufferMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+    replayWindow.reset();
+    dataLog.rewind();
+    replayRecordsSent = replayRecordsAcked;
+    xSemaphoreGive(bufferMutex);
+  }
+  endFlush(); // Nothing to send until the next connect
   if (WiFi.isConnected()) {
     xTimerStart(mqttReconnectTimer, 0); // Start MQTT reconnect timer
   }
 }
 
+// Pack the records at the data log read cursor into one columnar block (see block_codec.h).
+// batchEnd is set just past the last record included; the read cursor is left there.
+size_t buildReplayBatch(uint8_t* payload, size_t capacity, LogCursor& batchEnd) {
+  uint8_t recordBuf[DataLog::MAX_RECORD_SIZE];
+  size_t recordLen;
+  blockEncoder.reset();
+  batchEnd = dataLog.readCursor();
+  while (dataLog.read(recordBuf, sizeof(recordBuf), recordLen)) {
+    if (recordLen == sizeof(SensorRecord)) {
+      SensorRecord record;
+      memcpy(&record, recordBuf, sizeof(record));
+      if (!blockEncoder.add(record.timestamp, record.counter)) {
+        break; // Block full, record goes out with the next batch
+      }
+    }
+    batchEnd = dataLog.readCursor();
+  }
+  dataLog.seekRead(batchEnd);
+  return blockEncoder.finish(payload, capacity);
+}
+
+// Replay the data log through a bounded in-flight window. Up to MAX_PROCESS_PER_CALL
+// batches are handed to the client per call; each is only committed when onMqttPublish()
+// sees its ack, so a dropped link simply rewinds to the last acked record.
 void processBufferedData() {
-  if (bufferedData.length() > 0) {
-    if (mqttClient.publish(BUFFERED_DATA_TOPIC, 2, true, bufferedData.c_str())) {
-      DEBUG_PRINTLN("Buffered data sent!");
-      bufferedData = ""; // Clear buffer after successful transmission
+  if (xSemaphoreTake(bufferMutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+    return;
+  }
+  spillRamBuffer();
+  dataLog.flush();
+
+  if (replayWindow.stalled(millis(), REPLAY_ACK_TIMEOUT)) {
+    DEBUG_PRINTLN("Buffered data ack timed out, resending");
+    replayWindow.reset();
+    dataLog.rewind();
+    replayRecordsSent = replayRecordsAcked;
+  }
+
+  uint8_t payload[BUFFERED_PAYLOAD_SIZE];
+  int sent = 0;
+  bool drained = false;
+  while (mqttClient.connected() && replayWindow.canSend() && sent < MAX_PROCESS_PER_CALL) {
+    LogCursor batchStart = dataLog.readCursor();
+    LogCursor batchEnd;
+    size_t used = buildReplayBatch(payload, sizeof(payload), batchEnd);
+    if (used == 0) {
+      drained = replayWindow.inFlight() == 0;
+      if (drained) {
+        dataLog.commit(batchEnd); // Only unreadable records were left
+      } else {
+        dataLog.seekRead(batchStart);
+      }
+      break;
+    }
+
+    uint16_t packetId = timedPublish(BUFFERED_DATA_TOPIC, 2, true, reinterpret_cast<const char*>(payload), used);
+    if (packetId) {
+      replayRecordsSent += blockEncoder.count();
+      replayWindow.onSent(packetId, ReplayMark{batchEnd, replayRecordsSent}, millis());
+      sent++;
     } else {
       DEBUG_PRINTLN("Failed to send buffered data!");
+      replayWindow.onSendFailed();
+      dataLog.seekRead(batchStart);
+      break;
     }
   }
+  xSemaphoreGive(bufferMutex);
+  if (drained) {
+    endFlush();
+  }
 }
 
-void publishSensorData(void* parameter) {
-  String sensorData = "Counter: " + String(counter);
+// Ack for a QoS 1/2 publish: release replayed records and keep the window full
+void handleMqttAck(uint16_t packetId, int64_t eventUs) {
+  uint32_t ackUs;
+  if (publishAcks.acked(packetId, (uint32_t)eventUs, ackUs)) {
+    latency[LAT_PUBLISH_ACK].record(ackUs);
+  }
+  bool replayAck = false;
+  uint32_t delivered = 0;
+  if (xSemaphoreTake(bufferMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+    ReplayMark commitTo;
+    if (replayWindow.onAck(packetId, millis(), commitTo)) {
+      dataLog.commit(commitTo.end);
+      delivered = commitTo.records - replayRecordsAcked;
+      replayRecordsAcked = commitTo.records;
+    }
+    replayAck = replayWindow.inFlight() < replayWindow.window();
+    xSemaphoreGive(bufferMutex);
+  }
+  recordDelivered(delivered);
+  if (replayAck) {
+    processBufferedData();
+  }
+}
 
-  // Check if Wi-Fi and MQTT are connected before sending data
-  if (WiFi.isConnected() && mqttClient.connected()) {
-    if (mqttClient.publish(COUNTER_TOPIC, 2, true, sensorData.c_str())) {
-      DEBUG_PRINTLN("Data published: " + sensorData);
+// Queue a reading in the RAM tier; spill it to flash once MAX_BUFFER_SIZE readings are waiting
+void bufferReading(uint32_t value) {
+  SensorRecord record = {(uint32_t)millis(), value};
+  bool stored = ramBuffer.push(record);
+  if (!stored || ramBuffer.full()) {
+    if (xSemaphoreTake(bufferMutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+      spillRamBuffer();
+      if (!stored && !dataLog.append(&record, sizeof(record))) {
+        DEBUG_PRINTLN("Failed to buffer data!");
+      }
+      xSemaphoreGive(bufferMutex);
+    } else if (!stored) {
+      DEBUG_PRINTLN("Failed to buffer data!");
+    }
+  }
+}
+
+// Move everything from the RAM tier into the data log. Caller holds bufferMutex.
+void spillRamBuffer() {
+  SensorRecord record;
+  while (ramBuffer.pop(record)) {
+    if (!dataLog.append(&record, sizeof(record))) {
+      DEBUG_PRINTLN("Failed to buffer data!");
+    }
+  }
+}
+
+// Write the pending batch so a planned restart does not lose readings
+void flushBufferedData() {
+  if (xSemaphoreTake(bufferMutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+    spillRamBuffer();
+    dataLog.flush();
+    dataLog.persistCursor();
+    xSemaphoreGive(bufferMutex);
+  }
+}
+
+// Logger task: one counter reading per counterTimer tick. The timer only wakes it, so publishing and the
+// data log's flash writes run on LOG_TASK_CORE instead of the timer service task.
+void loggerTask(void* parameter) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        publishSensorData(nullptr);
+    }
+}
+
+void publishSensorData(void* parameter) {
+  if (!shouldReport(REPORT_COUNTER, counter)) {
+    counter++; // Within the deadband: neither published nor buffered
+    return;
+  }
+  CounterPayload sensorData;
+  sensorData.add(COUNTER_PREFIX).addUint(counter);
+
+  // Low power holds every reading for the next flush; otherwise publish while Wi-Fi and MQTT are up
+  if (lowPowerMode) {
+    holdReading(counter); // Goes out with the next flush
+  } else if (WiFi.isConnected() && mqttClient.connected()) {
+    bool published = SPARKPLUG_B_ENABLED ? publishSparkplugData(counter)
+                                         : timedPublish(COUNTER_TOPIC, 2, true, sensorData.c_str(), sensorData.length());
+    if (published) {
+      DEBUG_PRINTF("Data published: %s\n", sensorData.c_str());
+      recordDelivered(1);
+      processBufferedData(); // Picks up any replay that stalled on a full send buffer
     } else {
       DEBUG_PRINTLN("Failed to publish data!");
-      bufferedData += sensorData + "\n"; // Buffer data if publish fails
+      bufferReading(counter); // Buffer data if publish fails
     }
   } else {
-    bufferedData += sensorData + "\n"; // Buffer data if no connection
+    bufferReading(counter); // Buffer data if no connection
     DEBUG_PRINTLN("Data buffered due to no connection");
   }
 
   counter++; // Increment the counter
 }
 
+// **MQTT callbacks** (AsyncTCP task): copy the event into mqttEvents and return
+
+// Queue an event unless fewer than reserve slots are free; counts it as dropped otherwise
+bool queueMqttEvent(const MqttEvent& event, UBaseType_t reserve) {
+  if (uxQueueSpacesAvailable(mqttEvents) <= reserve || xQueueSend(mqttEvents, &event, 0) != pdTRUE) {
+    mqttQueueStats.dropped++;
+    return false;
+  }
+  UBaseType_t depth = uxQueueMessagesWaiting(mqttEvents);
+  if (depth > mqttQueueStats.maxDepth) {
+    mqttQueueStats.maxDepth = depth;
+  }
+  return true;
+}
+
+void onMqttConnect(bool sessionPresent) {
+  MqttEvent event = {MqttEvent::CONNECTED, 0, 0, esp_timer_get_time()};
+  queueMqttEvent(event, 0);
+}
+
+void onMqttDisconnect(AsyncMqttClientDisconnectReason reason) {
+  MqttEvent event = {MqttEvent::DISCONNECTED, 0, 0, esp_timer_get_time()};
+  queueMqttEvent(event, 0);
+}
+
+void onMqttPublish(uint16_t packetId) {
+  MqttEvent event = {MqttEvent::ACKED, packetId, 0, esp_timer_get_time()};
+  queueMqttEvent(event, 0);
+}
+
+// Called per TCP segment; a message is queued once all of its pieces are in (see message_pool.h).
+// Small payloads travel inside the queue item, larger ones in a pool buffer that mqttTask() releases.
+// Messages only take the queue while MQTT_QUEUE_RESERVE slots stay free for acks and connection events.
 void onMqttMessage(char* topic, char* payload, AsyncMqttClientMessageProperties properties, size_t len, size_t index, size_t total) {
-    DEBUG_PRINTLN("Message received on topic: " + String(topic));
-    
-    // Create a null-terminated string from the payload
-    char* message = new char[len + 1];
-    memcpy(message, payload, len);
-    message[len] = '\0';
-    
-    // Create JSON document
+    LatencyScope timing(latency[LAT_MQTT_MESSAGE]);
+    if (index == 0) {
+        mqttMessageArrivalUs = esp_timer_get_time();
+    }
+    MessageAssembler<MqttMessagePool>::Status status = mqttAssembler.add(payload, len, index, total);
+    if (status == MessageAssembler<MqttMessagePool>::DROPPED && index == 0) {
+        mqttQueueStats.rejected++;
+    }
+    if (status != MessageAssembler<MqttMessagePool>::COMPLETE) {
+        return;
+    }
+
+    MqttEvent event = {MqttEvent::MESSAGE, 0, (uint16_t)mqttAssembler.length(), mqttMessageArrivalUs,
+                       topicRouter.find(topic), nullptr};
+    if (event.length <= sizeof(event.inlinePayload)) {
+        memcpy(event.inlinePayload, mqttAssembler.message(), event.length);
+    } else {
+        event.buffer = mqttAssembler.take();
+        if (!event.buffer && (event.buffer = mqttMessagePool.acquire())) {
+            memcpy(event.buffer, mqttAssembler.message(), event.length);
+        }
+    }
+    mqttAssembler.release();
+    if (!event.route) {
+        mqttMessagePool.release(event.buffer); // Nothing subscribed to it is handled here
+    } else if (event.length > sizeof(event.inlinePayload) && !event.buffer) {
+        mqttQueueStats.rejected++;
+    } else if (!queueMqttEvent(event, MQTT_QUEUE_RESERVE)) {
+        mqttMessagePool.release(event.buffer);
+    }
+}
+
+// **MQTT worker**: everything the callbacks used to do, in the order the events arrived
+void mqttTask(void* parameter) {
+    for (;;) {
+        handleNextMqttEvent(portMAX_DELAY);
+    }
+}
+
+// Handle one event from mqttEvents; false if none arrived within wait
+bool handleNextMqttEvent(TickType_t wait) {
+    MqttEvent event;
+    if (xQueueReceive(mqttEvents, &event, wait) != pdTRUE) {
+        return false;
+    }
+    latency[LAT_MQTT_QUEUE].record((uint32_t)(esp_timer_get_time() - event.us));
+    switch (event.type) {
+        case MqttEvent::CONNECTED:
+            handleMqttConnect(event.us);
+            break;
+        case MqttEvent::DISCONNECTED:
+            handleMqttDisconnect(event.us);
+            break;
+        case MqttEvent::ACKED:
+            handleMqttAck(event.packetId, event.us);
+            break;
+        case MqttEvent::MESSAGE:
+            mqttMessageStartUs = event.us;
+            handleMqttMessage(event.route->key, event.route->handler, event.buffer ? event.buffer : event.inlinePayload,
+                              event.length);
+            mqttMessagePool.release(event.buffer);
+            break;
+    }
+    return true;
+}
+
+// A whole message; payload is not null-terminated
+void handleMqttMessage(const char* topic, TopicHandler handler, const char* payload, size_t len) {
+    handler(payload, len);
+    DEBUG_PRINTF("Message received on topic: %s\n", topic);
+}
+
+// JSON commands on SUBSCRIBE_TOPIC; every key of the object is one command (see commandRoutes)
+void handleCommandMessage(const char* payload, size_t len) {
+    // Create JSON document, parsed straight from the payload
     JsonDocument doc;  
-    DeserializationError error = deserializeJson(doc, message);
+    DeserializationError error = deserializeJson(doc, payload, len);
     
     // Check if parsing succeeded
     if (error) {
         DEBUG_PRINT("JSON parsing failed: ");
         DEBUG_PRINTLN(error.c_str());
-    } else {
-        // Assuming JSON format like {"state": "0"} or {"state": "1"}
-        const char* state = doc["state"];
-        
-        if (String(state) == "0") {
-            DEBUG_PRINTLN("off");
-        } 
-        else if (String(state) == "1") {
-            DEBUG_PRINTLN("on");
-        }
-        else {
-            DEBUG_PRINTLN("Unknown state: " + String(state));
+        return;
+    }
+    for (JsonPairConst command : doc.as<JsonObjectConst>()) {
+        const router::Route<CommandHandler>* route = commandRouter.find(command.key().c_str(), command.key().size());
+        if (route) {
+            route->handler(command.value());
+        } else {
+            DEBUG_PRINTF("Unknown command: %s\n", command.key().c_str());
         }
     }
-    
-    // Free the allocated memory
-    delete[] message;
 }
+
+// Retained manifest on OTA_MANIFEST_TOPIC; the update itself runs in otaTask(), on a copy taken under manifestMutex
+void handleManifestMessage(const char* payload, size_t len) {
+    JsonDocument doc;
+    JsonDocument filter;
+    String channel = updateChannel();
+    buildManifestFilter(filter, channel);
+    Manifest manifest;
+    if (!deserializeJson(doc, payload, len, DeserializationOption::Filter(filter))
+        && readManifest(doc.as<JsonVariantConst>(), channel, manifest)) {
+        xSemaphoreTake(manifestMutex, portMAX_DELAY);
+        announcedManifest = manifest;
+        xSemaphoreGive(manifestMutex);
+        xEventGroupSetBits(otaEvents, OTA_EVT_MANIFEST);
+    }
+}
+
+// Fast path on ACTUATION_TOPIC: exactly two bytes, {output index, level 0/1}, no JSON
+void handleActuation(const char* payload, size_t len) {
+    const uint8_t* command = reinterpret_cast<const uint8_t*>(payload);
+    if (len != 2 || command[0] >= sizeof(outputPins) || command[1] > 1) {
+        DEBUG_PRINTLN("Malformed actuation command");
+        return;
+    }
+    setOutput(command[0], command[1]);
+}
+
+void handleSparkplugCommand(const char* payload, size_t len) {
+    if (SPARKPLUG_B_ENABLED
+        && sparkplug::commandIsSet(reinterpret_cast<const uint8_t*>(payload), len, "Node Control/Rebirth", ALIAS_REBIRTH)) {
+        DEBUG_PRINTLN("Rebirth requested");
+        publishSparkplugBirth();
+    }
+}
+
+void setStateCommand(const char* state) {
+    if (strcmp(state, "0") == 0) {
+        setOutput(0, false);
+        DEBUG_PRINTLN("off");
+    } else if (strcmp(state, "1") == 0) {
+        setOutput(0, true);
+        DEBUG_PRINTLN("on");
+    } else {
+        DEBUG_PRINTF("Unknown state: %s\n", state);
+    }
+}
+
+void setOutput(uint8_t output, bool on) {
+    digitalWrite(outputPins[output], on ? HIGH : LOW);
+    latency[LAT_ACTUATION].record((uint32_t)(esp_timer_get_time() - mqttMessageStartUs));
+}
+
+// **Sparkplug B**
+// Milliseconds since the Unix epoch (SNTP is started on WiFi connect); falls back to uptime before sync.
+uint64_t epochMillis() {
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+// NDEATH must be registered as the will before every connect, carrying the bdSeq the next NBIRTH will repeat
+void setSparkplugWill() {
+  sparkplugBdSeq++;
+  sparkplug::PayloadWriter death(sparkplugDeath, sizeof(sparkplugDeath));
+  death.timestamp(epochMillis());
+  death.metricUInt("bdSeq", -1, epochMillis(), sparkplug::DataType::UInt64, sparkplugBdSeq);
+  mqttClient.setWill(SPARKPLUG_TOPIC("NDEATH"), 1, false, reinterpret_cast<const char*>(sparkplugDeath), death.size());
+}
+
+// NBIRTH defines every metric by name and alias once; NDATA then only sends aliases
+void publishSparkplugBirth() {
+  uint8_t buffer[SPARKPLUG_MAX_PAYLOAD];
+  uint64_t now = epochMillis();
+  payload::Payload<payload::IPV4_CHARS + 1> ip;
+  ip.addIp(WiFi.localIP());
+
+  sparkplug::PayloadWriter birth(buffer, sizeof(buffer));
+  birth.timestamp(now);
+  birth.metricUInt("bdSeq", -1, now, sparkplug::DataType::UInt64, sparkplugBdSeq);
+  birth.metricBool("Node Control/Rebirth", ALIAS_REBIRTH, now, false);
+  birth.metricUInt("Counter", ALIAS_COUNTER, now, sparkplug::DataType::UInt32, counter);
+  birth.metricString("Properties/Firmware Version", ALIAS_FW_VERSION, now, FirmwareVer.c_str());
+  birth.metricString("Properties/IP", ALIAS_IP, now, ip.c_str());
+  sparkplugSeq = 0;
+  birth.seq(sparkplugSeq);
+  if (birth.ok()) {
+    mqttClient.publish(SPARKPLUG_TOPIC("NBIRTH"), 0, false, reinterpret_cast<const char*>(buffer), birth.size());
+  } else {
+    DEBUG_PRINTLN("NBIRTH does not fit SPARKPLUG_MAX_PAYLOAD");
+  }
+}
+
+bool publishSparkplugData(uint32_t value) {
+  uint8_t buffer[32];
+  uint64_t now = epochMillis();
+  sparkplug::PayloadWriter data(buffer, sizeof(buffer));
+  data.timestamp(now);
+  data.metricUInt(nullptr, ALIAS_COUNTER, now, sparkplug::DataType::UInt32, value);
+  data.seq(++sparkplugSeq);
+  return timedPublish(SPARKPLUG_TOPIC("NDATA"), 0, false, reinterpret_cast<const char*>(buffer), data.size()) != 0;
+}
+
+// Wake loop() from an ISR and note when, for the button-to-action latency
+static void IRAM_ATTR raiseButtonEvent(EventBits_t bits) {
+    BaseType_t woken = pdFALSE;
+    buttonEventUs = esp_timer_get_time();
+    xEventGroupSetBitsFromISR(systemEvents, bits, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
 // **Interrupt Service Routine (ISR) for button**
 void IRAM_ATTR buttonISR() {
     static unsigned long lastInterruptTime = 0;
@@ -663,7 +1996,7 @@ void IRAM_ATTR buttonISR() {
         } else if (pressCount == 1) {
             // Double press detected within time window
             if (currentTime - lastPressTime <= DOUBLE_PRESS_WINDOW) {
-                hardResetFlag = true; // Set flag instead of direct function call
+                raiseButtonEvent(EVT_HARD_RESET); // Handled in loop(), not in the ISR
                 pressCount = 0;
                 return;
             }
@@ -671,7 +2004,7 @@ void IRAM_ATTR buttonISR() {
         pressCount++;
     } else { // Button released
         if (currentTime - pressStartTime >= SOFT_RESET_TIME) {
-            softResetFlag = true; // Set flag instead of direct function call
+            raiseButtonEvent(EVT_SOFT_RESET); // Handled in loop(), not in the ISR
             pressCount = 0;
             return;
         }
@@ -687,9 +2020,424 @@ void IRAM_ATTR buttonISR() {
 }
 
 
+// **ISR for the rollback pin**
+void IRAM_ATTR rollbackISR() {
+    raiseButtonEvent(EVT_ROLLBACK);
+}
+
+// **CPU statistics**
+// Tick hook on each core: counts the ticks that interrupted the idle task, a sampling estimate of idle time
+void IRAM_ATTR sampleIdleTick() {
+    BaseType_t core = xPortGetCoreID();
+    sampledTicks[core]++;
+    if (xTaskGetCurrentTaskHandle() == xTaskGetIdleTaskHandleForCPU(core)) {
+        idleTicks[core]++;
+    }
+}
+
+// Idle share of a core in 0.1 % since the caller's previous call; each caller keeps its own marks
+struct IdleMark {
+    uint32_t sampled;
+    uint32_t idle;
+};
+uint32_t takeIdlePermille(IdleMark& mark, int core) {
+    uint32_t sampled = sampledTicks[core] - mark.sampled;
+    uint32_t idle = idleTicks[core] - mark.idle;
+    mark.sampled += sampled;
+    mark.idle += idle;
+    return sampled ? idle * 1000 / sampled : 0;
+}
+
+// Idle share of each core since the previous report, then where every task runs
+void reportCpuStats() {
+    static IdleMark marks[portNUM_PROCESSORS];
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t idle = takeIdlePermille(marks[core], core);
+        DEBUG_PRINTF("Core %d idle: %lu.%lu%%\n", core, (unsigned long)(idle / 10), (unsigned long)(idle % 10));
+    }
+    reportTaskStats();
+}
+
+// **Task table**
+void startTask(uint8_t id, TaskFunction_t function) {
+    const TaskSpec& spec = taskTable[id];
+    if (xTaskCreatePinnedToCore(function, spec.name, spec.stack, nullptr, spec.priority, &taskHandles[id], spec.core)
+        != pdPASS) {
+        taskHandles[id] = nullptr;
+        DEBUG_PRINTF("Failed to start task %s\n", spec.name);
+    }
+}
+
+// Finds the external tasks that exist by now and gives them their table priority. Their core is a build
+// setting, so a task running elsewhere is only reported.
+void applyTaskTable() {
+    for (int id = 0; id < TASK_COUNT; id++) {
+        const TaskSpec& spec = taskTable[id];
+        if (!spec.external || taskHandles[id]) {
+            continue;
+        }
+        TaskHandle_t handle = xTaskGetHandle(spec.name);
+        if (!handle) {
+            continue;
+        }
+        vTaskPrioritySet(handle, spec.priority);
+        BaseType_t core = xTaskGetAffinity(handle);
+        if (core != spec.core) {
+            DEBUG_PRINTF("Task %s runs on core %d, the task table says %d\n", spec.name, (int)core, (int)spec.core);
+        }
+        taskHandles[id] = handle;
+    }
+}
+
+// Stack high-water mark of every running task: bytes never used since it started
+void reportTaskStats() {
+    for (int id = 0; id < TASK_COUNT; id++) {
+        if (taskHandles[id]) {
+            DEBUG_PRINTF("Task %-9s core %d prio %2lu stack %5lu of %5lu bytes free\n", taskTable[id].name,
+                         (int)xTaskGetAffinity(taskHandles[id]), (unsigned long)uxTaskPriorityGet(taskHandles[id]),
+                         (unsigned long)uxTaskGetStackHighWaterMark(taskHandles[id]),
+                         (unsigned long)taskTable[id].stack);
+        }
+    }
+}
+
+// **Report by exception**
+// Each metric's samples go through its ReportFilter; only reported values are published or buffered
+
+// Policies saved by setReportPolicies(), config.h defaults for the rest
+void loadReportPolicies() {
+    reportPrefs.begin("report", false);
+    for (int i = 0; i < REPORT_COUNT; i++) {
+        ReportPolicy policy = {REPORT_DEADBAND, REPORT_DEADBAND_PCT, REPORT_MIN_INTERVAL, REPORT_HEARTBEAT};
+        if (reportPrefs.getBytesLength(reportNames[i]) == sizeof(policy)) {
+            reportPrefs.getBytes(reportNames[i], &policy, sizeof(policy));
+        }
+        reportFilters[i].setPolicy(policy);
+    }
+}
+
+bool shouldReport(uint8_t metric, double value) {
+    portENTER_CRITICAL(&reportLock);
+    bool report = reportFilters[metric].offer(value, millis()) != ReportFilter::SUPPRESS;
+    portEXIT_CRITICAL(&reportLock);
+    return report;
+}
+
+// {"report": {"counter": {"deadband": 5, "deadband_pct": 1.5, "min_interval": 10000, "heartbeat": 300000}}}
+// Fields left out keep their current value; the next sample of a changed metric is always reported.
+void setReportPolicies(JsonObjectConst metrics) {
+    for (JsonPairConst metric : metrics) {
+        int i = 0;
+        while (i < REPORT_COUNT && strcmp(reportNames[i], metric.key().c_str()) != 0) {
+            i++;
+        }
+        if (i == REPORT_COUNT) {
+            DEBUG_PRINTF("Unknown report metric: %s\n", metric.key().c_str());
+            continue;
+        }
+        JsonVariantConst settings = metric.value();
+        ReportPolicy policy = reportFilters[i].policy();
+        policy.deadband = settings["deadband"] | policy.deadband;
+        policy.deadbandPct = settings["deadband_pct"] | policy.deadbandPct;
+        policy.minIntervalMs = settings["min_interval"] | policy.minIntervalMs;
+        policy.maxSilenceMs = settings["heartbeat"] | policy.maxSilenceMs;
+        if (policy.deadband < 0 || policy.deadbandPct < 0) {
+            DEBUG_PRINTF("Negative deadband for %s ignored\n", reportNames[i]);
+            continue;
+        }
+        portENTER_CRITICAL(&reportLock);
+        reportFilters[i].setPolicy(policy);
+        portEXIT_CRITICAL(&reportLock);
+        reportPrefs.putBytes(reportNames[i], &policy, sizeof(policy));
+        DEBUG_PRINTF("Report policy for %s: deadband %.3f, %.2f%%, min interval %lu ms, heartbeat %lu ms\n",
+                     reportNames[i], policy.deadband, policy.deadbandPct, (unsigned long)policy.minIntervalMs,
+                     (unsigned long)policy.maxSilenceMs);
+    }
+}
+
+// **Sampling**
+// samplingTask() reads every source at SAMPLE_RATE_HZ into its SampleWindow and closes the windows every
+// SAMPLE_WINDOW ms; loop() takes the closed windows and publishes them. Neither waits for the other.
+
+void samplingTask(void* parameter) {
+    int64_t windowEndUs = esp_timer_get_time() + SAMPLE_WINDOW * 1000LL;
+    for (;;) {
+        uint32_t periods = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        latency[LAT_SAMPLE_WAKE].record((uint32_t)esp_timer_get_time() - sampleDueUs);
+        if (periods > 1) {
+            sampleOverruns += periods - 1;
+        }
+        float value;
+        for (size_t i = 0; i < SAMPLE_SOURCES; i++) {
+            if (sampleSources[i].read(value)) {
+                sampleWindows[i].add(value);
+            }
+        }
+        if (esp_timer_get_time() >= windowEndUs) {
+            windowEndUs += SAMPLE_WINDOW * 1000LL;
+            for (size_t i = 0; i < SAMPLE_SOURCES; i++) {
+                sampleWindows[i].close(millis());
+            }
+            xEventGroupSetBits(systemEvents, EVT_WINDOW);
+        }
+    }
+}
+
+// {"source":"sim","end":123456,"n":1000,"min":40.1,"max":59.8,"mean":50.02,"std":7.07}
+// end is millis() when the window closed. Windows are reported by exception on their mean and are not
+// buffered while offline: the counter readings cover store-and-forward. In low-power mode only the newest
+// window goes out with each flush; the ones in between count as missed.
+void publishSampleWindows() {
+    if (lowPowerMode && !radioFlushing) {
+        return;
+    }
+    for (size_t i = 0; i < SAMPLE_SOURCES; i++) {
+        WindowStats window;
+        if (!sampleWindows[i].take(window) || !window.count || !shouldReport(sampleSources[i].metric, window.mean)
+            || !mqttClient.connected()) {
+            continue;
+        }
+        char payload[192];
+        int used = snprintf(payload, sizeof(payload),
+                            "{\"source\":\"%s\",\"end\":%lu,\"n\":%lu,\"min\":%g,\"max\":%g,\"mean\":%g,\"std\":%g}",
+                            sampleSources[i].name, (unsigned long)window.endMs, (unsigned long)window.count,
+                            window.min, window.max, window.mean, window.stddev);
+        if (used > 0 && used < (int)sizeof(payload)) {
+            timedPublish(SAMPLES_TOPIC, 1, false, payload, used);
+        }
+    }
+}
+
+// Stand-in for a process input, also what the native build samples: a slow 0.05 Hz swing of +-10 around
+// 50 with up to +-0.5 of noise
+bool readSimulatedSource(float& value) {
+    static uint32_t noise = 0x2545F491;
+    noise ^= noise << 13;          // xorshift32
+    noise ^= noise >> 17;
+    noise ^= noise << 5;
+    float t = (esp_timer_get_time() % 20000000LL) / 20000000.0f;
+    value = 50.0f + 10.0f * sinf(2 * (float)M_PI * t) + ((noise & 0xFFFF) / 65536.0f - 0.5f);
+    return true;
+}
+
+// **Power management**
+// Low-power mode buffers every reading and wakes the radio per flushSchedule; between flushes WiFi is in
+// maximum modem sleep and, if esp_pm allows it (CONFIG_PM_ENABLE), the CPU light-sleeps whenever idle.
+
+// Settings saved by setPowerSettings(), config.h defaults for the rest
+void loadPowerSettings() {
+    powerPrefs.begin("power", false);
+    lowPowerMode = powerPrefs.getBool("low", POWER_LOW_DEFAULT);
+    flushSchedule.configure(powerPrefs.getULong("interval", POWER_FLUSH_INTERVAL),
+                            powerPrefs.getULong("batch", POWER_FLUSH_READINGS));
+}
+
+// Where the radio rests between flushes in the current mode
+RadioState idleRadioState() {
+    return lowPowerMode && lightSleepAvailable ? RADIO_LIGHT_SLEEP : RADIO_MODEM_SLEEP;
+}
+
+void setRadioState(RadioState state) {
+    portENTER_CRITICAL(&powerLock);
+    energyMeter.setState(state, esp_timer_get_time());
+    portEXIT_CRITICAL(&powerLock);
+    WiFi.setSleep(state == RADIO_ACTIVE ? WIFI_PS_NONE : lowPowerMode ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+}
+
+// CPU clock, light sleep, radio power save and sample rate for lowPowerMode. The MQTT keep-alive
+// follows on the next connect (connectToMqtt()).
+void applyPowerMode() {
+    static const int maxMhz = ESP.getCpuFreqMHz(); // First call is at boot, before any frequency scaling
+    esp_pm_config_esp32_t pm = {maxMhz, lowPowerMode ? POWER_MIN_CPU_MHZ : maxMhz, (bool)lowPowerMode};
+    esp_err_t err = esp_pm_configure(&pm);
+    lightSleepAvailable = lowPowerMode && err == ESP_OK;
+    if (lowPowerMode && err != ESP_OK) {
+        DEBUG_PRINTF("No light sleep (%s): the radio uses modem sleep only\n", esp_err_to_name(err));
+    }
+    radioFlushing = false;
+    setRadioState(idleRadioState());
+    esp_timer_stop(sampleTimer);
+    esp_timer_start_periodic(sampleTimer, 1000000 / (lowPowerMode ? POWER_SAMPLE_RATE_HZ : SAMPLE_RATE_HZ));
+    DEBUG_PRINTF("Power mode: %s\n", lowPowerMode ? "low" : "normal");
+}
+
+// Logger task, low power: buffer the reading and wake the radio once the schedule says so
+void holdReading(uint32_t value) {
+    bufferReading(value);
+    portENTER_CRITICAL(&powerLock);
+    flushSchedule.held(millis());
+    bool due = flushSchedule.due(millis());
+    portEXIT_CRITICAL(&powerLock);
+    if (due && !radioFlushing && mqttClient.connected()) {
+        startFlush(); // Otherwise the connect flushes, or the next reading tries again
+    }
+}
+
+// Radio awake until processBufferedData() finds the backlog drained. The newest window statistics and
+// the metrics snapshot go out in the same wake-up.
+void startFlush() {
+    portENTER_CRITICAL(&powerLock);
+    flushSchedule.flushed(millis());
+    energyMeter.flushed();
+    portEXIT_CRITICAL(&powerLock);
+    radioFlushing = true;
+    setRadioState(RADIO_ACTIVE);
+    xEventGroupSetBits(systemEvents, EVT_WINDOW | EVT_METRICS);
+    processBufferedData();
+}
+
+// Backlog drained or link lost: back to sleep until the next flush
+void endFlush() {
+    if (radioFlushing) {
+        radioFlushing = false;
+        setRadioState(idleRadioState());
+    }
+}
+
+// Readings published directly, or acked as part of a replayed batch
+void recordDelivered(uint32_t readings) {
+    if (readings) {
+        portENTER_CRITICAL(&powerLock);
+        energyMeter.delivered(readings);
+        portEXIT_CRITICAL(&powerLock);
+    }
+}
+
+// {"power": {"mode": "low", "interval": 300000, "batch": 60}}: mode is "low" or "normal"; interval and
+// batch are the low-power flush triggers. Fields left out keep their value. A mode change reconnects
+// MQTT with the mode's keep-alive; the disconnect is a clean one, so the broker does not send the will.
+void setPowerSettings(JsonObjectConst settings) {
+    const char* mode = settings["mode"] | (lowPowerMode ? "low" : "normal");
+    uint32_t interval = settings["interval"] | flushSchedule.intervalMs();
+    uint32_t batch = settings["batch"] | flushSchedule.batchReadings();
+    bool low = strcmp(mode, "low") == 0;
+    if ((!low && strcmp(mode, "normal") != 0) || batch == 0) {
+        DEBUG_PRINTF("Invalid power settings: mode %s, batch %lu\n", mode, (unsigned long)batch);
+        return;
+    }
+    portENTER_CRITICAL(&powerLock);
+    flushSchedule.configure(interval, batch);
+    portEXIT_CRITICAL(&powerLock);
+    powerPrefs.putBool("low", low);
+    powerPrefs.putULong("interval", interval);
+    powerPrefs.putULong("batch", batch);
+    DEBUG_PRINTF("Low-power flush every %lu ms or %lu readings\n", (unsigned long)interval, (unsigned long)batch);
+    if (low != lowPowerMode) {
+        lowPowerMode = low;
+        applyPowerMode();
+        if (mqttClient.connected()) {
+            mqttClient.disconnect();
+        }
+    }
+}
+
+// **Latency metrics**
+// mqttClient.publish() with the call timed and, for QoS 1/2, the send time kept for onMqttPublish()
+uint16_t timedPublish(const char* topic, uint8_t qos, bool retain, const char* payload, size_t length) {
+    int64_t start = esp_timer_get_time();
+    uint16_t packetId = mqttClient.publish(topic, qos, retain, payload, length);
+    int64_t end = esp_timer_get_time();
+    latency[LAT_PUBLISH].record((uint32_t)(end - start));
+    if (packetId && qos > 0) {
+        publishAcks.sent(packetId, (uint32_t)start);
+    }
+    return packetId;
+}
+
+// One JSON line per interval, all times in microseconds:
+// {"fw":"1.0.1","uptime":600,"us":{"publish":[count,p50,p90,p99,max],...},
+//  "queue":{"depth":0,"max":3,"dropped":0,"rejected":0},"report":{"counter":[sent,heartbeats,suppressed],...},
+//  "sampling":{"overruns":0,"missed":0},"idle":[97.5,41.2],"tasks":{"mqtt":[0,2,5120],...},
+//  "power":{"mode":"low","light_sleep":true,"ms":[active,modem,light],"flushes":1,"readings":60,"mj":2310.5,
+//  "mj_per_reading":38.51}}
+// queue is mqttEvents: events waiting now, most waiting at once since boot, and messages lost to a full
+// queue or refused as too large / without a pool buffer (also counted since boot).
+// report counts the samples of each metric reported as changed, sent as heartbeats and suppressed.
+// sampling counts sample periods the sampling task woke too late for and windows loop() never took (since boot).
+// idle is each core's idle percentage since the previous snapshot; tasks gives every running task of the
+// task table as [core, priority, stack bytes never used].
+// power is the energy estimate of power_schedule.h over the interval: ms per radio state, radio wake-ups
+// for a flush, readings delivered (published, or acked in a replayed batch), and energy in total and per
+// delivered reading.
+// Nothing is taken while MQTT is down, so an offline stretch shows up in the next snapshot.
+void publishLatencyMetrics() {
+    if (!mqttClient.connected() || (lowPowerMode && !radioFlushing)) {
+        return; // In low-power mode the snapshot waits for the next flush
+    }
+    char payload[METRICS_PAYLOAD_SIZE];
+    int used = snprintf(payload, sizeof(payload), "{\"fw\":\"%s\",\"uptime\":%lu,\"us\":{",
+                        FirmwareVer.c_str(), (unsigned long)(millis() / 1000));
+    for (int i = 0; i < LAT_COUNT && used > 0 && used < (int)sizeof(payload); i++) {
+        LatencyHistogram::Summary s = latency[i].take();
+        used += snprintf(payload + used, sizeof(payload) - used, "%s\"%s\":[%lu,%lu,%lu,%lu,%lu]", i ? "," : "",
+                         latencyNames[i], (unsigned long)s.count, (unsigned long)s.p50, (unsigned long)s.p90,
+                         (unsigned long)s.p99, (unsigned long)s.max);
+    }
+    if (used > 0 && used < (int)sizeof(payload)) {
+        used += snprintf(payload + used, sizeof(payload) - used,
+                         "},\"queue\":{\"depth\":%lu,\"max\":%lu,\"dropped\":%lu,\"rejected\":%lu},\"report\":{",
+                         (unsigned long)uxQueueMessagesWaiting(mqttEvents), (unsigned long)mqttQueueStats.maxDepth,
+                         (unsigned long)mqttQueueStats.dropped, (unsigned long)mqttQueueStats.rejected);
+    }
+    for (int i = 0; i < REPORT_COUNT && used > 0 && used < (int)sizeof(payload); i++) {
+        ReportFilter::Stats r = reportFilters[i].takeStats();
+        used += snprintf(payload + used, sizeof(payload) - used, "%s\"%s\":[%lu,%lu,%lu]", i ? "," : "",
+                         reportNames[i], (unsigned long)r.sent, (unsigned long)r.heartbeats,
+                         (unsigned long)r.suppressed);
+    }
+    uint32_t missedWindows = 0;
+    for (size_t i = 0; i < SAMPLE_SOURCES; i++) {
+        missedWindows += sampleWindows[i].missed();
+    }
+    if (used > 0 && used < (int)sizeof(payload)) {
+        used += snprintf(payload + used, sizeof(payload) - used, "},\"sampling\":{\"overruns\":%lu,\"missed\":%lu},\"idle\":[",
+                         (unsigned long)sampleOverruns, (unsigned long)missedWindows);
+    }
+    static IdleMark marks[portNUM_PROCESSORS];
+    for (int core = 0; core < portNUM_PROCESSORS && used > 0 && used < (int)sizeof(payload); core++) {
+        uint32_t idle = takeIdlePermille(marks[core], core);
+        used += snprintf(payload + used, sizeof(payload) - used, "%s%lu.%lu", core ? "," : "",
+                         (unsigned long)(idle / 10), (unsigned long)(idle % 10));
+    }
+    if (used > 0 && used < (int)sizeof(payload)) {
+        used += snprintf(payload + used, sizeof(payload) - used, "],\"tasks\":{");
+    }
+    bool first = true;
+    for (int id = 0; id < TASK_COUNT && used > 0 && used < (int)sizeof(payload); id++) {
+        if (taskHandles[id]) {
+            used += snprintf(payload + used, sizeof(payload) - used, "%s\"%s\":[%d,%lu,%lu]", first ? "" : ",",
+                             taskTable[id].name, (int)xTaskGetAffinity(taskHandles[id]),
+                             (unsigned long)uxTaskPriorityGet(taskHandles[id]),
+                             (unsigned long)uxTaskGetStackHighWaterMark(taskHandles[id]));
+            first = false;
+        }
+    }
+    if (used > 0 && used < (int)sizeof(payload)) {
+        used += snprintf(payload + used, sizeof(payload) - used, "},");
+    }
+    portENTER_CRITICAL(&powerLock);
+    EnergyMeter::Snapshot energy = energyMeter.take(esp_timer_get_time());
+    portEXIT_CRITICAL(&powerLock);
+    if (used > 0 && used < (int)sizeof(payload)) {
+        used += snprintf(payload + used, sizeof(payload) - used,
+                         "\"power\":{\"mode\":\"%s\",\"light_sleep\":%s,\"ms\":[%lu,%lu,%lu],\"flushes\":%lu,"
+                         "\"readings\":%lu,\"mj\":%.1f,\"mj_per_reading\":%.2f}}",
+                         lowPowerMode ? "low" : "normal", lightSleepAvailable ? "true" : "false",
+                         (unsigned long)energy.stateMs[RADIO_ACTIVE], (unsigned long)energy.stateMs[RADIO_MODEM_SLEEP],
+                         (unsigned long)energy.stateMs[RADIO_LIGHT_SLEEP], (unsigned long)energy.flushes,
+                         (unsigned long)energy.readings, energy.energyMj, energy.mjPerReading);
+    }
+    if (used <= 0 || used >= (int)sizeof(payload)) {
+        DEBUG_PRINTLN("Latency metrics do not fit METRICS_PAYLOAD_SIZE");
+        return;
+    }
+    mqttClient.publish(METRICS_TOPIC, 0, false, payload, used);
+}
+
 // **Soft Reset: Erase WiFi credentials**
 void handleSoftReset() {
     DEBUG_PRINTLN("Performing Soft Reset...");
+    flushBufferedData();
     delay(100);
 
     if (LittleFS.remove("/wifi_credentials.txt")) {
@@ -736,3 +2484,159 @@ void handleHardReset() {
     esp_deep_sleep_start();  // Initiate deep sleep to shut down everything
 }
 
+#if BENCHMARK
+// **Benchmarks**
+// Hot paths timed by bench.h; results go to Serial as one JSON document (see tools/bench_compare.py)
+bench::Runner benchRunner(Serial);
+
+// The RAM tier before RingBuffer, as the baseline of the offlineTick cases: every offline reading appended to
+// one String, emptied by the publish after the reconnect. Created per case, so each starts from an empty heap.
+String* legacyBuffer = nullptr;
+
+void legacyOfflineTick(uint32_t value) {
+  String sensorData = "Counter: " + String(value);
+  *legacyBuffer += sensorData + "\n";
+}
+
+void legacyReconnect() {
+  *legacyBuffer = "";
+}
+
+// The ring tier without the flash behind it: a full ring is emptied as spillRamBuffer() would
+RingBuffer<SensorRecord, MAX_BUFFER_SIZE> benchRing;
+
+void ringOfflineTick(uint32_t value) {
+  SensorRecord record = {(uint32_t)millis(), value};
+  if (!benchRing.push(record)) {
+    SensorRecord spilled;
+    while (benchRing.pop(spilled)) {
+    }
+    benchRing.push(record);
+  }
+}
+
+void ringReconnect() {
+}
+
+// BENCH_OFFLINE_TICKS readings with a reconnect every BENCH_OUTAGE_TICKS, then the heap report as counters:
+// peak heap taken, heap still held afterwards, and how fragmented the free heap is (target only; the native
+// heap reports one free block)
+void offlineTicks(void (*tick)(uint32_t), void (*reconnect)()) {
+  uint32_t freeBefore = ESP.getFreeHeap();
+  uint32_t lowest = freeBefore;
+  for (uint32_t i = 1; i <= BENCH_OFFLINE_TICKS; i++) {
+    tick(counter++);
+    if (i % BENCH_OUTAGE_TICKS == 0) {
+      uint32_t freeNow = ESP.getFreeHeap();
+      lowest = freeNow < lowest ? freeNow : lowest;
+      reconnect();
+    }
+  }
+  reconnect();
+  uint32_t freeAfter = ESP.getFreeHeap();
+  benchRunner.counter("heap_peak_bytes", (double)freeBefore - lowest);
+  benchRunner.counter("heap_held_bytes", (double)freeBefore - freeAfter);
+  benchRunner.counter("fragmentation_pct", freeAfter ? 100.0 - 100.0 * ESP.getMaxAllocHeap() / freeAfter : 0);
+}
+
+// Offline paths, run from setup() before WiFi starts
+void runOfflineBenchmarks() {
+    benchRunner.begin(FirmwareVer.c_str(), BENCH_PLATFORM);
+
+    benchRunner.run("loadRootCACertificate", [] {
+        String rootCA;
+        loadRootCACertificate(rootCA);
+    });
+
+    // Callback plus the worker's handling of the event; mqttTask() is not running yet
+    AsyncMqttClientMessageProperties properties = {0, false, false};
+    benchRunner.run("onMqttMessage/state", [&properties] {
+        char payload[] = "{\"state\":\"1\"}";
+        onMqttMessage((char*)SUBSCRIBE_TOPIC, payload, properties, strlen(payload), 0, strlen(payload));
+        handleNextMqttEvent(0);
+    });
+    benchRunner.run("onMqttMessage/actuation", [&properties] {
+        char payload[] = {0, 1};
+        onMqttMessage((char*)ACTUATION_TOPIC, payload, properties, sizeof(payload), 0, sizeof(payload));
+        handleNextMqttEvent(0);
+    });
+    // Same version as the running firmware, so the manifest is parsed and compared but not acted on
+    String manifest = "{\"version\":\"" + FirmwareVer + "\",\"bin_url\":\"https://example.com/firmware.bin\","
+                      "\"size\":1048576,\"sha256\":\"9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08\"}";
+    benchRunner.run("onMqttMessage/manifest", [&properties, &manifest] {
+        char payload[256];
+        size_t len = manifest.length() < sizeof(payload) ? manifest.length() : sizeof(payload);
+        memcpy(payload, manifest.c_str(), len);
+        onMqttMessage((char*)OTA_MANIFEST_TOPIC, payload, properties, len, 0, len);
+        handleNextMqttEvent(0);
+    });
+
+    // Payload formatting alone; both must report 0 allocations
+    benchRunner.run("payload/counter", [] {
+        CounterPayload sensorData;
+        sensorData.add(COUNTER_PREFIX).addUint(counter++);
+    });
+    benchRunner.run("payload/birth", [] {
+        BirthPayload birthMessage;
+        birthMessage.add(BIRTH_PREFIX).addIp(WiFi.localIP()).add(BIRTH_SUFFIX);
+    });
+
+    // One source read and window update, as samplingTask() does SAMPLE_RATE_HZ times a second
+    benchRunner.run("sampling/sim", [] {
+        static SampleWindow window;
+        float value;
+        if (readSimulatedSource(value)) {
+            window.add(value);
+        }
+    });
+
+    // RAM tier against the String buffer it replaced, per reading and as a heap report over a long outage
+    legacyBuffer = new String();
+    benchRunner.run("offlineTick/string", [] {
+        legacyOfflineTick(counter++);
+        if (counter % BENCH_OUTAGE_TICKS == 0) {
+            legacyReconnect();
+        }
+    });
+    delete legacyBuffer;
+    benchRunner.run("offlineTick/ring", [] { ringOfflineTick(counter++); });
+    benchRunner.run("offlineTicks100k/string", [] {
+        legacyBuffer = new String();
+        offlineTicks(legacyOfflineTick, legacyReconnect);
+        delete legacyBuffer;
+    }, 1);
+    benchRunner.run("offlineTicks100k/ring", [] { offlineTicks(ringOfflineTick, ringReconnect); }, 1);
+
+    benchRunner.run("bufferReading", [] { bufferReading(counter++); });
+    benchRunner.run("publishSensorData/offline", [] { publishSensorData(nullptr); });
+
+    // Drain: the buffered readings above are read back into replay blocks without being consumed
+    xSemaphoreTake(bufferMutex, portMAX_DELAY);
+    spillRamBuffer();
+    dataLog.flush();
+    LogCursor start = dataLog.readCursor();
+    benchRunner.run("buildReplayBatch", [&start] {
+        uint8_t payload[BUFFERED_PAYLOAD_SIZE];
+        LogCursor batchEnd;
+        buildReplayBatch(payload, sizeof(payload), batchEnd);
+        dataLog.seekRead(start);
+    });
+    xSemaphoreGive(bufferMutex);
+}
+
+// Paths that need the broker, once MQTT is up
+void benchmarkTask(void* parameter) {
+    unsigned long waitStart = millis();
+    while (!mqttClient.connected() && millis() - waitStart < BENCH_CONNECT_TIMEOUT) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    if (mqttClient.connected()) {
+        // Capped: every call is a QoS 2 publish and may also replay part of the backlog
+        benchRunner.run("publishSensorData/online", [] { publishSensorData(nullptr); }, BENCH_PUBLISH_ITERATIONS);
+    } else {
+        benchRunner.skip("publishSensorData/online", "MQTT not connected");
+    }
+    benchRunner.end();
+    vTaskDelete(nullptr);
+}
+#endif
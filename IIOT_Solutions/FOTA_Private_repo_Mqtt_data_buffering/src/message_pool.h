@@ -0,0 +1,144 @@
+#ifndef MESSAGE_POOL_H
+#define MESSAGE_POOL_H
+
+/*
+Reassembly of incoming MQTT messages without the heap.
+
+AsyncMqttClient calls onMessage once per received TCP segment, with the
+segment's offset in the payload (index) and the payload size (total), so a
+message bigger than one segment arrives as several calls, in order, before
+the next message starts. MessageAssembler copies those pieces into a buffer
+from a MessagePool and hands back the whole payload once the last piece is
+in. A message that arrives in one piece is handed back where it is, without
+a copy. Messages larger than the pool's buffers, or arriving while every
+buffer is taken, are dropped as a whole; a message cut short (the connection
+dropped mid-payload) is discarded when the next one starts.
+
+Payloads are not null-terminated: use length(), e.g. deserializeJson(doc,
+message(), length()) parses straight from the buffer.
+
+MessagePool is a fixed set of Slots buffers of SlotSize bytes. acquire() and
+release() use one atomic bitmask, so a buffer may be released by another
+task than the one that took it.
+*/
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+template <size_t Slots, size_t SlotSize>
+class MessagePool {
+    static_assert(Slots > 0 && Slots <= 32, "MessagePool tracks its buffers in one 32-bit mask");
+
+public:
+    static const size_t BUFFER_SIZE = SlotSize;
+
+    // A free buffer, or nullptr when all are taken
+    char* acquire() {
+        uint32_t used = used_.load(std::memory_order_relaxed);
+        for (;;) {
+            uint32_t free = ~used & ALL;
+            if (!free) {
+                return nullptr;
+            }
+            uint32_t bit = free & (0 - free); // Lowest free slot
+            if (used_.compare_exchange_weak(used, used | bit, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return buffers_[__builtin_ctz(bit)];
+            }
+        }
+    }
+
+    // Ignores nullptr and pointers that are not one of the pool's buffers
+    void release(char* buffer) {
+        for (size_t slot = 0; slot < Slots; slot++) {
+            if (buffer == buffers_[slot]) {
+                used_.fetch_and(~((uint32_t)1 << slot), std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    size_t inUse() const { return __builtin_popcount(used_.load(std::memory_order_relaxed)); }
+
+private:
+    static const uint32_t ALL = 0xFFFFFFFFUL >> (32 - Slots);
+
+    char buffers_[Slots][SlotSize];
+    std::atomic<uint32_t> used_{0};
+};
+
+template <typename Pool>
+class MessageAssembler {
+public:
+    enum Status {
+        PARTIAL,                   // More pieces to come
+        COMPLETE,                  // message()/length() hold the whole payload until release()
+        DROPPED                    // Too large, no free buffer or out of sequence; the rest of it is ignored
+    };
+
+    explicit MessageAssembler(Pool& pool) : pool_(pool), buffer_(nullptr), message_(nullptr), length_(0),
+                                            received_(0), dropping_(false) {}
+
+    Status add(const char* data, size_t len, size_t index, size_t total) {
+        if (index == 0) {
+            release();             // Whatever was left of an interrupted message
+            dropping_ = total > Pool::BUFFER_SIZE;
+            if (!dropping_ && len == total) {
+                message_ = data;
+                length_ = total;
+                return COMPLETE;
+            }
+            if (dropping_ || !(buffer_ = pool_.acquire())) {
+                dropping_ = true;
+                return DROPPED;
+            }
+            received_ = 0;
+        }
+        if (dropping_) {
+            return DROPPED;
+        }
+        if (!buffer_ || index != received_ || len > Pool::BUFFER_SIZE - received_) {
+            release();
+            dropping_ = true;
+            return DROPPED;
+        }
+        memcpy(buffer_ + received_, data, len);
+        received_ += len;
+        if (received_ < total) {
+            return PARTIAL;
+        }
+        message_ = buffer_;
+        length_ = total;
+        return COMPLETE;
+    }
+
+    const char* message() const { return message_; }
+    size_t length() const { return length_; }
+
+    // Hands the pool buffer of a COMPLETE message to the caller, who releases it to the pool later.
+    // nullptr if the message was not copied (it arrived in one piece); message() is then still valid.
+    char* take() {
+        char* taken = buffer_;
+        buffer_ = nullptr;
+        return taken;
+    }
+
+    // Done with the message: its buffer goes back to the pool
+    void release() {
+        pool_.release(buffer_);
+        buffer_ = nullptr;
+        message_ = nullptr;
+        length_ = 0;
+    }
+
+private:
+    Pool& pool_;
+    char* buffer_;                 // Pool buffer of the message being assembled, if it came in pieces
+    const char* message_;
+    size_t length_;
+    size_t received_;
+    bool dropping_;
+};
+
+#endif // MESSAGE_POOL_H
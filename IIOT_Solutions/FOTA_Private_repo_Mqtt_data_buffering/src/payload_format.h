@@ -0,0 +1,113 @@
+#ifndef PAYLOAD_FORMAT_H
+#define PAYLOAD_FORMAT_H
+
+/*
+Fixed-capacity message formatting for the publish path.
+
+A Payload<N> is a char array that lives wherever the caller puts it (stack
+or static) and is filled in place: string literals are copied with their
+length taken from the array type at compile time, integers and IPv4
+addresses are formatted digit by digit. Nothing touches the heap, unlike
+building the same message from String.
+
+Payload templates are declared as constexpr literals (config.h values can be
+spliced in by literal concatenation) and sized with capacity(), which adds up
+the literal parts and the widest text of each field at compile time:
+
+    constexpr char PREFIX[] = "{\"id\":\"" DEVICE_ACCESS_TOKEN "\",\"n\":";
+    payload::Payload<payload::capacity(sizeof(PREFIX), payload::UINT32_CHARS, sizeof("}"))> msg;
+    msg.add(PREFIX).addUint(counter).add("}");
+
+If a template was sized too small, appends stop and ok() turns false instead
+of the message being truncated silently.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace payload {
+
+const size_t UINT32_CHARS = 10;    // "4294967295"
+const size_t IPV4_CHARS = 15;      // "255.255.255.255"
+
+// Sum of the parts of a template; sizeof() of a literal counts its terminator, which is harmless slack
+constexpr size_t capacity(size_t part) {
+    return part;
+}
+
+template <typename... Parts>
+constexpr size_t capacity(size_t part, Parts... rest) {
+    return part + capacity(rest...);
+}
+
+template <size_t N>
+class Payload {
+    static_assert(N > 0, "Payload needs room for the terminator");
+
+public:
+    Payload() : len_(0), ok_(true) { buf_[0] = '\0'; }
+
+    template <size_t L>
+    Payload& add(const char (&literal)[L]) {
+        return add(literal, L - 1);
+    }
+
+    Payload& add(const char* text, size_t len) {
+        if (!reserve(len)) {
+            return *this;
+        }
+        memcpy(buf_ + len_, text, len);
+        len_ += len;
+        buf_[len_] = '\0';
+        return *this;
+    }
+
+    Payload& addUint(uint32_t value) {
+        char digits[UINT32_CHARS];
+        size_t n = 0;
+        do {
+            digits[n++] = '0' + value % 10;
+            value /= 10;
+        } while (value);
+        if (!reserve(n)) {
+            return *this;
+        }
+        while (n) {
+            buf_[len_++] = digits[--n];
+        }
+        buf_[len_] = '\0';
+        return *this;
+    }
+
+    // Anything with operator[] giving the four octets, such as IPAddress
+    template <typename Ip>
+    Payload& addIp(const Ip& ip) {
+        for (int i = 0; i < 4; i++) {
+            if (i) {
+                add(".");
+            }
+            addUint((uint8_t)ip[i]);
+        }
+        return *this;
+    }
+
+    const char* c_str() const { return buf_; }
+    size_t length() const { return len_; }
+    bool ok() const { return ok_; }
+    static size_t capacity() { return N - 1; }
+
+private:
+    bool reserve(size_t len) {
+        ok_ = ok_ && len <= N - 1 - len_;
+        return ok_;
+    }
+
+    char buf_[N];
+    size_t len_;
+    bool ok_;
+};
+
+} // namespace payload
+
+#endif // PAYLOAD_FORMAT_H
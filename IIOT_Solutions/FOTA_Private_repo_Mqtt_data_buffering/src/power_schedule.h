@@ -0,0 +1,133 @@
+#ifndef POWER_SCHEDULE_H
+#define POWER_SCHEDULE_H
+
+/*
+Radio scheduling and energy accounting for the low-power mode.
+
+In low-power mode readings are held in the buffer instead of being
+published one by one. FlushSchedule decides when the radio is woken to send
+them as one batch: intervalMs after the previous flush, or as soon as
+batchReadings are waiting, whichever comes first. Nothing waiting means
+nothing to wake for; the MQTT keep-alive keeps the session (and with it the
+will) alive meanwhile.
+
+EnergyMeter estimates the energy drawn: time spent in each radio state
+times that state's average current (PowerProfile) at the supply voltage.
+Divided by the readings delivered meanwhile this gives energy per delivered
+reading, the figure the low-power settings are tuned for. The currents are
+datasheet-level estimates, not measurements; calibrate them against a meter
+on the actual board.
+
+Neither class locks; main.cpp calls both under powerLock.
+*/
+
+#include <stdint.h>
+
+enum RadioState {
+    RADIO_ACTIVE,                  // WiFi power save off: receiver always on
+    RADIO_MODEM_SLEEP,             // Receiver wakes for DTIM beacons only
+    RADIO_LIGHT_SLEEP,             // Modem sleep, and the CPU light-sleeps in between
+    RADIO_STATES
+};
+
+struct PowerProfile {
+    uint32_t supplyMv;
+    uint32_t currentMa[RADIO_STATES]; // Average current of the whole module per RadioState
+};
+
+class FlushSchedule {
+public:
+    FlushSchedule() : intervalMs_(0), batchReadings_(0), lastFlushMs_(0), waiting_(0) {}
+
+    void configure(uint32_t intervalMs, uint32_t batchReadings) {
+        intervalMs_ = intervalMs;
+        batchReadings_ = batchReadings;
+    }
+
+    // A reading was buffered for the next flush
+    void held(uint32_t nowMs) {
+        if (waiting_++ == 0 && nowMs - lastFlushMs_ > intervalMs_) {
+            lastFlushMs_ = nowMs; // First reading after a quiet stretch: the interval starts now
+        }
+    }
+
+    bool due(uint32_t nowMs) const {
+        return waiting_ && (waiting_ >= batchReadings_ || nowMs - lastFlushMs_ >= intervalMs_);
+    }
+
+    // The radio woke up for the readings waiting so far
+    void flushed(uint32_t nowMs) {
+        lastFlushMs_ = nowMs;
+        waiting_ = 0;
+    }
+
+    uint32_t waiting() const { return waiting_; }
+    uint32_t intervalMs() const { return intervalMs_; }
+    uint32_t batchReadings() const { return batchReadings_; }
+
+private:
+    uint32_t intervalMs_;
+    uint32_t batchReadings_;
+    uint32_t lastFlushMs_;
+    uint32_t waiting_;             // Readings buffered since the last flush
+};
+
+class EnergyMeter {
+public:
+    struct Snapshot {
+        uint32_t stateMs[RADIO_STATES];
+        uint32_t flushes;
+        uint32_t readings;         // Delivered readings
+        float energyMj;            // Estimated energy drawn, millijoules
+        float mjPerReading;        // 0 if nothing was delivered
+    };
+
+    explicit EnergyMeter(const PowerProfile& profile)
+        : profile_(profile), state_(RADIO_MODEM_SLEEP), sinceUs_(0), stateUs_(), flushes_(0), readings_(0) {}
+
+    RadioState state() const { return state_; }
+
+    void setState(RadioState state, int64_t nowUs) {
+        accumulate(nowUs);
+        state_ = state;
+    }
+
+    void flushed() { flushes_++; }
+    void delivered(uint32_t readings) { readings_ += readings; }
+
+    // Totals since the previous take()
+    Snapshot take(int64_t nowUs) {
+        accumulate(nowUs);
+        Snapshot snapshot = {};
+        uint64_t picojoules = 0; // us * mA * mV
+        for (int i = 0; i < RADIO_STATES; i++) {
+            snapshot.stateMs[i] = (uint32_t)(stateUs_[i] / 1000);
+            picojoules += stateUs_[i] * profile_.currentMa[i] * profile_.supplyMv;
+            stateUs_[i] = 0;
+        }
+        snapshot.flushes = flushes_;
+        snapshot.readings = readings_;
+        snapshot.energyMj = picojoules / 1e9f;
+        snapshot.mjPerReading = readings_ ? snapshot.energyMj / readings_ : 0;
+        flushes_ = 0;
+        readings_ = 0;
+        return snapshot;
+    }
+
+private:
+    void accumulate(int64_t nowUs) {
+        if (sinceUs_) {
+            stateUs_[state_] += (uint64_t)(nowUs - sinceUs_);
+        }
+        sinceUs_ = nowUs;
+    }
+
+    PowerProfile profile_;
+    RadioState state_;
+    int64_t sinceUs_;              // esp_timer time of the last accumulate(), 0 before the first
+    uint64_t stateUs_[RADIO_STATES];
+    uint32_t flushes_;
+    uint32_t readings_;
+};
+
+#endif // POWER_SCHEDULE_H
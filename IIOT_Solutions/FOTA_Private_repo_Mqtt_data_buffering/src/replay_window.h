@@ -0,0 +1,132 @@
+#ifndef REPLAY_WINDOW_H
+#define REPLAY_WINDOW_H
+
+/*
+In-flight window for backlog replay.
+
+Every buffered-data publish is tracked with its packet id and the data log
+cursor just past its last record. Acks may arrive in any order; the commit
+point only advances over the oldest contiguous run of acked batches, so a
+record is released exactly when it and everything before it is confirmed.
+
+The window size adapts to the ack round-trip time, roughly like TCP Vegas:
+while acks come back close to the smallest RTT seen on this connection the
+window grows by one per window's worth of acks; once the smoothed RTT climbs
+to RTT_BACKOFF_FACTOR times that baseline (the broker or AsyncTCP's send
+buffer is queueing) or a publish is refused, it is halved.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename Cursor, size_t MaxWindow, size_t MinWindow = 1>
+class ReplayWindow {
+    static_assert(MinWindow >= 1 && MinWindow <= MaxWindow, "invalid replay window bounds");
+
+public:
+    static const uint32_t RTT_BACKOFF_FACTOR = 3;
+
+    bool canSend() const { return count_ < window_; }
+
+    void onSent(uint16_t packetId, const Cursor& end, uint32_t now) {
+        Batch& batch = batches_[(head_ + count_) % MaxWindow];
+        batch.packetId = packetId;
+        batch.end = end;
+        batch.sentAt = now;
+        batch.acked = false;
+        count_++;
+    }
+
+    // Returns true and sets commitTo when the oldest batches are now all acked.
+    bool onAck(uint16_t packetId, uint32_t now, Cursor& commitTo) {
+        size_t i = 0;
+        for (; i < count_; i++) {
+            Batch& batch = batches_[(head_ + i) % MaxWindow];
+            if (batch.packetId == packetId && !batch.acked) {
+                batch.acked = true;
+                updateRtt(now - batch.sentAt);
+                break;
+            }
+        }
+        if (i == count_) {
+            return false; // Not a replay publish
+        }
+
+        bool advanced = false;
+        while (count_ > 0 && batches_[head_].acked) {
+            commitTo = batches_[head_].end;
+            head_ = (head_ + 1) % MaxWindow;
+            count_--;
+            advanced = true;
+        }
+        return advanced;
+    }
+
+    // The client refused a publish (send buffer full): back off right away.
+    void onSendFailed() {
+        shrink();
+    }
+
+    // True when the oldest unacked batch has waited longer than timeoutMs.
+    bool stalled(uint32_t now, uint32_t timeoutMs) const {
+        return count_ > 0 && now - batches_[head_].sentAt > timeoutMs;
+    }
+
+    // Drop all in-flight state, e.g. after a disconnect. The caller rewinds its read cursor.
+    void reset() {
+        head_ = 0;
+        count_ = 0;
+        minRtt_ = 0;
+        srtt_ = 0;
+        acksSinceResize_ = 0;
+        window_ = MinWindow;
+    }
+
+    size_t inFlight() const { return count_; }
+    size_t window() const { return window_; }
+    uint32_t smoothedRtt() const { return srtt_; }
+    uint32_t minRtt() const { return minRtt_; }
+
+private:
+    struct Batch {
+        uint16_t packetId;
+        Cursor end;
+        uint32_t sentAt;
+        bool acked;
+    };
+
+    void updateRtt(uint32_t sample) {
+        if (sample == 0) {
+            sample = 1;
+        }
+        if (minRtt_ == 0 || sample < minRtt_) {
+            minRtt_ = sample;
+        }
+        srtt_ = srtt_ == 0 ? sample : (srtt_ * 7 + sample) / 8;
+
+        if (++acksSinceResize_ < window_) {
+            return;
+        }
+        if (srtt_ >= minRtt_ * RTT_BACKOFF_FACTOR) {
+            shrink();
+        } else if (window_ < MaxWindow) {
+            window_++;
+            acksSinceResize_ = 0;
+        }
+    }
+
+    void shrink() {
+        window_ = window_ / 2 < MinWindow ? MinWindow : window_ / 2;
+        acksSinceResize_ = 0;
+    }
+
+    Batch batches_[MaxWindow];
+    size_t head_ = 0;
+    size_t count_ = 0;
+    size_t window_ = MinWindow;
+    size_t acksSinceResize_ = 0;
+    uint32_t minRtt_ = 0;
+    uint32_t srtt_ = 0;
+};
+
+#endif // REPLAY_WINDOW_H
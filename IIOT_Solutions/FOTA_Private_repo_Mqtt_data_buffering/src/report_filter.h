@@ -0,0 +1,114 @@
+#ifndef REPORT_FILTER_H
+#define REPORT_FILTER_H
+
+/*
+Report-by-exception for sampled process values.
+
+Every sample of a metric is offered to its ReportFilter, which decides
+whether it is worth a message:
+
+- a change from the last reported value is reported only if it exceeds the
+  absolute deadband and the percent deadband (of the last reported value);
+  a deadband of 0 lets any change through, so the default policy reports
+  every change and drops only repeats
+- no change is reported sooner than minIntervalMs after the previous report
+  (the next sample after that is compared again)
+- a heartbeat goes out after maxSilenceMs without a report, changed or not,
+  so subscribers can tell a flat value from a dead device (0 disables it)
+- the first sample is always reported
+
+With both deadbands set, the absolute one dominates near zero and the
+percent one for large values. Whatever is reported stays within one
+deadband of the true value, except while minIntervalMs holds a change back.
+
+offer() is a few compares with no I/O, so the same class runs on the
+device and in tools/report_replay.cpp. Samples are doubles: integer metrics
+such as the counter stay exact up to 2^53, where a float would merge
+neighbouring values above 2^24 and report them as unchanged. The deadbands
+stay float, as saved in NVS. offer() and setPolicy() must not run
+at the same time (main.cpp wraps both in a critical section); the counters
+are atomic, so any task may takeStats() for the metrics message.
+*/
+
+#include <atomic>
+#include <math.h>
+#include <stdint.h>
+
+struct ReportPolicy {
+    float deadband;                // Absolute change needed to report, 0 = any change
+    float deadbandPct;             // Change needed, in percent of the last reported value; 0 = any change
+    uint32_t minIntervalMs;        // Shortest time between reports of a change
+    uint32_t maxSilenceMs;         // Heartbeat after this long without a report, 0 = never
+};
+
+class ReportFilter {
+public:
+    enum Decision {
+        SUPPRESS,                  // Within the deadband, or too soon after the last report
+        CHANGED,                   // Report: first sample or a change beyond the deadband
+        HEARTBEAT                  // Report: unchanged, but silent for maxSilenceMs
+    };
+
+    struct Stats {
+        uint32_t sent;             // CHANGED decisions
+        uint32_t heartbeats;       // HEARTBEAT decisions
+        uint32_t suppressed;       // SUPPRESS decisions
+    };
+
+    // Reports every change and never sends a heartbeat until setPolicy()
+    ReportFilter() : policy_(), last_(0), lastMs_(0), reported_(false) {}
+
+    Decision offer(double value, uint32_t nowMs) {
+        Decision decision = decide(value, nowMs);
+        counts_[decision].fetch_add(1, std::memory_order_relaxed);
+        if (decision == SUPPRESS) {
+            return SUPPRESS;
+        }
+        last_ = value;
+        lastMs_ = nowMs;
+        reported_ = true;
+        return decision;
+    }
+
+    // The next sample is reported whatever its value, e.g. after a policy change
+    void reset() { reported_ = false; }
+
+    const ReportPolicy& policy() const { return policy_; }
+    void setPolicy(const ReportPolicy& policy) {
+        policy_ = policy;
+        reset();
+    }
+
+    // Counters since the previous takeStats()
+    Stats takeStats() {
+        Stats taken = {counts_[CHANGED].exchange(0, std::memory_order_relaxed),
+                       counts_[HEARTBEAT].exchange(0, std::memory_order_relaxed),
+                       counts_[SUPPRESS].exchange(0, std::memory_order_relaxed)};
+        return taken;
+    }
+
+private:
+    Decision decide(double value, uint32_t nowMs) const {
+        if (!reported_) {
+            return CHANGED;
+        }
+        uint32_t silentMs = nowMs - lastMs_;
+        double change = fabs(value - last_);
+        bool beyond = change > policy_.deadband && change > fabs(last_) * policy_.deadbandPct / 100.0;
+        if (beyond && silentMs >= policy_.minIntervalMs) {
+            return CHANGED;
+        }
+        if (policy_.maxSilenceMs && silentMs >= policy_.maxSilenceMs) {
+            return HEARTBEAT;
+        }
+        return SUPPRESS;
+    }
+
+    ReportPolicy policy_;
+    std::atomic<uint32_t> counts_[3] = {};     // Per Decision
+    double last_;                  // Last reported value
+    uint32_t lastMs_;              // ... and when
+    bool reported_;
+};
+
+#endif // REPORT_FILTER_H
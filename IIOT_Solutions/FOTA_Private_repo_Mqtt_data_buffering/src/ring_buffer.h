@@ -0,0 +1,71 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+/*
+Fixed-slot ring buffer for the RAM tier of offline buffering.
+
+Storage is a plain array sized at compile time, so push() and pop() never
+touch the heap. One producer and one consumer may run concurrently without a
+lock: the producer only writes head_, the consumer only writes tail_, and each
+index is published with release/acquire ordering after the slot itself has
+been written or read. If several tasks consume, they must serialise among
+themselves (the firmware does this with bufferMutex).
+
+head_ and tail_ count modulo 2 * Capacity rather than running free, so a full
+ring (head_ - tail_ == Capacity) is told apart from an empty one for any
+Capacity, not only powers of two, and nothing goes wrong when a free-running
+32-bit count would have wrapped.
+*/
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t Capacity>
+class RingBuffer {
+    static_assert(Capacity > 0, "RingBuffer needs at least one slot");
+    static_assert(Capacity <= UINT32_MAX / 2, "RingBuffer indices count up to 2 * Capacity");
+
+public:
+    // Producer side. Returns false when every slot is taken.
+    bool push(const T& item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (distance(head, tail_.load(std::memory_order_acquire)) >= Capacity) {
+            return false;
+        }
+        slots_[slot(head)] = item;
+        head_.store(next(head), std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false when empty.
+    bool pop(T& item) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) == tail) {
+            return false;
+        }
+        item = slots_[slot(tail)];
+        tail_.store(next(tail), std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return distance(head_.load(std::memory_order_acquire), tail_.load(std::memory_order_acquire));
+    }
+    bool empty() const { return size() == 0; }
+    bool full() const { return size() >= Capacity; }
+    static size_t capacity() { return Capacity; }
+
+private:
+    static const uint32_t INDICES = 2 * Capacity;
+
+    static uint32_t next(uint32_t index) { return index + 1 == INDICES ? 0 : index + 1; }
+    static uint32_t slot(uint32_t index) { return index < Capacity ? index : index - Capacity; }
+    static uint32_t distance(uint32_t head, uint32_t tail) { return head >= tail ? head - tail : head + INDICES - tail; }
+
+    T slots_[Capacity];
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+};
+
+#endif // RING_BUFFER_H
@@ -0,0 +1,119 @@
+#ifndef SAMPLE_WINDOW_H
+#define SAMPLE_WINDOW_H
+
+/*
+Windowed statistics of a high-rate sample stream, handed from the sampling
+task to the publisher without locks.
+
+A SampleWindow has two accumulators. Window number w collects its samples
+in accumulator w % 2 as they arrive (count, min, max, and mean and variance
+by Welford's method, so nothing is stored per sample). close() ends window
+w: it publishes w + 1 as the number of closed windows, and the next window
+collects into the other accumulator. The publisher's take() reads the
+newest closed window, which the sampling task does not write again until
+one more window has passed. If the reader was that slow, the closed count
+has moved on meanwhile; take() notices and reads again, as with a seqlock.
+
+add() and close() belong to one task (the sampler) and take() to one other
+task; neither waits for the other. Windows closed twice between two take()s
+are skipped and counted in missed().
+*/
+
+#include <atomic>
+#include <math.h>
+#include <stdint.h>
+
+struct WindowStats {
+    uint32_t count;                // Samples in the window
+    uint32_t endMs;                // millis() when the window closed
+    float min;
+    float max;
+    float mean;
+    float stddev;                  // Population standard deviation
+};
+
+class WindowAccumulator {
+public:
+    void reset() {
+        count_ = 0;
+        mean_ = 0;
+        m2_ = 0;
+    }
+
+    void add(float value) {
+        if (count_ == 0) {
+            min_ = max_ = value;
+        } else {
+            min_ = value < min_ ? value : min_;
+            max_ = value > max_ ? value : max_;
+        }
+        count_++;
+        float delta = value - mean_;
+        mean_ += delta / count_;
+        m2_ += delta * (value - mean_);
+    }
+
+    WindowStats stats(uint32_t endMs) const {
+        WindowStats stats = {count_, endMs, 0, 0, 0, 0};
+        if (count_) {
+            stats.min = min_;
+            stats.max = max_;
+            stats.mean = mean_;
+            stats.stddev = sqrtf(m2_ / count_);
+        }
+        return stats;
+    }
+
+private:
+    uint32_t count_ = 0;
+    float min_ = 0;
+    float max_ = 0;
+    float mean_ = 0;
+    float m2_ = 0;                 // Sum of squared differences from the mean
+};
+
+class SampleWindow {
+public:
+    // Sampling task
+    void add(float value) { windows_[open_ & 1].add(value); }
+
+    // Sampling task: ends the open window, the next sample starts a new one
+    void close(uint32_t nowMs) {
+        endMs_[open_ & 1] = nowMs;
+        open_++;
+        closed_.store(open_, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_release); // take() sees the new count before any reset below
+        windows_[open_ & 1].reset();
+    }
+
+    // Publisher: the newest window closed since the last take(), false if there is none
+    bool take(WindowStats& stats) {
+        for (;;) {
+            uint32_t closed = closed_.load(std::memory_order_acquire);
+            if (closed == taken_) {
+                return false;
+            }
+            uint32_t w = closed - 1;
+            stats = windows_[w & 1].stats(endMs_[w & 1]);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (closed_.load(std::memory_order_relaxed) == closed) {
+                missed_ += w - taken_;
+                taken_ = closed;
+                return true;
+            }
+        }
+    }
+
+    // Closed windows the publisher never took
+    uint32_t missed() const { return missed_; }
+
+private:
+    WindowAccumulator windows_[2];
+    uint32_t endMs_[2] = {};
+    uint32_t open_ = 0;                    // Sampling task: number of the window collecting samples
+    std::atomic<uint32_t> closed_{0};      // Windows closed so far
+    uint32_t taken_ = 0;                   // Publisher: closed_ at the last take()
+    uint32_t missed_ = 0;
+};
+
+#endif // SAMPLE_WINDOW_H
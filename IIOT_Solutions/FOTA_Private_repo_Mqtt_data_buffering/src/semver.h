@@ -0,0 +1,133 @@
+#ifndef SEMVER_H
+#define SEMVER_H
+
+/*
+Semantic version parsing and precedence (semver.org, section 11).
+
+    MAJOR.MINOR.PATCH[-prerelease][+build]
+
+A leading "v" is accepted and missing MINOR/PATCH count as 0, so the
+"1.0" style tags already in use still parse. Build metadata is ignored.
+A pre-release sorts below its release (1.2.0-beta.2 < 1.2.0), and its
+dot-separated identifiers compare numerically when both are numeric,
+otherwise as ASCII, with numeric identifiers below alphanumeric ones.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct SemVer {
+    static const size_t PRERELEASE_MAX = 24;
+
+    uint32_t major;
+    uint32_t minor;
+    uint32_t patch;
+    char prerelease[PRERELEASE_MAX]; // Empty for a release
+
+    // Returns false if text is not a version.
+    static bool parse(const char* text, SemVer& out) {
+        if (!text) {
+            return false;
+        }
+        if (*text == 'v' || *text == 'V') {
+            text++;
+        }
+        uint32_t* parts[3] = {&out.major, &out.minor, &out.patch};
+        out.major = out.minor = out.patch = 0;
+        out.prerelease[0] = '\0';
+        for (int i = 0; i < 3; i++) {
+            if (*text < '0' || *text > '9') {
+                return false;
+            }
+            char* end;
+            *parts[i] = strtoul(text, &end, 10);
+            text = end;
+            if (*text != '.') {
+                break;
+            }
+            text++;
+        }
+        if (*text == '-') {
+            const char* end = strchr(text, '+');
+            size_t len = end ? (size_t)(end - text - 1) : strlen(text + 1);
+            if (len == 0 || len >= PRERELEASE_MAX) {
+                return false;
+            }
+            memcpy(out.prerelease, text + 1, len);
+            out.prerelease[len] = '\0';
+            text += len + 1;
+        }
+        return *text == '\0' || *text == '+';
+    }
+
+    // <0, 0 or >0 as a sorts before, equal to or after b
+    static int compare(const SemVer& a, const SemVer& b) {
+        if (a.major != b.major) {
+            return a.major < b.major ? -1 : 1;
+        }
+        if (a.minor != b.minor) {
+            return a.minor < b.minor ? -1 : 1;
+        }
+        if (a.patch != b.patch) {
+            return a.patch < b.patch ? -1 : 1;
+        }
+        if (!a.prerelease[0] || !b.prerelease[0]) {
+            return (b.prerelease[0] != '\0') - (a.prerelease[0] != '\0');
+        }
+        const char* x = a.prerelease;
+        const char* y = b.prerelease;
+        while (*x && *y) {
+            size_t xn = strcspn(x, ".");
+            size_t yn = strcspn(y, ".");
+            int order = compareIdentifier(x, xn, y, yn);
+            if (order != 0) {
+                return order;
+            }
+            x += xn + (x[xn] == '.');
+            y += yn + (y[yn] == '.');
+        }
+        return (*x != '\0') - (*y != '\0'); // More identifiers sort later
+    }
+
+    // Shorthand for comparing two version strings; unparsable versions sort lowest.
+    static int compare(const char* a, const char* b) {
+        SemVer x, y;
+        bool xOk = parse(a, x);
+        bool yOk = parse(b, y);
+        if (!xOk || !yOk) {
+            return xOk - yOk;
+        }
+        return compare(x, y);
+    }
+
+private:
+    static bool numeric(const char* s, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (s[i] < '0' || s[i] > '9') {
+                return false;
+            }
+        }
+        return n > 0;
+    }
+
+    static int compareIdentifier(const char* x, size_t xn, const char* y, size_t yn) {
+        bool xNum = numeric(x, xn);
+        bool yNum = numeric(y, yn);
+        if (xNum && yNum) {
+            unsigned long xv = strtoul(x, nullptr, 10);
+            unsigned long yv = strtoul(y, nullptr, 10);
+            return xv == yv ? 0 : (xv < yv ? -1 : 1);
+        }
+        if (xNum != yNum) {
+            return xNum ? -1 : 1;
+        }
+        int order = memcmp(x, y, xn < yn ? xn : yn);
+        if (order != 0) {
+            return order < 0 ? -1 : 1;
+        }
+        return xn == yn ? 0 : (xn < yn ? -1 : 1);
+    }
+};
+
+#endif // SEMVER_H
@@ -0,0 +1,220 @@
+#ifndef SPARKPLUG_H
+#define SPARKPLUG_H
+
+/*
+Minimal Sparkplug B payload encoder.
+
+Writes the org.eclipse.tahu.protobuf.Payload wire format directly into a
+caller-provided buffer; nothing is allocated. Only the fields the firmware
+needs are covered:
+
+    Payload { timestamp = 1; repeated Metric metrics = 2; seq = 3; }
+    Metric  { name = 1; alias = 2; timestamp = 3; datatype = 4;
+              int_value = 10; long_value = 11; boolean_value = 14; string_value = 15; }
+
+NBIRTH/NDEATH carry metric names (and aliases in NBIRTH); NDATA refers to
+metrics by alias only. If the buffer is too small the writer stops and ok()
+returns false.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace sparkplug {
+
+// Sparkplug B DataType values used by this firmware
+enum class DataType : uint32_t {
+    UInt32 = 7,
+    UInt64 = 8,
+    Boolean = 11,
+    String = 12,
+};
+
+class PayloadWriter {
+public:
+    PayloadWriter(uint8_t* buffer, size_t capacity) : buf_(buffer), cap_(capacity) {}
+
+    void timestamp(uint64_t ms) {
+        tag(1, WIRE_VARINT);
+        varint(ms);
+    }
+
+    void seq(uint64_t seq) {
+        tag(3, WIRE_VARINT);
+        varint(seq);
+    }
+
+    // name may be nullptr (NDATA), alias < 0 leaves the alias out (NDEATH bdSeq)
+    void metricUInt(const char* name, int32_t alias, uint64_t ts, DataType type, uint64_t value) {
+        size_t start = beginMetric(name, alias, ts, type);
+        tag(type == DataType::UInt64 ? 11 : 10, WIRE_VARINT);
+        varint(value);
+        endMetric(start);
+    }
+
+    void metricBool(const char* name, int32_t alias, uint64_t ts, bool value) {
+        size_t start = beginMetric(name, alias, ts, DataType::Boolean);
+        tag(14, WIRE_VARINT);
+        varint(value ? 1 : 0);
+        endMetric(start);
+    }
+
+    void metricString(const char* name, int32_t alias, uint64_t ts, const char* value) {
+        size_t start = beginMetric(name, alias, ts, DataType::String);
+        tag(15, WIRE_LEN);
+        bytes(value, strlen(value));
+        endMetric(start);
+    }
+
+    size_t size() const { return len_; }
+    bool ok() const { return ok_; }
+
+private:
+    static const uint8_t WIRE_VARINT = 0;
+    static const uint8_t WIRE_LEN = 2;
+
+    void put(uint8_t b) {
+        if (len_ < cap_) {
+            buf_[len_++] = b;
+        } else {
+            ok_ = false;
+        }
+    }
+
+    void varint(uint64_t v) {
+        while (v >= 0x80) {
+            put((v & 0x7F) | 0x80);
+            v >>= 7;
+        }
+        put(v);
+    }
+
+    void tag(uint32_t field, uint8_t wire) { varint((field << 3) | wire); }
+
+    void bytes(const char* data, size_t n) {
+        varint(n);
+        if (len_ + n > cap_) {
+            ok_ = false;
+            return;
+        }
+        memcpy(buf_ + len_, data, n);
+        len_ += n;
+    }
+
+    // Metrics are embedded messages: reserve one length byte and patch it in endMetric().
+    size_t beginMetric(const char* name, int32_t alias, uint64_t ts, DataType type) {
+        tag(2, WIRE_LEN);
+        put(0);
+        size_t start = len_;
+        if (name) {
+            tag(1, WIRE_LEN);
+            bytes(name, strlen(name));
+        }
+        if (alias >= 0) {
+            tag(2, WIRE_VARINT);
+            varint(alias);
+        }
+        tag(3, WIRE_VARINT);
+        varint(ts);
+        tag(4, WIRE_VARINT);
+        varint(static_cast<uint32_t>(type));
+        return start;
+    }
+
+    void endMetric(size_t start) {
+        if (!ok_) {
+            return;
+        }
+        size_t n = len_ - start;
+        uint8_t prefix[5];
+        size_t prefixLen = 0;
+        for (size_t v = n; ; v >>= 7) {
+            prefix[prefixLen++] = v >= 0x80 ? (v & 0x7F) | 0x80 : v;
+            if (v < 0x80) break;
+        }
+        if (prefixLen > 1) {
+            // Metric grew past 127 bytes: make room for the longer length prefix.
+            if (len_ + prefixLen - 1 > cap_) {
+                ok_ = false;
+                return;
+            }
+            memmove(buf_ + start + prefixLen - 1, buf_ + start, n);
+            len_ += prefixLen - 1;
+        }
+        memcpy(buf_ + start - 1, prefix, prefixLen);
+    }
+
+    uint8_t* buf_;
+    size_t cap_;
+    size_t len_ = 0;
+    bool ok_ = true;
+};
+
+// True if an NCMD payload sets the given boolean metric (by name or alias) to true.
+inline bool commandIsSet(const uint8_t* p, size_t len, const char* name, int32_t alias) {
+    struct Reader {
+        const uint8_t* p;
+        const uint8_t* end;
+        bool varint(uint64_t& v) {
+            v = 0;
+            for (int shift = 0; p < end && shift < 64; shift += 7) {
+                uint8_t b = *p++;
+                v |= (uint64_t)(b & 0x7F) << shift;
+                if (!(b & 0x80)) return true;
+            }
+            return false;
+        }
+        bool skip(uint8_t wire) {
+            uint64_t v;
+            switch (wire) {
+                case 0: return varint(v);
+                case 1: if (end - p < 8) return false; p += 8; return true;
+                case 2: if (!varint(v) || (uint64_t)(end - p) < v) return false; p += v; return true;
+                case 5: if (end - p < 4) return false; p += 4; return true;
+                default: return false;
+            }
+        }
+    };
+
+    Reader payload = {p, p + len};
+    uint64_t key;
+    while (payload.p < payload.end && payload.varint(key)) {
+        if (key != ((2 << 3) | 2)) {
+            if (!payload.skip(key & 7)) return false;
+            continue;
+        }
+        uint64_t metricLen;
+        if (!payload.varint(metricLen) || (uint64_t)(payload.end - payload.p) < metricLen) return false;
+        Reader metric = {payload.p, payload.p + metricLen};
+        payload.p += metricLen;
+
+        bool matches = false;
+        bool value = false;
+        while (metric.p < metric.end && metric.varint(key)) {
+            uint32_t field = key >> 3;
+            uint64_t v;
+            if (field == 1 && (key & 7) == 2) {
+                if (!metric.varint(v) || (uint64_t)(metric.end - metric.p) < v) return false;
+                matches |= v == strlen(name) && memcmp(metric.p, name, v) == 0;
+                metric.p += v;
+            } else if (field == 2 && (key & 7) == 0) {
+                if (!metric.varint(v)) return false;
+                matches |= alias >= 0 && v == (uint64_t)alias;
+            } else if (field == 14 && (key & 7) == 0) {
+                if (!metric.varint(v)) return false;
+                value = v != 0;
+            } else if (!metric.skip(key & 7)) {
+                return false;
+            }
+        }
+        if (matches && value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace sparkplug
+
+#endif // SPARKPLUG_H
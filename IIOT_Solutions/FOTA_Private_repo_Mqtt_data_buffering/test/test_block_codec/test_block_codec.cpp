@@ -0,0 +1,205 @@
+// BlockEncoder against the reference decoder in tools/decode_block.py, plus the replay figures: bytes per
+// record, ratio to the "Counter: N\n" lines replayed before, and encode cost per record
+//   pio test -e native -f test_block_codec
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "block_codec.h"
+
+namespace {
+
+struct Reading {
+    uint32_t timestamp;
+    uint32_t value;
+};
+
+typedef std::vector<Reading> Trace;
+
+const uint32_t TRACE_LENGTH = 20000;
+
+// Deterministic, so every run measures the same traces
+uint32_t lcg(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+// The counter as the firmware buffers it: one reading per COUNTER_INTERVAL, value + 1
+Trace steadyCounter() {
+    Trace trace;
+    for (uint32_t i = 0; i < TRACE_LENGTH; i++) {
+        trace.push_back({1000 + i * 5000, i});
+    }
+    return trace;
+}
+
+// A process value: timer jitter of +-20 ms and a random walk with steps of up to +-100
+Trace noisyProcess() {
+    Trace trace;
+    uint32_t state = 7;
+    uint32_t timestamp = 1000;
+    int32_t value = 50000;
+    for (uint32_t i = 0; i < TRACE_LENGTH; i++) {
+        timestamp += 4980 + lcg(state) % 41;
+        value += (int32_t)(lcg(state) % 201) - 100;
+        trace.push_back({timestamp, (uint32_t)value});
+    }
+    return trace;
+}
+
+// Nothing to exploit: random 32-bit values at random intervals, wrapping included
+Trace randomWords() {
+    Trace trace;
+    uint32_t state = 11;
+    uint32_t timestamp = 0xFFFF0000u;
+    for (uint32_t i = 0; i < TRACE_LENGTH; i++) {
+        timestamp += lcg(state) % 100000;
+        trace.push_back({timestamp, lcg(state) ^ (lcg(state) << 24)});
+    }
+    return trace;
+}
+
+std::string decoderPath() {
+    std::string file = __FILE__; // <project>/test/test_block_codec/test_block_codec.cpp
+    size_t test = file.rfind("test/test_block_codec/");
+    return (test == std::string::npos ? std::string() : file.substr(0, test)) + "tools/decode_block.py";
+}
+
+// Runs the reference decoder and compares every record it prints with the trace
+void checkDecoder(const std::string& command, const Trace& trace) {
+    FILE* decoder = popen(command.c_str(), "r");
+    TEST_ASSERT_NOT_NULL(decoder);
+    size_t decoded = 0;
+    bool match = true;
+    unsigned long timestamp, value;
+    while (fscanf(decoder, "%lu,%lu", &timestamp, &value) == 2) {
+        match = match && decoded < trace.size() && trace[decoded].timestamp == timestamp &&
+                trace[decoded].value == value;
+        decoded++;
+    }
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, pclose(decoder), "tools/decode_block.py failed");
+    TEST_ASSERT_EQUAL_size_t(trace.size(), decoded);
+    TEST_ASSERT_TRUE_MESSAGE(match, "decoded records differ from the encoded ones");
+}
+
+// Encodes the trace into blocks of at most BLOCK_MAX_BODY column bytes, as buildReplayBatch() does, decodes
+// them with the reference decoder, one file per block and back to back on stdin as mosquitto_sub -N writes
+// them, and compares every record
+void roundTrip(const char* name, const Trace& trace) {
+    static BlockEncoder encoder;
+    std::vector<std::vector<uint8_t> > blocks;
+    uint8_t out[BlockEncoder::HEADER_SIZE + BLOCK_MAX_BODY];
+
+    auto start = std::chrono::steady_clock::now();
+    encoder.reset();
+    for (const Reading& reading : trace) {
+        if (!encoder.add(reading.timestamp, reading.value)) {
+            size_t len = encoder.finish(out, sizeof(out));
+            TEST_ASSERT_GREATER_THAN(0, len);
+            blocks.push_back(std::vector<uint8_t>(out, out + len));
+            encoder.reset();
+            TEST_ASSERT_TRUE(encoder.add(reading.timestamp, reading.value));
+        }
+    }
+    size_t len = encoder.finish(out, sizeof(out));
+    TEST_ASSERT_GREATER_THAN(0, len);
+    blocks.push_back(std::vector<uint8_t>(out, out + len));
+    double encodeNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    char dir[] = "/tmp/block-codec-XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+    std::string command = "python3 " + decoderPath();
+    std::string stream = std::string(dir) + "/stream.bin";
+    FILE* all = fopen(stream.c_str(), "wb");
+    TEST_ASSERT_NOT_NULL(all);
+    size_t encoded = 0;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "%s/%05u.bin", dir, (unsigned)i);
+        FILE* file = fopen(path, "wb");
+        TEST_ASSERT_NOT_NULL(file);
+        fwrite(blocks[i].data(), 1, blocks[i].size(), file);
+        fclose(file);
+        fwrite(blocks[i].data(), 1, blocks[i].size(), all);
+        command += std::string(" ") + path;
+        encoded += blocks[i].size();
+    }
+    fclose(all);
+
+    checkDecoder(command, trace);
+    checkDecoder("python3 " + decoderPath() + " - < " + stream, trace);
+    system((std::string("rm -rf ") + dir).c_str());
+
+    size_t text = 0;
+    for (const Reading& reading : trace) {
+        char line[32];
+        text += snprintf(line, sizeof(line), "Counter: %lu\n", (unsigned long)reading.value);
+    }
+    char message[160];
+    snprintf(message, sizeof(message), "%s: %u records in %u blocks, %.2f B/record, %.1fx smaller than text, "
+             "encode %.1f ns/record", name, (unsigned)trace.size(), (unsigned)blocks.size(),
+             (double)encoded / trace.size(), (double)text / encoded, encodeNs / trace.size());
+    TEST_MESSAGE(message);
+}
+
+} // namespace
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_steady_counter() {
+    roundTrip("steady counter", steadyCounter());
+}
+
+void test_noisy_process() {
+    roundTrip("noisy process", noisyProcess());
+}
+
+void test_random_words() {
+    roundTrip("random words", randomWords());
+}
+
+// The LZ4 stage alone on inputs that are partly repetitive, partly random, including overlapping matches
+void test_lz4_random_inputs() {
+    static BlockEncoder encoder;
+    uint32_t state = 3;
+    for (int trial = 0; trial < 300; trial++) {
+        encoder.reset();
+        uint32_t timestamp = lcg(state);
+        uint32_t value = lcg(state);
+        uint32_t period = 1 + lcg(state) % 8;
+        uint32_t records = 1 + lcg(state) % 400;
+        Trace trace;
+        for (uint32_t i = 0; i < records; i++) {
+            timestamp += i % period ? 5000 : lcg(state) % 70000;
+            value += i % period ? 1 : lcg(state);
+            if (!encoder.add(timestamp, value)) {
+                break;
+            }
+            trace.push_back({timestamp, value});
+        }
+        uint8_t out[BlockEncoder::HEADER_SIZE + BLOCK_MAX_BODY];
+        TEST_ASSERT_GREATER_THAN(0, encoder.finish(out, sizeof(out)));
+        TEST_ASSERT_LESS_OR_EQUAL(BLOCK_MAX_BODY, encoder.rawSize());
+        if (trial % 30 == 0) {
+            roundTrip("random block", trace); // Through the reference decoder; 300 spawns would be slow
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_steady_counter);
+    RUN_TEST(test_noisy_process);
+    RUN_TEST(test_random_words);
+    RUN_TEST(test_lz4_random_inputs);
+    return UNITY_END();
+}
@@ -0,0 +1,155 @@
+// router::makeRouter() over a 32-route table of topics and command keys like the firmware's: every key finds
+// its own route, and unrouted keys, prefixes and longer keys (find(key, len) into a bigger buffer) find none
+//   pio test -e native -f test_command_router
+
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include "command_router.h"
+
+namespace {
+
+typedef int (*Handler)();
+
+template <int N>
+int handler() {
+    return N;
+}
+
+// The topics from config.h and the firmware's command keys, plus ones a larger deployment would add; several
+// share long prefixes or differ only in their last character
+constexpr router::Route<Handler> routes[] = {
+    {"test/counter/datasub", handler<0>},
+    {"device/ota/ESP32", handler<1>},
+    {"device/actuate/ESP32", handler<2>},
+    {"spBv1.0/IIoT/NCMD/ESP32", handler<3>},
+    {"spBv1.0/IIoT/DCMD/ESP32", handler<4>},
+    {"spBv1.0/STATE/scada-primary", handler<5>},
+    {"device/config/ESP32", handler<6>},
+    {"device/reboot/ESP32", handler<7>},
+    {"device/time/ESP32", handler<8>},
+    {"device/ota/ESP32/cancel", handler<9>},
+    {"device/ota/broadcast", handler<10>},
+    {"test/counter/datasub2", handler<11>},
+    {"ota_interval", handler<12>},
+    {"ota_channel", handler<13>},
+    {"ota_url", handler<14>},
+    {"state", handler<15>},
+    {"report", handler<16>},
+    {"power", handler<17>},
+    {"reboot", handler<18>},
+    {"sample_rate", handler<19>},
+    {"sample_window", handler<20>},
+    {"deadband", handler<21>},
+    {"heartbeat", handler<22>},
+    {"mqtt_keepalive", handler<23>},
+    {"log_level", handler<24>},
+    {"output0", handler<25>},
+    {"output1", handler<26>},
+    {"output2", handler<27>},
+    {"output3", handler<28>},
+    {"wifi_ssid", handler<29>},
+    {"wifi_rssi_min", handler<30>},
+    {"factory_reset", handler<31>},
+};
+const size_t ROUTES = sizeof(routes) / sizeof(routes[0]);
+
+constexpr auto table = router::makeRouter(routes);
+static_assert(table.ok(), "No perfect hash for the test routes");
+static_assert(decltype(table)::SIZE == 128, "Four slots per route, rounded up to a power of two");
+
+constexpr router::Route<Handler> single[] = {{"state", handler<0>}};
+constexpr auto singleTable = router::makeRouter(single);
+static_assert(singleTable.ok(), "No perfect hash for one route");
+
+uint32_t lcg(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+bool routed(const std::string& key) {
+    for (size_t i = 0; i < ROUTES; i++) {
+        if (key == routes[i].key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_every_key_routed() {
+    for (size_t i = 0; i < ROUTES; i++) {
+        const router::Route<Handler>* route = table.find(routes[i].key);
+        TEST_ASSERT_NOT_NULL_MESSAGE(route, routes[i].key);
+        TEST_ASSERT_EQUAL_PTR(&routes[i], route);
+        TEST_ASSERT_EQUAL_INT((int)i, route->handler());
+
+        // As onMqttMessage() and the command loop pass them: not NUL-terminated at len
+        std::string buffer = std::string(routes[i].key) + "/extra\x01payload";
+        TEST_ASSERT_EQUAL_PTR(&routes[i], table.find(buffer.c_str(), strlen(routes[i].key)));
+    }
+    TEST_ASSERT_EQUAL_PTR(&single[0], singleTable.find("state"));
+}
+
+void test_prefixes_and_longer_keys() {
+    for (size_t i = 0; i < ROUTES; i++) {
+        std::string key = routes[i].key;
+        for (size_t len = 0; len < key.size(); len++) {
+            if (!routed(key.substr(0, len))) {
+                TEST_ASSERT_NULL_MESSAGE(table.find(key.c_str(), len), key.substr(0, len).c_str());
+            }
+        }
+        for (const char* suffix : {"/", "0", "x", " ", "/#"}) {
+            std::string longer = key + suffix;
+            if (!routed(longer)) {
+                TEST_ASSERT_NULL_MESSAGE(table.find(longer.c_str(), longer.size()), longer.c_str());
+            }
+        }
+        std::string changed = key;
+        changed[changed.size() - 1] ^= 0x20;
+        TEST_ASSERT_NULL_MESSAGE(table.find(changed.c_str()), changed.c_str());
+    }
+    TEST_ASSERT_NULL(singleTable.find("stat"));
+    TEST_ASSERT_NULL(singleTable.find("states"));
+    TEST_ASSERT_NULL(singleTable.find(""));
+}
+
+// Seeded topics and keys that look like the routed ones but are not in the table
+void test_unrouted() {
+    const char* const parts[] = {"device", "test", "counter", "ota", "status", "spBv1.0", "NCMD", "NDATA",
+                                 "ESP32", "output", "state", "report", "power", "+", "#", ""};
+    const size_t PARTS = sizeof(parts) / sizeof(parts[0]);
+    uint32_t state = 11;
+    size_t tried = 0;
+    for (int i = 0; i < 100000; i++) {
+        std::string key = parts[lcg(state) % PARTS];
+        for (uint32_t levels = lcg(state) % 4; levels > 0; levels--) {
+            key += (lcg(state) % 3 ? "/" : "_");
+            key += parts[lcg(state) % PARTS];
+        }
+        if (!routed(key)) {
+            TEST_ASSERT_NULL_MESSAGE(table.find(key.c_str(), key.size()), key.c_str());
+            tried++;
+        }
+    }
+    char message[64];
+    snprintf(message, sizeof(message), "%u unrouted keys", (unsigned)tried);
+    TEST_MESSAGE(message);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_every_key_routed);
+    RUN_TEST(test_prefixes_and_longer_keys);
+    RUN_TEST(test_unrouted);
+    return UNITY_END();
+}
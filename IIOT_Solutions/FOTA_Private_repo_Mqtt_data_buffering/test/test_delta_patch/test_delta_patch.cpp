@@ -0,0 +1,332 @@
+// DeltaApplier against a patch built by tools/delta_patch.py, checked byte for byte, then truncated streams,
+// COPY outside the source image, output longer or shorter than the target and unknown commands, each of
+// which must end with its own Result
+//   pio test -e native -f test_delta_patch
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "delta_patch.h"
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+char dir[] = "/tmp/delta-patch-XXXXXX";
+Bytes oldImage;
+Bytes newImage;
+Bytes patch;
+
+uint32_t lcg(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+// Code with a small alphabet, string tables and 0xFF padding, like an app image
+Bytes firmwareImage(uint32_t seed, size_t size) {
+    Bytes data;
+    uint32_t state = seed;
+    data.push_back(0xE9);
+    while (data.size() < size) {
+        uint32_t kind = lcg(state) % 3;
+        uint32_t len = 64 + lcg(state) % 2048;
+        if (kind == 0) {
+            for (uint32_t i = 0; i < len; i++) {
+                data.push_back((uint8_t)(lcg(state) % 24 * 11));
+            }
+        } else if (kind == 1) {
+            const char* text = "esp_ota_set_boot_partition failed: %s\0";
+            for (uint32_t i = 0; i < len; i++) {
+                data.push_back((uint8_t)text[i % 39]);
+            }
+        } else {
+            data.insert(data.end(), len, 0xFF);
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+// The next release: a patched function, code inserted and removed (so everything after it moves), a block
+// moved to the front and a longer tail
+Bytes nextRelease(const Bytes& old) {
+    Bytes next(old.begin() + 150000, old.begin() + 154000);
+    next.insert(next.end(), old.begin(), old.begin() + 20000);
+    uint32_t state = 77;
+    for (int i = 0; i < 300; i++) {
+        next.push_back((uint8_t)lcg(state));
+    }
+    next.insert(next.end(), old.begin() + 20000, old.begin() + 90000);
+    next.insert(next.end(), old.begin() + 92000, old.end());
+    for (size_t i = 60000; i < 60040; i++) {
+        next[i] ^= 0x5A;
+    }
+    Bytes tail = firmwareImage(99, 12000);
+    next.insert(next.end(), tail.begin(), tail.end());
+    return next;
+}
+
+std::string toolPath() {
+    std::string file = __FILE__; // <project>/test/test_delta_patch/test_delta_patch.cpp
+    size_t test = file.rfind("test/test_delta_patch/");
+    return (test == std::string::npos ? std::string() : file.substr(0, test)) + "tools/delta_patch.py";
+}
+
+bool writeFile(const std::string& path, const Bytes& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && ok;
+}
+
+Bytes readFile(const std::string& path) {
+    Bytes data;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file) {
+        uint8_t buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+            data.insert(data.end(), buf, buf + n);
+        }
+        fclose(file);
+    }
+    return data;
+}
+
+bool makePatch() {
+    std::string base(dir);
+    if (!writeFile(base + "/old.bin", oldImage) || !writeFile(base + "/new.bin", newImage)) {
+        return false;
+    }
+    std::string command = "python3 " + toolPath() + " make " + base + "/old.bin " + base + "/new.bin " + base +
+                          "/patch.bin > /dev/null";
+    if (system(command.c_str()) != 0) {
+        return false;
+    }
+    patch = readFile(base + "/patch.bin");
+    return !patch.empty();
+}
+
+// The HTTPS stream as OtaStream reads it: readBytes() waits for len bytes, so a short count is the end
+struct StreamInput {
+    const Bytes* data;
+    size_t pos;
+    size_t read(uint8_t* buf, size_t len) {
+        size_t n = len < data->size() - pos ? len : data->size() - pos;
+        memcpy(buf, data->data() + pos, n);
+        pos += n;
+        return n;
+    }
+};
+
+// The running partition; reads past the image fail as they would past the partition
+struct ImageSource {
+    const Bytes* image;
+    bool fail;
+    bool read(uint32_t offset, uint8_t* buf, size_t len) {
+        if (fail || offset > image->size() || len > image->size() - offset) {
+            return false;
+        }
+        memcpy(buf, image->data() + offset, len);
+        return true;
+    }
+};
+
+struct PartitionSink {
+    Bytes out;
+    bool fail;
+    size_t largestWrite;
+    bool write(const uint8_t* buf, size_t len) {
+        if (fail) {
+            return false;
+        }
+        largestWrite = len > largestWrite ? len : largestWrite;
+        out.insert(out.end(), buf, buf + len);
+        return true;
+    }
+};
+
+DeltaApplier::Result apply(const Bytes& stream, PartitionSink& sink, bool sourceFails = false) {
+    StreamInput in = {&stream, 0};
+    DeltaHeader header;
+    if (!DeltaApplier::readHeader(in, header)) {
+        return DeltaApplier::BAD_HEADER;
+    }
+    ImageSource source = {&oldImage, sourceFails};
+    return DeltaApplier::apply(in, header, source, sink);
+}
+
+void put32(Bytes& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+void putVarint(Bytes& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+// A hand-made patch against oldImage; the hashes are not checked by the applier
+Bytes header(uint32_t targetSize) {
+    Bytes out = {'D', 'P', DeltaApplier::VERSION, 0};
+    put32(out, oldImage.size());
+    put32(out, targetSize);
+    out.insert(out.end(), 64, 0);
+    return out;
+}
+
+void copy(Bytes& out, uint32_t offset, uint32_t length) {
+    out.push_back(0x01);
+    put32(out, offset);
+    putVarint(out, length);
+}
+
+void insert(Bytes& out, const Bytes& literal) {
+    out.push_back(0x02);
+    putVarint(out, literal.size());
+    out.insert(out.end(), literal.begin(), literal.end());
+}
+
+void checkResult(DeltaApplier::Result expected, const Bytes& stream, const char* what) {
+    PartitionSink sink = {Bytes(), false, 0};
+    DeltaApplier::Result result = apply(stream, sink);
+    char message[128];
+    snprintf(message, sizeof(message), "%s: %s", what, DeltaApplier::resultName(result));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(expected, result, message);
+}
+
+} // namespace
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_applies_python_patch() {
+    char message[96];
+    snprintf(message, sizeof(message), "%u -> %u bytes, patch %u bytes", (unsigned)oldImage.size(),
+             (unsigned)newImage.size(), (unsigned)patch.size());
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(patch.size() < newImage.size() / 4); // Mostly COPY commands
+
+    StreamInput in = {&patch, 0};
+    DeltaHeader header;
+    TEST_ASSERT_TRUE(DeltaApplier::readHeader(in, header));
+    TEST_ASSERT_EQUAL_UINT32(oldImage.size(), header.sourceSize);
+    TEST_ASSERT_EQUAL_UINT32(newImage.size(), header.targetSize);
+    ImageSource source = {&oldImage, false};
+    PartitionSink sink = {Bytes(), false, 0};
+    TEST_ASSERT_EQUAL_INT(DeltaApplier::OK, DeltaApplier::apply(in, header, source, sink));
+    TEST_ASSERT_EQUAL_size_t(newImage.size(), sink.out.size());
+    TEST_ASSERT_EQUAL_MEMORY(newImage.data(), sink.out.data(), newImage.size());
+    TEST_ASSERT_EQUAL_size_t(patch.size(), in.pos); // Nothing read past END
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(DeltaApplier::CHUNK_SIZE, sink.largestWrite);
+}
+
+void test_truncated_stream() {
+    for (size_t cut = 0; cut < patch.size(); cut += cut < DeltaApplier::HEADER_SIZE + 64 ? 1 : 97) {
+        Bytes stream(patch.begin(), patch.begin() + cut);
+        PartitionSink sink = {Bytes(), false, 0};
+        DeltaApplier::Result result = apply(stream, sink);
+        DeltaApplier::Result expected = cut < DeltaApplier::HEADER_SIZE ? DeltaApplier::BAD_HEADER : DeltaApplier::TRUNCATED;
+        TEST_ASSERT_EQUAL_INT(expected, result);
+    }
+    Bytes stream = header(10);
+    stream.push_back(0x02);
+    stream.insert(stream.end(), {0x80, 0x80, 0x80, 0x80, 0x80}); // Varint without an end
+    checkResult(DeltaApplier::TRUNCATED, stream, "endless varint");
+}
+
+void test_copy_outside_source() {
+    uint32_t size = oldImage.size();
+    Bytes stream = header(10);
+    copy(stream, size - 10, 10); // Last bytes of the image: fine
+    stream.push_back(0x00);
+    checkResult(DeltaApplier::OK, stream, "copy to the end");
+
+    stream = header(11);
+    copy(stream, size - 10, 11);
+    stream.push_back(0x00);
+    checkResult(DeltaApplier::SOURCE_RANGE, stream, "copy past the end");
+
+    stream = header(10);
+    copy(stream, size + 1, 0);
+    stream.push_back(0x00);
+    checkResult(DeltaApplier::SOURCE_RANGE, stream, "copy offset past the end");
+
+    stream = header(0x20);
+    copy(stream, 0xFFFFFFF0, 0x20); // offset + length wraps around
+    stream.push_back(0x00);
+    checkResult(DeltaApplier::SOURCE_RANGE, stream, "copy wrapping around");
+}
+
+void test_target_size_mismatch() {
+    Bytes stream = header(100);
+    copy(stream, 0, 60);
+    insert(stream, Bytes(41, 0xAB)); // One byte too many
+    stream.push_back(0x00);
+    checkResult(DeltaApplier::TARGET_OVERFLOW, stream, "longer than the target");
+
+    stream = header(100);
+    copy(stream, 0, 60);
+    insert(stream, Bytes(39, 0xAB)); // END one byte early
+    stream.push_back(0x00);
+    checkResult(DeltaApplier::TARGET_OVERFLOW, stream, "shorter than the target");
+
+    stream = header(100);
+    copy(stream, 0, 60);
+    insert(stream, Bytes(40, 0xAB));
+    stream.push_back(0x00);
+    checkResult(DeltaApplier::OK, stream, "exact target");
+}
+
+void test_bad_command_and_header() {
+    for (uint8_t op : {0x03, 0x7F, 0xFF}) {
+        Bytes stream = header(10);
+        insert(stream, Bytes(5, 1));
+        stream.push_back(op);
+        stream.insert(stream.end(), 10, 0);
+        checkResult(DeltaApplier::BAD_COMMAND, stream, "unknown command");
+    }
+
+    Bytes stream = patch;
+    stream[0] = 'X';
+    checkResult(DeltaApplier::BAD_HEADER, stream, "bad magic");
+    stream = patch;
+    stream[2] = DeltaApplier::VERSION + 1;
+    checkResult(DeltaApplier::BAD_HEADER, stream, "newer version");
+
+    PartitionSink sink = {Bytes(), false, 0};
+    TEST_ASSERT_EQUAL_INT(DeltaApplier::READ_FAILED, apply(patch, sink, true));
+    sink.fail = true;
+    TEST_ASSERT_EQUAL_INT(DeltaApplier::WRITE_FAILED, apply(patch, sink));
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    oldImage = firmwareImage(13, 200000);
+    newImage = nextRelease(oldImage);
+    if (!mkdtemp(dir) || !makePatch()) {
+        fprintf(stderr, "python3 %s could not build the patch\n", toolPath().c_str());
+        return 1;
+    }
+    system((std::string("rm -rf ") + dir).c_str());
+
+    UNITY_BEGIN();
+    RUN_TEST(test_applies_python_patch);
+    RUN_TEST(test_truncated_stream);
+    RUN_TEST(test_copy_outside_source);
+    RUN_TEST(test_target_size_mismatch);
+    RUN_TEST(test_bad_command_and_header);
+    return UNITY_END();
+}
@@ -0,0 +1,311 @@
+// GzipInflater against Python's gzip: levels 0/1/6/9 fed 1, 7 and 4096 bytes at a time, then corrupted,
+// truncated and non-gzip inputs, which must never come out as OK with the wrong image
+//   pio test -e native -f test_gzip_stream
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "gzip_stream.h"
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+const int LEVELS[] = {0, 1, 6, 9};
+const size_t FEEDS[] = {1, 7, 4096};
+const size_t PARTITION_SIZE = 0x140000; // app0/app1 in partitions.csv
+
+struct Sample {
+    const char* name;
+    Bytes data;
+    Bytes gz[4];  // By LEVELS
+    Bytes named;  // Level 9 with FNAME set, as the gzip command line writes it
+};
+
+std::vector<Sample> samples;
+char dir[] = "/tmp/gzip-stream-XXXXXX";
+
+// Deterministic, so every run inflates the same inputs
+uint32_t lcg(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+Bytes logText() {
+    std::string text;
+    uint32_t state = 5;
+    for (uint32_t i = 0; text.size() < 40000; i++) {
+        char line[96];
+        snprintf(line, sizeof(line), "I (%lu) wifi: sta connected, rssi -%lu, channel %lu\n",
+                 (unsigned long)(i * 37), (unsigned long)(40 + lcg(state) % 50), (unsigned long)(1 + lcg(state) % 13));
+        text += line;
+    }
+    return Bytes(text.begin(), text.end());
+}
+
+Bytes randomBytes() {
+    Bytes data(70000); // More than one 64 KB stored block at level 0
+    uint32_t state = 9;
+    for (uint8_t& b : data) {
+        b = (uint8_t)lcg(state);
+    }
+    return data;
+}
+
+// Roughly what an app image looks like: code with a small alphabet, copies of earlier blocks up to the
+// 32 KB window apart, string tables and 0xFF padding
+Bytes firmwareImage() {
+    Bytes data;
+    uint32_t state = 13;
+    data.push_back(0xE9);
+    while (data.size() < 300000) {
+        uint32_t kind = lcg(state) % 4;
+        uint32_t len = 64 + lcg(state) % 2048;
+        if (kind == 0) {
+            for (uint32_t i = 0; i < len; i++) {
+                data.push_back((uint8_t)(lcg(state) % 24 * 11));
+            }
+        } else if (kind == 1 && data.size() > 1) {
+            uint32_t distance = 1 + lcg(state) % (data.size() < 32768 ? data.size() : 32768);
+            for (uint32_t i = 0; i < len; i++) {
+                data.push_back(data[data.size() - distance]); // Overlapping when distance < len
+            }
+        } else if (kind == 2) {
+            const char* text = "esp_ota_set_boot_partition failed: %s\0";
+            for (uint32_t i = 0; i < len; i++) {
+                data.push_back((uint8_t)text[i % 39]);
+            }
+        } else {
+            data.insert(data.end(), len, 0xFF);
+        }
+    }
+    return data;
+}
+
+bool writeFile(const std::string& path, const Bytes& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && ok;
+}
+
+Bytes readFile(const std::string& path) {
+    Bytes data;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file) {
+        uint8_t buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+            data.insert(data.end(), buf, buf + n);
+        }
+        fclose(file);
+    }
+    return data;
+}
+
+// Compresses every sample with Python's gzip module in one run
+bool compressSamples() {
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (!writeFile(std::string(dir) + "/" + std::to_string(i), samples[i].data)) {
+            return false;
+        }
+    }
+    std::string command = std::string("python3 -c '\n"
+        "import gzip, sys\n"
+        "for i in range(int(sys.argv[2])):\n"
+        "    path = \"%s/%d\" % (sys.argv[1], i)\n"
+        "    data = open(path, \"rb\").read()\n"
+        "    for level in (0, 1, 6, 9):\n"
+        "        open(\"%s.%d\" % (path, level), \"wb\").write(gzip.compress(data, compresslevel=level, mtime=0))\n"
+        "    with open(path + \".named\", \"wb\") as out:\n"
+        "        with gzip.GzipFile(\"firmware.bin\", \"wb\", 9, out, mtime=0) as named:\n"
+        "            named.write(data)\n"
+        "' ") + dir + " " + std::to_string(samples.size());
+    if (system(command.c_str()) != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < samples.size(); i++) {
+        std::string path = std::string(dir) + "/" + std::to_string(i);
+        for (int l = 0; l < 4; l++) {
+            samples[i].gz[l] = readFile(path + "." + std::to_string(LEVELS[l]));
+        }
+        samples[i].named = readFile(path + ".named");
+    }
+    return true;
+}
+
+// The HTTPS stream: at most `feed` bytes per read, 0 at the end
+struct FeedInput {
+    const Bytes* data;
+    size_t pos;
+    size_t feed;
+    size_t read(uint8_t* buf, size_t len) {
+        size_t n = len < feed ? len : feed;
+        n = n < data->size() - pos ? n : data->size() - pos;
+        memcpy(buf, data->data() + pos, n);
+        pos += n;
+        return n;
+    }
+};
+
+// Like the OTA partition: appends only, never past its size
+struct PartitionSink {
+    Bytes out;
+    size_t limit;
+    size_t largestWrite;
+    bool write(const uint8_t* buf, size_t len) {
+        if (len > limit - out.size()) {
+            return false;
+        }
+        largestWrite = len > largestWrite ? len : largestWrite;
+        out.insert(out.end(), buf, buf + len);
+        return true;
+    }
+};
+
+GzipInflater::Result inflate(const Bytes& gz, size_t feed, PartitionSink& sink, uint32_t* inputBytes = nullptr) {
+    static uint8_t window[GzipInflater::WINDOW_SIZE];
+    GzipInflater inflater(window);
+    FeedInput in = {&gz, 0, feed};
+    GzipInflater::Result result = inflater.inflate(in, sink);
+    if (result == GzipInflater::OK) {
+        TEST_ASSERT_EQUAL_UINT32(sink.out.size(), inflater.outputBytes());
+    }
+    if (inputBytes) {
+        *inputBytes = inflater.inputBytes();
+    }
+    return result;
+}
+
+void checkInflates(const Sample& sample, const Bytes& gz, size_t feed) {
+    PartitionSink sink = {Bytes(), PARTITION_SIZE, 0};
+    uint32_t consumed = 0;
+    GzipInflater::Result result = inflate(gz, feed, sink, &consumed);
+    char message[96];
+    snprintf(message, sizeof(message), "%s, %u-byte feed: %s", sample.name, (unsigned)feed,
+             GzipInflater::resultName(result));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(GzipInflater::OK, result, message);
+    TEST_ASSERT_TRUE_MESSAGE(sink.out == sample.data, message);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(gz.size(), consumed, message);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(GzipInflater::WINDOW_SIZE, sink.largestWrite);
+}
+
+const Sample& firmware() {
+    return samples.back();
+}
+
+} // namespace
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_python_gzip_levels_and_feeds() {
+    for (const Sample& sample : samples) {
+        for (int l = 0; l < 4; l++) {
+            TEST_ASSERT_GREATER_THAN(0, sample.gz[l].size());
+            for (size_t feed : FEEDS) {
+                checkInflates(sample, sample.gz[l], feed);
+            }
+        }
+        checkInflates(sample, sample.named, 7);
+    }
+    char message[96];
+    snprintf(message, sizeof(message), "%u-byte image: level 1 %u B, level 9 %u B (%.0f%%)",
+             (unsigned)firmware().data.size(), (unsigned)firmware().gz[1].size(), (unsigned)firmware().gz[3].size(),
+             100.0 * firmware().gz[3].size() / firmware().data.size());
+    TEST_MESSAGE(message);
+}
+
+// One byte changed anywhere. The header's MTIME, XFL and OS bytes and the padding bits after the last block are
+// not checked, so those may still inflate; anything else has to fail, and nothing may pass with other output.
+void test_corrupted_inputs() {
+    uint32_t state = 17;
+    int rejected = 0;
+    const Sample* targets[] = {&samples[1], &firmware()};
+    for (const Sample* sample : targets) {
+        const Bytes& good = sample->gz[2];
+        for (int trial = 0; trial < 300; trial++) {
+            Bytes bad = good;
+            size_t pos = lcg(state) % bad.size();
+            bad[pos] ^= (uint8_t)(1 + lcg(state) % 255);
+            PartitionSink sink = {Bytes(), PARTITION_SIZE, 0};
+            GzipInflater::Result result = inflate(bad, 4096, sink);
+            if (result == GzipInflater::OK) {
+                TEST_ASSERT_TRUE_MESSAGE(sink.out == sample->data, "corrupted input inflated to another image");
+                TEST_ASSERT_TRUE_MESSAGE((pos >= 4 && pos < 10) || pos == good.size() - 9, "corruption not detected");
+            } else {
+                rejected++;
+            }
+        }
+    }
+    TEST_ASSERT_GREATER_THAN(550, rejected);
+}
+
+// Every cut in the header and the trailer and 300 in between: always TRUNCATED, never OK
+void test_truncated_inputs() {
+    const Bytes& good = firmware().gz[2];
+    std::vector<size_t> cuts;
+    for (size_t i = 0; i < 20; i++) {
+        cuts.push_back(i);
+        cuts.push_back(good.size() - 1 - i);
+    }
+    for (size_t i = 0; i < 300; i++) {
+        cuts.push_back(20 + i * (good.size() - 40) / 300);
+    }
+    for (size_t cut : cuts) {
+        Bytes truncated(good.begin(), good.begin() + cut);
+        PartitionSink sink = {Bytes(), PARTITION_SIZE, 0};
+        TEST_ASSERT_EQUAL_INT(GzipInflater::TRUNCATED, inflate(truncated, 4096, sink));
+    }
+}
+
+void test_not_gzip() {
+    const Bytes& gz = firmware().gz[2];
+    PartitionSink sink = {Bytes(), PARTITION_SIZE, 0};
+    TEST_ASSERT_EQUAL_INT(GzipInflater::BAD_HEADER, inflate(firmware().data, 4096, sink)); // Uncompressed image
+
+    Bytes deflateMethod = gz;
+    deflateMethod[2] = 7; // CM other than deflate
+    TEST_ASSERT_EQUAL_INT(GzipInflater::BAD_HEADER, inflate(deflateMethod, 4096, sink));
+
+    Bytes zlib = gz; // Raw deflate data behind a zlib header (78 9c) instead of gzip's
+    zlib.erase(zlib.begin(), zlib.begin() + 10);
+    zlib.insert(zlib.begin(), {0x78, 0x9c});
+    TEST_ASSERT_EQUAL_INT(GzipInflater::BAD_HEADER, inflate(zlib, 4096, sink));
+}
+
+// An image larger than the partition stops at the partition's end
+void test_partition_overflow() {
+    PartitionSink sink = {Bytes(), firmware().data.size() - 1, 0};
+    TEST_ASSERT_EQUAL_INT(GzipInflater::WRITE_FAILED, inflate(firmware().gz[3], 4096, sink));
+    TEST_ASSERT_LESS_THAN_UINT32(firmware().data.size(), sink.out.size());
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    samples.push_back({"empty", Bytes(), {}, Bytes()});
+    samples.push_back({"log text", logText(), {}, Bytes()});
+    samples.push_back({"random", randomBytes(), {}, Bytes()});
+    samples.push_back({"firmware", firmwareImage(), {}, Bytes()}); // Last, see firmware()
+    if (!mkdtemp(dir) || !compressSamples()) {
+        fprintf(stderr, "python3 could not compress the samples\n");
+        return 1;
+    }
+    system((std::string("rm -rf ") + dir).c_str());
+
+    UNITY_BEGIN();
+    RUN_TEST(test_python_gzip_levels_and_feeds);
+    RUN_TEST(test_corrupted_inputs);
+    RUN_TEST(test_truncated_inputs);
+    RUN_TEST(test_not_gzip);
+    RUN_TEST(test_partition_overflow);
+    return UNITY_END();
+}
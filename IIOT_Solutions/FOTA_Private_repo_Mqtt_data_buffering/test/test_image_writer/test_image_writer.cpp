@@ -0,0 +1,231 @@
+// ImageWriter and Sha256: 300 randomised downloads with dropped connections, reboots and images replaced on
+// the server, each of which must leave exactly the image and its SHA-256 in the partition
+//   pio test -e native -f test_image_writer
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "image_writer.h"
+#include "sha256.h"
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+const uint32_t PARTITION_SIZE = 0x140000; // app0/app1 in partitions.csv
+const uint32_t RANGE_CHUNK = 65536;       // OTA_RANGE_CHUNK
+
+// Deterministic, so every run replays the same trials
+uint32_t lcg(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+// NOR flash: erase sets a sector to 0xFF, a write can only clear bits. Writing over bytes that were not
+// erased since their last write is what a resume that skips the erase would do, so it is counted.
+struct NorFlash {
+    Bytes bytes;
+    std::vector<bool> erased;
+    uint32_t dirtyWrites;
+    bool write(uint32_t offset, const uint8_t* buf, size_t len) {
+        if (offset + len > bytes.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < len; i++) {
+            dirtyWrites += erased[offset + i] ? 0 : 1;
+            bytes[offset + i] &= buf[i];
+            erased[offset + i] = false;
+        }
+        return true;
+    }
+    bool erase(uint32_t offset, size_t len) {
+        if (offset % ImageWriter<NorFlash>::SECTOR_SIZE != 0 || offset + len > bytes.size()) {
+            return false;
+        }
+        memset(&bytes[offset], 0xFF, len);
+        std::fill(erased.begin() + offset, erased.begin() + offset + len, true);
+        return true;
+    }
+};
+
+Bytes makeImage(uint32_t& state) {
+    Bytes image(1 + lcg(state) % 300000);
+    for (uint8_t& b : image) {
+        b = (uint8_t)lcg(state);
+    }
+    image[0] = 0xE9;
+    return image;
+}
+
+void digestOf(const Bytes& data, uint8_t digest[Sha256::DIGEST_SIZE]) {
+    Sha256 sha;
+    sha.update(data.data(), data.size());
+    sha.finish(digest);
+}
+
+void checkDigest(const char* message, const char* expectedHex) {
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    digestOf(Bytes(message, message + strlen(message)), digest);
+    char hex[65];
+    for (int i = 0; i < 32; i++) {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+    TEST_ASSERT_EQUAL_STRING(expectedHex, hex);
+}
+
+} // namespace
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+// FIPS 180-2 examples, so the reference digests below are themselves right
+void test_sha256_known_answers() {
+    checkDigest("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    checkDigest("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    checkDigest("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+                "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+// Saving the midstate at any block boundary and restoring it in a fresh object continues the same hash
+void test_sha256_midstate() {
+    uint32_t state = 21;
+    for (int trial = 0; trial < 100; trial++) {
+        Bytes data = makeImage(state);
+        uint8_t expected[Sha256::DIGEST_SIZE];
+        digestOf(data, expected);
+
+        size_t split = (lcg(state) % (data.size() + 1)) / Sha256::BLOCK_SIZE * Sha256::BLOCK_SIZE;
+        Sha256 first;
+        first.update(data.data(), split);
+        uint32_t midstate[8];
+        TEST_ASSERT_TRUE(first.saveState(midstate));
+        Sha256 second;
+        second.restoreState(midstate, split);
+        second.update(data.data() + split, data.size() - split);
+        uint8_t digest[Sha256::DIGEST_SIZE];
+        second.finish(digest);
+        TEST_ASSERT_EQUAL_MEMORY(expected, digest, sizeof(digest));
+    }
+}
+
+// resumableUpdate()/downloadRange() on a simulated link. Each Range request covers the rest of the current
+// RANGE_CHUNK and arrives in TCP-sized pieces; any piece may be the last before the connection drops (the writer
+// carries on from its offset) or before a reboot (a new writer resumes from the checkpoint in "NVS"). Now and
+// then the server gets a new image, and the next If-Range request starts over from byte 0.
+void test_randomised_disconnects_and_reboots() {
+    uint32_t state = 1;
+    uint32_t drops = 0;
+    uint32_t reboots = 0;
+    uint32_t replaced = 0;
+    static NorFlash flash;
+    flash.bytes.assign(PARTITION_SIZE, 0);
+    flash.erased.assign(PARTITION_SIZE, false);
+
+    for (int trial = 0; trial < 300; trial++) {
+        Bytes image = makeImage(state);
+        uint32_t dropPercent = 1 + lcg(state) % 10;    // Per piece
+        uint32_t rebootPercent = lcg(state) % 4;       // Per piece
+        bool replace = lcg(state) % 10 == 0;
+
+        flash.dirtyWrites = 0;
+        ImageCheckpoint nvs;                           // dl_state
+        bool saved = false;
+        ImageWriter<NorFlash>* writer = new ImageWriter<NorFlash>(flash);
+        writer->start(image.size());
+
+        for (int requests = 0; !writer->complete(); requests++) {
+            TEST_ASSERT_TRUE_MESSAGE(requests < 100000, "download makes no progress");
+            uint32_t from = writer->offset();
+            uint32_t to = (from / RANGE_CHUNK + 1) * RANGE_CHUNK;
+            to = to < image.size() ? to : image.size();
+            bool rebooted = false;
+            while (writer->offset() < to) {
+                uint32_t n = 1 + lcg(state) % 1460;
+                n = n < to - writer->offset() ? n : to - writer->offset();
+                TEST_ASSERT_TRUE(writer->write(&image[writer->offset()], n));
+                if (lcg(state) % 100 < rebootPercent) {
+                    rebooted = true;
+                    break;
+                }
+                if (lcg(state) % 100 < dropPercent) {
+                    break;
+                }
+            }
+            if (rebooted) {
+                reboots++;
+                delete writer;
+                writer = new ImageWriter<NorFlash>(flash);
+                if (!saved || !writer->resume(nvs)) {
+                    writer->start(image.size());
+                }
+            } else if (writer->offset() < to) {
+                drops++;
+            } else if (writer->atSectorBoundary() && !writer->complete()) {
+                nvs = writer->checkpoint();            // saveDownloadCheckpoint()
+                saved = true;
+            }
+            if (replace && writer->offset() > image.size() / 2) {
+                // If-Range no longer matches: the whole new image comes back with a 200
+                replaced++;
+                replace = false;
+                image = makeImage(state);
+                writer->start(image.size());
+                saved = false;                         // clearDownloadCheckpoint()
+            }
+        }
+
+        uint8_t expected[Sha256::DIGEST_SIZE];
+        uint8_t digest[Sha256::DIGEST_SIZE];
+        digestOf(image, expected);
+        writer->finish(digest);
+        delete writer;
+        char message[64];
+        snprintf(message, sizeof(message), "trial %d, %u-byte image", trial, (unsigned)image.size());
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(expected, digest, sizeof(digest), message);
+        TEST_ASSERT_EQUAL_MEMORY_MESSAGE(image.data(), flash.bytes.data(), image.size(), message);
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, flash.dirtyWrites, message);
+    }
+
+    char message[96];
+    snprintf(message, sizeof(message), "300 downloads: %u dropped connections, %u reboots, %u images replaced",
+             (unsigned)drops, (unsigned)reboots, (unsigned)replaced);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_THAN_UINT32(1000, drops);
+    TEST_ASSERT_GREATER_THAN_UINT32(100, reboots);
+}
+
+// A checkpoint that does not describe a sector boundary inside the image is refused
+void test_resume_rejects_bad_checkpoints() {
+    NorFlash flash;
+    flash.bytes.assign(2 * ImageWriter<NorFlash>::SECTOR_SIZE, 0);
+    flash.erased.assign(flash.bytes.size(), false);
+    ImageWriter<NorFlash> writer(flash);
+    ImageCheckpoint checkpoint = {};
+    checkpoint.size = 8192;
+    checkpoint.offset = 100;
+    TEST_ASSERT_FALSE(writer.resume(checkpoint));
+    checkpoint.offset = 12288;
+    TEST_ASSERT_FALSE(writer.resume(checkpoint));
+    checkpoint.offset = 4096;
+    TEST_ASSERT_TRUE(writer.resume(checkpoint));
+
+    uint8_t byte = 0;
+    writer.start(1);
+    TEST_ASSERT_TRUE(writer.write(&byte, 1));
+    TEST_ASSERT_FALSE(writer.write(&byte, 1)); // Past the announced size
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_sha256_known_answers);
+    RUN_TEST(test_sha256_midstate);
+    RUN_TEST(test_randomised_disconnects_and_reboots);
+    RUN_TEST(test_resume_rejects_bad_checkpoints);
+    return UNITY_END();
+}
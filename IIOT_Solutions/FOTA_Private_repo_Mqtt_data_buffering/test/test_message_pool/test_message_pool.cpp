@@ -0,0 +1,218 @@
+// MessageAssembler and MessagePool: random payloads cut into TCP-sized pieces as AsyncMqttClient delivers them,
+// pool exhaustion, and buffers handed to another thread, with no corruption, leaked buffers or heap growth
+//   pio test -e native -f test_message_pool
+
+#include <unity.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "message_pool.h"
+
+namespace {
+
+const size_t MESSAGE_MAX = 32768;     // Pool buffer size for these runs
+const size_t LARGEST_SENT = 40000;    // Some messages exceed MESSAGE_MAX and must be dropped
+const size_t SEGMENT_MAX = 1436;      // TCP payload per segment with the usual MSS
+
+typedef MessagePool<2, MESSAGE_MAX> Pool;
+typedef MessageAssembler<Pool> Assembler;
+
+Pool pool;
+std::vector<char> payload(LARGEST_SENT);
+
+// Deterministic, so every run sends the same messages
+uint32_t lcg(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+size_t heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return 0; // Not measured on this libc
+#endif
+}
+
+// Sends data[0, total) in random pieces; with cut set, the connection drops before the last one
+Assembler::Status send(Assembler& assembler, const char* data, size_t total, bool cut, uint32_t& state,
+                       size_t& sentUpTo) {
+    size_t stopAt = cut ? 1 + lcg(state) % (total - 1) : total;
+    Assembler::Status status = Assembler::DROPPED;
+    size_t index = 0;
+    do {
+        size_t len = 1 + lcg(state) % SEGMENT_MAX;
+        len = total - index < len ? total - index : len;
+        if (cut && index + len >= total) {
+            len = stopAt - index;             // The rest never arrives
+        }
+        status = assembler.add(data + index, len, index, total);
+        index += len;
+    } while (index < stopAt && status != Assembler::COMPLETE);
+    sentUpTo = index;
+    return status;
+}
+
+} // namespace
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_random_segments() {
+    const uint32_t MESSAGES = 100000;
+    Assembler assembler(pool);
+    uint32_t state = 1;
+    uint32_t delivered = 0;
+    uint32_t dropped = 0;
+    uint32_t errors = 0;
+    uint64_t bytes = 0;
+
+    size_t heapBefore = heapInUse();
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t m = 0; m < MESSAGES; m++) {
+        // Mostly small commands, some large manifests, a few over the limit
+        size_t total = lcg(state) % 4 ? lcg(state) % 512 : lcg(state) % (LARGEST_SENT + 1);
+        const char* data = payload.data() + lcg(state) % (LARGEST_SENT - total + 1);
+        bool cut = lcg(state) % 50 == 0 && total > 1;
+        bool expected = total <= MESSAGE_MAX && !cut;
+
+        size_t sent = 0;
+        bool completed = send(assembler, data, total, cut, state, sent) == Assembler::COMPLETE;
+        if (completed) {
+            if (sent != total || assembler.length() != total || memcmp(assembler.message(), data, total) != 0) {
+                errors++;
+            }
+            bytes += total;
+            assembler.release();
+        }
+        errors += completed != expected ? 1 : 0;
+        completed ? delivered++ : dropped++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    assembler.add("", 0, 0, 0); // A message after a cut one frees its buffer
+    assembler.release();
+    long heapGrowth = (long)heapInUse() - (long)heapBefore;
+
+    char message[160];
+    snprintf(message, sizeof(message), "%lu messages (%lu delivered, %lu dropped): %.0f messages/s, %.1f MB/s, "
+             "heap growth %ld B", (unsigned long)MESSAGES, (unsigned long)delivered, (unsigned long)dropped,
+             MESSAGES / seconds, bytes / seconds / 1e6, heapGrowth);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_UINT32(0, errors);
+    TEST_ASSERT_EQUAL_size_t(0, pool.inUse());
+    TEST_ASSERT_TRUE_MESSAGE(heapGrowth <= 0, "the heap grew");
+    TEST_ASSERT_GREATER_THAN_UINT32(1000, dropped); // Oversized and cut messages were exercised
+}
+
+// Messages whose buffers were taken by the handler hold the pool; with none left the next multi-piece
+// message is dropped, while single-piece ones still go through without a buffer
+void test_pool_exhaustion() {
+    Assembler assembler(pool);
+    uint32_t state = 5;
+    size_t sent = 0;
+    char* taken[2];
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_EQUAL_INT(Assembler::COMPLETE, send(assembler, payload.data(), 4000, false, state, sent));
+        taken[i] = assembler.take();
+        TEST_ASSERT_NOT_NULL(taken[i]);
+        TEST_ASSERT_EQUAL_MEMORY(payload.data(), taken[i], 4000);
+    }
+    TEST_ASSERT_EQUAL_size_t(2, pool.inUse());
+
+    TEST_ASSERT_EQUAL_INT(Assembler::DROPPED, assembler.add(payload.data(), 100, 0, 200));
+    TEST_ASSERT_EQUAL_INT(Assembler::DROPPED, assembler.add(payload.data() + 100, 100, 100, 200));
+    TEST_ASSERT_EQUAL_INT(Assembler::COMPLETE, assembler.add(payload.data(), 50, 0, 50));
+    TEST_ASSERT_NULL(assembler.take());
+    assembler.release();
+
+    pool.release(taken[0]);
+    TEST_ASSERT_EQUAL_INT(Assembler::COMPLETE, send(assembler, payload.data() + 7, 3000, false, state, sent));
+    TEST_ASSERT_EQUAL_MEMORY(payload.data() + 7, assembler.message(), 3000);
+    assembler.release();
+    pool.release(taken[1]);
+    TEST_ASSERT_EQUAL_size_t(0, pool.inUse());
+}
+
+// The AsyncTCP task assembles and hands buffers over with take(); the MQTT task parses and releases them.
+// Every handed-over buffer must still hold its message when the other thread reads it.
+void test_release_from_another_thread() {
+    const uint32_t MESSAGES = 200000;
+    struct Handoff {
+        std::atomic<char*> buffer{nullptr};
+        size_t offset;
+        size_t length;
+    };
+    static Handoff slot;
+    std::atomic<uint32_t> errors{0};
+    std::atomic<bool> done{false};
+
+    std::thread consumer([&] {
+        for (;;) {
+            char* buffer = slot.buffer.load(std::memory_order_acquire);
+            if (!buffer) {
+                if (done.load(std::memory_order_acquire) && !slot.buffer.load(std::memory_order_acquire)) {
+                    return;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            if (memcmp(buffer, payload.data() + slot.offset, slot.length) != 0) {
+                errors++;
+            }
+            slot.buffer.store(nullptr, std::memory_order_release);
+            pool.release(buffer);
+        }
+    });
+
+    Assembler assembler(pool);
+    uint32_t state = 9;
+    uint32_t handedOver = 0;
+    for (uint32_t m = 0; m < MESSAGES; m++) {
+        size_t total = 2 + lcg(state) % 3000;
+        size_t offset = lcg(state) % (LARGEST_SENT - total + 1);
+        size_t sent = 0;
+        if (send(assembler, payload.data() + offset, total, false, state, sent) != Assembler::COMPLETE) {
+            continue; // Both buffers busy: dropped, as on the device
+        }
+        char* buffer = assembler.take();
+        if (!buffer) {
+            assembler.release(); // Arrived in one piece, handled in place
+            continue;
+        }
+        while (slot.buffer.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        slot.offset = offset;
+        slot.length = total;
+        slot.buffer.store(buffer, std::memory_order_release);
+        handedOver++;
+    }
+    done = true;
+    consumer.join();
+
+    TEST_ASSERT_EQUAL_UINT32(0, errors.load());
+    TEST_ASSERT_EQUAL_size_t(0, pool.inUse());
+    TEST_ASSERT_GREATER_THAN_UINT32(MESSAGES / 2, handedOver);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    uint32_t state = 1;
+    for (char& c : payload) {
+        c = (char)lcg(state);
+    }
+    UNITY_BEGIN();
+    RUN_TEST(test_random_segments);
+    RUN_TEST(test_pool_exhaustion);
+    RUN_TEST(test_release_from_another_thread);
+    return UNITY_END();
+}
@@ -0,0 +1,163 @@
+// payload::Payload: the counter and birth messages come out as the String code built them, overflow is
+// reported, and formatting makes no heap allocation at all
+//   pio test -e native -f test_payload_format
+
+#include <unity.h>
+#include <stdio.h>
+#include "Arduino.h"
+#include "WiFi.h"
+#include "payload_format.h"
+
+// Heap calls made on the thread that is counting, through glibc's own entry points. operator new and
+// String both end up in malloc, so nothing escapes.
+namespace {
+thread_local bool counting = false;
+uint32_t allocations = 0;
+} // namespace
+
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    allocations += counting ? 1 : 0;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocations += counting ? 1 : 0;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    allocations += counting ? 1 : 0;
+    return __libc_realloc(ptr, size);
+}
+}
+#endif
+
+namespace {
+
+// As in main.cpp, with DEVICE_ACCESS_TOKEN "ESP32"
+constexpr char COUNTER_PREFIX[] = "Counter: ";
+constexpr char BIRTH_PREFIX[] = "{\"status\":\"online\", \"deviceId\":\"" "ESP32" "\", \"ip\":\"";
+constexpr char BIRTH_SUFFIX[] = "\"}";
+typedef payload::Payload<payload::capacity(sizeof(COUNTER_PREFIX), payload::UINT32_CHARS)> CounterPayload;
+typedef payload::Payload<payload::capacity(sizeof(BIRTH_PREFIX), payload::IPV4_CHARS, sizeof(BIRTH_SUFFIX))> BirthPayload;
+
+const uint32_t VALUES[] = {0, 1, 9, 10, 99, 100, 65535, 1000000, 2147483647u, 4294967295u};
+
+uint32_t lcg(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state;
+}
+
+void startCounting() {
+#ifndef __GLIBC__
+    TEST_IGNORE_MESSAGE("allocation counting needs glibc");
+#endif
+    allocations = 0;
+    counting = true;
+}
+
+uint32_t stopCounting() {
+    counting = false;
+    return allocations;
+}
+
+} // namespace
+
+void setUp() {
+}
+
+void tearDown() {
+    counting = false;
+}
+
+void test_counter_matches_string_format() {
+    uint32_t state = 3;
+    for (int i = 0; i < 100000; i++) {
+        uint32_t value = i < 10 ? VALUES[i] : lcg(state);
+        CounterPayload sensorData;
+        sensorData.add(COUNTER_PREFIX).addUint(value);
+        String expected = "Counter: " + String((unsigned long)value); // What publishSensorData() used to send
+        TEST_ASSERT_TRUE(sensorData.ok());
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), sensorData.c_str());
+        TEST_ASSERT_EQUAL_size_t(expected.length(), sensorData.length());
+    }
+}
+
+void test_birth_matches_string_format() {
+    IPAddress addresses[] = {IPAddress(0, 0, 0, 0), IPAddress(192, 168, 4, 2), IPAddress(255, 255, 255, 255),
+                             IPAddress(10, 0, 100, 9)};
+    for (const IPAddress& ip : addresses) {
+        BirthPayload birthMessage;
+        birthMessage.add(BIRTH_PREFIX).addIp(ip).add(BIRTH_SUFFIX);
+        String expected = String("{\"status\":\"online\", \"deviceId\":\"ESP32\", \"ip\":\"") + ip.toString() + "\"}";
+        TEST_ASSERT_TRUE(birthMessage.ok());
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), birthMessage.c_str());
+    }
+    // The capacity computed at compile time fits the widest address
+    TEST_ASSERT_LESS_OR_EQUAL(BirthPayload::capacity(), strlen(BIRTH_PREFIX) + 15 + strlen(BIRTH_SUFFIX));
+}
+
+// A template sized too small stops appending and says so instead of truncating silently
+void test_overflow_is_reported() {
+    payload::Payload<sizeof("Counter: 12")> small;
+    small.add(COUNTER_PREFIX).addUint(123);
+    TEST_ASSERT_FALSE(small.ok());
+    TEST_ASSERT_EQUAL_STRING("Counter: ", small.c_str());
+    small.add("x");
+    TEST_ASSERT_FALSE(small.ok());
+    TEST_ASSERT_EQUAL_STRING("Counter: ", small.c_str());
+
+    payload::Payload<sizeof("Counter: 123")> exact;
+    exact.add(COUNTER_PREFIX).addUint(123);
+    TEST_ASSERT_TRUE(exact.ok());
+    TEST_ASSERT_EQUAL_STRING("Counter: 123", exact.c_str());
+}
+
+// The point of the change: no heap traffic per publish. The String version is counted as well, so the check
+// cannot pass because nothing is being counted.
+void test_no_allocations() {
+    IPAddress ip(192, 168, 4, 2);
+    uint32_t state = 7;
+    size_t checksum = 0;
+    startCounting();
+    for (int i = 0; i < 100000; i++) {
+        CounterPayload sensorData;
+        sensorData.add(COUNTER_PREFIX).addUint(lcg(state));
+        BirthPayload birthMessage;
+        birthMessage.add(BIRTH_PREFIX).addIp(ip).add(BIRTH_SUFFIX);
+        checksum += sensorData.length() + birthMessage.length();
+    }
+    uint32_t payloadAllocations = stopCounting();
+
+    startCounting();
+    for (int i = 0; i < 1000; i++) {
+        String birth = String("{\"status\":\"online\", \"deviceId\":\"ESP32\", \"ip\":\"") + ip.toString() + "\"}";
+        checksum += birth.length();
+    }
+    uint32_t stringAllocations = stopCounting();
+
+    char message[128];
+    snprintf(message, sizeof(message), "100000 counter + birth payloads: %lu allocations; 1000 String births: %lu",
+             (unsigned long)payloadAllocations, (unsigned long)stringAllocations);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_GREATER_THAN(0, checksum);
+    TEST_ASSERT_EQUAL_UINT32(0, payloadAllocations);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(1000, stringAllocations);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_counter_matches_string_format);
+    RUN_TEST(test_birth_matches_string_format);
+    RUN_TEST(test_overflow_is_reported);
+    RUN_TEST(test_no_allocations);
+    return UNITY_END();
+}
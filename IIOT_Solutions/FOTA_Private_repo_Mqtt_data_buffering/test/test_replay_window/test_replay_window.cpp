@@ -0,0 +1,294 @@
+// ReplayWindow: out-of-order acks, the window following the ack RTT, and replay of a DataLog the way
+// processBufferedData() drives it, through ack timeouts and seeded disconnects
+//   pio test -e native -f test_replay_window
+
+#include <unity.h>
+#include <set>
+#include <vector>
+#include "LittleFS.h"
+#include "data_log.h"
+#include "mock.h"
+#include "replay_window.h"
+
+namespace {
+
+const uint32_t ACK_TIMEOUT = 10000;
+
+uint32_t lcgState;
+
+uint32_t lcg() {
+    lcgState = lcgState * 1664525u + 1013904223u;
+    return lcgState >> 8;
+}
+
+// What the firmware keeps per batch: the log cursor past it, and the last record it carries
+struct Mark {
+    LogCursor end;
+    uint32_t lastSeq;
+};
+
+// A DataLog of consecutive sequence numbers replayed through a window, in the same steps as
+// processBufferedData(), handleMqttAck() and handleMqttDisconnect() in main.cpp
+struct Replay {
+    DataLog log;
+    ReplayWindow<Mark, 8> window;
+    uint32_t committed = 0;       // Records released from the log
+    std::set<uint32_t> acked;     // Records the broker has confirmed
+    std::vector<uint32_t> sent;   // Every record handed to the link, resends included
+
+    void fill(uint32_t records) {
+        for (uint32_t seq = 1; seq <= records; seq++) {
+            TEST_ASSERT_TRUE(log.append(&seq, sizeof(seq)));
+        }
+        TEST_ASSERT_TRUE(log.flush());
+    }
+
+    // One batch of up to maxRecords; false once the log is drained
+    bool send(uint16_t packetId, uint32_t now, uint32_t maxRecords, std::vector<uint32_t>& batch) {
+        batch.clear();
+        uint32_t seq;
+        size_t len;
+        Mark mark = {log.readCursor(), 0};
+        while (batch.size() < maxRecords && log.read(&seq, sizeof(seq), len)) {
+            TEST_ASSERT_EQUAL_size_t(sizeof(seq), len);
+            batch.push_back(seq);
+            mark.end = log.readCursor();
+            mark.lastSeq = seq;
+        }
+        if (batch.empty()) {
+            return false;
+        }
+        sent.insert(sent.end(), batch.begin(), batch.end());
+        window.onSent(packetId, mark, now);
+        return true;
+    }
+
+    void ack(uint16_t packetId, uint32_t now, const std::vector<uint32_t>& batch) {
+        acked.insert(batch.begin(), batch.end());
+        Mark commitTo;
+        if (window.onAck(packetId, now, commitTo)) {
+            // Nothing up to the commit point may still be waiting for its ack
+            for (uint32_t seq = committed + 1; seq <= commitTo.lastSeq; seq++) {
+                TEST_ASSERT_TRUE_MESSAGE(acked.count(seq), "record committed before its ack");
+            }
+            TEST_ASSERT_TRUE(commitTo.lastSeq > committed);
+            log.commit(commitTo.end);
+            committed = commitTo.lastSeq;
+        }
+    }
+
+    // Disconnect or ack timeout: unacked batches go out again from the commit point
+    void rewind() {
+        window.reset();
+        log.rewind();
+    }
+
+    uint32_t nextRead() {
+        uint32_t seq = 0;
+        size_t len;
+        LogCursor at = log.readCursor();
+        if (log.read(&seq, sizeof(seq), len)) {
+            log.seekRead(at);
+        }
+        return seq;
+    }
+};
+
+struct InFlight {
+    uint16_t packetId;
+    std::vector<uint32_t> records;
+};
+
+} // namespace
+
+void setUp() {
+    mock::restorePower();
+    LittleFS.format();
+}
+
+void tearDown() {
+}
+
+void test_out_of_order_acks() {
+    ReplayWindow<uint32_t, 4, 4> window;
+    for (uint16_t id = 1; id <= 4; id++) {
+        TEST_ASSERT_TRUE(window.canSend());
+        window.onSent(id, id * 10, 0);
+    }
+    TEST_ASSERT_FALSE(window.canSend());
+
+    uint32_t commitTo = 0;
+    TEST_ASSERT_FALSE(window.onAck(3, 5, commitTo)); // Batches 1 and 2 are still out
+    TEST_ASSERT_FALSE(window.onAck(2, 5, commitTo));
+    TEST_ASSERT_EQUAL_size_t(4, window.inFlight());
+    TEST_ASSERT_FALSE(window.onAck(99, 5, commitTo)); // Not a replay publish
+    TEST_ASSERT_FALSE(window.onAck(3, 5, commitTo));  // Duplicate
+    TEST_ASSERT_TRUE(window.onAck(1, 5, commitTo));   // Releases 1, 2 and 3 at once
+    TEST_ASSERT_EQUAL_UINT32(30, commitTo);
+    TEST_ASSERT_EQUAL_size_t(1, window.inFlight());
+
+    window.onSent(5, 50, 6);
+    window.onSent(6, 60, 6);
+    TEST_ASSERT_FALSE(window.onAck(6, 8, commitTo));
+    TEST_ASSERT_FALSE(window.onAck(5, 8, commitTo)); // 4 is still out, the commit stays put
+    TEST_ASSERT_EQUAL_UINT32(30, commitTo);
+    TEST_ASSERT_TRUE(window.onAck(4, 9, commitTo));
+    TEST_ASSERT_EQUAL_UINT32(60, commitTo);
+    TEST_ASSERT_EQUAL_size_t(0, window.inFlight());
+}
+
+void test_stall_then_rewind() {
+    Replay replay;
+    TEST_ASSERT_TRUE(replay.log.begin());
+    replay.fill(20);
+
+    std::vector<uint32_t> first;
+    std::vector<uint32_t> second;
+    TEST_ASSERT_TRUE(replay.send(1, 1000, 5, first));
+    TEST_ASSERT_FALSE(replay.window.stalled(1000 + ACK_TIMEOUT, ACK_TIMEOUT));
+    TEST_ASSERT_TRUE(replay.window.stalled(1001 + ACK_TIMEOUT, ACK_TIMEOUT));
+
+    // The first batch is acked late, the second never is
+    replay.ack(1, 1000 + ACK_TIMEOUT, first);
+    TEST_ASSERT_EQUAL_UINT32(5, replay.committed);
+    TEST_ASSERT_FALSE(replay.window.stalled(1001 + ACK_TIMEOUT, ACK_TIMEOUT));
+    TEST_ASSERT_TRUE(replay.send(2, 12000, 5, second));
+    TEST_ASSERT_FALSE(replay.window.stalled(12000 + ACK_TIMEOUT, ACK_TIMEOUT));
+    TEST_ASSERT_TRUE(replay.window.stalled(12001 + ACK_TIMEOUT, ACK_TIMEOUT));
+
+    replay.rewind();
+    TEST_ASSERT_FALSE(replay.window.stalled(30000, ACK_TIMEOUT));
+    TEST_ASSERT_EQUAL_size_t(0, replay.window.inFlight());
+    TEST_ASSERT_EQUAL_UINT32(6, replay.nextRead()); // Straight after the last acked record
+
+    // A late ack for the abandoned batch must not commit anything
+    replay.window.onSent(3, Mark{replay.log.readCursor(), 0}, 30000);
+    Mark commitTo;
+    TEST_ASSERT_FALSE(replay.window.onAck(2, 30001, commitTo));
+    replay.rewind();
+
+    TEST_ASSERT_TRUE(replay.send(4, 30000, 15, second));
+    TEST_ASSERT_EQUAL_size_t(15, second.size());
+    TEST_ASSERT_EQUAL_UINT32(6, second.front());
+    replay.ack(4, 30010, second);
+    TEST_ASSERT_EQUAL_UINT32(20, replay.committed);
+    TEST_ASSERT_EQUAL_UINT32(0, replay.nextRead());
+}
+
+// Seeded runs of replay with acks in any order, the link dropping mid-replay and publishes refused
+void test_disconnect_mid_replay() {
+    const uint32_t RECORDS = 2000;
+    for (uint32_t seed = 1; seed <= 20; seed++) {
+        setUp();
+        lcgState = seed;
+        Replay replay;
+        TEST_ASSERT_TRUE(replay.log.begin());
+        replay.fill(RECORDS);
+
+        std::vector<InFlight> inFlight;
+        uint16_t nextId = 1;
+        uint32_t now = 0;
+        uint32_t disconnects = 0;
+        while (replay.committed < RECORDS) {
+            now += 1 + lcg() % 20;
+            uint32_t action = lcg() % 100;
+            if (action < 2) {
+                // Link drops: in-flight acks never arrive, the next connect resends from the commit point
+                inFlight.clear();
+                replay.rewind();
+                TEST_ASSERT_EQUAL_UINT32(replay.committed + 1, replay.nextRead());
+                disconnects++;
+            } else if (action < 50 && !inFlight.empty()) {
+                size_t pick = lcg() % inFlight.size();
+                replay.ack(inFlight[pick].packetId, now, inFlight[pick].records);
+                inFlight.erase(inFlight.begin() + pick);
+            } else if (action < 53) {
+                replay.window.onSendFailed();
+            } else if (replay.window.canSend()) {
+                InFlight batch;
+                batch.packetId = nextId++;
+                if (nextId == 0) {
+                    nextId = 1;
+                }
+                if (replay.send(batch.packetId, now, 1 + lcg() % 40, batch.records)) {
+                    inFlight.push_back(batch);
+                }
+            }
+            // Acked batches behind an unacked one stay in the window until it is acked
+            TEST_ASSERT_TRUE(replay.window.inFlight() >= inFlight.size() && replay.window.inFlight() <= 8);
+        }
+
+        TEST_ASSERT_TRUE(disconnects > 0);
+        TEST_ASSERT_EQUAL_size_t(RECORDS, replay.acked.size());
+        TEST_ASSERT_EQUAL_UINT32(RECORDS, *replay.acked.rbegin());
+        std::set<uint32_t> sent(replay.sent.begin(), replay.sent.end());
+        TEST_ASSERT_EQUAL_size_t(RECORDS, sent.size()); // Every record went out, resends aside
+        TEST_ASSERT_EQUAL_UINT32(0, replay.nextRead());
+    }
+}
+
+void test_window_follows_rtt() {
+    ReplayWindow<uint32_t, 8> window;
+    uint32_t now = 0;
+    uint16_t id = 1;
+    uint32_t commitTo;
+    // Sends a full window, acks it after rtt ms
+    auto round = [&](uint32_t rtt) {
+        size_t first = id;
+        while (window.canSend()) {
+            window.onSent(id, id, now);
+            id++;
+        }
+        now += rtt;
+        for (size_t i = first; i < id; i++) {
+            window.onAck((uint16_t)i, now, commitTo);
+        }
+        TEST_ASSERT_EQUAL_size_t(0, window.inFlight());
+    };
+
+    TEST_ASSERT_EQUAL_size_t(1, window.window());
+    size_t last = window.window();
+    for (int i = 0; i < 20; i++) { // Steady 20 ms acks: one more per window's worth of acks
+        round(20);
+        TEST_ASSERT_TRUE(window.window() >= last && window.window() <= last + 1);
+        last = window.window();
+    }
+    TEST_ASSERT_EQUAL_size_t(8, window.window());
+    TEST_ASSERT_EQUAL_UINT32(20, window.minRtt());
+    TEST_ASSERT_EQUAL_UINT32(20, window.smoothedRtt());
+
+    for (int i = 0; i < 20; i++) { // The broker starts queueing: 200 ms acks halve the window
+        round(200);
+        TEST_ASSERT_TRUE(window.window() <= last);
+        last = window.window();
+    }
+    TEST_ASSERT_EQUAL_size_t(1, window.window());
+    TEST_ASSERT_TRUE(window.smoothedRtt() >= 20 * window.RTT_BACKOFF_FACTOR);
+
+    for (int i = 0; i < 60; i++) { // Queue gone: srtt decays and the window opens again
+        round(20);
+    }
+    TEST_ASSERT_EQUAL_size_t(8, window.window());
+
+    window.onSendFailed();
+    TEST_ASSERT_EQUAL_size_t(4, window.window());
+    window.onSendFailed();
+    window.onSendFailed();
+    window.onSendFailed();
+    TEST_ASSERT_EQUAL_size_t(1, window.window()); // Never below MinWindow
+
+    window.reset();
+    TEST_ASSERT_EQUAL_size_t(1, window.window());
+    TEST_ASSERT_EQUAL_UINT32(0, window.minRtt());
+}
+
+int main(int argc, char** argv) {
+    mock::begin(argc, argv);
+    LittleFS.begin();
+    UNITY_BEGIN();
+    RUN_TEST(test_out_of_order_acks);
+    RUN_TEST(test_stall_then_rewind);
+    RUN_TEST(test_disconnect_mid_replay);
+    RUN_TEST(test_window_follows_rtt);
+    return UNITY_END();
+}
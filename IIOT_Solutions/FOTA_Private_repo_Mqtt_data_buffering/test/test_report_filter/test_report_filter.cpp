@@ -0,0 +1,52 @@
+// ReportFilter: deadbands, minimum interval and heartbeat, and counter values above 2^24 that a float
+// would round together
+//   pio test -e native -f test_report_filter
+
+#include <unity.h>
+#include "report_filter.h"
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_deadband_interval_and_heartbeat() {
+    ReportFilter filter;
+    ReportPolicy policy = {0.5f, 0, 10000, 60000};
+    filter.setPolicy(policy);
+    TEST_ASSERT_EQUAL_INT(ReportFilter::CHANGED, filter.offer(20.0, 0));      // First sample
+    TEST_ASSERT_EQUAL_INT(ReportFilter::SUPPRESS, filter.offer(20.4, 15000)); // Within the deadband
+    TEST_ASSERT_EQUAL_INT(ReportFilter::SUPPRESS, filter.offer(21.0, 5000));  // Beyond, but too soon
+    TEST_ASSERT_EQUAL_INT(ReportFilter::CHANGED, filter.offer(21.0, 20000));
+    TEST_ASSERT_EQUAL_INT(ReportFilter::SUPPRESS, filter.offer(21.2, 79999));
+    TEST_ASSERT_EQUAL_INT(ReportFilter::HEARTBEAT, filter.offer(21.2, 80000));
+
+    ReportFilter::Stats stats = filter.takeStats();
+    TEST_ASSERT_EQUAL_UINT32(2, stats.sent);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.heartbeats);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.suppressed);
+}
+
+// publishSensorData() offers the counter itself: with the default policy every increment is a change,
+// however long the device has been counting
+void test_large_counter_values() {
+    ReportFilter filter;
+    const unsigned long starts[] = {16777216ul, 123456789ul, 4294967000ul};
+    for (unsigned long start : starts) {
+        filter.reset();
+        for (unsigned long i = 0; i < 200; i++) {
+            TEST_ASSERT_EQUAL_INT(ReportFilter::CHANGED, filter.offer(start + i, i * 5000));
+        }
+        TEST_ASSERT_EQUAL_INT(ReportFilter::SUPPRESS, filter.offer(start + 199, 1000000));
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_deadband_interval_and_heartbeat);
+    RUN_TEST(test_large_counter_values);
+    return UNITY_END();
+}
@@ -0,0 +1,139 @@
+// RingBuffer: capacity and order on one thread, then a producer and a consumer thread checking for loss,
+// duplicates and torn slots
+//   pio test -e native -f test_ring_buffer
+
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include "ring_buffer.h"
+
+namespace {
+
+struct Item {
+    uint32_t seq;
+    uint32_t check; // ~seq, so a slot read while it is being written shows up
+};
+
+Item makeItem(uint32_t seq) {
+    Item item = {seq, ~seq};
+    return item;
+}
+
+// Fills and drains a ring of N slots to a different level on each lap, so head and tail pass every index
+template <size_t N>
+void checkLaps() {
+    RingBuffer<Item, N> ring;
+    uint32_t pushed = 0;
+    uint32_t popped = 0;
+    Item item;
+    for (uint32_t lap = 0; lap < 8 * N + 3; lap++) {
+        while (ring.push(makeItem(pushed))) {
+            pushed++;
+        }
+        TEST_ASSERT_TRUE(ring.full());
+        TEST_ASSERT_FALSE(ring.empty());
+        TEST_ASSERT_EQUAL_size_t(N, ring.size());
+        for (uint32_t i = 0; i <= lap % N; i++) {
+            TEST_ASSERT_TRUE(ring.pop(item));
+            TEST_ASSERT_EQUAL_UINT32(popped++, item.seq);
+        }
+        TEST_ASSERT_EQUAL_size_t(pushed - popped, ring.size());
+    }
+    while (ring.pop(item)) {
+        TEST_ASSERT_EQUAL_UINT32(popped++, item.seq);
+    }
+    TEST_ASSERT_EQUAL_UINT32(pushed, popped);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+} // namespace
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_capacity_and_order() {
+    RingBuffer<Item, 10> ring;
+    Item item;
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_FALSE(ring.pop(item));
+
+    uint32_t pushed = 0;
+    uint32_t popped = 0;
+    for (int round = 0; round < 100; round++) { // Many laps around the slots
+        while (ring.push(makeItem(pushed))) {
+            pushed++;
+        }
+        TEST_ASSERT_TRUE(ring.full());
+        TEST_ASSERT_EQUAL_size_t(10, ring.size());
+        for (int i = 0; i < 3 + round % 7; i++) {
+            TEST_ASSERT_TRUE(ring.pop(item));
+            TEST_ASSERT_EQUAL_UINT32(popped++, item.seq);
+        }
+    }
+    while (ring.pop(item)) {
+        TEST_ASSERT_EQUAL_UINT32(popped++, item.seq);
+    }
+    TEST_ASSERT_EQUAL_UINT32(pushed, popped);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+// Capacities that are not powers of two, the firmware's MAX_BUFFER_SIZE among them
+void test_any_capacity() {
+    checkLaps<1>();
+    checkLaps<3>();
+    checkLaps<10>();
+    checkLaps<16>();
+}
+
+// The firmware's pattern: loggerTask() pushes while another task drains. Every item must arrive once, in order.
+void test_producer_consumer_threads() {
+    const uint32_t ITEMS = 2000000;
+    static RingBuffer<Item, 10> ring;
+    std::atomic<uint32_t> fullRetries{0};
+
+    std::thread producer([&] {
+        for (uint32_t seq = 0; seq < ITEMS; seq++) {
+            while (!ring.push(makeItem(seq))) {
+                fullRetries++;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t expected = 0;
+    uint32_t errors = 0;
+    size_t maxSize = 0;
+    while (expected < ITEMS) {
+        size_t size = ring.size();
+        maxSize = size > maxSize ? size : maxSize;
+        Item item;
+        if (!ring.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (item.seq != expected || item.check != ~item.seq) {
+            errors++;
+        }
+        expected = item.seq + 1;
+    }
+    producer.join();
+
+    Item extra;
+    TEST_ASSERT_FALSE(ring.pop(extra));
+    TEST_ASSERT_EQUAL_UINT32(0, errors);
+    TEST_ASSERT_LESS_OR_EQUAL(10, maxSize);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, fullRetries.load()); // The ring did fill, so the full path was exercised
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_capacity_and_order);
+    RUN_TEST(test_any_capacity);
+    RUN_TEST(test_producer_consumer_threads);
+    return UNITY_END();
+}
@@ -0,0 +1,182 @@
+// SampleWindow: statistics of known series, then a sampler thread closing windows while the publisher takes
+// them, checking that no window comes out torn and that every window is either taken or counted as missed
+//   pio test -e native -f test_sample_window
+
+#include <unity.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include "sample_window.h"
+
+namespace {
+
+// Window w carries a series only it has, so stats mixed from two windows or read during a reset show up
+uint32_t samplesIn(uint32_t w) {
+    return 1 + w % 13;
+}
+
+float firstValue(uint32_t w) {
+    return (float)(w % 1024) * 16;
+}
+
+void fillWindow(SampleWindow& window, uint32_t w) {
+    for (uint32_t i = 0; i < samplesIn(w); i++) {
+        window.add(firstValue(w) + i);
+    }
+    window.close(w); // endMs names the window
+}
+
+bool consistent(const WindowStats& stats) {
+    uint32_t w = stats.endMs;
+    uint32_t n = samplesIn(w);
+    float mean = firstValue(w) + (n - 1) / 2.0f;
+    float stddev = sqrtf((float)(n * n - 1) / 12); // Of n consecutive integers
+    return stats.count == n && stats.min == firstValue(w) && stats.max == firstValue(w) + n - 1 &&
+           fabsf(stats.mean - mean) < 1e-3f && fabsf(stats.stddev - stddev) < 1e-3f;
+}
+
+} // namespace
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_known_series() {
+    SampleWindow window;
+    WindowStats stats;
+    TEST_ASSERT_FALSE(window.take(stats)); // Nothing closed yet
+
+    const float series[] = {2, 4, 4, 4, 5, 5, 7, 9}; // Mean 5, population standard deviation 2
+    for (float value : series) {
+        window.add(value);
+    }
+    window.close(1000);
+    TEST_ASSERT_TRUE(window.take(stats));
+    TEST_ASSERT_EQUAL_UINT32(8, stats.count);
+    TEST_ASSERT_EQUAL_UINT32(1000, stats.endMs);
+    TEST_ASSERT_EQUAL_FLOAT(2, stats.min);
+    TEST_ASSERT_EQUAL_FLOAT(9, stats.max);
+    TEST_ASSERT_EQUAL_FLOAT(5, stats.mean);
+    TEST_ASSERT_EQUAL_FLOAT(2, stats.stddev);
+    TEST_ASSERT_FALSE(window.take(stats)); // Taken once only
+
+    // The same spread far from zero (Welford keeps the variance), and negative values
+    for (float value : series) {
+        window.add(10000 + value);
+    }
+    window.close(2000);
+    TEST_ASSERT_TRUE(window.take(stats));
+    TEST_ASSERT_EQUAL_UINT32(8, stats.count);
+    TEST_ASSERT_EQUAL_FLOAT(10005, stats.mean);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 2, stats.stddev);
+
+    for (float value : series) {
+        window.add(-value);
+    }
+    window.close(3000);
+    TEST_ASSERT_TRUE(window.take(stats));
+    TEST_ASSERT_EQUAL_FLOAT(-9, stats.min);
+    TEST_ASSERT_EQUAL_FLOAT(-2, stats.max);
+    TEST_ASSERT_EQUAL_FLOAT(-5, stats.mean);
+    TEST_ASSERT_EQUAL_FLOAT(2, stats.stddev);
+
+    window.add(42);
+    window.close(4000);
+    TEST_ASSERT_TRUE(window.take(stats));
+    TEST_ASSERT_EQUAL_UINT32(1, stats.count);
+    TEST_ASSERT_EQUAL_FLOAT(42, stats.min);
+    TEST_ASSERT_EQUAL_FLOAT(42, stats.max);
+    TEST_ASSERT_EQUAL_FLOAT(0, stats.stddev);
+
+    window.close(5000); // No samples, e.g. the sensor failed for a whole window
+    TEST_ASSERT_TRUE(window.take(stats));
+    TEST_ASSERT_EQUAL_UINT32(0, stats.count);
+    TEST_ASSERT_EQUAL_UINT32(5000, stats.endMs);
+    TEST_ASSERT_EQUAL_UINT32(0, window.missed());
+}
+
+void test_missed_windows() {
+    SampleWindow window;
+    WindowStats stats;
+    for (uint32_t w = 0; w < 5; w++) {
+        fillWindow(window, w);
+    }
+    TEST_ASSERT_TRUE(window.take(stats)); // The newest one
+    TEST_ASSERT_EQUAL_UINT32(4, stats.endMs);
+    TEST_ASSERT_TRUE(consistent(stats));
+    TEST_ASSERT_EQUAL_UINT32(4, window.missed());
+
+    fillWindow(window, 5);
+    TEST_ASSERT_TRUE(window.take(stats));
+    TEST_ASSERT_EQUAL_UINT32(5, stats.endMs);
+    TEST_ASSERT_EQUAL_UINT32(4, window.missed());
+}
+
+// samplingTask() and publishSampleWindows(): close() on one thread, take() on another
+void test_take_while_closing() {
+    const uint32_t WINDOWS = 2000000;
+    const uint32_t AHEAD = 3; // Windows the sampler may close past the last one taken
+    static SampleWindow window;
+    std::atomic<bool> done{false};
+    std::atomic<uint32_t> lastTaken{0};
+
+    // Kept a few windows ahead of the publisher, so close() keeps running while take() reads, and sometimes
+    // overtakes it; left free-running, it wins every race and only a handful of windows are taken
+    std::thread sampler([&] {
+        for (uint32_t w = 0; w < WINDOWS; w++) {
+            while (w > lastTaken.load() + AHEAD) {
+                std::this_thread::yield();
+            }
+            fillWindow(window, w);
+        }
+        done = true;
+    });
+
+    uint32_t taken = 0;
+    uint32_t torn = 0;
+    uint32_t last = 0;
+    uint32_t outOfOrder = 0;
+    WindowStats stats;
+    for (;;) {
+        bool finished = done; // Read before take(), so the last window is taken below
+        while (window.take(stats)) {
+            if (!consistent(stats)) {
+                torn++;
+            }
+            if (taken > 0 && stats.endMs <= last) {
+                outOfOrder++;
+            }
+            last = stats.endMs;
+            lastTaken = last;
+            taken++;
+        }
+        if (finished) {
+            break;
+        }
+        std::this_thread::yield();
+    }
+    sampler.join();
+
+    char message[96];
+    snprintf(message, sizeof(message), "%u windows: %u taken, %u missed", (unsigned)WINDOWS, (unsigned)taken,
+             (unsigned)window.missed());
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_UINT32(0, torn);
+    TEST_ASSERT_EQUAL_UINT32(0, outOfOrder);
+    TEST_ASSERT_EQUAL_UINT32(WINDOWS - 1, last);
+    TEST_ASSERT_EQUAL_UINT32(WINDOWS, taken + window.missed());
+    TEST_ASSERT_GREATER_THAN_UINT32(0, window.missed()); // The sampler did get ahead
+    TEST_ASSERT_GREATER_THAN_UINT32(1, taken);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_known_series);
+    RUN_TEST(test_missed_windows);
+    RUN_TEST(test_take_while_closing);
+    return UNITY_END();
+}
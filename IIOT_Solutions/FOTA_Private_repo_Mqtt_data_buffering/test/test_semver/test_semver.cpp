@@ -0,0 +1,116 @@
+// SemVer: the precedence example from semver.org section 11 compared pairwise, the "v" and "1.0" forms
+// already tagged, build metadata, and strings that must not parse
+//   pio test -e native -f test_semver
+
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include "semver.h"
+
+namespace {
+
+// Ascending precedence
+const char* const ORDERED[] = {
+    "0.9.9",
+    "1.0.0-alpha",
+    "1.0.0-alpha.1",
+    "1.0.0-alpha.beta",
+    "1.0.0-beta",
+    "1.0.0-beta.2",
+    "1.0.0-beta.11",
+    "1.0.0-rc.1",
+    "1.0.0",
+    "1.0.1",
+    "1.2.0",
+    "1.10.0",
+    "2.0.0",
+};
+const size_t ORDERED_COUNT = sizeof(ORDERED) / sizeof(ORDERED[0]);
+
+int sign(int value) {
+    return value < 0 ? -1 : (value > 0 ? 1 : 0);
+}
+
+void checkParses(const char* text, uint32_t major, uint32_t minor, uint32_t patch, const char* prerelease) {
+    SemVer version;
+    TEST_ASSERT_TRUE_MESSAGE(SemVer::parse(text, version), text);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(major, version.major, text);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(minor, version.minor, text);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(patch, version.patch, text);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(prerelease, version.prerelease, text);
+}
+
+} // namespace
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_precedence() {
+    for (size_t i = 0; i < ORDERED_COUNT; i++) {
+        for (size_t j = 0; j < ORDERED_COUNT; j++) {
+            char message[64];
+            snprintf(message, sizeof(message), "%s vs %s", ORDERED[i], ORDERED[j]);
+            int expected = i < j ? -1 : (i > j ? 1 : 0);
+            TEST_ASSERT_EQUAL_INT_MESSAGE(expected, sign(SemVer::compare(ORDERED[i], ORDERED[j])), message);
+        }
+    }
+}
+
+void test_tag_forms() {
+    checkParses("v1.2.3", 1, 2, 3, "");
+    checkParses("V1.2.3-rc.1", 1, 2, 3, "rc.1");
+    checkParses("1.0", 1, 0, 0, "");
+    checkParses("2", 2, 0, 0, "");
+    checkParses("1.0-beta", 1, 0, 0, "beta");
+    TEST_ASSERT_EQUAL_INT(0, SemVer::compare("v1.0", "1.0.0"));
+    TEST_ASSERT_EQUAL_INT(0, SemVer::compare("1.0", "1"));
+    TEST_ASSERT_TRUE(SemVer::compare("1.0", "1.0.1") < 0);
+    TEST_ASSERT_TRUE(SemVer::compare("v1.10", "1.9.9") > 0);
+}
+
+void test_build_metadata_ignored() {
+    checkParses("1.0.0+20240117", 1, 0, 0, "");
+    checkParses("1.0.0-beta.2+exp.sha.5114f85", 1, 0, 0, "beta.2");
+    TEST_ASSERT_EQUAL_INT(0, SemVer::compare("1.0.0+build.1", "1.0.0+build.2"));
+    TEST_ASSERT_EQUAL_INT(0, SemVer::compare("1.0.0-rc.1+a", "1.0.0-rc.1"));
+    TEST_ASSERT_TRUE(SemVer::compare("1.0.0-rc.1+zzz", "1.0.0") < 0);
+}
+
+void test_invalid() {
+    const char* invalid[] = {
+        "", "v", "1.", "1.2.", "1.2.3.4", "1.2.3-", "1.2.3-+build", "1.2.3junk", ".1.2", "a.b.c", "1.2.3 ",
+        "-1.0.0",
+    };
+    SemVer version;
+    for (const char* text : invalid) {
+        TEST_ASSERT_FALSE_MESSAGE(SemVer::parse(text, version), text);
+    }
+    TEST_ASSERT_FALSE(SemVer::parse(nullptr, version));
+
+    // The longest pre-release that fits, and one character more
+    std::string fits = "1.0.0-" + std::string(SemVer::PRERELEASE_MAX - 1, 'a');
+    std::string tooLong = fits + "a";
+    TEST_ASSERT_TRUE(SemVer::parse(fits.c_str(), version));
+    TEST_ASSERT_EQUAL_size_t(SemVer::PRERELEASE_MAX - 1, strlen(version.prerelease));
+    TEST_ASSERT_FALSE(SemVer::parse(tooLong.c_str(), version));
+    TEST_ASSERT_FALSE(SemVer::parse((tooLong + "+build").c_str(), version));
+
+    // A version the device cannot read never counts as newer
+    TEST_ASSERT_TRUE(SemVer::compare("1.2.3.4", "0.0.1") < 0);
+    TEST_ASSERT_TRUE(SemVer::compare("0.0.1", "1.") > 0);
+    TEST_ASSERT_EQUAL_INT(0, SemVer::compare("garbage", "1.2.3-"));
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_precedence);
+    RUN_TEST(test_tag_forms);
+    RUN_TEST(test_build_metadata_ignored);
+    RUN_TEST(test_invalid);
+    return UNITY_END();
+}
@@ -0,0 +1,222 @@
+// Sparkplug B payloads from PayloadWriter, decoded by protoc against the Tahu schema in tools/sparkplug_b.proto
+// and compared as text format; plus commandIsSet() on NCMD payloads
+//   pio test -e native -f test_sparkplug
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include "sparkplug.h"
+
+namespace {
+
+const uint64_t NOW = 1700000000123ull; // Epoch ms: a 6-byte varint, as on a device with SNTP time
+
+std::string toolsPath() {
+    std::string file = __FILE__; // <project>/test/test_sparkplug/test_sparkplug.cpp
+    size_t test = file.rfind("test/test_sparkplug/");
+    return (test == std::string::npos ? std::string() : file.substr(0, test)) + "tools";
+}
+
+// The payload as protoc prints it in text format. protoc fails on anything that is not a valid Payload, and
+// prints fields the schema does not know, or knows with another wire type, by number.
+std::string decode(const uint8_t* data, size_t len) {
+    char path[] = "/tmp/sparkplug-XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    TEST_ASSERT_EQUAL_INT((int)len, (int)write(fd, data, len));
+    close(fd);
+    std::string command = "protoc --proto_path=" + toolsPath() +
+                          " --decode=org.eclipse.tahu.protobuf.Payload sparkplug_b.proto < " + path + " 2>&1";
+    FILE* protoc = popen(command.c_str(), "r");
+    TEST_ASSERT_NOT_NULL(protoc);
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), protoc)) > 0) {
+        text.append(buf, n);
+    }
+    int status = pclose(protoc);
+    unlink(path);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, status, ("protoc --decode failed (needs protoc): " + text).c_str());
+    return text;
+}
+
+std::string field(const char* name, const std::string& value) {
+    return std::string("  ") + name + ": " + value + "\n";
+}
+
+std::string number(uint64_t value) {
+    return std::to_string(value);
+}
+
+std::string quoted(const std::string& value) {
+    return "\"" + value + "\"";
+}
+
+// One Metric as protoc prints it: fields in schema order, name and alias only when written
+std::string metric(const char* name, int32_t alias, uint32_t datatype, const char* valueField, const std::string& value) {
+    std::string text = "metrics {\n";
+    if (name) {
+        text += field("name", quoted(name));
+    }
+    if (alias >= 0) {
+        text += field("alias", number(alias));
+    }
+    text += field("timestamp", number(NOW));
+    text += field("datatype", number(datatype));
+    text += field(valueField, value);
+    return text + "}\n";
+}
+
+} // namespace
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+// As publishSparkplugBirth() writes it
+void test_nbirth() {
+    uint8_t buffer[256];
+    sparkplug::PayloadWriter birth(buffer, sizeof(buffer));
+    birth.timestamp(NOW);
+    birth.metricUInt("bdSeq", -1, NOW, sparkplug::DataType::UInt64, 3);
+    birth.metricBool("Node Control/Rebirth", 1, NOW, false);
+    birth.metricUInt("Counter", 2, NOW, sparkplug::DataType::UInt32, 4000000000u);
+    birth.metricString("Properties/Firmware Version", 3, NOW, "1.0.1");
+    birth.metricString("Properties/IP", 4, NOW, "192.168.4.2");
+    birth.seq(0);
+    TEST_ASSERT_TRUE(birth.ok());
+
+    std::string expected = "timestamp: " + number(NOW) + "\n" +
+                           metric("bdSeq", -1, 8, "long_value", "3") +
+                           metric("Node Control/Rebirth", 1, 11, "boolean_value", "false") +
+                           metric("Counter", 2, 7, "int_value", "4000000000") +
+                           metric("Properties/Firmware Version", 3, 12, "string_value", quoted("1.0.1")) +
+                           metric("Properties/IP", 4, 12, "string_value", quoted("192.168.4.2")) +
+                           "seq: 0\n";
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), decode(buffer, birth.size()).c_str());
+}
+
+// As publishSparkplugData() writes it: alias only, into its 32-byte buffer
+void test_ndata() {
+    uint8_t buffer[32];
+    sparkplug::PayloadWriter data(buffer, sizeof(buffer));
+    data.timestamp(NOW);
+    data.metricUInt(nullptr, 2, NOW, sparkplug::DataType::UInt32, 0xFFFFFFFFu);
+    data.seq(255);
+    TEST_ASSERT_TRUE(data.ok());
+
+    std::string expected = "timestamp: " + number(NOW) + "\n" +
+                           metric(nullptr, 2, 7, "int_value", "4294967295") +
+                           "seq: 255\n";
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), decode(buffer, data.size()).c_str());
+}
+
+// As setSparkplugWill() writes it into sparkplugDeath[32]: no seq, bdSeq by name
+void test_ndeath() {
+    uint8_t buffer[32];
+    sparkplug::PayloadWriter death(buffer, sizeof(buffer));
+    death.timestamp(NOW);
+    death.metricUInt("bdSeq", -1, NOW, sparkplug::DataType::UInt64, 255);
+    TEST_ASSERT_TRUE(death.ok());
+
+    std::string expected = "timestamp: " + number(NOW) + "\n" + metric("bdSeq", -1, 8, "long_value", "255");
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), decode(buffer, death.size()).c_str());
+}
+
+// endMetric() reserves one length byte; metrics past 127 (and 16383) bytes must move their body up
+void test_metric_length_prefix_growth() {
+    static uint8_t buffer[20000];
+    std::string value;
+    for (size_t len = 60; len < 17000; len += len < 200 ? 1 : 997) {
+        value.assign(len, 'x');
+        for (size_t i = 0; i < len; i++) {
+            value[i] = 'a' + i % 26;
+        }
+        memset(buffer, 0xEE, sizeof(buffer));
+        sparkplug::PayloadWriter writer(buffer, sizeof(buffer));
+        writer.timestamp(NOW);
+        writer.metricString("Properties/Long", 9, NOW, value.c_str());
+        writer.metricUInt(nullptr, 2, NOW, sparkplug::DataType::UInt32, 7); // Must land after the moved metric
+        writer.seq(1);
+        TEST_ASSERT_TRUE(writer.ok());
+
+        std::string expected = "timestamp: " + number(NOW) + "\n" +
+                               metric("Properties/Long", 9, 12, "string_value", quoted(value)) +
+                               metric(nullptr, 2, 7, "int_value", "7") +
+                               "seq: 1\n";
+        TEST_ASSERT_TRUE_MESSAGE(expected == decode(buffer, writer.size()), "payload decodes differently");
+        TEST_ASSERT_EQUAL_HEX8(0xEE, buffer[writer.size()]);
+    }
+}
+
+// A payload that does not fit reports !ok() and never writes past the capacity it was given
+void test_overflow() {
+    uint8_t buffer[64];
+    for (size_t capacity = 0; capacity < 48; capacity++) {
+        memset(buffer, 0xEE, sizeof(buffer));
+        sparkplug::PayloadWriter writer(buffer, capacity);
+        writer.timestamp(NOW);
+        writer.metricString("Properties/Firmware Version", 3, NOW, "1.0.1");
+        TEST_ASSERT_FALSE(writer.ok());
+        TEST_ASSERT_LESS_OR_EQUAL(capacity, writer.size());
+        for (size_t i = capacity; i < sizeof(buffer); i++) {
+            TEST_ASSERT_EQUAL_HEX8(0xEE, buffer[i]);
+        }
+    }
+}
+
+void test_command_is_set() {
+    uint8_t buffer[128];
+    const char* REBIRTH = "Node Control/Rebirth";
+
+    sparkplug::PayloadWriter byName(buffer, sizeof(buffer));
+    byName.timestamp(NOW);
+    byName.metricBool(REBIRTH, -1, NOW, true);
+    TEST_ASSERT_TRUE(sparkplug::commandIsSet(buffer, byName.size(), REBIRTH, 1));
+    TEST_ASSERT_FALSE(sparkplug::commandIsSet(buffer, byName.size(), "Node Control/Reboot", 5));
+    for (size_t len = 0; len < byName.size(); len++) {
+        TEST_ASSERT_FALSE(sparkplug::commandIsSet(buffer, len, REBIRTH, 1)); // Truncated
+    }
+
+    sparkplug::PayloadWriter byAlias(buffer, sizeof(buffer));
+    byAlias.metricUInt(nullptr, 2, NOW, sparkplug::DataType::UInt32, 1); // Another metric first
+    byAlias.metricBool(nullptr, 1, NOW, true);
+    TEST_ASSERT_TRUE(sparkplug::commandIsSet(buffer, byAlias.size(), REBIRTH, 1));
+    TEST_ASSERT_FALSE(sparkplug::commandIsSet(buffer, byAlias.size(), REBIRTH, -1));
+    TEST_ASSERT_FALSE(sparkplug::commandIsSet(buffer, byAlias.size(), REBIRTH, 2)); // Alias 2 is no boolean
+
+    sparkplug::PayloadWriter cleared(buffer, sizeof(buffer));
+    cleared.metricBool(REBIRTH, 1, NOW, false);
+    TEST_ASSERT_FALSE(sparkplug::commandIsSet(buffer, cleared.size(), REBIRTH, 1));
+
+    // Fields other SCADA hosts send are skipped: a double value (fixed64) and float (fixed32) in the metric,
+    // and uuid (field 4) in the payload
+    const uint8_t foreign[] = {
+        0x22, 0x02, 'i', 'd',                                       // uuid = "id"
+        0x12, 0x26,                                                 // metric, 38 bytes
+        0x0A, 0x14, 'N', 'o', 'd', 'e', ' ', 'C', 'o', 'n', 't', 'r', 'o', 'l', '/', 'R', 'e', 'b', 'i', 'r', 't', 'h',
+        0x61, 0, 0, 0, 0, 0, 0, 0xF0, 0x3F,                         // double_value = 1.0
+        0x70, 0x01,                                                 // boolean_value = true
+        0x5D, 0, 0, 0x80, 0x3F,                                     // float_value = 1.0 (after the boolean)
+    };
+    TEST_ASSERT_TRUE(sparkplug::commandIsSet(foreign, sizeof(foreign), REBIRTH, -1));
+    TEST_ASSERT_FALSE(sparkplug::commandIsSet(foreign, sizeof(foreign) - 5, REBIRTH, -1)); // Metric cut short
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_nbirth);
+    RUN_TEST(test_ndata);
+    RUN_TEST(test_ndeath);
+    RUN_TEST(test_metric_length_prefix_growth);
+    RUN_TEST(test_overflow);
+    RUN_TEST(test_command_is_set);
+    return UNITY_END();
+}
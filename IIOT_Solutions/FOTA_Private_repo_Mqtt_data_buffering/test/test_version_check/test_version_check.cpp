@@ -0,0 +1,303 @@
+// FirmwareVersionCheck() against an HTTP stand-in for the release server: 200, then 304 while version.json is
+// unchanged, then 200 once it changes, checking the validators sent and stored and the bytes each poll moves,
+// and version.json sent with chunked transfer coding
+//   pio test -e native -f test_version_check
+
+#include <unity.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Arduino.h"
+#include "LittleFS.h"
+#include "Preferences.h"
+#include "WiFi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mock.h"
+
+extern Preferences otaPrefs;
+extern String FirmwareVer;
+extern volatile unsigned long interval;
+extern SemaphoreHandle_t manifestMutex;
+void checkForUpdate(); // FirmwareVersionCheck(), and the update if it finds one
+void initOtaClient();
+
+namespace {
+
+// Serves version.json on every GET, over keep-alive connections like a CDN. The ETag follows the content,
+// Last-Modified is set by the test; If-None-Match takes precedence over If-Modified-Since as in RFC 9110.
+// A chunked body comes in uneven chunks, with a chunk extension and a trailer field, and its last chunk
+// follows a little later, as from a server still producing the body.
+class ReleaseServer {
+public:
+    struct Request {
+        int status;
+        std::string ifNoneMatch;
+        std::string ifModifiedSince;
+    };
+
+    uint16_t start() {
+        listener_ = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        bind(listener_, (struct sockaddr*)&addr, sizeof(addr));
+        listen(listener_, 4);
+        getsockname(listener_, (struct sockaddr*)&addr, &len);
+        std::thread([this] { serve(); }).detach();
+        return ntohs(addr.sin_port);
+    }
+
+    void publish(const std::string& body, time_t modified, bool chunked = false) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        body_ = body;
+        modified_ = modified;
+        chunked_ = chunked;
+    }
+
+    Request lastRequest() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return last_;
+    }
+
+    int connections() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connections_;
+    }
+
+    std::string etag() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        char tag[24];
+        snprintf(tag, sizeof(tag), "\"%016zx\"", std::hash<std::string>()(body_));
+        return tag;
+    }
+
+    std::string lastModified() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return httpDate(modified_);
+    }
+
+    static std::string httpDate(time_t t) {
+        char date[40];
+        strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&t));
+        return date;
+    }
+
+private:
+    static std::string header(const std::string& request, const char* name) {
+        std::string key = std::string("\r\n") + name + ": ";
+        size_t at = request.find(key);
+        if (at == std::string::npos) {
+            return std::string();
+        }
+        at += key.size();
+        return request.substr(at, request.find("\r\n", at) - at);
+    }
+
+    void serve() {
+        for (;;) {
+            int fd = accept(listener_, nullptr, nullptr);
+            if (fd < 0) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                connections_++;
+            }
+            std::string pending;
+            char buf[1024];
+            ssize_t n;
+            while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+                pending.append(buf, n);
+                size_t end;
+                while ((end = pending.find("\r\n\r\n")) != std::string::npos) {
+                    std::vector<std::string> response = respond(pending.substr(0, end + 2));
+                    pending.erase(0, end + 4);
+                    for (size_t i = 0; i < response.size(); i++) {
+                        if (i > 0) {
+                            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                        }
+                        send(fd, response[i].data(), response[i].size(), MSG_NOSIGNAL);
+                    }
+                }
+            }
+            close(fd);
+        }
+    }
+
+    std::vector<std::string> respond(const std::string& request) {
+        std::string tag = etag();
+        std::lock_guard<std::mutex> lock(mutex_);
+        Request seen = {200, header(request, "If-None-Match"), header(request, "If-Modified-Since")};
+        if (!seen.ifNoneMatch.empty()) {
+            seen.status = seen.ifNoneMatch == tag || seen.ifNoneMatch == "*" ? 304 : 200;
+        } else if (!seen.ifModifiedSince.empty()) {
+            struct tm since = {};
+            bool parsed = strptime(seen.ifModifiedSince.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &since) != nullptr;
+            seen.status = parsed && timegm(&since) >= modified_ ? 304 : 200;
+        }
+        last_ = seen;
+        std::string validators = "ETag: " + tag + "\r\nLast-Modified: " + httpDate(modified_) + "\r\n";
+        if (seen.status == 304) {
+            return {"HTTP/1.1 304 Not Modified\r\n" + validators + "\r\n"};
+        }
+        if (!chunked_) {
+            return {"HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                    std::to_string(body_.size()) + "\r\n" + validators + "\r\n" + body_};
+        }
+        std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n" +
+                               validators + "\r\n";
+        size_t sizes[] = {1, 97, 512, 3};
+        for (size_t at = 0, i = 0; at < body_.size(); i++) {
+            size_t n = std::min(sizes[i % 4], body_.size() - at);
+            char line[32];
+            snprintf(line, sizeof(line), i == 1 ? "%zX;source=cdn\r\n" : "%zx\r\n", n);
+            response += line + body_.substr(at, n) + "\r\n";
+            at += n;
+        }
+        return {response, "0\r\nX-Checksum: none\r\n\r\n"};
+    }
+
+    int listener_ = -1;
+    std::mutex mutex_;
+    std::string body_;
+    time_t modified_ = 0;
+    bool chunked_ = false;
+    int connections_ = 0;
+    Request last_ = {};
+};
+
+ReleaseServer server;
+
+struct Poll {
+    uint32_t sent;
+    uint32_t received;
+    ReleaseServer::Request request;
+};
+
+// A version.json listing several boards and channels, as a shared release repository has it. This board's
+// stable entry is the running version, so there is nothing to install and the validators get stored.
+std::string manifest(const char* betaVersion) {
+    std::string json = "{\n";
+    const char* boards[] = {"esp32", "esp32s3", "esp32c3", "esp8266"};
+    for (const char* board : boards) {
+        const char* stable = strcmp(board, "esp32") == 0 ? FirmwareVer.c_str() : "2.4.0";
+        json += std::string("  \"") + board + "\": {\n";
+        json += std::string("    \"stable\": {\"version\": \"") + stable + "\", \"bin_url\": \"https://example.com/" +
+                board + "/firmware.bin\", \"size\": 1048576, \"sha256\": "
+                "\"6f1ed002ab5595859014ebf0951522d9f2bb1ef1d7b1e6c9b5c8b4f4a1f2e3d4\", \"compression\": \"gzip\"},\n";
+        json += std::string("    \"beta\": {\"version\": \"") + betaVersion + "\", \"bin_url\": \"https://example.com/" +
+                board + "/beta.bin\", \"size\": 1052672, \"sha256\": "
+                "\"0c4a1e9b27d6f3852e1b7a9d4c6f08e3b5d2a7c91f4e6b8d0a3c5e7f9b1d2c4e\"}\n";
+        json += strcmp(board, "esp8266") == 0 ? "  }\n" : "  },\n";
+    }
+    return json + "}\n";
+}
+
+Poll poll() {
+    uint64_t sent = mock::tcpBytesSent();
+    uint64_t received = mock::tcpBytesReceived();
+    checkForUpdate(); // The manifest never offers a newer version for this board
+    Poll result = {(uint32_t)(mock::tcpBytesSent() - sent), (uint32_t)(mock::tcpBytesReceived() - received),
+                   server.lastRequest()};
+    return result;
+}
+
+} // namespace
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_conditional_polling() {
+    std::string first = manifest("1.1.0-beta.1");
+    std::string second = manifest("1.1.0-beta.2");
+    time_t firstModified = time(nullptr) - 3600;
+    time_t secondModified = firstModified + 600;
+    server.publish(first, firstModified);
+    std::string firstEtag = server.etag();
+
+    Poll full = poll();
+    TEST_ASSERT_EQUAL_INT(200, full.request.status);
+    TEST_ASSERT_TRUE(full.request.ifNoneMatch.empty());
+    TEST_ASSERT_EQUAL_STRING(firstEtag.c_str(), otaPrefs.getString("etag", "").c_str());
+    TEST_ASSERT_EQUAL_STRING(ReleaseServer::httpDate(firstModified).c_str(), otaPrefs.getString("modified", "").c_str());
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(first.size(), full.received);
+
+    Poll unchanged = poll();
+    TEST_ASSERT_EQUAL_INT(304, unchanged.request.status);
+    TEST_ASSERT_EQUAL_STRING(firstEtag.c_str(), unchanged.request.ifNoneMatch.c_str());
+    TEST_ASSERT_EQUAL_STRING(ReleaseServer::httpDate(firstModified).c_str(), unchanged.request.ifModifiedSince.c_str());
+    TEST_ASSERT_EQUAL_STRING(firstEtag.c_str(), otaPrefs.getString("etag", "").c_str());
+    TEST_ASSERT_LESS_THAN_UINT32(full.received - first.size() + 64, unchanged.received); // Headers only
+
+    server.publish(second, secondModified);
+    Poll changed = poll();
+    TEST_ASSERT_EQUAL_INT(200, changed.request.status);
+    TEST_ASSERT_EQUAL_STRING(server.etag().c_str(), otaPrefs.getString("etag", "").c_str());
+    TEST_ASSERT_EQUAL_STRING(ReleaseServer::httpDate(secondModified).c_str(), otaPrefs.getString("modified", "").c_str());
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(second.size(), changed.received);
+
+    // What the device moves in an hour at the current interval, each poll a full 200 as before, or a 304
+    double polls = 3600000.0 / interval;
+    char message[200];
+    snprintf(message, sizeof(message), "%.0f polls/h: 200 %lu+%lu B/poll = %.0f KB/h, 304 %lu+%lu B/poll = "
+             "%.0f KB/h (payload only, no TLS)", polls, (unsigned long)full.sent,
+             (unsigned long)full.received, polls * (full.sent + full.received) / 1024,
+             (unsigned long)unchanged.sent, (unsigned long)unchanged.received,
+             polls * (unchanged.sent + unchanged.received) / 1024);
+    TEST_MESSAGE(message);
+}
+
+// Parsed from the connection as it arrives, and read to its end so the next request on the same
+// connection gets its own response
+void test_chunked_manifest() {
+    std::string third = manifest("1.1.0-beta.3");
+    server.publish(third, time(nullptr) - 60, true);
+    int connections = server.connections();
+
+    Poll chunked = poll();
+    TEST_ASSERT_EQUAL_INT(200, chunked.request.status);
+    TEST_ASSERT_EQUAL_STRING(server.etag().c_str(), otaPrefs.getString("etag", "").c_str());
+
+    // A leftover last chunk would be read as the status line of the 304, and the connection dropped
+    for (int i = 0; i < 2; i++) {
+        Poll unchanged = poll();
+        TEST_ASSERT_EQUAL_INT(304, unchanged.request.status);
+        TEST_ASSERT_EQUAL_STRING(server.etag().c_str(), unchanged.request.ifNoneMatch.c_str());
+    }
+    TEST_ASSERT_EQUAL_INT(connections, server.connections());
+}
+
+int main(int argc, char** argv) {
+    mock::begin(argc, argv);
+    LittleFS.begin();
+    setenv("NATIVE_HTTP_PORT", std::to_string(server.start()).c_str(), 1);
+
+    manifestMutex = xSemaphoreCreateMutex(); // Created by setup() on the device
+    otaPrefs.begin("ota", false);
+    otaPrefs.remove("etag");
+    otaPrefs.remove("modified");
+    initOtaClient();
+    WiFi.begin("test", "test");
+    while (!WiFi.isConnected()) {
+        delay(10);
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_conditional_polling);
+    RUN_TEST(test_chunked_manifest);
+    return UNITY_END();
+}
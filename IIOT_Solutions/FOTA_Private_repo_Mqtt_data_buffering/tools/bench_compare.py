@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""
+Compares two benchmark runs of the BENCHMARK build (see src/bench.h).
+
+Each input is either the JSON document or a whole serial/console log that
+contains it (pio device monitor > before.log). Time, allocations and heap
+bytes per call are listed side by side; the exit status is 1 if any case
+got slower by more than --threshold percent or allocates more. Usage:
+
+    python3 bench_compare.py before.log after.log [--threshold 10]
+    python3 bench_compare.py after.log --save results/1.0.2.json  # keep the JSON for later comparisons
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    text = open(path, errors="replace").read()
+    start = text.find('{"context"')
+    if start < 0:
+        sys.exit("%s: no benchmark results found" % path)
+    document, _ = json.JSONDecoder().raw_decode(text[start:])
+    return document
+
+
+def by_name(document):
+    return {b["name"]: b for b in document["benchmarks"] if not b.get("error_occurred")}
+
+
+def change(old, new):
+    return (new - old) * 100.0 / old if old else (0.0 if new == old else float("inf"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("before")
+    parser.add_argument("after", nargs="?")
+    parser.add_argument("--threshold", type=float, default=10.0, help="allowed slowdown in percent")
+    parser.add_argument("--save", help="write the (last) run's JSON to this file")
+    args = parser.parse_args()
+
+    before = load(args.before)
+    after = load(args.after) if args.after else None
+    if args.save:
+        with open(args.save, "w") as out:
+            json.dump(after or before, out, indent=1)
+    if not after:
+        for name, b in by_name(before).items():
+            print("%-28s %12.1f ns %8.2f allocs %10.1f B" % (name, b["real_time"], b.get("allocs_per_iteration", 0),
+                                                             b.get("bytes_per_iteration", 0)))
+        return 0
+
+    print("%s -> %s (%s)" % (before["context"]["executable"], after["context"]["executable"],
+                             after["context"]["host_name"]))
+    print("%-28s %12s %12s %8s %14s %16s" % ("case", "before ns", "after ns", "time", "allocs", "bytes"))
+    regressions = 0
+    old = by_name(before)
+    for name, new in by_name(after).items():
+        if name not in old:
+            print("%-28s %12s %12.1f %8s" % (name, "-", new["real_time"], "new"))
+            continue
+        o = old[name]
+        slower = change(o["real_time"], new["real_time"])
+        allocs = (o.get("allocs_per_iteration", 0), new.get("allocs_per_iteration", 0))
+        heap = (o.get("bytes_per_iteration", 0), new.get("bytes_per_iteration", 0))
+        regressed = slower > args.threshold or allocs[1] > allocs[0]
+        regressions += regressed
+        line = "%-28s %12.1f %12.1f %+7.1f%% %6.2f->%-6.2f %7.0f->%-7.0f%s" % (
+            name, o["real_time"], new["real_time"], slower, allocs[0], allocs[1], heap[0], heap[1],
+            "  REGRESSION" if regressed else "")
+        print(line.rstrip())
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
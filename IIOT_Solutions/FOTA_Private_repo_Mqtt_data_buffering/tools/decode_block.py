@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""
+Reference decoder for the columnar blocks published on BUFFERED_DATA_TOPIC.
+
+The format is described in src/block_codec.h. Usage:
+
+    python3 decode_block.py block.bin          # one block per file
+    python3 decode_block.py 1.bin 2.bin ...    # several blocks, in order
+    mosquitto_sub -t test/counter/dataBuffered -N | python3 decode_block.py -
+
+Prints one "timestamp,value" line per record. Each input may hold several
+blocks back to back, as mosquitto_sub -N writes them: a block ends after
+raw_len body bytes, or for LZ4 bodies after the sequence that brings the
+output to raw_len. From "-" every block is printed as soon as it is in.
+"""
+
+import struct
+import sys
+
+MAGIC = b"CB"
+VERSION = 1
+FLAG_LZ4 = 0x01
+
+
+def read_exact(stream, n):
+    data = stream.read(n)
+    if len(data) != n:
+        raise ValueError("block truncated")
+    return data
+
+
+def read_length(stream, length):
+    while True:
+        b = read_exact(stream, 1)[0]
+        length += b
+        if b != 255:
+            return length
+
+
+def lz4_block_decompress(stream, raw_len):
+    """Reads one LZ4 block from stream, up to the sequence that completes raw_len bytes"""
+    out = bytearray()
+    while True:
+        token = read_exact(stream, 1)[0]
+        lit_len = token >> 4
+        if lit_len == 15:
+            lit_len = read_length(stream, lit_len)
+        out += read_exact(stream, lit_len)
+        if len(out) >= raw_len:
+            break  # last sequence carries literals only
+        offset = int.from_bytes(read_exact(stream, 2), "little")
+        if offset == 0 or offset > len(out):
+            raise ValueError("bad LZ4 match offset")
+        match_len = (token & 0x0F) + 4
+        if token & 0x0F == 15:
+            match_len = read_length(stream, match_len)
+        start = len(out) - offset
+        for k in range(match_len):  # byte-wise: matches may overlap
+            out.append(out[start + k])
+    if len(out) != raw_len:
+        raise ValueError("LZ4 body decoded to %d bytes, header says %d" % (len(out), raw_len))
+    return bytes(out)
+
+
+def read_varint(buf, pos):
+    value = 0
+    shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return value, pos
+        shift += 7
+
+
+def unzigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+def read_block(stream):
+    """Decodes the next block from stream; None at the end of the stream"""
+    header = stream.read(8)
+    if not header:
+        return None
+    if len(header) < 8 or header[:2] != MAGIC:
+        raise ValueError("not a columnar block")
+    version, flags, count, raw_len = struct.unpack_from("<BBHH", header, 2)
+    if version != VERSION:
+        raise ValueError("unsupported block version %d" % version)
+    if flags & FLAG_LZ4:
+        body = lz4_block_decompress(stream, raw_len)
+    else:
+        body = read_exact(stream, raw_len)
+
+    pos = 0
+    timestamps = []
+    prev_delta = 0
+    for n in range(count):
+        v, pos = read_varint(body, pos)
+        if n == 0:
+            timestamps.append(v)
+        else:
+            prev_delta += unzigzag(v)
+            timestamps.append((timestamps[-1] + prev_delta) & 0xFFFFFFFF)
+    values = []
+    for n in range(count):
+        v, pos = read_varint(body, pos)
+        if n == 0:
+            values.append(unzigzag(v) & 0xFFFFFFFF)
+        else:
+            values.append((values[-1] + unzigzag(v)) & 0xFFFFFFFF)
+    return list(zip(timestamps, values))
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        return 1
+    for path in sys.argv[1:]:
+        stream = sys.stdin.buffer if path == "-" else open(path, "rb")
+        with stream:
+            while True:
+                records = read_block(stream)
+                if records is None:
+                    break
+                for timestamp, value in records:
+                    print("%d,%d" % (timestamp, value))
+                sys.stdout.flush()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,73 @@
+/*
+Applies a delta patch on a PC with the same DeltaApplier the firmware uses.
+
+    g++ -std=c++11 -O2 -I../src delta_apply.cpp -o delta_apply
+    ./delta_apply app0.bin patch.bin app1.bin
+    python3 delta_patch.py check patch.bin app1.bin
+
+The source may be a raw dump of the running OTA partition (esptool.py
+read_flash); only its first source-size bytes are used, as on the device.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "delta_patch.h"
+
+struct FileInput {
+    FILE* file;
+    size_t read(uint8_t* buf, size_t len) { return fread(buf, 1, len, file); }
+};
+
+struct ImageSource {
+    std::vector<uint8_t> image;
+    bool read(uint32_t offset, uint8_t* buf, size_t len) {
+        if (offset > image.size() || len > image.size() - offset) {
+            return false;
+        }
+        memcpy(buf, image.data() + offset, len);
+        return true;
+    }
+};
+
+struct FileSink {
+    FILE* file;
+    bool write(const uint8_t* buf, size_t len) { return fwrite(buf, 1, len, file) == len; }
+};
+
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <source image> <patch> <output image>\n", argv[0]);
+        return 2;
+    }
+    FILE* sourceFile = fopen(argv[1], "rb");
+    FILE* patchFile = fopen(argv[2], "rb");
+    FILE* outFile = fopen(argv[3], "wb");
+    if (!sourceFile || !patchFile || !outFile) {
+        perror("open");
+        return 2;
+    }
+
+    ImageSource source;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), sourceFile)) > 0) {
+        source.image.insert(source.image.end(), buf, buf + n);
+    }
+
+    FileInput in = {patchFile};
+    FileSink sink = {outFile};
+    DeltaHeader header;
+    if (!DeltaApplier::readHeader(in, header)) {
+        fprintf(stderr, "not a delta patch\n");
+        return 1;
+    }
+    if (header.sourceSize > source.image.size()) {
+        fprintf(stderr, "source image is %zu bytes, patch expects %u\n", source.image.size(), header.sourceSize);
+        return 1;
+    }
+    DeltaApplier::Result result = DeltaApplier::apply(in, header, source, sink);
+    fclose(outFile);
+    printf("%s: %u -> %u bytes\n", DeltaApplier::resultName(result), header.sourceSize, header.targetSize);
+    return result == DeltaApplier::OK ? 0 : 1;
+}
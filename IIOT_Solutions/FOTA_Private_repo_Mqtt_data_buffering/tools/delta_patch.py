@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+Delta patch generator for firmware updates.
+
+The patch format is described in src/delta_patch.h. Usage:
+
+    python3 delta_patch.py make old.bin new.bin patch.bin   # build a patch
+    python3 delta_patch.py apply old.bin patch.bin out.bin  # reference applier
+    python3 delta_patch.py check patch.bin out.bin          # out.bin matches the patch's target hash
+
+old.bin must be exactly the image running on the device (the .bin of that
+release); the device refuses a patch whose source hash does not match the
+first source-size bytes of its running partition.
+"""
+
+import hashlib
+import struct
+import sys
+
+MAGIC = b"DP"
+VERSION = 1
+HEADER = struct.Struct("<2sBBII32s32s")
+
+OP_END = 0x00
+OP_COPY = 0x01
+OP_INSERT = 0x02
+
+BLOCK = 32       # Minimum match length; shorter runs are cheaper as literals
+INDEX_STEP = 4   # Old image is indexed at every 4th offset (code and data are word aligned)
+
+
+def put_varint(out, value):
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+
+
+def read_varint(buf, pos):
+    value = 0
+    shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return value, pos
+        shift += 7
+
+
+def make_patch(old, new):
+    index = {}
+    for i in range(0, len(old) - BLOCK + 1, INDEX_STEP):
+        index.setdefault(old[i:i + BLOCK], i)
+
+    body = bytearray()
+    literal_start = 0
+
+    def emit_literals(end):
+        if end > literal_start:
+            body.append(OP_INSERT)
+            put_varint(body, end - literal_start)
+            body.extend(new[literal_start:end])
+
+    i = 0
+    while i + BLOCK <= len(new):
+        src = index.get(new[i:i + BLOCK])
+        if src is None:
+            i += 1
+            continue
+        # Grow the match both ways; backwards only into bytes not yet emitted
+        start = i
+        while start > literal_start and src > 0 and new[start - 1] == old[src - 1]:
+            start -= 1
+            src -= 1
+        end = i + BLOCK
+        src_end = src + (end - start)
+        while end < len(new) and src_end < len(old) and new[end] == old[src_end]:
+            end += 1
+            src_end += 1
+        emit_literals(start)
+        body.append(OP_COPY)
+        body.extend(struct.pack("<I", src))
+        put_varint(body, end - start)
+        literal_start = end
+        i = end
+    emit_literals(len(new))
+    body.append(OP_END)
+
+    header = HEADER.pack(MAGIC, VERSION, 0, len(old), len(new),
+                         hashlib.sha256(old).digest(), hashlib.sha256(new).digest())
+    return header + bytes(body)
+
+
+def parse_header(patch):
+    magic, version, _flags, source_size, target_size, source_hash, target_hash = HEADER.unpack_from(patch)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a version %d delta patch" % VERSION)
+    return source_size, target_size, source_hash, target_hash
+
+
+def apply_patch(old, patch):
+    source_size, target_size, source_hash, target_hash = parse_header(patch)
+    if hashlib.sha256(old[:source_size]).digest() != source_hash:
+        raise ValueError("source image does not match the patch")
+    out = bytearray()
+    pos = HEADER.size
+    while True:
+        op = patch[pos]
+        pos += 1
+        if op == OP_END:
+            break
+        if op == OP_COPY:
+            src, = struct.unpack_from("<I", patch, pos)
+            length, pos = read_varint(patch, pos + 4)
+            out += old[src:src + length]
+        elif op == OP_INSERT:
+            length, pos = read_varint(patch, pos)
+            out += patch[pos:pos + length]
+            pos += length
+        else:
+            raise ValueError("bad command 0x%02x at %d" % (op, pos - 1))
+    if len(out) != target_size or hashlib.sha256(out).digest() != target_hash:
+        raise ValueError("patched image does not match the target hash")
+    return bytes(out)
+
+
+def main(argv):
+    if len(argv) == 5 and argv[1] == "make":
+        old = open(argv[2], "rb").read()
+        new = open(argv[3], "rb").read()
+        patch = make_patch(old, new)
+        open(argv[4], "wb").write(patch)
+        print("%d -> %d bytes, patch %d bytes (%.1f%%)" % (len(old), len(new), len(patch), 100.0 * len(patch) / len(new)))
+    elif len(argv) == 5 and argv[1] == "apply":
+        out = apply_patch(open(argv[2], "rb").read(), open(argv[3], "rb").read())
+        open(argv[4], "wb").write(out)
+        print("wrote %d bytes" % len(out))
+    elif len(argv) == 4 and argv[1] == "check":
+        _source_size, target_size, _source_hash, target_hash = parse_header(open(argv[2], "rb").read())
+        image = open(argv[3], "rb").read()[:target_size]
+        if len(image) != target_size or hashlib.sha256(image).digest() != target_hash:
+            print("MISMATCH")
+            return 1
+        print("OK")
+    else:
+        print(__doc__.strip())
+        return 2
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,58 @@
+/*
+Inflates a gzip firmware image on a PC with the same GzipInflater the
+firmware uses between the HTTPS stream and Update.
+
+    g++ -std=c++11 -O2 -I../src inflate_image.cpp -o inflate_image
+    gzip -9 -k firmware.bin
+    ./inflate_image firmware.bin.gz app1.bin
+    cmp firmware.bin app1.bin
+
+The output goes through a sink that, like the OTA partition, only accepts
+writes at the next offset and never more than the partition size.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "gzip_stream.h"
+
+static const size_t PARTITION_SIZE = 0x140000; // app0/app1 in partitions.csv
+
+struct FileInput {
+    FILE* file;
+    size_t read(uint8_t* buf, size_t len) { return fread(buf, 1, len, file); }
+};
+
+struct PartitionSink {
+    FILE* file;
+    size_t written;
+    bool write(const uint8_t* buf, size_t len) {
+        if (len > PARTITION_SIZE - written) {
+            return false;
+        }
+        written += len;
+        return fwrite(buf, 1, len, file) == len;
+    }
+};
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <image.gz> <output image>\n", argv[0]);
+        return 2;
+    }
+    FILE* in = fopen(argv[1], "rb");
+    FILE* out = fopen(argv[2], "wb");
+    if (!in || !out) {
+        perror("open");
+        return 2;
+    }
+
+    static uint8_t window[GzipInflater::WINDOW_SIZE];
+    GzipInflater inflater(window);
+    FileInput input = {in};
+    PartitionSink sink = {out, 0};
+    GzipInflater::Result result = inflater.inflate(input, sink);
+    fclose(out);
+    printf("%s: %u -> %u bytes, decoder state %u bytes + %u byte window\n", GzipInflater::resultName(result),
+           inflater.inputBytes(), inflater.outputBytes(), (unsigned)sizeof(inflater), (unsigned)sizeof(window));
+    return result == GzipInflater::OK ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""
+Local firmware server with HTTP Range support and injected disconnects.
+
+Serves one image the way GitHub/S3 do for resumable downloads: ETag,
+Range/Content-Range (206) and If-Range. With --drop, each response is cut
+off after a random number of bytes with that probability, so the device's
+resume path can be watched on the serial log. Usage:
+
+    python3 range_server.py firmware.bin --port 8000 --drop 0.3 [--manifest version.json]
+
+Point bin_url at http://<pc>:8000/firmware.bin (the device code uses TLS,
+so put a TLS proxy in front or use a debug build with a plain client). With
+--manifest, requests for *.json get that file instead, so the native build
+(pio run -e native) can run the whole version check and update against it.
+The manifest is re-read on every request and carries an ETag and
+Last-Modified; If-None-Match / If-Modified-Since get 304 while it is
+unchanged, as from raw.githubusercontent.com.
+"""
+
+import argparse
+import email.utils
+import hashlib
+import http.server
+import os
+import random
+import re
+
+
+class RangeHandler(http.server.BaseHTTPRequestHandler):
+    image = b""
+    etag = ""
+    drop = 0.0
+    manifest = None
+
+    def do_GET(self):
+        if self.manifest is not None and self.path.endswith(".json"):
+            self.send_manifest()
+            return
+        size = len(self.image)
+        start, end = 0, size - 1
+        status = 200
+        match = re.match(r"bytes=(\d+)-(\d*)$", self.headers.get("Range", ""))
+        if_range = self.headers.get("If-Range")
+        if match and (if_range is None or if_range == self.etag):
+            start = int(match.group(1))
+            end = min(int(match.group(2)), size - 1) if match.group(2) else size - 1
+            if start >= size or start > end:
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % size)
+                self.end_headers()
+                return
+            status = 206
+
+        self.send_response(status)
+        self.send_header("ETag", self.etag)
+        self.send_header("Accept-Ranges", "bytes")
+        self.send_header("Content-Length", str(end - start + 1))
+        if status == 206:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end, size))
+        self.end_headers()
+
+        body = self.image[start:end + 1]
+        if random.random() < self.drop:
+            cut = random.randrange(len(body))
+            self.wfile.write(body[:cut])
+            self.log_message("dropped after %d of %d bytes", cut, len(body))
+            self.close_connection = True
+            return
+        self.wfile.write(body)
+
+    def send_manifest(self):
+        with open(self.manifest, "rb") as f:
+            body = f.read()
+        modified = int(os.stat(self.manifest).st_mtime)
+        etag = '"%s"' % hashlib.sha256(body).hexdigest()[:16]
+        last_modified = email.utils.formatdate(modified, usegmt=True)
+        if_none_match = self.headers.get("If-None-Match")
+        if_modified_since = self.headers.get("If-Modified-Since")
+        if if_none_match is not None:
+            fresh = etag in [tag.strip() for tag in if_none_match.split(",")] or if_none_match.strip() == "*"
+        elif if_modified_since is not None:
+            try:
+                fresh = email.utils.parsedate_to_datetime(if_modified_since).timestamp() >= modified
+            except (TypeError, ValueError):
+                fresh = False
+        else:
+            fresh = False
+
+        self.send_response(304 if fresh else 200)
+        self.send_header("ETag", etag)
+        self.send_header("Last-Modified", last_modified)
+        if fresh:
+            self.end_headers()
+            return
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("image")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--drop", type=float, default=0.0, help="probability of cutting a response short")
+    parser.add_argument("--manifest", help="file served for requests ending in .json")
+    args = parser.parse_args()
+
+    RangeHandler.image = open(args.image, "rb").read()
+    RangeHandler.etag = '"%s"' % hashlib.sha256(RangeHandler.image).hexdigest()[:16]
+    RangeHandler.drop = args.drop
+    RangeHandler.manifest = args.manifest
+    RangeHandler.protocol_version = "HTTP/1.1"
+    print("serving %d bytes, sha256 %s" % (len(RangeHandler.image), hashlib.sha256(RangeHandler.image).hexdigest()))
+    http.server.ThreadingHTTPServer(("", args.port), RangeHandler).serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""
+Signs firmware images for the manifest's "sha256" and "signature" fields.
+
+The signature is ECDSA P-256 over the SHA-256 of the image, DER encoded and
+base64'd; the device checks it against otaSigningKey (src/cert.h) before
+switching partitions. Uses the openssl command line tool. Usage:
+
+    python3 sign_image.py keygen signing.pem public.pem  # new key pair; paste public.pem into cert.h
+    python3 sign_image.py sign signing.pem firmware.bin  # manifest fields for firmware.bin
+    python3 sign_image.py verify public.pem firmware.bin <signature>
+
+sign and verify also print the host's verify cost (hash per MB and the
+signature check) for comparison with the device's "Image verify cost" log line.
+"""
+
+import base64
+import hashlib
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def openssl(*args, data=None):
+    return subprocess.run(("openssl",) + args, input=data, stdout=subprocess.PIPE, check=True).stdout
+
+
+def hash_cost(image):
+    start = time.perf_counter()
+    digest = hashlib.sha256(image).hexdigest()
+    elapsed = time.perf_counter() - start
+    return digest, elapsed * 1000 / (len(image) / 1048576.0)
+
+
+def verify(public_key, image, signature):
+    with tempfile.NamedTemporaryFile(delete=False) as sig:
+        sig.write(base64.b64decode(signature))
+    try:
+        start = time.perf_counter()
+        ok = subprocess.run(("openssl", "dgst", "-sha256", "-verify", public_key, "-signature", sig.name),
+                            input=image, stdout=subprocess.DEVNULL).returncode == 0
+        return ok, (time.perf_counter() - start) * 1000
+    finally:
+        os.unlink(sig.name)
+
+
+def main(argv):
+    if len(argv) == 4 and argv[1] == "keygen":
+        openssl("ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", argv[2])
+        openssl("ec", "-in", argv[2], "-pubout", "-out", argv[3])
+        print("wrote %s and %s" % (argv[2], argv[3]))
+    elif len(argv) == 4 and argv[1] == "sign":
+        image = open(argv[3], "rb").read()
+        digest, ms_per_mb = hash_cost(image)
+        signature = base64.b64encode(openssl("dgst", "-sha256", "-sign", argv[2], data=image)).decode()
+        print('"size": %d, "sha256": "%s", "signature": "%s"' % (len(image), digest, signature))
+        public_key = tempfile.NamedTemporaryFile(delete=False)
+        public_key.write(openssl("ec", "-in", argv[2], "-pubout"))
+        public_key.close()
+        ok, verify_ms = verify(public_key.name, image, signature)
+        os.unlink(public_key.name)
+        print("host: sha256 %.2f ms/MB, signature check %.1f ms (openssl process included), %s" %
+              (ms_per_mb, verify_ms, "OK" if ok else "FAILED"), file=sys.stderr)
+    elif len(argv) == 5 and argv[1] == "verify":
+        image = open(argv[3], "rb").read()
+        _digest, ms_per_mb = hash_cost(image)
+        ok, verify_ms = verify(argv[2], image, argv[4])
+        print("%s: sha256 %.2f ms/MB, signature check %.1f ms" % ("OK" if ok else "BAD SIGNATURE", ms_per_mb, verify_ms))
+        return 0 if ok else 1
+    else:
+        print(__doc__.strip())
+        return 2
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -16,5 +16,7 @@ String FirmwareVer = "1.0.0";
 
 // URLs
 #define URL_fw_Version "https://raw.githubusercontent.com/MadeeshaLakshan/ESP32_OTA_Github/main/version.json"
+#define OTA_CHECK_INTERVAL 5000      // Default version check interval (ms); change at runtime with "interval <ms>" on Serial
+#define OTA_MIN_CHECK_INTERVAL 1000  // Lower bound for runtime changes
 #endif // CONFIG_H
 
@@ -21,6 +21,7 @@ Remarks  : The certification is valid until 2038. Please verify the `cert.h` fil
 #include <WiFiClientSecure.h>
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include <Preferences.h>  // NVS storage for OTA check state
 #include "cert.h"
 #include "config.h"  // Include the config file
 
@@ -28,7 +29,8 @@ Remarks  : The certification is valid until 2038. Please verify the `cert.h` fil
 #include "esp_ota_ops.h"    // Include ESP-IDF OTA operations header
 
 unsigned long previousMillis = 0;  // will store last time update was checked
-const long interval = 5000;        // interval at which to check for updates (milliseconds)
+unsigned long interval = OTA_CHECK_INTERVAL; // interval at which to check for updates (milliseconds), settable at runtime
+Preferences otaPrefs;              // ETag/Last-Modified of version.json and the check interval
 String newFirmwareURL = "";        // Variable to store new firmware URL
 
 // Function declarations
@@ -41,11 +43,15 @@ void rollbackToPreviousFirmware();
 void checkForUpdate();
 void firmwareUpdate();
 int FirmwareVersionCheck();
+void setCheckInterval(unsigned long ms);
+void handleSerialCommand();
 void saveRootCACertificate(const char* rootCA);
 bool loadRootCACertificate(String &rootCA);
 
 void setup() {
     Serial.begin(115200);
+    otaPrefs.begin("ota", false);
+    interval = otaPrefs.getULong("interval", OTA_CHECK_INTERVAL);
     pinMode(ROLLBACK_PIN, INPUT_PULLUP);  // Set up the rollback pin as an input with an internal pull-up resistor
     initFileSystem();
 
@@ -77,6 +83,7 @@ void setup() {
 
 
 void loop() {
+    handleSerialCommand();
     unsigned long currentMillis = millis();
     if (digitalRead(ROLLBACK_PIN) == LOW) {  // Check if the rollback pin is triggered (assuming active low)
         Serial.println("Rollback pin triggered. Rolling back to previous firmware.");
@@ -246,10 +253,9 @@ void firmwareUpdate() {
 
 int FirmwareVersionCheck() {
     String payload;
-    int httpCode;
+    int httpCode = 0;
     String FirmwareURL = URL_fw_Version;
-    FirmwareURL += "?";
-    FirmwareURL += String(rand());
+    String etag, lastModified;         // Validators returned with this response
 
     WiFiClientSecure* client = new WiFiClientSecure;
 
@@ -266,12 +272,27 @@ int FirmwareVersionCheck() {
 
         if (https.begin(*client, FirmwareURL)) {
             https.addHeader("Authorization", "token " + String(GITHUB_TOKEN)); // Add the authorization header
+            // Conditional GET: while version.json is unchanged the server answers 304 without a body
+            String knownEtag = otaPrefs.getString("etag", "");
+            String knownModified = otaPrefs.getString("modified", "");
+            if (knownEtag.length() > 0) {
+                https.addHeader("If-None-Match", knownEtag);
+            }
+            if (knownModified.length() > 0) {
+                https.addHeader("If-Modified-Since", knownModified);
+            }
+            const char* validatorHeaders[] = {"ETag", "Last-Modified"};
+            https.collectHeaders(validatorHeaders, 2);
             Serial.print("[HTTPS] GET...\n");
             delay(100);
             httpCode = https.GET();
             delay(100);
             if (httpCode == HTTP_CODE_OK) {
                 payload = https.getString();
+                etag = https.header("ETag");
+                lastModified = https.header("Last-Modified");
+            } else if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+                Serial.println("version.json not modified");
             } else {
                 Serial.print("Error Occurred During Version Check: ");
                 Serial.println(httpCode);
@@ -297,6 +318,9 @@ int FirmwareVersionCheck() {
         newFirmwareURL.trim();
 
         if (newVersion.equals(FirmwareVer)) {
+            // Only remember the validators once nothing is left to do, so a failed update is retried
+            otaPrefs.putString("etag", etag);
+            otaPrefs.putString("modified", lastModified);
             Serial.printf("\nDevice is already on the latest firmware version: %s\n", FirmwareVer.c_str());
             return 0;
         } else {
@@ -336,4 +360,24 @@ bool loadRootCACertificate(String &rootCA) {
     return true;
 }
 
+// Change the version check interval at runtime and keep it across reboots
+void setCheckInterval(unsigned long ms) {
+    if (ms < OTA_MIN_CHECK_INTERVAL) {
+        ms = OTA_MIN_CHECK_INTERVAL;
+    }
+    interval = ms;
+    otaPrefs.putULong("interval", ms);
+    Serial.printf("Version check interval set to %lu ms\n", ms);
+}
 
+// Serial console: "interval <ms>" changes the version check interval
+void handleSerialCommand() {
+    if (!Serial.available()) {
+        return;
+    }
+    String command = Serial.readStringUntil('\n');
+    command.trim();
+    if (command.startsWith("interval ")) {
+        setCheckInterval(command.substring(9).toInt());
+    }
+}
@@ -15,6 +15,7 @@ Remarks : This certification only valid until 2038. please verfiy cert.h file to
 #include <HTTPUpdate.h>
 #include <WiFiClientSecure.h>
 #include <ArduinoJson.h> // v 7.2.1
+#include <Preferences.h>  // NVS storage for OTA check state
 #include "cert.h" // include certification file
 #include "config.h"  // Include the new configuration header file
 
@@ -24,10 +25,13 @@ String newFwVersion = "";
 String newFwBinURL = "";
 
 unsigned long previousMillis = 0;
-const long interval = 5000;
+unsigned long interval = OTA_CHECK_INTERVAL; // interval at which to check for updates (milliseconds), settable at runtime
+Preferences otaPrefs;              // ETag/Last-Modified of version.json and the check interval
 
 void setup() {
     Serial.begin(115200);
+    otaPrefs.begin("ota", false);
+    interval = otaPrefs.getULong("interval", OTA_CHECK_INTERVAL);
     Serial.print("Active Firmware Version: ");
     Serial.println(FirmwareVer);
 
@@ -46,6 +50,7 @@ void setup() {
 }
 
 void loop() {
+    handleSerialCommand();
     unsigned long currentMillis = millis();
 
     if (currentMillis - previousMillis >= interval) {
@@ -108,10 +113,9 @@ void firmwareUpdate() {
 
 int FirmwareVersionCheck() {
     String payload;
-    int httpCode;
+    int httpCode = 0;
     String FirmwareURL = URL_fw_JSON;
-    FirmwareURL += "?";
-    FirmwareURL += String(rand());
+    String etag, lastModified;         // Validators returned with this response
 
     WiFiClientSecure* client = new WiFiClientSecure;
 
@@ -120,12 +124,27 @@ int FirmwareVersionCheck() {
         HTTPClient https;
 
         if (https.begin(*client, FirmwareURL)) {
+            // Conditional GET: while version.json is unchanged the server answers 304 without a body
+            String knownEtag = otaPrefs.getString("etag", "");
+            String knownModified = otaPrefs.getString("modified", "");
+            if (knownEtag.length() > 0) {
+                https.addHeader("If-None-Match", knownEtag);
+            }
+            if (knownModified.length() > 0) {
+                https.addHeader("If-Modified-Since", knownModified);
+            }
+            const char* validatorHeaders[] = {"ETag", "Last-Modified"};
+            https.collectHeaders(validatorHeaders, 2);
             Serial.print("[HTTPS] GET...\n");
             delay(100);
             httpCode = https.GET();
             delay(100);
             if (httpCode == HTTP_CODE_OK) {
                 payload = https.getString();
+                etag = https.header("ETag");
+                lastModified = https.header("Last-Modified");
+            } else if (httpCode == HTTP_CODE_NOT_MODIFIED) {
+                Serial.println("version.json not modified");
             } else {
                 Serial.print("Error Occurred During Version Check: ");
                 Serial.println(httpCode);
@@ -151,6 +170,9 @@ int FirmwareVersionCheck() {
 
         // Compare the extracted version with the current version
         if (newFwVersion.equals(FirmwareVer)) {
+            // Only remember the validators once nothing is left to do, so a failed update is retried
+            otaPrefs.putString("etag", etag);
+            otaPrefs.putString("modified", lastModified);
             Serial.printf("\nDevice is already on the latest firmware version: %s\n", FirmwareVer.c_str());
             return 0;  // No update needed
         } else {
@@ -162,3 +184,24 @@ int FirmwareVersionCheck() {
     return 0;  // Failed to get valid response
 }
 
+// Change the version check interval at runtime and keep it across reboots
+void setCheckInterval(unsigned long ms) {
+    if (ms < OTA_MIN_CHECK_INTERVAL) {
+        ms = OTA_MIN_CHECK_INTERVAL;
+    }
+    interval = ms;
+    otaPrefs.putULong("interval", ms);
+    Serial.printf("Version check interval set to %lu ms\n", ms);
+}
+
+// Serial console: "interval <ms>" changes the version check interval
+void handleSerialCommand() {
+    if (!Serial.available()) {
+        return;
+    }
+    String command = Serial.readStringUntil('\n');
+    command.trim();
+    if (command.startsWith("interval ")) {
+        setCheckInterval(command.substring(9).toInt());
+    }
+}
@@ -12,5 +12,7 @@ String FirmwareVer = "1.0.0";
 
 // Define the URL for the JSON file
 #define URL_fw_JSON "https://raw.githubusercontent.com/MadeeshaLakshan/ESP8266_FOTA_PUBLIC/refs/heads/main/version.json"
+#define OTA_CHECK_INTERVAL 5000      // Default version check interval (ms); change at runtime with "interval <ms>" on Serial
+#define OTA_MIN_CHECK_INTERVAL 1000  // Lower bound for runtime changes
 
 #endif 